@@ -0,0 +1,102 @@
+/**
+ * @file block_pool.h
+ * @brief Fixed-block pools for per-connection state
+ *
+ * A pool takes one heap block at boot, sized from a configured connection
+ * limit, and hands out equal blocks from it with O(1) alloc and free.
+ * Contexts that come and go with connections (HTTP sessions, Modbus
+ * masters) live in pools instead of being heap-allocated per connection,
+ * so months of connects and disconnects cannot fragment the heap.
+ */
+
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @brief A pool of equal blocks (treat the fields as private)
+ */
+typedef struct block_pool {
+    const char *name;
+    uint8_t *base;              // count * block_size bytes from one allocation
+    void *free_list;            // Each free block starts with the next one
+    size_t block_size;
+    uint16_t count;
+    uint16_t in_use;
+    uint16_t peak;
+    uint32_t allocs;
+    uint32_t failures;          // Allocs refused because the pool was empty
+    portMUX_TYPE lock;
+    struct block_pool *next;    // Registered pools, for the status report
+} block_pool_t;
+
+/**
+ * @brief Pool usage counters
+ */
+typedef struct {
+    const char *name;
+    uint32_t block_size;
+    uint16_t count;
+    uint16_t in_use;
+    uint16_t peak;              // Most blocks in use at once since boot
+    uint32_t allocs;
+    uint32_t failures;
+} block_pool_stats_t;
+
+/**
+ * @brief Heap state, to watch fragmentation next to the pools
+ */
+typedef struct {
+    uint32_t free;              // Free heap bytes
+    uint32_t min_free;          // Low-water mark since boot
+    uint32_t largest;           // Largest free block
+} block_pool_heap_t;
+
+/**
+ * @brief Allocate a pool's storage and register it
+ *
+ * Call once at boot. The storage is never returned to the heap.
+ *
+ * @param pool Pool to set up (static storage)
+ * @param name Name in the status report (string literal)
+ * @param block_size Bytes per block, rounded up to pointer alignment
+ * @param count Number of blocks
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the heap is short
+ */
+esp_err_t block_pool_init(block_pool_t *pool, const char *name, size_t block_size, uint16_t count);
+
+/**
+ * @brief Take a block
+ *
+ * Safe from any task. The block's contents are undefined.
+ *
+ * @return The block, or NULL if every block is in use
+ */
+void *block_pool_alloc(block_pool_t *pool);
+
+/**
+ * @brief Return a block to its pool
+ *
+ * NULL is ignored. A pointer that is not a block of this pool is logged
+ * and dropped.
+ */
+void block_pool_free(block_pool_t *pool, void *block);
+
+/**
+ * @brief Counters of the registered pools
+ *
+ * @param out Filled with up to max entries
+ * @return Number of entries filled
+ */
+size_t block_pool_get_stats(block_pool_stats_t *out, size_t max);
+
+/**
+ * @brief Current heap free size, low-water mark and largest free block
+ */
+void block_pool_get_heap(block_pool_heap_t *out);
+
+#endif // BLOCK_POOL_H
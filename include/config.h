@@ -16,6 +16,37 @@
 #define WIFI_PASSWORD       "bsnl@7979"
 #define WIFI_MAX_RETRY      10          // Number of reconnection attempts
 #define WIFI_RETRY_DELAY_MS 1000        // Delay between retries (milliseconds)
+#define WIFI_CHECK_INTERVAL_MS 10000    // Main loop link check period
+#define WIFI_RESTART_AFTER_S 300        // Restart after this long without WiFi (not while the UART link is in use)
+
+// Roaming between access points of the same SSID. Below WIFI_ROAM_RSSI_LOW
+// the board looks for an AP at least WIFI_ROAM_HYSTERESIS_DB stronger and
+// moves to it, using 802.11k neighbor reports, 802.11v BSS transition and
+// 802.11r fast transition where the network offers them (sdkconfig
+// CONFIG_ESP_WIFI_11KV_SUPPORT / CONFIG_ESP_WIFI_11R_SUPPORT)
+#define WIFI_ROAM_ENABLE    1           // Set to 0 to stay on the joined AP
+#define WIFI_ROAM_RSSI_LOW  -70         // dBm; look for a better AP below this
+#define WIFI_ROAM_HYSTERESIS_DB 8       // A candidate must beat the current AP by this
+#define WIFI_ROAM_CHECK_MS  5000        // RSSI poll period while below the threshold
+#define WIFI_ROAM_SCAN_MAX_AGE_S 30     // Scan results older than this are refreshed
+#define WIFI_ROAM_SCAN_DWELL_MS 60      // Active scan time per channel
+#define WIFI_ROAM_MIN_INTERVAL_S 30     // At most one roam per this period
+#define WIFI_ROAM_BTM_WAIT_MS 1000      // Time the AP has to steer us after a BTM query
+#define WIFI_ROAM_TIMEOUT_MS 5000       // Give up on a roam that has not joined by then
+#define WIFI_ROAM_MAX_CANDIDATES 8      // Cached access points of our SSID
+#define WIFI_ROAM_LOG_LEN   8           // Recent link gaps kept for /wifi/status
+#define WIFI_ROAM_TASK_PRIORITY 3
+#define WIFI_ROAM_TASK_STACK_SIZE 3072
+
+// Radio profiles, switched at runtime with GET /wifi/profile?name=... and
+// kept in NVS: "latency" (no power save), "balanced" (wake every DTIM, the
+// ESP-IDF default) and "low_power" (wake every WIFI_PROFILE_LOW_POWER_LISTEN
+// beacons, reduced TX power)
+#define WIFI_PROFILE_DEFAULT 1          // 0 latency, 1 balanced, 2 low_power
+#define WIFI_PROFILE_LOW_POWER_LISTEN 10    // Beacon intervals between wakes
+#define WIFI_PROFILE_TX_DBM 20          // TX power of latency/balanced (ESP32 max 19.5)
+#define WIFI_PROFILE_LOW_POWER_TX_DBM 11    // TX power of low_power
+#define WIFI_PROFILE_REASSOC_DELAY_MS 500   // Reassociate after the reply is out
 
 /*============================================================================
  * Static IP Configuration (set USE_STATIC_IP to 1 to enable)
@@ -55,6 +86,32 @@
 #define RELAY_3_NAME        "Fan 1"
 #define RELAY_4_NAME        "Fan 2"
 
+// Relay groups for UI display (channels of a group are listed together)
+#define RELAY_1_GROUP       "Lights"
+#define RELAY_2_GROUP       "Lights"
+#define RELAY_3_GROUP       "Fans"
+#define RELAY_4_GROUP       "Fans"
+
+/*============================================================================
+ * Power Budget Configuration
+ *
+ * Each relay has a load weight (watts) and a priority (higher wins).
+ * Switching a relay ON that would exceed POWER_BUDGET_W first sheds
+ * lower-priority loads; if that cannot free enough, the command is
+ * rejected. Set POWER_BUDGET_W to 0 to disable the governor.
+ *============================================================================*/
+#define POWER_BUDGET_W      300         // Total sustained load allowed
+
+#define RELAY_1_POWER_W     60          // Light 1
+#define RELAY_2_POWER_W     60          // Light 2
+#define RELAY_3_POWER_W     75          // Fan 1
+#define RELAY_4_POWER_W     75          // Fan 2
+
+#define RELAY_1_PRIORITY    1
+#define RELAY_2_PRIORITY    1
+#define RELAY_3_PRIORITY    2           // Fans outrank lights
+#define RELAY_4_PRIORITY    2
+
 /*============================================================================
  * Relay Behavior Configuration
  *============================================================================*/
@@ -69,6 +126,153 @@
 // Save relay states to flash (NVS) for persistence across reboots
 #define RELAY_PERSIST_STATE 1           // Set to 0 to disable
 
+// State changes kept in RAM for webhook/telemetry consumers (16 bytes each)
+#define RELAY_EVENT_LOG_SIZE 64
+
+// Read each output back after writing it. A command whose outputs do not
+// take (shorted line, failed driver stage) is rolled back and fails. Needs
+// the relay module's pull-up on the open-drain lines: without it every OFF
+// edge reads back LOW and every command fails, so it is off by default.
+// Set to 1 (or -DRELAY_VERIFY_OUTPUTS=1) once the module is wired
+#ifndef RELAY_VERIFY_OUTPUTS
+#define RELAY_VERIFY_OUTPUTS 0
+#endif
+#define RELAY_OUTPUT_RETRY_MS 100       // Retry a pulse end the outputs refused
+
+/*============================================================================
+ * Power-Fail Flush Configuration
+ *
+ * A supply supervisor (open-drain, active LOW) watching the 5 V input
+ * warns of a power cut while the 3.3 V rail still holds up. The interrupt
+ * copies the last saved relay state into RTC memory and a task programs it
+ * into a pre-erased slot of its own partition (see partitions.csv). Boot
+ * restores that record ahead of NVS. esp_restart() leaves the same record
+ * in RTC memory. Without a supervisor the pull-up keeps the input idle.
+ *============================================================================*/
+#define POWERFAIL_ENABLE    1           // Set to 0 to disable the flush
+#define POWERFAIL_GPIO      27          // Supervisor output, LOW = input failing
+#define POWERFAIL_HOLDUP_US 5000        // Rail hold-up after the warning (flush budget)
+#define POWERFAIL_RECHECK_MS 100        // Poll for the supply coming back after a dip
+#define POWERFAIL_PARTITION_LABEL "pfail"
+#define POWERFAIL_PARTITION_SUBTYPE 0x41 // Custom data subtype, must match partitions.csv
+#define POWERFAIL_TASK_PRIORITY 24      // Highest application priority
+#define POWERFAIL_TASK_STACK_SIZE 2560
+
+/*============================================================================
+ * Momentary Pulse Configuration
+ *
+ * A pulse drives a relay ON and switches it OFF again from a one-shot
+ * esp_timer, so garage doors and gate controllers get an exact contact
+ * closure without a second request. A pulse is never persisted as ON:
+ * a reboot mid-pulse always comes back with the relay OFF.
+ *============================================================================*/
+#define RELAY_PULSE_DEFAULT_MS  500     // Used when ?ms= is omitted
+#define RELAY_PULSE_MIN_MS      10      // Shortest accepted pulse
+#define RELAY_PULSE_MAX_MS      10000   // Longest accepted pulse
+
+/*============================================================================
+ * IRAM Placement Profile
+ *
+ * While flash is written (every NVS set that changes a value) the cache is
+ * off and no task runs; only interrupts whose code and data are in
+ * internal RAM do.
+ * The profile build (pio run -e esp32dev_iram) sets RELAY_IRAM_PROFILE and
+ * adds sdkconfig.iram.defaults: the output frame code runs from IRAM with
+ * its data in DRAM, pulse ends are switched from the esp_timer interrupt
+ * instead of the esp_timer task, and the UART link's interrupt stays live.
+ * tools/iram_check.py then checks the ELF for flash references from every
+ * IRAM function in src/.
+ *============================================================================*/
+// Trade-off: the frame code takes IRAM; pulse ends are counted, not logged
+#ifndef RELAY_IRAM_PROFILE
+#define RELAY_IRAM_PROFILE  0
+#endif
+
+/*============================================================================
+ * Shadow (Dry-Run) Mode Configuration
+ *
+ * A shadow command takes the full path - routing, validation, debounce,
+ * the power governor, the state model, pulse timers, the change journal
+ * and the state save - against a separate shadow copy of the relay state,
+ * but never drives a relay, the LED or flash. Select it per request with
+ * the header below, or for every HTTP, Modbus and UART link command with
+ * GET /shadow?enabled=1. The global switch lives in RAM only: a reboot
+ * always comes back live. Automations (sequencer, thermostat, solar,
+ * failover) always stay live.
+ *============================================================================*/
+#define SHADOW_HEADER       "X-Shadow"  // Request header; "1" runs it in shadow
+#define SHADOW_MAX_SCOPES   3           // Tasks in a shadow scope at once (HTTP, Modbus, UART link)
+
+/*============================================================================
+ * Sequencer Configuration
+ *
+ * Sequences are short scripts of relay mask changes and delays, stored in
+ * NVS and executed on-device: a single esp_timer wakes the sequencer task,
+ * which runs the steps that are due. Text format (upload
+ * with POST /seq/{slot}), steps separated by ',':
+ *   on:N  off:N          - switch relay N
+ *   set:MASK=VAL         - hex mask/value for several relays at once
+ *   wait:MS              - delay in milliseconds
+ *   loop:STEP*COUNT      - jump back to STEP, COUNT passes (0 = forever)
+ *   abort:MASK=VAL       - stop if (relay states & MASK) == VAL
+ * Example: "on:2,wait:3000,on:3,wait:10000,off:0"
+ *============================================================================*/
+#define SEQ_MAX_SLOTS       4           // Number of stored sequences
+#define SEQ_MAX_STEPS       32          // Steps per sequence (4 bytes each)
+#define SEQ_MAX_TEXT_LEN    512         // Longest accepted upload
+#define SEQ_TASK_PRIORITY   8           // Above the network servers and the UART link
+#define SEQ_TASK_STACK_SIZE 3072
+
+/*============================================================================
+ * Thermostat Configuration
+ *
+ * Two-stage cooling: Fan 1 is stage 1, Fan 2 joins as stage 2 when the
+ * temperature keeps rising. Each stage switches ON at
+ * setpoint + offset + hysteresis and OFF at setpoint + offset - hysteresis.
+ *
+ * The thermostat only starts with a sensor. THERMO_SENSOR_NTC reads an NTC
+ * thermistor divider on an ADC1 pin: 3V3 - series resistor - pin - NTC - GND.
+ *============================================================================*/
+#define THERMO_SENSOR_NONE      0
+#define THERMO_SENSOR_NTC       1
+#define THERMO_SENSOR           THERMO_SENSOR_NONE  // No sensor: thermostat not started
+#define THERMO_NTC_ADC_CHANNEL  6           // ADC1 channel 6 = GPIO34 (input only)
+#define THERMO_NTC_R25_OHM      10000.0f    // Thermistor resistance at 25 C
+#define THERMO_NTC_BETA         3950.0f     // Thermistor B constant (25/85 C)
+#define THERMO_NTC_SERIES_OHM   10000.0f    // Divider resistor to 3V3
+#define THERMO_DEFAULT_ENABLED  0           // Controller state on first boot
+#define THERMO_DEFAULT_SETPOINT 26.0f       // Degrees C
+#define THERMO_HYSTERESIS_C     0.5f        // Half-width of the switching band
+#define THERMO_STAGE2_OFFSET_C  2.0f        // Stage 2 band above the setpoint
+#define THERMO_STAGE1_RELAY     2           // Fan 1 (RELAY_3)
+#define THERMO_STAGE2_RELAY     3           // Fan 2 (RELAY_4)
+#define THERMO_PERIOD_MS        1000        // Sensor read / control interval
+#define THERMO_MIN_ON_S         30          // Minimum run time per stage
+#define THERMO_MIN_OFF_S        30          // Minimum rest time per stage
+#define THERMO_SENSOR_MAX_FAILS 5           // Consecutive read errors before fail-safe
+#define THERMO_FAILSAFE_ON      0           // 1 = run all fans on sensor failure
+#define THERMO_TASK_PRIORITY    4
+#define THERMO_TASK_STACK_SIZE  3072
+
+/*============================================================================
+ * Solar Schedule Configuration
+ *
+ * Rules fire relays relative to local sunrise/sunset. Sun times are
+ * computed once per day; the periodic check only compares minutes.
+ * Rule text (upload with POST /solar/rules), rules separated by ',':
+ *   sunset-15:on:0      - 15 min before sunset, relay 0 ON
+ *   sunrise+10:off:0    - 10 min after sunrise, relay 0 OFF
+ *============================================================================*/
+#define SOLAR_LATITUDE      28.6139     // Degrees, north positive
+#define SOLAR_LONGITUDE     77.2090     // Degrees, east positive
+#define SOLAR_TIMEZONE      "IST-5:30"  // POSIX TZ string
+#define SOLAR_SNTP_SERVER   "pool.ntp.org"
+#define SOLAR_MAX_RULES     8
+#define SOLAR_MAX_TEXT_LEN  256
+#define SOLAR_CHECK_PERIOD_MS 10000     // Rule check interval
+#define SOLAR_TASK_PRIORITY 3
+#define SOLAR_TASK_STACK_SIZE 3072
+
 /*============================================================================
  * HTTP Server Configuration
  *============================================================================*/
@@ -84,6 +288,10 @@
 // Trade-off: Too high may starve other tasks
 #define HTTP_TASK_PRIORITY  5
 
+// Per-request socket receive/send timeout in seconds
+// Trade-off: A slow client holds the server task for up to this long
+#define HTTP_SOCKET_TIMEOUT_S 10
+
 // Server task stack size in bytes (2048-8192)
 // Trade-off: Larger = handles complex requests, uses more RAM
 #define HTTP_TASK_STACK_SIZE 8192
@@ -91,11 +299,184 @@
 // URI buffer size for incoming requests
 #define HTTP_URI_BUFFER_SIZE 512
 
+// Maximum number of registered URI handlers
+// Trade-off: Each slot costs a few bytes of RAM in the server instance
+#define HTTP_MAX_URI_HANDLERS 48
+
+// Changes /relay/state sends one by one before it falls back to the full
+// state bitmask (a client further behind, or past the journal, gets the mask)
+#define HTTP_STATE_MAX_CHANGES 16
+
+/*============================================================================
+ * Connection Pool Configuration
+ *
+ * Per-connection contexts (HTTP sessions, Modbus masters) come from
+ * fixed-block pools sized at boot from HTTP_MAX_CONNECTIONS and
+ * MODBUS_MAX_CLIENTS, so connection churn never allocates from the heap.
+ *============================================================================*/
+#define BLOCK_POOL_MAX_REPORTED 8       // Pools listed by /pool/status
+
+/*============================================================================
+ * Modbus TCP Server Configuration
+ *
+ * Coils 0..RELAY_COUNT-1 map to the relays (also readable as discrete
+ * inputs). Input registers expose state and counters, see modbus_server.h.
+ * Every client has a fixed receive buffer from the Modbus pool; nothing is
+ * allocated per request or per connection.
+ *============================================================================*/
+#define MODBUS_ENABLE       1           // Set to 0 to disable the server
+#define MODBUS_PORT         502
+#define MODBUS_MAX_CLIENTS  3           // Concurrent masters (each uses a socket)
+#define MODBUS_UNIT_ID      1           // Also answers unit 0 and 255
+#define MODBUS_IDLE_TIMEOUT_S 60        // Close masters silent for this long
+#define MODBUS_TASK_PRIORITY 5
+#define MODBUS_TASK_STACK_SIZE 4096
+
+/*============================================================================
+ * Wired UART Link Configuration
+ *
+ * Binary control protocol on a second UART, for a PLC or Raspberry Pi
+ * wired to the board, so relays can still be switched when WiFi is
+ * congested or down. Frames are COBS-encoded with a CRC-16; commands are
+ * listed in uart_link.h. UART0 keeps the console. Wire TX to the
+ * controller's RX and RX to its TX, 3.3 V levels, common ground.
+ *============================================================================*/
+#define UART_LINK_ENABLE    1           // Set to 0 to leave the UART unused
+#define UART_LINK_PORT      1           // UART_NUM_1 (UART0 is the console)
+#define UART_LINK_TX_GPIO   25
+#define UART_LINK_RX_GPIO   26
+#define UART_LINK_BAUD      115200
+#define UART_LINK_RX_BUFFER 256         // Driver ring buffer (more than the 128-byte FIFO)
+#define UART_LINK_QUEUE_LEN 8           // Driver events waiting for the task
+#define UART_LINK_RETRY_WINDOW_MS 1000  // A repeated request within this is a retry
+
+// Idle time, in character times, after which the driver hands received
+// bytes to the task (ESP-IDF default 10). The last byte of a frame waits
+// this long before the task sees it.
+// Trade-off: A controller that pauses mid-frame longer than this splits
+// the frame into several events (harmless, the decoder reassembles it)
+#define UART_LINK_RX_TIMEOUT_CHARS 2
+
+#define UART_LINK_TASK_PRIORITY 7       // Above the network servers, below power-fail
+#define UART_LINK_TASK_STACK_SIZE 3072
+
+/*============================================================================
+ * Failover Configuration
+ *
+ * Optional hot-standby pair. Both boards run this firmware, each built with
+ * its own FAILOVER_ROLE / FAILOVER_NODE_IP / FAILOVER_PEER_IP. Boards boot
+ * on their node address; the active one moves to STATIC_IP (the service
+ * address) and serves the API. The standby mirrors relay state from UDP
+ * heartbeats and versioned deltas, and takes over STATIC_IP after
+ * FAILOVER_MISS_LIMIT heartbeats are missed. Failover time is roughly
+ * FAILOVER_HEARTBEAT_MS * FAILOVER_MISS_LIMIT.
+ *============================================================================*/
+#define FAILOVER_ENABLE     0           // Set to 1 on both boards of a pair
+#define FAILOVER_ROLE_PRIMARY 0
+#define FAILOVER_ROLE_STANDBY 1
+#define FAILOVER_ROLE       FAILOVER_ROLE_PRIMARY
+#define FAILOVER_NODE_IP    "192.168.1.101"   // This board's own address
+#define FAILOVER_PEER_IP    "192.168.1.102"   // The other board's own address
+#define FAILOVER_PORT       5030        // UDP heartbeat port
+#define FAILOVER_PAIR_ID    1           // Ignore heartbeats from other pairs
+#define FAILOVER_HEARTBEAT_MS 200       // Heartbeat interval
+#define FAILOVER_MISS_LIMIT 5           // Missed heartbeats before takeover
+#define FAILOVER_POLL_MS    20          // Relay change detection interval
+#define FAILOVER_TASK_PRIORITY 6
+#define FAILOVER_TASK_STACK_SIZE 3072
+
+#if FAILOVER_ENABLE && !USE_STATIC_IP
+#error "Failover needs USE_STATIC_IP: the service address moves between boards"
+#endif
+
+/*============================================================================
+ * Gossip Configuration
+ *
+ * Boards on the same subnet spread sequence and solar rule uploads to each
+ * other: a write to any board reaches the fleet in O(log n) rounds. Every
+ * round a board sends a small version digest to one random peer, which
+ * pushes or pulls whatever is newer. Peers are discovered from periodic
+ * broadcast digests.
+ *
+ * The UDP port is not authenticated: anyone on the subnet can replace
+ * sequences and solar rules by sending a higher version. Enable it only
+ * on a trusted, isolated network.
+ *============================================================================*/
+#define GOSSIP_ENABLE       0           // Set to 1 on every board of the fleet
+#define GOSSIP_PORT         5031        // UDP port shared by the fleet
+#define GOSSIP_PERIOD_MS    1000        // Round interval
+#define GOSSIP_MAX_PEERS    16          // Peer table size (random subset of the fleet)
+#define GOSSIP_PEER_TIMEOUT_S 120       // Forget peers silent for this long
+#define GOSSIP_ANNOUNCE_ROUNDS 10       // Broadcast the digest every N rounds
+#define GOSSIP_TASK_PRIORITY 3
+#define GOSSIP_TASK_STACK_SIZE 4096
+
+/*============================================================================
+ * Webhook Configuration
+ *
+ * Relay state changes are POSTed as JSON batches to up to
+ * WEBHOOK_MAX_TARGETS URLs (set with POST /webhooks, one URL per line).
+ * A low-priority task collects changes from the relay change journal every
+ * WEBHOOK_BATCH_MS, so switching never waits on the network. Failed posts
+ * are retried with exponential backoff; events that overflow a target's
+ * queue, or a batch that keeps failing, are dropped and counted.
+ *============================================================================*/
+#define WEBHOOK_ENABLE      1           // Set to 0 to disable notifications
+#define WEBHOOK_MAX_TARGETS 2
+#define WEBHOOK_URL_MAX_LEN 128
+#define WEBHOOK_BATCH_MS    250         // Collection window
+#define WEBHOOK_BATCH_MAX   16          // Events per POST
+#define WEBHOOK_QUEUE_LEN   64          // Pending events per target
+#define WEBHOOK_TIMEOUT_MS  2000        // Per POST
+#define WEBHOOK_RETRY_BASE_MS 500       // First retry delay, doubled per failure
+#define WEBHOOK_RETRY_MAX_MS 30000      // Backoff ceiling
+#define WEBHOOK_MAX_ATTEMPTS 6          // Drop a batch after this many failures
+#define WEBHOOK_TASK_PRIORITY 2         // Below HTTP, relay and control tasks
+#define WEBHOOK_TASK_STACK_SIZE 6144
+
+/*============================================================================
+ * Telemetry Configuration
+ *
+ * Every TELEMETRY_SAMPLE_S a fixed 48-byte binary sample (heap, WiFi,
+ * relays, power, counter deltas, Modbus service time histogram) is added
+ * to a RAM ring; every TELEMETRY_PUSH_S the ring is POSTed to the
+ * collector URL set with POST /telemetry. While the collector is down
+ * pushes back off and the ring keeps filling; once full the oldest sample
+ * is dropped, so RAM use is fixed at TELEMETRY_BUFFER_SAMPLES * 48 bytes.
+ *============================================================================*/
+#define TELEMETRY_ENABLE    1           // Set to 0 to disable the agent
+#define TELEMETRY_URL_MAX_LEN 128
+#define TELEMETRY_SAMPLE_S  10          // Sampling interval
+#define TELEMETRY_PUSH_S    60          // Upload interval
+#define TELEMETRY_BUFFER_SAMPLES 120    // RAM cap (20 min of samples, 5.6 KB)
+#define TELEMETRY_BATCH_MAX 30          // Samples per POST
+#define TELEMETRY_TIMEOUT_MS 3000       // Per POST
+#define TELEMETRY_RETRY_BASE_S 5        // First retry delay, doubled per failure
+#define TELEMETRY_RETRY_MAX_S 300       // Backoff ceiling
+#define TELEMETRY_TASK_PRIORITY 1       // Lowest of all application tasks
+#define TELEMETRY_TASK_STACK_SIZE 4096
+
+/*============================================================================
+ * UI Assets Configuration
+ *
+ * The web UI is served from an archive of precompressed files in its own
+ * flash partition (see partitions.csv), memory-mapped at boot. Build the
+ * archive from ui/ with tools/mkassets.py and upload it with
+ * POST /assets; the firmware is not touched. Without a valid archive the
+ * built-in page from ui_templates.h is served.
+ *============================================================================*/
+#define ASSETS_ENABLE       1           // Set to 0 to always serve the built-in page
+#define ASSETS_PARTITION_LABEL "assets"
+#define ASSETS_PARTITION_SUBTYPE 0x40   // Custom data subtype, must match partitions.csv
+#define ASSETS_MAX_FILES    64          // Index entries accepted (64 bytes each)
+#define ASSETS_UPLOAD_CHUNK 2048        // Receive buffer on the HTTP task stack
+
 /*============================================================================
  * Performance Tuning
  *============================================================================*/
-// Response buffer size for HTTP responses
-#define HTTP_RESPONSE_BUFFER_SIZE 256
+// JSON writer buffer for HTTP responses (on the server task stack)
+// Trade-off: A longer response is sent as HTTP chunks of this size
+#define HTTP_RESPONSE_BUFFER_SIZE 512
 
 // Debounce time for relay switching (prevents rapid toggling)
 #define RELAY_DEBOUNCE_MS   50
@@ -105,6 +486,13 @@
  *============================================================================*/
 #define NVS_NAMESPACE       "relay_ctrl"
 #define NVS_KEY_RELAY_STATE "relay_state"
+#define NVS_KEY_SEQ_PREFIX  "seq"       // Sequences stored as seq0..seqN
+#define NVS_KEY_THERMO      "thermo"
+#define NVS_KEY_SOLAR_RULES "solar_rules"
+#define NVS_KEY_GOSSIP_PREFIX "gsp"     // Gossip objects stored as gsp0..gspN
+#define NVS_KEY_WEBHOOKS    "webhooks"
+#define NVS_KEY_TELEMETRY   "telemetry"
+#define NVS_KEY_WIFI_PROFILE "wifi_profile"
 
 /*============================================================================
  * Logging Configuration
@@ -113,5 +501,17 @@
 #define LOG_TAG_WIFI        "WIFI"
 #define LOG_TAG_RELAY       "RELAY"
 #define LOG_TAG_HTTP        "HTTP"
+#define LOG_TAG_SEQ         "SEQ"
+#define LOG_TAG_THERMO      "THERMO"
+#define LOG_TAG_SOLAR       "SOLAR"
+#define LOG_TAG_MODBUS      "MODBUS"
+#define LOG_TAG_UART_LINK   "UART_LINK"
+#define LOG_TAG_FAILOVER    "FAILOVER"
+#define LOG_TAG_GOSSIP      "GOSSIP"
+#define LOG_TAG_WEBHOOK     "WEBHOOK"
+#define LOG_TAG_TELEMETRY   "TELEMETRY"
+#define LOG_TAG_ASSETS      "ASSETS"
+#define LOG_TAG_POWERFAIL   "POWERFAIL"
+#define LOG_TAG_POOL        "POOL"
 
 #endif // CONFIG_H
@@ -0,0 +1,80 @@
+/**
+ * @file failover.h
+ * @brief Hot-standby failover interface
+ *
+ * Two boards form a pair. The active board holds the service address
+ * (STATIC_IP) and serves the API; the standby mirrors the relay state and
+ * takes over when the active board stops sending heartbeats.
+ */
+
+#ifndef FAILOVER_H
+#define FAILOVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Failover state of this board
+ */
+typedef enum {
+    FAILOVER_STATE_STARTING = 0,    // Listening for an active peer
+    FAILOVER_STATE_STANDBY = 1,     // Mirroring the active peer
+    FAILOVER_STATE_ACTIVE = 2       // Holding the service address
+} failover_state_t;
+
+/**
+ * @brief Failover status snapshot
+ */
+typedef struct {
+    failover_state_t state;
+    uint32_t term;              // Incremented on every takeover in the pair
+    uint32_t version;           // Relay state version (sent or applied)
+    bool peer_seen;             // Heartbeat received within the miss window
+    uint32_t peer_age_ms;       // Time since the last peer heartbeat
+    uint32_t heartbeats_tx;
+    uint32_t heartbeats_rx;
+    uint32_t deltas_tx;
+    uint32_t deltas_rx;
+    uint32_t resyncs;           // Full-state repairs after lost deltas
+    uint32_t apply_errors;      // Peer states the relay service refused
+    uint32_t takeovers;
+    uint32_t last_takeover_ms;  // Silence before the last takeover
+} failover_status_t;
+
+/**
+ * @brief Start the failover task
+ *
+ * Does nothing and returns ESP_OK when FAILOVER_ENABLE is 0.
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t failover_init(void);
+
+/**
+ * @brief Block until this board holds the service address
+ *
+ * A standby board parks here until its peer fails.
+ */
+void failover_wait_active(void);
+
+/**
+ * @brief Check whether this board is the active one
+ *
+ * @return true if active (always true when failover is disabled)
+ */
+bool failover_is_active(void);
+
+/**
+ * @brief Get the failover status
+ *
+ * @param out Filled with the current status
+ */
+void failover_get_status(failover_status_t *out);
+
+/**
+ * @brief Get a failover state name for display
+ */
+const char* failover_state_name(failover_state_t state);
+
+#endif // FAILOVER_H
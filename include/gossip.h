@@ -0,0 +1,68 @@
+/**
+ * @file gossip.h
+ * @brief Fleet configuration gossip interface
+ *
+ * Configuration objects (sequence slots and the solar rule set) carry a
+ * version (Lamport counter + origin node). Nodes periodically exchange
+ * digests of their versions with a random peer and push or pull whatever
+ * is newer, so a write on one board reaches the whole fleet in O(log n)
+ * rounds and a board that missed a rollout catches up on its own.
+ */
+
+#ifndef GOSSIP_H
+#define GOSSIP_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "config.h"
+
+/**
+ * @brief Gossiped configuration objects
+ */
+#define GOSSIP_OBJ_SEQ(slot)    (slot)              // Sequence slots
+#define GOSSIP_OBJ_SOLAR_RULES  SEQ_MAX_SLOTS       // Solar rule set
+#define GOSSIP_OBJ_COUNT        (SEQ_MAX_SLOTS + 1)
+
+/**
+ * @brief Gossip statistics
+ */
+typedef struct {
+    uint32_t node_id;                       // This board's origin id
+    uint32_t rounds;
+    uint32_t objects_tx;                    // Objects pushed to peers
+    uint32_t objects_rx;                    // Newer objects received
+    uint32_t applied;                       // Objects applied locally
+    uint32_t rejected;                      // Objects the owning module refused
+    uint32_t bytes_tx;
+    uint32_t bytes_rx;
+    uint8_t peers;                          // Known live peers
+    uint32_t versions[GOSSIP_OBJ_COUNT];    // Lamport counter per object
+} gossip_stats_t;
+
+/**
+ * @brief Load object versions and start the gossip task
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t gossip_init(void);
+
+/**
+ * @brief Publish a local configuration write to the fleet
+ *
+ * Call after the owning module accepted the text. The object gets a new
+ * version and is offered to peers from the next round on.
+ *
+ * @param obj Object id (GOSSIP_OBJ_*)
+ * @param text Object text as accepted by the owning module
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t gossip_publish(uint8_t obj, const char *text);
+
+/**
+ * @brief Get gossip statistics
+ *
+ * @param out Filled with the current counters
+ */
+void gossip_get_stats(gossip_stats_t *out);
+
+#endif // GOSSIP_H
@@ -0,0 +1,99 @@
+/**
+ * @file json_writer.h
+ * @brief Bounded streaming JSON writer
+ *
+ * Builds a JSON document into a caller-supplied buffer without format
+ * strings. Strings are escaped, numbers are converted by hand, and commas
+ * between members are tracked per nesting level. When the buffer fills,
+ * its contents go to a flush callback (an HTTP chunk, a CRC) and writing
+ * continues from the start, so a response of any length needs only the
+ * buffer. Without a callback the output stops at the buffer's end and
+ * the writer reports ESP_ERR_INVALID_SIZE.
+ *
+ * Keys are written as given and must not need escaping (string literals).
+ * Pass NULL as the key for array elements and for the top-level value.
+ */
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define JSON_WRITER_MAX_DEPTH   31      // Nesting levels (one bit each)
+
+/**
+ * @brief Receives each full buffer, and the remainder from json_writer_end()
+ *
+ * @param last true for the final call (len may be 0)
+ * @return ESP_OK to go on; any error stops the writer
+ */
+typedef esp_err_t (*json_flush_t)(void *ctx, const char *data, size_t len, bool last);
+
+/**
+ * @brief Writer state (treat the fields as private)
+ */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    json_flush_t flush;         // NULL: fixed buffer
+    void *ctx;
+    uint32_t members;           // Bit N: level N already has a member
+    uint8_t depth;
+    esp_err_t err;              // First error; later writes are dropped
+} json_writer_t;
+
+/**
+ * @brief Start a document
+ *
+ * @param buf Output buffer; without flush, one byte is kept for the NUL
+ * @param flush Called when the buffer is full (NULL for a fixed buffer)
+ */
+void json_writer_init(json_writer_t *w, char *buf, size_t size, json_flush_t flush, void *ctx);
+
+/**
+ * @brief Finish the document
+ *
+ * Hands the rest of the buffer to the flush callback (last = true), or
+ * NUL-terminates a fixed buffer.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if a fixed buffer overflowed or
+ *         the nesting was unbalanced, or the flush callback's error
+ */
+esp_err_t json_writer_end(json_writer_t *w);
+
+void json_object_begin(json_writer_t *w, const char *key);
+void json_object_end(json_writer_t *w);
+void json_array_begin(json_writer_t *w, const char *key);
+void json_array_end(json_writer_t *w);
+
+/**
+ * @brief String value, escaped (NULL is written as null)
+ */
+void json_string(json_writer_t *w, const char *key, const char *value);
+
+void json_int(json_writer_t *w, const char *key, long value);
+void json_uint(json_writer_t *w, const char *key, unsigned long value);
+void json_bool(json_writer_t *w, const char *key, bool value);
+
+/**
+ * @brief Fixed-point number: value / 10^decimals with all decimals shown
+ *
+ * json_fixed(w, "t", 2150, 2) writes "t":21.50.
+ */
+void json_fixed(json_writer_t *w, const char *key, long value, unsigned decimals);
+
+/**
+ * @brief Float rounded to decimals places (null if not finite)
+ */
+void json_float(json_writer_t *w, const char *key, float value, unsigned decimals);
+
+/**
+ * @brief Hex string value, zero-padded to digits (e.g. a CRC or node id)
+ */
+void json_hex(json_writer_t *w, const char *key, unsigned long value, unsigned digits);
+
+#endif // JSON_WRITER_H
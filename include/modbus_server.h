@@ -0,0 +1,67 @@
+/**
+ * @file modbus_server.h
+ * @brief Modbus TCP server interface
+ *
+ * Supported function codes:
+ *   0x01 Read Coils               - relay states
+ *   0x02 Read Discrete Inputs     - relay states (read-only view)
+ *   0x04 Read Input Registers     - see register map below
+ *   0x05 Write Single Coil        - switch one relay
+ *   0x0F Write Multiple Coils     - switch several relays in one
+ *                                   relay_set_mask_atomic(), all or none
+ *
+ * Input register map:
+ *   0  relay state bitmask        7-8  requests served (low, high word)
+ *   1  power used (W)             9    exception responses
+ *   2  power budget (W)           10   max request service time (us, capped)
+ *   3  loads shed                 11   connected masters
+ *   4  commands rejected          12   free heap (KB)
+ *   5-6 uptime seconds (low, high word)
+ */
+
+#ifndef MODBUS_SERVER_H
+#define MODBUS_SERVER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Number of input registers exposed
+ */
+#define MODBUS_INPUT_REG_COUNT  13
+
+/**
+ * @brief Service time histogram buckets
+ *
+ * Bucket i counts requests served in under (32 << i) us; the last bucket
+ * takes everything slower.
+ */
+#define MODBUS_HIST_BUCKETS     8
+
+/**
+ * @brief Server statistics
+ */
+typedef struct {
+    uint32_t requests;          // Requests answered
+    uint32_t exceptions;        // Exception responses sent
+    uint32_t max_service_us;    // Worst request service time
+    uint32_t total_service_us;  // Sum of service times (for the average)
+    uint32_t service_hist[MODBUS_HIST_BUCKETS];
+    uint8_t clients;            // Currently connected masters
+} modbus_stats_t;
+
+/**
+ * @brief Start the Modbus TCP server task
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t modbus_server_init(void);
+
+/**
+ * @brief Get server statistics
+ *
+ * @param out Filled with the current counters
+ */
+void modbus_server_get_stats(modbus_stats_t *out);
+
+#endif // MODBUS_SERVER_H
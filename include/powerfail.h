@@ -0,0 +1,98 @@
+/**
+ * @file powerfail.h
+ * @brief Emergency flush of the relay state on a power-fail warning
+ *
+ * The relay service stages a small record (packed states, journal version,
+ * counters) every time it saves its state. When the supply monitor on
+ * POWERFAIL_GPIO warns of a power cut, the interrupt copies the staged
+ * record into RTC memory and a top-priority task programs it into the next
+ * pre-erased slot of the POWERFAIL_PARTITION_LABEL partition, well within
+ * the rail's hold-up time. esp_restart() leaves the same record in RTC
+ * memory. At boot the record wins over NVS until a later NVS commit makes
+ * it redundant.
+ */
+
+#ifndef POWERFAIL_H
+#define POWERFAIL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief State captured at the power-fail warning (32 bytes, one flash slot)
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t states;            // Packed relay states, pulsing relays OFF
+    uint32_t version;           // Relay state changes in that boot
+    uint32_t commands;          // Switching commands accepted in that boot
+    uint32_t saves;             // State saves in that boot
+    uint32_t uptime_ms;         // When the record was taken
+    uint32_t cause;             // POWERFAIL_CAUSE_*
+    uint32_t crc;               // CRC32 of the fields above
+} powerfail_record_t;
+
+#define POWERFAIL_CAUSE_WARNING 1   // Power-fail input went LOW
+#define POWERFAIL_CAUSE_RESTART 2   // esp_restart()
+
+/**
+ * @brief Flush and recovery status
+ */
+typedef struct {
+    bool armed;                 // Power-fail interrupt installed
+    bool failing;               // Warning seen, supply not back yet
+    const char *recovered_from; // "rtc", "flash" or "none" at this boot
+    powerfail_record_t recovered;
+    uint32_t warnings;          // Power-fail interrupts since boot
+    uint32_t flushes;           // Records programmed into flash since boot
+    uint32_t erases;            // Slot erases after an NVS commit
+    uint32_t isr_us;            // Longest interrupt-side capture
+    uint32_t flash_us;          // Longest slot program
+    uint16_t slots_free;        // Pre-erased slots left
+    uint16_t slots;             // Slots in the partition
+} powerfail_status_t;
+
+/**
+ * @brief Read the records left by the last boot and arm the warning input
+ *
+ * Call before relay_service_init(), which takes the record. A missing
+ * partition leaves the RTC record and the restart handler working.
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t powerfail_init(void);
+
+/**
+ * @brief Record left by the last boot, newest first (RTC, then flash)
+ *
+ * @param out Filled with the record
+ * @return true if a valid record was found
+ */
+bool powerfail_recover(powerfail_record_t *out);
+
+/**
+ * @brief Stage the state to flush if the power fails
+ *
+ * Called by the relay service with every state save; a few stores under a
+ * spinlock, safe from any task.
+ */
+void powerfail_stage(uint32_t states, uint32_t version, uint32_t commands, uint32_t saves);
+
+/**
+ * @brief The staged state is committed to NVS; drop any saved record
+ *
+ * Clears the RTC record at once and has the flush task erase used slots,
+ * so an old record can never override newer NVS state. Ignored while a
+ * warning is active.
+ */
+void powerfail_committed(void);
+
+/**
+ * @brief Get flush and recovery status
+ *
+ * @param out Filled with the current status
+ */
+void powerfail_get_status(powerfail_status_t *out);
+
+#endif // POWERFAIL_H
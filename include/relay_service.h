@@ -10,6 +10,7 @@
 #define RELAY_SERVICE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "esp_err.h"
 
@@ -27,9 +28,77 @@ typedef enum {
 typedef struct {
     uint8_t gpio_pin;
     const char *name;
+    const char *group;      // UI group the channel is listed under
     relay_state_t state;
+    uint16_t power_w;       // Load weight for the power budget
+    uint8_t priority;       // Higher priority loads shed lower ones
 } relay_info_t;
 
+/**
+ * @brief Power budget utilisation
+ */
+typedef struct {
+    uint32_t used_w;        // Sum of weights of relays that are ON
+    uint32_t budget_w;      // POWER_BUDGET_W (0 = governor disabled)
+    uint32_t shed_count;    // Loads switched OFF to admit higher priority
+    uint32_t reject_count;  // ON commands refused for lack of budget
+} relay_power_t;
+
+/**
+ * @brief Relay state change (from the change journal)
+ */
+typedef struct {
+    uint32_t seq;           // 1 for the first change after boot, then +1
+    int64_t time_us;        // esp_timer time of the change
+    uint8_t relay_id;
+    uint8_t state;          // relay_state_t
+} relay_event_t;
+
+/**
+ * @brief Shadow (dry-run) mode state and counters
+ */
+typedef struct {
+    bool enabled;           // Global switch for HTTP and Modbus commands
+    uint32_t commands;      // Switching commands run against the shadow model
+    uint32_t events;        // Changes in the shadow journal
+    uint32_t saves;         // State saves simulated instead of written to NVS
+    uint32_t mask;          // Shadow relay states, bit N = relay N
+    relay_power_t power;    // Shadow power budget figures
+} relay_shadow_status_t;
+
+/**
+ * @brief A batch of relay changes, applied as one output frame
+ * 
+ * Lives on the caller's stack. Staging only records the change, so a
+ * transaction holds no lock and dropping it uncommitted is an abort.
+ */
+typedef struct {
+    uint32_t mask;          // Relays staged, bit N = relay N
+    uint32_t values;        // Their new states
+} relay_txn_t;
+
+/**
+ * @brief Pulse end lateness buckets
+ *
+ * Bucket i counts pulse ends switched less than (32 << i) us after their
+ * deadline; the last bucket takes everything later.
+ */
+#define RELAY_LATE_HIST_BUCKETS 8
+
+/**
+ * @brief Output driver counters (live outputs only)
+ */
+typedef struct {
+    uint32_t frames;            // Frames written and verified
+    uint32_t write_errors;      // Writes the driver refused
+    uint32_t verify_errors;     // Outputs that read back wrong
+    uint32_t rollbacks;         // Failed frames undone
+    uint32_t rollback_failures; // Failed frames that could not be undone either
+    uint32_t pulse_ends;        // Pulses switched OFF by their timer
+    uint32_t pulse_late_max_us; // Worst pulse end after its deadline
+    uint32_t pulse_late_hist[RELAY_LATE_HIST_BUCKETS];
+} relay_output_stats_t;
+
 /**
  * @brief Initialize the relay service
  * 
@@ -43,7 +112,9 @@ esp_err_t relay_service_init(void);
  * @brief Toggle a relay's state
  * 
  * @param relay_id Relay index (0-3)
- * @return New state after toggle, or -1 on error
+ * @return New state after toggle, -1 on error (invalid id, or switching ON
+ *         would exceed the power budget), -2 if the outputs failed and the
+ *         change was rolled back
  */
 int relay_toggle(uint8_t relay_id);
 
@@ -52,7 +123,9 @@ int relay_toggle(uint8_t relay_id);
  * 
  * @param relay_id Relay index (0-3)
  * @param state Desired state (RELAY_ON or RELAY_OFF)
- * @return ESP_OK on success, ESP_ERR_INVALID_ARG if relay_id is invalid
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if relay_id is invalid,
+ *         ESP_ERR_NOT_ALLOWED if switching ON would exceed the power budget,
+ *         or the output error (see relay_txn_commit())
  */
 esp_err_t relay_set_state(uint8_t relay_id, relay_state_t state);
 
@@ -96,15 +169,225 @@ esp_err_t relay_load_states(void);
 /**
  * @brief Turn all relays OFF
  * 
- * @return ESP_OK on success
+ * @return ESP_OK on success, or the output error (see relay_txn_commit())
  */
 esp_err_t relay_all_off(void);
 
 /**
  * @brief Turn all relays ON
  * 
- * @return ESP_OK on success
+ * Relays are switched in priority order while the power budget allows.
+ * 
+ * @return ESP_OK on success, ESP_ERR_NOT_ALLOWED if some relays were left
+ *         OFF by the power budget, or the output error (see relay_txn_commit())
  */
 esp_err_t relay_all_on(void);
 
+/**
+ * @brief Drive several relays in one call
+ * 
+ * Every relay whose bit is set in mask is driven to the matching bit of
+ * values. No LED blink and no debounce, so with persist=false it is safe
+ * to call from timer context (persist=true commits to NVS, which must not
+ * run in the esp_timer task or an ISR). Pending pulses on the affected
+ * relays are cancelled.
+ * 
+ * @param mask Bit i selects relay i
+ * @param values Bit i is the new state of relay i
+ * @param persist Save the resulting states to NVS
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if mask names unknown relays,
+ *         ESP_ERR_NOT_ALLOWED if some relays were left OFF by the power budget,
+ *         or the output error (see relay_txn_commit())
+ */
+esp_err_t relay_set_mask(uint32_t mask, uint32_t values, bool persist);
+
+/**
+ * @brief Drive several relays in one call, all of them or none
+ * 
+ * As relay_set_mask(), but the whole batch is planned first and nothing
+ * is switched (and nothing shed) if the power budget refuses any of its
+ * ON changes. For protocol writes that must not half-apply, such as a
+ * Modbus multi-coil write.
+ * 
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if mask names unknown relays,
+ *         ESP_ERR_NOT_ALLOWED if the power budget refused the batch (nothing
+ *         applied), or the output error (nothing applied)
+ */
+esp_err_t relay_set_mask_atomic(uint32_t mask, uint32_t values, bool persist);
+
+/**
+ * @brief Flip several relays in one call
+ * 
+ * As relay_set_mask(), with each relay in mask driven to the opposite of
+ * its current state. The states are read under the same lock as the
+ * write, so two callers toggling at once flip twice instead of both
+ * writing the same value.
+ * 
+ * @return As relay_set_mask()
+ */
+esp_err_t relay_toggle_mask(uint32_t mask, bool persist);
+
+/**
+ * @brief Start an empty transaction
+ */
+void relay_txn_begin(relay_txn_t *txn);
+
+/**
+ * @brief Stage a relay change; a later stage of the same relay wins
+ * 
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if relay_id is invalid
+ */
+esp_err_t relay_txn_stage(relay_txn_t *txn, uint8_t relay_id, relay_state_t state);
+
+/**
+ * @brief Apply the staged changes as one output frame, all of them or none
+ * 
+ * The power budget is planned for the whole batch first (OFF changes, then
+ * ON changes in priority order, as relay_set_mask_atomic()); if it refuses
+ * any ON change, nothing is switched. The outputs are then written and read
+ * back. Only if that succeeds are the model, the change journal and NVS
+ * updated and pulses on the staged relays cancelled. If an output fails,
+ * the previous frame is written back and nothing changes. The transaction
+ * is empty again afterwards.
+ * 
+ * @param persist Save the resulting states to NVS
+ * @return ESP_OK on success, ESP_ERR_NOT_ALLOWED if the power budget
+ *         refused the batch, the GPIO driver's error or
+ *         ESP_ERR_INVALID_RESPONSE if an output read back wrong (nothing
+ *         applied in any of these cases)
+ */
+esp_err_t relay_txn_commit(relay_txn_t *txn, bool persist);
+
+/**
+ * @brief Get the output driver counters
+ * 
+ * @param out Filled with the current figures
+ */
+void relay_get_output_stats(relay_output_stats_t *out);
+
+/**
+ * @brief Get all relay states as a bitmask
+ * 
+ * @return Bit i set if relay i is ON
+ */
+uint32_t relay_get_mask(void);
+
+/**
+ * @brief Pulse a relay ON for a fixed duration
+ * 
+ * Drives the relay ON immediately and arms a one-shot esp_timer that
+ * switches it OFF again after duration_ms. Returns without waiting for
+ * the pulse to finish. Any later set/toggle/all command on the same
+ * relay cancels the pending pulse.
+ * 
+ * @param relay_id Relay index (0-3)
+ * @param duration_ms Pulse width (RELAY_PULSE_MIN_MS..RELAY_PULSE_MAX_MS)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a bad id or duration,
+ *         ESP_ERR_INVALID_STATE if a pulse is already running or debounced,
+ *         ESP_ERR_NOT_ALLOWED if the power budget does not allow it, or the
+ *         output error (see relay_txn_commit())
+ */
+esp_err_t relay_pulse(uint8_t relay_id, uint32_t duration_ms);
+
+/**
+ * @brief Cancel a running pulse and switch the relay OFF
+ * 
+ * @param relay_id Relay index (0-3)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if relay_id is invalid,
+ *         ESP_ERR_NOT_FOUND if no pulse was running, or the output error
+ *         (the pulse keeps running)
+ */
+esp_err_t relay_pulse_cancel(uint8_t relay_id);
+
+/**
+ * @brief Check whether a relay is in the middle of a pulse
+ * 
+ * @param relay_id Relay index (0-3)
+ * @return true if a pulse is running
+ */
+bool relay_is_pulsing(uint8_t relay_id);
+
+/**
+ * @brief Get power budget utilisation
+ * 
+ * @param out Filled with the current figures
+ */
+void relay_get_power(relay_power_t *out);
+
+/**
+ * @brief Read state changes recorded after a cursor
+ * 
+ * Every state change is appended to a fixed ring of RELAY_EVENT_LOG_SIZE
+ * entries while the state lock is already held, so consumers never slow
+ * down switching. A consumer that falls behind loses the oldest changes.
+ * 
+ * @param cursor Sequence number of the last change consumed (start at 0);
+ *               advanced past the returned changes
+ * @param out Buffer for the changes
+ * @param max Capacity of out
+ * @param lost Set to the number of changes overwritten before being read
+ *             (may be NULL)
+ * @return Number of changes copied to out
+ */
+size_t relay_read_events(uint32_t *cursor, relay_event_t *out, size_t max, uint32_t *lost);
+
+/**
+ * @brief Get the state version
+ * 
+ * The sequence number of the latest change in the change journal. Clients
+ * holding this version are up to date; relay_read_events() from an older
+ * version gives the changes they missed.
+ * 
+ * @return Changes recorded since boot
+ */
+uint32_t relay_get_version(void);
+
+/**
+ * @brief Run the calling task's relay calls against the shadow model
+ * 
+ * Until relay_shadow_end(), every relay_* call from this task takes its
+ * full path - validation, debounce, power governor, state model, pulse
+ * timers, journal and state save - against a separate copy of the relay
+ * state, but never drives a GPIO, the LED or NVS. Reads return the shadow
+ * state too. Other tasks are unaffected.
+ * 
+ * @return ESP_OK, or ESP_ERR_NO_MEM if SHADOW_MAX_SCOPES tasks already are
+ */
+esp_err_t relay_shadow_begin(void);
+
+/**
+ * @brief Return the calling task to the live model
+ */
+void relay_shadow_end(void);
+
+/**
+ * @brief Check if the calling task is inside a shadow scope
+ */
+bool relay_shadow_active(void);
+
+/**
+ * @brief Set the global shadow switch
+ * 
+ * Consulted by the HTTP and Modbus servers for every command. Switching it
+ * on first resets the shadow model from the live state. Not persisted.
+ */
+void relay_shadow_set_enabled(bool enabled);
+
+/**
+ * @brief Get the global shadow switch
+ */
+bool relay_shadow_enabled(void);
+
+/**
+ * @brief Copy the live relay states into the shadow model and zero its counters
+ */
+void relay_shadow_reset(void);
+
+/**
+ * @brief Get the shadow switch, model and counters
+ * 
+ * @param out Filled with the current figures
+ */
+void relay_shadow_get_status(relay_shadow_status_t *out);
+
 #endif // RELAY_SERVICE_H
@@ -0,0 +1,111 @@
+/**
+ * @file sequencer.h
+ * @brief On-device relay sequencer interface
+ *
+ * Runs stored multi-step relay sequences (mask changes, delays, loops and
+ * abort conditions) from a single esp_timer and the sequencer task, so
+ * step timing does not depend on network jitter between HTTP calls.
+ */
+
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Step opcodes
+ */
+typedef enum {
+    SEQ_OP_SET = 1,         // mask = relays, arg = new states
+    SEQ_OP_WAIT = 2,        // arg = delay in milliseconds
+    SEQ_OP_LOOP = 3,        // mask = target step, arg = passes (0 = forever)
+    SEQ_OP_ABORT_IF = 4     // mask = relays, arg = states that abort
+} seq_op_t;
+
+/**
+ * @brief Compact sequence step (4 bytes, stored as-is in NVS)
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t op;
+    uint8_t mask;
+    uint16_t arg;
+} seq_step_t;
+
+/**
+ * @brief Sequence run state
+ */
+typedef enum {
+    SEQ_STATE_IDLE = 0,
+    SEQ_STATE_RUNNING,
+    SEQ_STATE_DONE,
+    SEQ_STATE_CANCELLED,
+    SEQ_STATE_ABORTED,
+    SEQ_STATE_FAILED        // The relay service refused a step
+} seq_state_t;
+
+/**
+ * @brief Progress snapshot of one sequence slot
+ */
+typedef struct {
+    seq_state_t state;
+    uint8_t step;           // Index of the next step to execute
+    uint8_t step_count;     // Steps in the stored sequence (0 = empty slot)
+    uint32_t loops;         // Loop jumps taken so far
+    uint32_t elapsed_ms;    // Time since start (or total run time once stopped)
+} seq_progress_t;
+
+/**
+ * @brief Initialize the sequencer and load stored sequences from NVS
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t sequencer_init(void);
+
+/**
+ * @brief Parse and store a sequence in a slot
+ *
+ * An empty text clears the slot. The slot must not be running.
+ *
+ * @param slot Slot index (0 to SEQ_MAX_SLOTS-1)
+ * @param text Sequence in the text format described in config.h
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG on a parse error,
+ *         ESP_ERR_INVALID_SIZE if too many steps,
+ *         ESP_ERR_INVALID_STATE if the slot is running or being stored
+ */
+esp_err_t sequencer_store(uint8_t slot, const char *text);
+
+/**
+ * @brief Start the sequence in a slot
+ *
+ * @param slot Slot index
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the slot is empty,
+ *         ESP_ERR_INVALID_STATE if it is already running or being stored
+ */
+esp_err_t sequencer_start(uint8_t slot);
+
+/**
+ * @brief Cancel a running sequence
+ *
+ * Relays keep the state reached by the last executed step.
+ *
+ * @param slot Slot index
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if not running
+ */
+esp_err_t sequencer_cancel(uint8_t slot);
+
+/**
+ * @brief Get the progress of a slot
+ *
+ * @param slot Slot index
+ * @param out Filled with the current progress
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if slot is invalid
+ */
+esp_err_t sequencer_get_progress(uint8_t slot, seq_progress_t *out);
+
+/**
+ * @brief Get a printable name for a run state
+ */
+const char* sequencer_state_name(seq_state_t state);
+
+#endif // SEQUENCER_H
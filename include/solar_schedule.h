@@ -0,0 +1,92 @@
+/**
+ * @file solar_schedule.h
+ * @brief Sunrise/sunset relay scheduling interface
+ *
+ * Rules switch relays at an offset from local sunrise or sunset. The sun
+ * times are computed once per day, so the periodic rule check does no
+ * trigonometry.
+ */
+
+#ifndef SOLAR_SCHEDULE_H
+#define SOLAR_SCHEDULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Solar event a rule is anchored to
+ */
+typedef enum {
+    SOLAR_EVENT_SUNRISE = 0,
+    SOLAR_EVENT_SUNSET = 1
+} solar_event_t;
+
+/**
+ * @brief Compact schedule rule (stored as-is in NVS)
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t event;          // solar_event_t
+    int16_t offset_min;     // Minutes relative to the event
+    uint8_t mask;           // Relays affected
+    uint8_t values;         // New states
+} solar_rule_t;
+
+/**
+ * @brief Sun times for one day
+ */
+typedef struct {
+    int16_t sunrise_min;    // Local minutes after midnight, -1 if none
+    int16_t sunset_min;     // Local minutes after midnight, -1 if none
+} solar_day_t;
+
+/**
+ * @brief Schedule status snapshot
+ */
+typedef struct {
+    bool time_valid;        // Wall clock synchronised
+    int year;
+    int yday;               // Day of year the table was computed for
+    solar_day_t today;
+    uint8_t rule_count;
+    uint32_t fired;         // Rules fired since boot
+    uint32_t failed;        // Fired rules the relay service refused
+} solar_status_t;
+
+/**
+ * @brief Compute sunrise/sunset for a date and location (NOAA algorithm)
+ *
+ * @param yday Day of year (0-365)
+ * @param year Calendar year (for leap years)
+ * @param lat Latitude in degrees, north positive
+ * @param lon Longitude in degrees, east positive
+ * @param utc_offset_min Local time offset from UTC in minutes
+ * @param out Filled with local sunrise/sunset minutes (-1 for polar day/night)
+ */
+void solar_compute_day(int yday, int year, double lat, double lon,
+                       int utc_offset_min, solar_day_t *out);
+
+/**
+ * @brief Start SNTP, load rules from NVS and start the schedule task
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t solar_schedule_init(void);
+
+/**
+ * @brief Parse and store schedule rules (replaces all rules)
+ *
+ * @param text Rules in the text format described in config.h ("" clears)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG on a parse error,
+ *         ESP_ERR_INVALID_SIZE if there are too many rules
+ */
+esp_err_t solar_schedule_set_rules(const char *text);
+
+/**
+ * @brief Get the schedule status
+ *
+ * @param out Filled with the current status
+ */
+void solar_schedule_get_status(solar_status_t *out);
+
+#endif // SOLAR_SCHEDULE_H
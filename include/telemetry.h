@@ -0,0 +1,60 @@
+/**
+ * @file telemetry.h
+ * @brief Periodic telemetry push interface
+ *
+ * Samples are encoded into a compact binary format, buffered in a fixed
+ * RAM ring and POSTed in batches to one collector URL. See telemetry.c
+ * for the wire format.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "config.h"
+
+/**
+ * @brief Telemetry agent status
+ */
+typedef struct {
+    char url[TELEMETRY_URL_MAX_LEN];    // Collector ("" when unset)
+    uint16_t buffered;          // Samples waiting for upload
+    uint32_t samples;           // Samples taken since boot
+    uint32_t sent;              // Samples acknowledged by the collector
+    uint32_t dropped;           // Samples lost to the RAM cap
+    uint32_t batches;           // Successful POSTs
+    uint32_t failures;          // Failed POST attempts
+    uint32_t bytes_sent;        // Payload bytes of successful POSTs
+    uint32_t retry_in_s;        // Seconds until the next attempt while backing off
+    uint32_t sample_us;         // CPU time of the last sample (gather + encode)
+    uint32_t max_sample_us;     // Worst sample CPU time
+    int last_status;            // Last HTTP status, -1 on transport error
+} telemetry_status_t;
+
+/**
+ * @brief Load the collector URL from NVS and start the telemetry task
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t telemetry_init(void);
+
+/**
+ * @brief Set the collector URL
+ *
+ * Buffered samples are kept and go to the new collector.
+ *
+ * @param url http:// or https:// URL ("" stops uploads; sampling continues)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a malformed URL,
+ *         ESP_ERR_INVALID_SIZE if it is too long
+ */
+esp_err_t telemetry_set_url(const char *url);
+
+/**
+ * @brief Get agent status
+ *
+ * @param out Filled with the current status
+ */
+void telemetry_get_status(telemetry_status_t *out);
+
+#endif // TELEMETRY_H
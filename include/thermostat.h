@@ -0,0 +1,94 @@
+/**
+ * @file thermostat.h
+ * @brief Closed-loop thermostat driving the fan relays
+ *
+ * Reads a pluggable temperature source at a fixed rate and stages the two
+ * fan relays with hysteresis and minimum run/rest times. The firmware
+ * starts it only with the sensor chosen by THERMO_SENSOR; host builds
+ * plug in a simulated room (tools/relay_sim).
+ */
+
+#ifndef THERMOSTAT_H
+#define THERMOSTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Temperature source
+ *
+ * read() is called once per control period from the thermostat task and
+ * must not block longer than a fraction of THERMO_PERIOD_MS.
+ */
+typedef struct {
+    const char *name;
+    esp_err_t (*read)(void *ctx, float *temp_c);
+    void *ctx;
+} thermo_sensor_t;
+
+/**
+ * @brief Thermostat status snapshot
+ */
+typedef struct {
+    const char *sensor;         // Sensor name, NULL if the thermostat is not running
+    bool enabled;
+    bool sensor_ok;
+    bool failsafe;
+    float setpoint_c;
+    float temp_c;               // Last good reading
+    uint8_t stages_on;          // 0, 1 or 2
+    uint32_t iterations;        // Control loop passes
+    uint32_t switch_count[2];   // ON transitions per stage
+    uint32_t sensor_errors;     // Total failed reads
+    uint32_t relay_errors;      // Stage changes the relay service refused
+    uint32_t max_jitter_us;     // Worst period deviation seen
+} thermo_status_t;
+
+/**
+ * @brief Initialize the thermostat and start its control task
+ *
+ * @param sensor Temperature source (copied; must stay valid)
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t thermostat_init(const thermo_sensor_t *sensor);
+
+/**
+ * @brief Enable or disable the control loop
+ *
+ * Disabling switches both stages OFF. The setting is persisted.
+ *
+ * @param enabled true to run the loop
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the thermostat was
+ *         not started
+ */
+esp_err_t thermostat_set_enabled(bool enabled);
+
+/**
+ * @brief Change the setpoint (persisted)
+ *
+ * @param setpoint_c Target temperature in degrees C (0-60)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if out of range or not
+ *         a finite number, ESP_ERR_INVALID_STATE if the thermostat was not started
+ */
+esp_err_t thermostat_set_setpoint(float setpoint_c);
+
+/**
+ * @brief Get the current thermostat status
+ *
+ * @param out Filled with the current status
+ */
+void thermostat_get_status(thermo_status_t *out);
+
+/**
+ * @brief Get the sensor selected by THERMO_SENSOR
+ *
+ * Sets the sensor up on the first call. With THERMO_SENSOR_NTC this is a
+ * thermistor divider read through ADC1 (see config.h).
+ *
+ * @return Sensor descriptor for thermostat_init(), or NULL if no sensor is
+ *         configured or it could not be set up
+ */
+const thermo_sensor_t* thermostat_board_sensor(void);
+
+#endif // THERMOSTAT_H
@@ -0,0 +1,82 @@
+/**
+ * @file uart_frame.h
+ * @brief COBS framing with a CRC-16 for the wired UART link
+ *
+ * On the wire a frame is the COBS encoding of payload + CRC, followed by
+ * a single 0x00 delimiter. COBS leaves no zero byte inside a frame, so a
+ * receiver that starts mid-stream, or loses bytes to noise or an overrun,
+ * is back in step at the next delimiter. The CRC is CRC-16/MODBUS (the
+ * one PLCs already compute for Modbus RTU), sent low byte first.
+ *
+ * A sender should also lead each frame with a delimiter: line noise ahead
+ * of it then ends up in an empty or broken frame of its own, instead of
+ * spoiling the frame that follows.
+ *
+ * Frames are short, so the decoder just collects the encoded bytes up to
+ * the delimiter in a fixed buffer and decodes them in place.
+ */
+
+#ifndef UART_FRAME_H
+#define UART_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define UART_FRAME_PAYLOAD_MAX  32      // Largest payload, CRC not included
+
+// COBS adds one code byte per 254 data bytes (one here), plus the CRC
+// and the delimiter
+#define UART_FRAME_WIRE_MAX     (UART_FRAME_PAYLOAD_MAX + 4)
+
+// uart_frame_feed() results besides a payload length
+#define UART_FRAME_MORE         0       // Frame not complete, all bytes used
+#define UART_FRAME_ERR_FRAMING  (-1)    // Too long, bad COBS, or cut by uart_frame_abort()
+#define UART_FRAME_ERR_CRC      (-2)    // Decoded, but the CRC did not match
+
+/**
+ * @brief Receive state (treat the fields as private)
+ */
+typedef struct {
+    uint8_t buf[UART_FRAME_WIRE_MAX];   // Encoded bytes, then the decoded payload
+    uint8_t len;
+    bool discard;                       // Drop everything up to the next delimiter
+} uart_frame_decoder_t;
+
+/**
+ * @brief CRC-16/MODBUS (reflected 0x8005, initial 0xFFFF)
+ */
+uint16_t uart_frame_crc16(const uint8_t *data, size_t len);
+
+/**
+ * @brief Encode a payload into a wire frame, delimiter included
+ *
+ * @param out At least UART_FRAME_WIRE_MAX bytes
+ * @return Bytes to send, or 0 if len is over UART_FRAME_PAYLOAD_MAX
+ */
+size_t uart_frame_encode(const uint8_t *payload, size_t len, uint8_t *out);
+
+void uart_frame_decoder_init(uart_frame_decoder_t *d);
+
+/**
+ * @brief Drop the frame being received
+ *
+ * For bytes known to be lost (UART overrun, framing error): the partial
+ * frame is discarded at the next delimiter instead of failing its CRC.
+ */
+void uart_frame_abort(uart_frame_decoder_t *d);
+
+/**
+ * @brief Feed received bytes, stopping after each delimiter
+ *
+ * Empty frames (back-to-back delimiters, which senders may use to flush
+ * a receiver) are skipped silently.
+ *
+ * @param consumed Set to the bytes used; feed the rest in the next call
+ * @param payload Set to the decoded payload (valid until the next call)
+ * @return Payload length (> 0), UART_FRAME_MORE, or a UART_FRAME_ERR_* code
+ */
+int uart_frame_feed(uart_frame_decoder_t *d, const uint8_t *data, size_t len,
+                    size_t *consumed, const uint8_t **payload);
+
+#endif // UART_FRAME_H
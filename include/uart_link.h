@@ -0,0 +1,88 @@
+/**
+ * @file uart_link.h
+ * @brief Wired UART control link interface
+ *
+ * Each request and reply is one frame (see uart_frame.h). Payloads, with
+ * multi-byte fields little-endian and mask bit N for relay N:
+ *
+ *   request:  seq cmd args...
+ *   reply:    seq cmd|0x80 result mask[4] extra...
+ *
+ * Commands:
+ *   0x01 SET     id state           set one relay (state 0 or 1)
+ *   0x02 TOGGLE  id                 flip one relay
+ *   0x03 MASK    mask[4] values[4]  drive every relay in mask, as one frame
+ *   0x04 STATUS                     extra: count version[4] requests[4]
+ *                                   errors[4] max_edge_us[4]
+ *
+ * mask in the reply is the relay state after the command. Like Modbus
+ * coils, commands skip the LED blink and the debounce, and the NVS save
+ * happens after the reply is sent.
+ *
+ * A frame with a bad CRC gets no reply; the controller retries with the
+ * same seq after its timeout. A request identical to the previous one,
+ * seq included, within UART_LINK_RETRY_WINDOW_MS is answered from the
+ * stored reply without being run again, so a retried TOGGLE switches
+ * once. Controllers step seq for every new request.
+ */
+
+#ifndef UART_LINK_H
+#define UART_LINK_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Commands
+#define UART_LINK_CMD_SET       0x01
+#define UART_LINK_CMD_TOGGLE    0x02
+#define UART_LINK_CMD_MASK      0x03
+#define UART_LINK_CMD_STATUS    0x04
+#define UART_LINK_REPLY         0x80    // Or-ed into cmd in the reply
+
+// Results
+#define UART_LINK_OK            0
+#define UART_LINK_BAD_REQUEST   1       // Unknown command, wrong length or state
+#define UART_LINK_BAD_RELAY     2       // Relay id or mask bit out of range
+#define UART_LINK_BUDGET        3       // Some ON changes refused by the power budget
+#define UART_LINK_OUTPUT_FAULT  4       // Outputs failed, change rolled back
+#define UART_LINK_BUSY          5       // Shadow mode on and no shadow scope free
+
+/**
+ * @brief Command-to-edge histogram buckets
+ *
+ * Bucket i counts switching commands whose outputs were written less than
+ * (32 << i) us after their last byte was handed to the task; the last
+ * bucket takes everything slower.
+ */
+#define UART_LINK_HIST_BUCKETS  8
+
+/**
+ * @brief Link statistics
+ */
+typedef struct {
+    uint32_t requests;          // Requests answered
+    uint32_t retries;           // Repeats answered from the stored reply
+    uint32_t crc_errors;        // Frames dropped for a bad CRC
+    uint32_t framing_errors;    // Overlong or malformed frames, UART framing/parity errors
+    uint32_t overruns;          // RX FIFO or buffer overflows (input flushed)
+    uint32_t edges;             // Switching commands timed below
+    uint32_t max_edge_us;       // Worst frame-received-to-outputs-written time
+    uint32_t total_edge_us;     // Sum, for the average
+    uint32_t edge_hist[UART_LINK_HIST_BUCKETS];
+} uart_link_stats_t;
+
+/**
+ * @brief Install the UART driver and start the link task
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t uart_link_init(void);
+
+/**
+ * @brief Get link statistics
+ *
+ * @param out Filled with the current counters
+ */
+void uart_link_get_stats(uart_link_stats_t *out);
+
+#endif // UART_LINK_H
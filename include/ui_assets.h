@@ -0,0 +1,110 @@
+/**
+ * @file ui_assets.h
+ * @brief Web UI assets served from a memory-mapped flash partition
+ *
+ * The UI files live in an indexed archive of precompressed files in the
+ * ASSETS_PARTITION_LABEL partition, built with tools/mkassets.py. The
+ * partition is mapped once at boot, and responses are sent straight from
+ * the mapping. Uploading a new archive replaces the UI without touching
+ * the firmware. See ui_assets.c for the archive format.
+ */
+
+#ifndef UI_ASSETS_H
+#define UI_ASSETS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief One file in the archive
+ */
+typedef struct {
+    const uint8_t *data;        // Points into the flash mapping
+    size_t len;                 // Stored (possibly compressed) length
+    uint32_t etag;              // CRC32 of the stored bytes, from the index
+    bool gzip;                  // Stored with Content-Encoding: gzip
+    const char *content_type;
+} ui_asset_t;
+
+/**
+ * @brief Archive and update status
+ */
+typedef struct {
+    bool valid;                 // A verified archive is mapped
+    bool updating;              // An upload is in progress
+    uint16_t files;
+    uint32_t bytes;             // Archive size
+    uint32_t partition_size;
+    uint32_t crc;               // Archive CRC32 from its header
+    uint32_t updates;           // Successful uploads since boot
+    uint32_t failed_updates;    // Rejected or interrupted uploads since boot
+} ui_assets_status_t;
+
+/**
+ * @brief Find and map the assets partition and verify its archive
+ *
+ * A missing partition or an invalid archive is not fatal: lookups fail
+ * and the HTTP server falls back to the built-in page.
+ *
+ * @return ESP_OK if a valid archive is mapped, error code otherwise
+ */
+esp_err_t ui_assets_init(void);
+
+/**
+ * @brief Look up a file by name
+ *
+ * The returned data stays valid until the next update begins. Lookups and
+ * updates both run on the HTTP server task, so a handler can send the
+ * data directly.
+ *
+ * @param name File name as stored in the archive (e.g. "index.html")
+ * @param out Filled with the file
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND (also while no archive is mapped)
+ */
+esp_err_t ui_assets_find(const char *name, ui_asset_t *out);
+
+/**
+ * @brief Start replacing the archive
+ *
+ * Unmaps the current archive. Flash sectors are erased only as the new
+ * data reaches them.
+ *
+ * @param total_len Size of the archive that follows
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without a partition,
+ *         ESP_ERR_INVALID_SIZE if it cannot fit
+ */
+esp_err_t ui_assets_update_begin(size_t total_len);
+
+/**
+ * @brief Write the next chunk of the archive
+ *
+ * The header is checked as soon as it has arrived.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a bad header or too much data,
+ *         or a flash error
+ */
+esp_err_t ui_assets_update_write(const void *data, size_t len);
+
+/**
+ * @brief Verify the written archive and map it
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_CRC / ESP_ERR_INVALID_ARG if the
+ *         archive is incomplete or inconsistent (it is then invalidated)
+ */
+esp_err_t ui_assets_update_finish(void);
+
+/**
+ * @brief Abandon an upload and invalidate the partly written archive
+ */
+void ui_assets_update_abort(void);
+
+/**
+ * @brief Get archive and update status
+ *
+ * @param out Filled with the current status
+ */
+void ui_assets_get_status(ui_assets_status_t *out);
+
+#endif // UI_ASSETS_H
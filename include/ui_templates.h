@@ -10,14 +10,11 @@
 #define UI_TEMPLATES_H
 
 /**
- * @brief Main HTML page template
+ * @brief Built-in copy of ui/index.html
  * 
- * Placeholders:
- *   %s - IP address
- *   %d - Relay 1 state (0 or 1)
- *   %d - Relay 2 state (0 or 1)
- *   %d - Relay 3 state (0 or 1)
- *   %d - Relay 4 state (0 or 1)
+ * Served when the assets partition holds no valid archive; keep the two in
+ * step. The page is the same size for any RELAY_COUNT: channels come from
+ * /relay/meta and /relay/state, not from the markup.
  */
 static const char HTML_PAGE[] = 
 "<!DOCTYPE html>"
@@ -28,92 +25,121 @@ static const char HTML_PAGE[] =
 "<style>"
 "*{box-sizing:border-box;margin:0;padding:0}"
 "body{font-family:system-ui,-apple-system,sans-serif;background:#1a1a2e;color:#eee;min-height:100vh;padding:20px}"
-"h1{text-align:center;margin-bottom:20px;color:#0f0}"
-".info{text-align:center;color:#888;margin-bottom:10px;font-size:14px}"
-".resp{text-align:center;color:#0f0;margin-bottom:20px;font-size:12px;height:16px}"
-".grid{display:grid;grid-template-columns:repeat(auto-fit,minmax(150px,1fr));gap:15px;max-width:600px;margin:0 auto}"
-".card{background:#16213e;border-radius:12px;padding:20px;text-align:center;transition:transform .2s}"
-".card:active{transform:scale(.95)}"
-".name{font-size:14px;color:#888;margin-bottom:10px}"
-".btn{width:100%%;padding:15px;border:none;border-radius:8px;font-size:16px;font-weight:bold;cursor:pointer;transition:all .2s}"
+"h1{text-align:center;margin-bottom:10px;color:#0f0}"
+".info{text-align:center;color:#888;margin-bottom:6px;font-size:14px}"
+".resp{text-align:center;color:#0f0;margin-bottom:12px;font-size:12px;height:16px}"
+".bar{display:flex;gap:8px;max-width:600px;margin:0 auto 10px}"
+".bar input{flex:1;min-width:0;padding:8px;border:none;border-radius:6px;background:#16213e;color:#eee}"
+".bar button{padding:8px 14px;border:none;border-radius:6px;cursor:pointer;font-weight:bold}"
+".all-on{background:#00ff88;color:#000}"
+".all-off{background:#ff4444;color:#fff}"
+"#list{position:relative;max-width:600px;height:70vh;margin:0 auto;overflow-y:auto;background:#16213e;border-radius:12px}"
+".row{position:absolute;left:0;right:0;height:44px;display:flex;align-items:center;gap:10px;padding:0 14px}"
+".row.g{color:#0f0;font-weight:bold;cursor:pointer;border-bottom:1px solid #1a1a2e}"
+".name{flex:1;overflow:hidden;white-space:nowrap;text-overflow:ellipsis}"
+".cnt{color:#888;font-size:12px}"
+".btn{width:72px;padding:8px;border:none;border-radius:6px;font-weight:bold;cursor:pointer}"
 ".btn.on{background:#00ff88;color:#000}"
 ".btn.off{background:#333;color:#888}"
 ".btn:disabled{opacity:.5;cursor:wait}"
-".all{margin-top:20px;display:flex;gap:10px;justify-content:center}"
-".all button{padding:10px 20px;border:none;border-radius:6px;cursor:pointer;font-weight:bold}"
-".all-on{background:#00ff88;color:#000}"
-".all-off{background:#ff4444;color:#fff}"
 "</style>"
 "</head><body>"
 "<h1>⚡ Relay Control</h1>"
-"<p class='info'>IP: %s</p>"
+"<p class='info' id='info'>Loading...</p>"
 "<p class='resp' id='resp'>Response: --</p>"
-"<div class='grid'>"
-"<div class='card'><div class='name'>💡 Light 1</div><button class='btn %s' id='r0' onclick='toggle(0)'>%s</button></div>"
-"<div class='card'><div class='name'>💡 Light 2</div><button class='btn %s' id='r1' onclick='toggle(1)'>%s</button></div>"
-"<div class='card'><div class='name'>🌀 Fan 1</div><button class='btn %s' id='r2' onclick='toggle(2)'>%s</button></div>"
-"<div class='card'><div class='name'>🌀 Fan 2</div><button class='btn %s' id='r3' onclick='toggle(3)'>%s</button></div>"
-"</div>"
-"<div class='all'>"
-"<button class='all-on' onclick='allOn()'>All ON</button>"
-"<button class='all-off' onclick='allOff()'>All OFF</button>"
+"<div class='bar'>"
+"<input id='q' placeholder='Filter channels'>"
+"<button class='all-on' onclick='allSet(1)'>All ON</button>"
+"<button class='all-off' onclick='allSet(0)'>All OFF</button>"
 "</div>"
+"<div id='list'><div id='pad'></div></div>"
+"<!-- Channels come from /relay/meta (once) and /relay/state (polled by version)."
+"Only the rows in view exist in the DOM, so the page costs the same at 4 or 256 channels. -->"
 "<script>"
-"const respEl=document.getElementById('resp');"
+"const H=44,POLL_MS=1000;"
+"const $=id=>document.getElementById(id);"
+"const list=$('list'),pad=$('pad'),respEl=$('resp');"
+"let meta={groups:[],relays:[]},on=[],ver=-1,power=0,rows=[],closed={},pool=[];"
 "function showTime(ms){respEl.textContent='Response: '+ms+'ms';respEl.style.color=ms<100?'#0f0':ms<300?'#ff0':'#f44';}"
-"async function toggle(id){"
-"const btn=document.getElementById('r'+id);"
+"function build(){"
+"const q=$('q').value.toLowerCase();"
+"rows=[];"
+"meta.groups.forEach((g,gi)=>{"
+"const ids=[];"
+"meta.relays.forEach((r,i)=>{if(r[1]==gi&&(!q||r[0].toLowerCase().includes(q)))ids.push(i);});"
+"if(!ids.length)return;"
+"rows.push({g:gi,ids});"
+"if(!closed[gi])ids.forEach(i=>rows.push({i}));"
+"});"
+"pad.style.height=rows.length*H+'px';"
+"render();"
+"}"
+"function render(){"
+"const first=Math.max(0,Math.floor(list.scrollTop/H)-4);"
+"const n=Math.ceil(list.clientHeight/H)+8;"
+"while(pool.length<n){"
+"const e=document.createElement('div');"
+"e.innerHTML=\"<span class='name'></span><span class='cnt'></span><button class='btn'></button>\";"
+"e.onclick=click;"
+"list.appendChild(e);pool.push(e);"
+"}"
+"pool.forEach((e,k)=>{"
+"const r=rows[first+k];"
+"e.style.display=r?'':'none';"
+"if(!r)return;"
+"e.row=r;e.style.top=(first+k)*H+'px';"
+"const [name,cnt,btn]=e.children;"
+"if('g' in r){"
+"e.className='row g';"
+"name.textContent=(closed[r.g]?'▸ ':'▾ ')+meta.groups[r.g];"
+"cnt.textContent=r.ids.filter(i=>on[i]).length+'/'+r.ids.length+' on';"
+"btn.style.display='none';"
+"}else{"
+"e.className='row';"
+"name.textContent=meta.relays[r.i][0];"
+"cnt.textContent=meta.relays[r.i][2]+' W';"
+"btn.style.display='';"
+"btn.className='btn '+(on[r.i]?'on':'off');"
+"btn.textContent=on[r.i]?'ON':'OFF';"
+"}"
+"});"
+"$('info').textContent='IP: '+location.hostname+' · '+meta.relays.length+' channels · '+power+' W';"
+"}"
+"function apply(d){"
+"if(d.m){for(let i=0;i<meta.relays.length;i++)on[i]=(parseInt(d.m[d.m.length-1-(i>>2)]||'0',16)>>(i&3))&1;}"
+"if(d.c){for(let k=0;k<d.c.length;k+=2)on[d.c[k]]=d.c[k+1];}"
+"ver=d.v;power=d.p;"
+"render();"
+"}"
+"async function poll(){"
+"try{apply(await (await fetch(ver<0?'/relay/state':'/relay/state?v='+ver)).json());}catch(e){ver=-1;console.error(e);}"
+"}"
+"async function click(ev){"
+"const r=this.row;"
+"if('g' in r){closed[r.g]=!closed[r.g];build();return;}"
+"if(ev.target.tagName!='BUTTON')return;"
+"const btn=ev.target;"
 "btn.disabled=true;"
 "const t0=performance.now();"
 "try{"
-"const r=await fetch('/relay/'+id+'/toggle');"
-"const d=await r.json();"
+"const d=await (await fetch('/relay/'+r.i+'/toggle')).json();"
 "showTime(Math.round(performance.now()-t0));"
-"btn.className='btn '+(d.state?'on':'off');"
-"btn.textContent=d.state?'ON':'OFF';"
+"if('state' in d){on[r.i]=d.state;render();}else respEl.textContent=d.error;"
 "}catch(e){console.error(e);respEl.textContent='Error';}"
 "btn.disabled=false;"
 "}"
-"async function allOn(){"
-"const t0=performance.now();"
-"await fetch('/relay/all/on');"
-"showTime(Math.round(performance.now()-t0));"
-"setTimeout(()=>location.reload(),500);"
-"}"
-"async function allOff(){"
+"async function allSet(s){"
 "const t0=performance.now();"
-"await fetch('/relay/all/off');"
+"await fetch(s?'/relay/all/on':'/relay/all/off');"
 "showTime(Math.round(performance.now()-t0));"
-"setTimeout(()=>location.reload(),500);"
+"poll();"
 "}"
+"list.onscroll=render;"
+"window.onresize=render;"
+"$('q').oninput=build;"
+"fetch('/relay/meta').then(r=>r.json()).then(m=>{meta=m;build();return poll();})"
+".then(()=>setInterval(poll,POLL_MS)).catch(e=>{console.error(e);respEl.textContent='Error';});"
 "</script>"
 "</body></html>";
 
-/**
- * @brief JSON response template for relay status
- * 
- * Placeholders:
- *   %d - Relay ID
- *   %s - Relay name
- *   %d - State (0 or 1)
- */
-static const char JSON_RELAY_STATUS[] = 
-"{\"id\":%d,\"name\":\"%s\",\"state\":%d}";
-
-/**
- * @brief JSON response template for all relays status
- */
-static const char JSON_ALL_STATUS_START[] = "{\"relays\":[";
-static const char JSON_ALL_STATUS_END[] = "]}";
-
-/**
- * @brief JSON error response
- */
-static const char JSON_ERROR[] = "{\"error\":\"%s\"}";
-
-/**
- * @brief JSON success response
- */
-static const char JSON_SUCCESS[] = "{\"success\":true,\"message\":\"%s\"}";
-
 #endif // UI_TEMPLATES_H
@@ -0,0 +1,64 @@
+/**
+ * @file webhook.h
+ * @brief Outbound webhook notification interface
+ *
+ * Relay state changes are delivered as JSON batches via HTTP POST from a
+ * background task. Nothing here runs on the relay command path.
+ */
+
+#ifndef WEBHOOK_H
+#define WEBHOOK_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "config.h"
+
+/**
+ * @brief Delivery status of one target
+ */
+typedef struct {
+    char url[WEBHOOK_URL_MAX_LEN];
+    uint16_t queued;            // Events waiting for delivery
+    uint32_t delivered;         // Events acknowledged with a 2xx status
+    uint32_t batches;           // Successful POSTs
+    uint32_t failures;          // Failed POST attempts
+    uint32_t dropped;           // Events lost to overflow or exhausted retries
+    int last_status;            // Last HTTP status, -1 on transport error
+} webhook_target_status_t;
+
+/**
+ * @brief Webhook status snapshot
+ */
+typedef struct {
+    uint8_t target_count;
+    uint32_t journal_lost;      // Changes overwritten before collection
+    webhook_target_status_t targets[WEBHOOK_MAX_TARGETS];
+} webhook_status_t;
+
+/**
+ * @brief Load targets from NVS and start the delivery task
+ *
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t webhook_init(void);
+
+/**
+ * @brief Replace the webhook targets
+ *
+ * Queued events and counters are reset.
+ *
+ * @param text http:// or https:// URLs separated by newlines or commas
+ *             ("" removes all targets)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a malformed URL,
+ *         ESP_ERR_INVALID_SIZE for too many or too long URLs
+ */
+esp_err_t webhook_set_targets(const char *text);
+
+/**
+ * @brief Get delivery status
+ *
+ * @param out Filled with the current status
+ */
+void webhook_get_status(webhook_status_t *out);
+
+#endif // WEBHOOK_H
@@ -1,20 +1,96 @@
 /**
  * @file wifi_service.h
  * @brief WiFi connection service interface
+ *
+ * With WIFI_ROAM_ENABLE the station leaves a weak access point for a
+ * stronger one of the same SSID instead of holding on until the beacons
+ * stop: the driver reports when the RSSI falls below WIFI_ROAM_RSSI_LOW,
+ * a roam task finds candidates (802.11k neighbor report, else a scan) and
+ * moves by BSS transition (802.11v) or by reassociating with the chosen
+ * BSSID, which is a fast transition (802.11r) where the APs support it.
  */
 
 #ifndef WIFI_SERVICE_H
 #define WIFI_SERVICE_H
 
+#include "config.h"
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Link statistics
+ */
+typedef struct {
+    bool connected;
+    int8_t rssi;                // dBm of the current AP, 0 when disconnected
+    uint32_t disconnects;       // Disconnect events since boot
+} wifi_stats_t;
+
+/**
+ * @brief One period without a link, from disconnect to address
+ */
+typedef struct {
+    uint32_t uptime_s;          // When the link came back
+    uint32_t gap_ms;            // Time without a link
+    const char *kind;           // "btm", "reassoc" (roams) or "reconnect"
+    int8_t from_rssi;           // dBm before a roam, 0 otherwise
+    int8_t to_rssi;             // dBm of the AP joined
+    uint8_t channel;            // Channel of the AP joined
+} wifi_gap_t;
+
+/**
+ * @brief Access point and roaming status
+ */
+typedef struct {
+    bool connected;
+    bool roam_enabled;
+    bool roaming;               // A transition is under way
+    int8_t rssi;
+    uint8_t bssid[6];           // Current AP
+    uint8_t channel;
+    bool rrm;                   // Current AP offers 802.11k neighbor reports
+    bool btm;                   // Current AP offers 802.11v BSS transition
+    uint32_t roams;             // Completed roams since boot
+    uint32_t roam_failures;     // Roams that fell back to a plain reconnect
+    uint32_t scans;             // Candidate searches (neighbor report or scan)
+    uint8_t candidates;         // Cached APs of our SSID
+    uint32_t disconnects;
+    uint32_t max_gap_ms;        // Longest gap since boot
+    uint8_t gap_count;
+    wifi_gap_t gaps[WIFI_ROAM_LOG_LEN]; // Newest first
+} wifi_roam_status_t;
+
+/**
+ * @brief Radio profiles: power save, listen interval and TX power together
+ */
+typedef enum {
+    WIFI_PROFILE_LATENCY = 0,   // Radio always on, full TX power
+    WIFI_PROFILE_BALANCED,      // Modem sleep, wake every DTIM
+    WIFI_PROFILE_LOW_POWER,     // Modem sleep, wake every listen interval, less TX power
+    WIFI_PROFILE_COUNT
+} wifi_profile_t;
+
+/**
+ * @brief Active radio profile and the settings it applied
+ */
+typedef struct {
+    wifi_profile_t profile;
+    const char *name;           // "latency", "balanced" or "low_power"
+    const char *ps;             // Power-save mode: "none", "min_modem", "max_modem"
+    uint16_t listen_interval;   // Beacon intervals between wakes (max_modem)
+    int8_t tx_power_qdbm;       // TX power in 0.25 dBm, as the driver reports it
+    uint32_t changes;           // Profile switches since boot
+} wifi_profile_status_t;
 
 /**
  * @brief Initialize and connect to WiFi
  * 
- * Blocks until connected or max retries exceeded.
+ * Blocks until connected. Joining is retried without limit, so this does
+ * not return while the access point is out of reach.
  * 
- * @return ESP_OK on success, error code otherwise
+ * @return ESP_OK once connected, or an error if the service could not be
+ *         set up
  */
 esp_err_t wifi_service_init(void);
 
@@ -32,6 +108,58 @@ bool wifi_is_connected(void);
  */
 const char* wifi_get_ip_address(void);
 
+/**
+ * @brief Change the static IP address of the station interface
+ * 
+ * Gateway and netmask are kept. lwIP announces the new address with a
+ * gratuitous ARP so neighbours update their caches.
+ * 
+ * @param ip New address (e.g., "192.168.1.100")
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t wifi_set_ip_address(const char *ip);
+
+/**
+ * @brief Get link statistics
+ * 
+ * @param out Filled with the current statistics
+ */
+void wifi_get_stats(wifi_stats_t *out);
+
+/**
+ * @brief Get access point, roaming and link gap status
+ * 
+ * @param out Filled with the current status
+ */
+void wifi_get_roam_status(wifi_roam_status_t *out);
+
+/**
+ * @brief Switch the radio profile and save it to NVS
+ * 
+ * Power save and TX power change at once. A new listen interval is only
+ * announced at association, so switching to or from low_power also
+ * reassociates WIFI_PROFILE_REASSOC_DELAY_MS later (a gap of a few
+ * seconds).
+ * 
+ * @param profile Profile to apply
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an unknown profile
+ */
+esp_err_t wifi_set_profile(wifi_profile_t profile);
+
+/**
+ * @brief Look up a profile by name
+ * 
+ * @return The profile, or WIFI_PROFILE_COUNT if the name is unknown
+ */
+wifi_profile_t wifi_profile_from_name(const char *name);
+
+/**
+ * @brief Get the active radio profile
+ * 
+ * @param out Filled with the current profile and settings
+ */
+void wifi_get_profile(wifi_profile_status_t *out);
+
 /**
  * @brief Disconnect from WiFi
  */
@@ -0,0 +1,135 @@
+/**
+ * @file block_pool.c
+ * @brief Fixed-block pool implementation
+ *
+ * Free blocks form a singly linked list threaded through the blocks
+ * themselves, so alloc pops the head and free pushes it back: no search,
+ * no per-block header. A block is checked on free against the pool's
+ * range and alignment; double frees are not detected.
+ */
+
+#include "block_pool.h"
+#include "config.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = LOG_TAG_POOL;
+
+#define BLOCK_ALIGN         8           // Blocks may hold int64_t fields
+
+// Guards the registry list; each pool has its own lock for its blocks
+static portMUX_TYPE s_registry_lock = portMUX_INITIALIZER_UNLOCKED;
+static block_pool_t *s_pools = NULL;
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t block_pool_init(block_pool_t *pool, const char *name, size_t block_size, uint16_t count)
+{
+    if (pool == NULL || count == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    block_size = (block_size + BLOCK_ALIGN - 1) & ~(size_t)(BLOCK_ALIGN - 1);
+
+    uint8_t *base = heap_caps_malloc(block_size * count, MALLOC_CAP_8BIT);
+    if (base == NULL) {
+        ESP_LOGE(TAG, "No memory for pool %s (%u x %u bytes)",
+                 name, (unsigned)count, (unsigned)block_size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    pool->name = name;
+    pool->base = base;
+    pool->block_size = block_size;
+    pool->count = count;
+    portMUX_INITIALIZE(&pool->lock);
+
+    // Thread the free list in address order
+    for (uint16_t i = 0; i < count; i++) {
+        void *next = (i + 1 < count) ? base + (size_t)(i + 1) * block_size : NULL;
+        memcpy(base + (size_t)i * block_size, &next, sizeof(next));
+    }
+    pool->free_list = base;
+
+    taskENTER_CRITICAL(&s_registry_lock);
+    pool->next = s_pools;
+    s_pools = pool;
+    taskEXIT_CRITICAL(&s_registry_lock);
+
+    ESP_LOGI(TAG, "Pool %s: %u x %u bytes", name, (unsigned)count, (unsigned)block_size);
+    return ESP_OK;
+}
+
+void *block_pool_alloc(block_pool_t *pool)
+{
+    void *block;
+
+    taskENTER_CRITICAL(&pool->lock);
+    block = pool->free_list;
+    if (block != NULL) {
+        memcpy(&pool->free_list, block, sizeof(void *));
+        pool->in_use++;
+        pool->allocs++;
+        if (pool->in_use > pool->peak) {
+            pool->peak = pool->in_use;
+        }
+    } else {
+        pool->failures++;
+    }
+    taskEXIT_CRITICAL(&pool->lock);
+
+    return block;
+}
+
+void block_pool_free(block_pool_t *pool, void *block)
+{
+    if (block == NULL) {
+        return;
+    }
+
+    size_t off = (size_t)((uint8_t *)block - pool->base);
+    if ((uint8_t *)block < pool->base || off >= pool->block_size * pool->count ||
+        off % pool->block_size != 0) {
+        ESP_LOGE(TAG, "Pool %s: %p is not one of its blocks", pool->name, block);
+        return;
+    }
+
+    taskENTER_CRITICAL(&pool->lock);
+    memcpy(block, &pool->free_list, sizeof(void *));
+    pool->free_list = block;
+    pool->in_use--;
+    taskEXIT_CRITICAL(&pool->lock);
+}
+
+size_t block_pool_get_stats(block_pool_stats_t *out, size_t max)
+{
+    size_t n = 0;
+
+    taskENTER_CRITICAL(&s_registry_lock);
+    for (block_pool_t *p = s_pools; p != NULL && n < max; p = p->next) {
+        // Counters are read without the pool lock; a report may be one op stale
+        out[n++] = (block_pool_stats_t){
+            .name = p->name,
+            .block_size = (uint32_t)p->block_size,
+            .count = p->count,
+            .in_use = p->in_use,
+            .peak = p->peak,
+            .allocs = p->allocs,
+            .failures = p->failures,
+        };
+    }
+    taskEXIT_CRITICAL(&s_registry_lock);
+
+    return n;
+}
+
+void block_pool_get_heap(block_pool_heap_t *out)
+{
+    out->free = (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    out->min_free = (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    out->largest = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
@@ -0,0 +1,382 @@
+/**
+ * @file failover.c
+ * @brief Hot-standby failover implementation
+ *
+ * One task owns a UDP socket and runs the pair protocol:
+ *   - The active board sends a heartbeat every FAILOVER_HEARTBEAT_MS with
+ *     the full relay mask and its state version, and a delta as soon as it
+ *     sees the relay mask change (polled every FAILOVER_POLL_MS).
+ *   - The standby applies the changed relays of the next version, or the
+ *     full state if deltas were lost; heartbeats repair anything else, so
+ *     divergence is bounded by one heartbeat interval.
+ *   - After FAILOVER_MISS_LIMIT silent intervals the standby moves to
+ *     STATIC_IP (lwIP announces the address with a gratuitous ARP) and
+ *     releases failover_wait_active() so main.c starts the API.
+ * If both boards ever claim the service (healed network split), the one
+ * with the lower term yields by restarting and rejoins as standby; on a
+ * tie the primary keeps the address.
+ */
+
+#include "failover.h"
+#include "relay_service.h"
+#include "wifi_service.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "lwip/sockets.h"
+#include <string.h>
+
+static const char *TAG = LOG_TAG_FAILOVER;
+
+#define FO_MAGIC            0x52464F31UL    // "RFO1"
+#define FO_MSG_HEARTBEAT    1
+#define FO_MSG_DELTA        2
+
+#define ACTIVE_BIT          BIT0
+#define ALL_RELAYS_MASK     ((1UL << RELAY_COUNT) - 1)
+#define MISS_WINDOW_US      ((int64_t)FAILOVER_HEARTBEAT_MS * FAILOVER_MISS_LIMIT * 1000)
+
+/**
+ * @brief Wire format (all fields big-endian)
+ *
+ * Heartbeat: mask = all relays, values = full relay state.
+ * Delta:     mask = relays that changed, values = full relay state, so a
+ *            delta arriving after a lost one can still resync the standby.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t role;           // FAILOVER_ROLE of the sender
+    uint8_t state;          // failover_state_t of the sender
+    uint8_t pair_id;
+    uint32_t term;
+    uint32_t version;
+    uint32_t mask;
+    uint32_t values;
+} fo_msg_t;
+
+static TaskHandle_t s_task = NULL;
+static EventGroupHandle_t s_events = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static int s_sock = -1;
+
+static failover_status_t s_status;      // Guarded by s_lock
+static int64_t s_last_peer_us = 0;      // Any heartbeat from the peer
+static int64_t s_last_active_us = 0;    // Heartbeat from an active peer
+static uint32_t s_peer_term = 0;
+static uint32_t s_sent_mask = 0;        // Mask last announced by the active board
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+static void send_msg(uint8_t type, uint32_t mask, uint32_t values)
+{
+    fo_msg_t msg = {
+        .magic = htonl(FO_MAGIC),
+        .type = type,
+        .role = FAILOVER_ROLE,
+        .state = (uint8_t)s_status.state,
+        .pair_id = FAILOVER_PAIR_ID,
+        .term = htonl(s_status.term),
+        .version = htonl(s_status.version),
+        .mask = htonl(mask),
+        .values = htonl(values)
+    };
+
+    // The active board talks to the peer's own address, everyone else to
+    // the service address (wherever the active board currently is)
+    const char *dest = (s_status.state == FAILOVER_STATE_ACTIVE) ? FAILOVER_PEER_IP : STATIC_IP;
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(FAILOVER_PORT),
+        .sin_addr.s_addr = inet_addr(dest)
+    };
+
+    if (sendto(s_sock, &msg, sizeof(msg), 0, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ESP_LOGD(TAG, "sendto %s failed: errno %d", dest, errno);
+        return;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    if (type == FO_MSG_HEARTBEAT) {
+        s_status.heartbeats_tx++;
+    } else {
+        s_status.deltas_tx++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+/**
+ * @brief Claim the service address and start acting as the active board
+ */
+static void take_over(int64_t now_us)
+{
+    uint32_t silent_ms = (uint32_t)((now_us - s_last_active_us) / 1000);
+    uint32_t term = (s_status.term > s_peer_term ? s_status.term : s_peer_term) + 1;
+
+    ESP_LOGW(TAG, "Taking over %s (term %lu, %lu ms without an active peer)",
+             STATIC_IP, (unsigned long)term, (unsigned long)silent_ms);
+
+    esp_err_t ret = wifi_set_ip_address(STATIC_IP);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to claim service address: %s", esp_err_to_name(ret));
+        return;
+    }
+
+    // Mirrored states were applied without persisting; keep them now
+    relay_save_states();
+    s_sent_mask = relay_get_mask();
+
+    portENTER_CRITICAL(&s_lock);
+    s_status.state = FAILOVER_STATE_ACTIVE;
+    s_status.term = term;
+    s_status.takeovers++;
+    s_status.last_takeover_ms = silent_ms;
+    portEXIT_CRITICAL(&s_lock);
+
+    send_msg(FO_MSG_HEARTBEAT, ALL_RELAYS_MASK, s_sent_mask);
+    xEventGroupSetBits(s_events, ACTIVE_BIT);
+}
+
+/**
+ * @brief Handle one datagram from the peer
+ */
+static void handle_msg(const fo_msg_t *msg, int64_t now_us)
+{
+    if (ntohl(msg->magic) != FO_MAGIC || msg->pair_id != FAILOVER_PAIR_ID) {
+        return;
+    }
+
+    uint32_t term = ntohl(msg->term);
+    uint32_t version = ntohl(msg->version);
+    uint32_t mask = ntohl(msg->mask) & ALL_RELAYS_MASK;
+    uint32_t values = ntohl(msg->values) & ALL_RELAYS_MASK;
+
+    s_last_peer_us = now_us;
+    if (msg->type == FO_MSG_HEARTBEAT) {
+        portENTER_CRITICAL(&s_lock);
+        s_status.heartbeats_rx++;
+        portEXIT_CRITICAL(&s_lock);
+    }
+
+    if (msg->state != FAILOVER_STATE_ACTIVE) {
+        return;
+    }
+
+    if (s_status.state == FAILOVER_STATE_ACTIVE) {
+        bool peer_wins = term > s_status.term ||
+                         (term == s_status.term && msg->role == FAILOVER_ROLE_PRIMARY &&
+                          FAILOVER_ROLE != FAILOVER_ROLE_PRIMARY);
+        if (peer_wins) {
+            ESP_LOGE(TAG, "Peer is also active (term %lu vs %lu), yielding",
+                     (unsigned long)term, (unsigned long)s_status.term);
+            esp_restart();
+        }
+        return;
+    }
+
+    s_last_active_us = now_us;
+    s_peer_term = term;
+
+    if (s_status.state == FAILOVER_STATE_STARTING) {
+        ESP_LOGI(TAG, "Active peer found (term %lu), entering standby", (unsigned long)term);
+        portENTER_CRITICAL(&s_lock);
+        s_status.state = FAILOVER_STATE_STANDBY;
+        portEXIT_CRITICAL(&s_lock);
+    }
+
+    esp_err_t ret;
+    if (msg->type == FO_MSG_DELTA) {
+        portENTER_CRITICAL(&s_lock);
+        s_status.deltas_rx++;
+        portEXIT_CRITICAL(&s_lock);
+
+        int32_t ahead = (int32_t)(version - s_status.version);
+        if (ahead <= 0) return;             // Stale or duplicate
+        if (ahead == 1) {
+            ret = relay_set_mask(mask, values, false);
+        } else {
+            // Deltas were lost; this one still carries the full state
+            ret = relay_set_mask(ALL_RELAYS_MASK, values, false);
+            portENTER_CRITICAL(&s_lock);
+            s_status.resyncs++;
+            portEXIT_CRITICAL(&s_lock);
+        }
+    } else {
+        if (version == s_status.version && relay_get_mask() == values) return;
+        ret = relay_set_mask(ALL_RELAYS_MASK, values, false);
+        portENTER_CRITICAL(&s_lock);
+        s_status.resyncs++;
+        portEXIT_CRITICAL(&s_lock);
+    }
+
+    if (ret != ESP_OK) {
+        // Keep the old version: the next delta is then a gap and the next
+        // heartbeat a mismatch, so either applies the full state again
+        ESP_LOGW(TAG, "Peer state v%lu refused: %s", (unsigned long)version,
+                 esp_err_to_name(ret));
+        portENTER_CRITICAL(&s_lock);
+        s_status.apply_errors++;
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_status.version = version;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+/**
+ * @brief Pair protocol task
+ */
+static void failover_task(void *arg)
+{
+    int64_t boot_us = esp_timer_get_time();
+    int64_t last_hb_us = 0;
+
+    // The standby waits longer at boot so a simultaneous power-up settles
+    // on the primary without a split
+    s_last_active_us = boot_us;
+    if (FAILOVER_ROLE == FAILOVER_ROLE_STANDBY) {
+        s_last_active_us += MISS_WINDOW_US;
+    }
+
+    while (1) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(s_sock, &rfds);
+        struct timeval tv = { .tv_sec = 0, .tv_usec = FAILOVER_POLL_MS * 1000 };
+        int ready = select(s_sock + 1, &rfds, NULL, NULL, &tv);
+
+        int64_t now_us = esp_timer_get_time();
+
+        if (ready > 0) {
+            fo_msg_t msg;
+            while (recv(s_sock, &msg, sizeof(msg), MSG_DONTWAIT) == sizeof(msg)) {
+                handle_msg(&msg, now_us);
+            }
+        }
+
+        if (s_status.state == FAILOVER_STATE_ACTIVE) {
+            uint32_t mask = relay_get_mask();
+            if (mask != s_sent_mask) {
+                portENTER_CRITICAL(&s_lock);
+                s_status.version++;
+                portEXIT_CRITICAL(&s_lock);
+                send_msg(FO_MSG_DELTA, mask ^ s_sent_mask, mask);
+                s_sent_mask = mask;
+            }
+        } else if (now_us - s_last_active_us >= MISS_WINDOW_US) {
+            take_over(now_us);
+            last_hb_us = now_us;
+        }
+
+        if (now_us - last_hb_us >= (int64_t)FAILOVER_HEARTBEAT_MS * 1000) {
+            uint32_t values = (s_status.state == FAILOVER_STATE_ACTIVE) ? s_sent_mask : relay_get_mask();
+            send_msg(FO_MSG_HEARTBEAT, ALL_RELAYS_MASK, values);
+            last_hb_us = now_us;
+        }
+    }
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t failover_init(void)
+{
+    if (!FAILOVER_ENABLE) {
+        return ESP_OK;
+    }
+    if (s_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ESP_LOGI(TAG, "Initializing failover (%s, node %s, peer %s)...",
+             FAILOVER_ROLE == FAILOVER_ROLE_PRIMARY ? "primary" : "standby",
+             FAILOVER_NODE_IP, FAILOVER_PEER_IP);
+
+    s_events = xEventGroupCreate();
+    if (s_events == NULL) {
+        ESP_LOGE(TAG, "Failed to create event group");
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(FAILOVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    if (bind(s_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "Failed to bind port %d: errno %d", FAILOVER_PORT, errno);
+        close(s_sock);
+        s_sock = -1;
+        return ESP_FAIL;
+    }
+
+    memset(&s_status, 0, sizeof(s_status));
+    s_status.state = FAILOVER_STATE_STARTING;
+
+    BaseType_t ok = xTaskCreate(failover_task, "failover", FAILOVER_TASK_STACK_SIZE,
+                                NULL, FAILOVER_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create failover task");
+        close(s_sock);
+        s_sock = -1;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void failover_wait_active(void)
+{
+    if (!FAILOVER_ENABLE || s_events == NULL) {
+        return;
+    }
+
+    if (!failover_is_active()) {
+        ESP_LOGI(TAG, "Waiting as standby...");
+    }
+    xEventGroupWaitBits(s_events, ACTIVE_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+}
+
+bool failover_is_active(void)
+{
+    if (!FAILOVER_ENABLE) {
+        return true;
+    }
+    return s_status.state == FAILOVER_STATE_ACTIVE;
+}
+
+void failover_get_status(failover_status_t *out)
+{
+    portENTER_CRITICAL(&s_lock);
+    *out = s_status;
+    portEXIT_CRITICAL(&s_lock);
+
+    int64_t age_us = esp_timer_get_time() - s_last_peer_us;
+    out->peer_seen = s_last_peer_us != 0 && age_us < MISS_WINDOW_US;
+    out->peer_age_ms = s_last_peer_us != 0 ? (uint32_t)(age_us / 1000) : 0;
+}
+
+const char* failover_state_name(failover_state_t state)
+{
+    switch (state) {
+        case FAILOVER_STATE_STARTING: return "starting";
+        case FAILOVER_STATE_STANDBY:  return "standby";
+        case FAILOVER_STATE_ACTIVE:   return "active";
+        default:                      return "unknown";
+    }
+}
@@ -0,0 +1,573 @@
+/**
+ * @file gossip.c
+ * @brief Fleet configuration gossip implementation
+ *
+ * Push-pull anti-entropy over UDP. Every GOSSIP_PERIOD_MS the task sends
+ * a digest (object id + version for every object, ~55 bytes) to one
+ * random live peer. The receiver pushes each object it holds a newer
+ * version of and requests each object the sender holds a newer version
+ * of. Every GOSSIP_ANNOUNCE_ROUNDS rounds the digest is broadcast instead,
+ * which is how boards discover each other; any datagram refreshes the
+ * sender in the peer table.
+ *
+ * Object texts live in NVS (one blob per object: version header + text)
+ * and are only read when pushed, so RAM use is the version table plus one
+ * transfer buffer.
+ *
+ * An object the owning module rejects is neither stored nor adopted: the
+ * board keeps advertising the version it actually runs. The rejected
+ * version is remembered (in RAM) so it is not requested again; a newer
+ * version of the object is.
+ */
+
+#include "gossip.h"
+#include "sequencer.h"
+#include "solar_schedule.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include <string.h>
+
+static const char *TAG = LOG_TAG_GOSSIP;
+
+#define GS_MAGIC            0x52475331UL    // "RGS1"
+#define GS_MSG_DIGEST       1
+#define GS_MSG_REQUEST      2
+#define GS_MSG_OBJECT       3
+
+#define GS_TEXT_MAX         SEQ_MAX_TEXT_LEN    // Largest object text
+#define GS_PACKET_MAX       (sizeof(gs_header_t) + sizeof(gs_object_t) + GS_TEXT_MAX)
+
+/**
+ * @brief Object version: Lamport counter, ties broken by origin node
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t counter;
+    uint32_t origin;
+} gs_version_t;
+
+/**
+ * @brief Datagram header (multi-byte fields big-endian)
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t count;          // Digest entries
+    uint32_t node_id;
+} gs_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t obj;
+    gs_version_t version;
+} gs_digest_entry_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t obj;
+    gs_version_t version;
+    uint16_t len;           // Text bytes that follow (no terminator)
+} gs_object_t;
+
+/**
+ * @brief NVS blob layout
+ */
+typedef struct __attribute__((packed)) {
+    gs_version_t version;
+    char text[GS_TEXT_MAX + 1];
+} gs_stored_t;
+
+typedef struct {
+    struct sockaddr_in addr;
+    int64_t last_seen_us;   // 0 = free slot
+} gs_peer_t;
+
+static TaskHandle_t s_task = NULL;
+static SemaphoreHandle_t s_lock = NULL;     // Versions, NVS blobs, s_stored
+static int s_sock = -1;
+
+static uint32_t s_node_id = 0;
+static uint32_t s_clock = 0;                // Lamport clock
+static gs_version_t s_versions[GOSSIP_OBJ_COUNT];
+static gs_version_t s_rejected[GOSSIP_OBJ_COUNT];  // Newest version the owner refused
+static gs_peer_t s_peers[GOSSIP_MAX_PEERS];
+static gossip_stats_t s_stats;
+
+static gs_stored_t s_stored;                // Transfer buffer
+static uint8_t s_tx[GS_PACKET_MAX];
+static uint8_t s_rx[GS_PACKET_MAX];
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+static bool version_newer(const gs_version_t *a, const gs_version_t *b)
+{
+    return a->counter > b->counter ||
+           (a->counter == b->counter && a->origin > b->origin);
+}
+
+static void object_key(uint8_t obj, char *key, size_t size)
+{
+    snprintf(key, size, "%s%u", NVS_KEY_GOSSIP_PREFIX, obj);
+}
+
+/**
+ * @brief Read an object blob into s_stored (caller holds s_lock)
+ */
+static esp_err_t object_load(uint8_t obj)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    char key[16];
+    object_key(obj, key, sizeof(key));
+    size_t len = sizeof(s_stored);
+    ret = nvs_get_blob(nvs_handle, key, &s_stored, &len);
+    nvs_close(nvs_handle);
+
+    if (ret == ESP_OK && len <= sizeof(gs_version_t)) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    if (ret == ESP_OK) {
+        s_stored.text[len - sizeof(gs_version_t) - 1] = '\0';
+    }
+    return ret;
+}
+
+/**
+ * @brief Store an object and adopt its version (caller holds s_lock)
+ */
+static esp_err_t object_save(uint8_t obj, const gs_version_t *version, const char *text)
+{
+    size_t text_len = strlen(text);
+    if (text_len > GS_TEXT_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    s_stored.version = *version;
+    memcpy(s_stored.text, text, text_len + 1);
+
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    char key[16];
+    object_key(obj, key, sizeof(key));
+    ret = nvs_set_blob(nvs_handle, key, &s_stored, sizeof(gs_version_t) + text_len + 1);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save object %u: %s", obj, esp_err_to_name(ret));
+        return ret;
+    }
+
+    s_versions[obj] = *version;
+    if (version->counter > s_clock) {
+        s_clock = version->counter;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Hand an object to the module that owns it
+ */
+static esp_err_t object_apply(uint8_t obj, const char *text)
+{
+    if (obj == GOSSIP_OBJ_SOLAR_RULES) {
+        return solar_schedule_set_rules(text);
+    }
+    return sequencer_store(obj, text);
+}
+
+static void send_packet(const struct sockaddr_in *to, size_t len)
+{
+    if (sendto(s_sock, s_tx, len, 0, (const struct sockaddr *)to, sizeof(*to)) == (int)len) {
+        s_stats.bytes_tx += len;
+    }
+}
+
+static size_t put_header(uint8_t type, uint8_t count)
+{
+    gs_header_t *hdr = (gs_header_t *)s_tx;
+    hdr->magic = htonl(GS_MAGIC);
+    hdr->type = type;
+    hdr->count = count;
+    hdr->node_id = htonl(s_node_id);
+    return sizeof(*hdr);
+}
+
+static void send_digest(const struct sockaddr_in *to)
+{
+    size_t len = put_header(GS_MSG_DIGEST, GOSSIP_OBJ_COUNT);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < GOSSIP_OBJ_COUNT; i++) {
+        gs_digest_entry_t *e = (gs_digest_entry_t *)(s_tx + len);
+        e->obj = i;
+        e->version.counter = htonl(s_versions[i].counter);
+        e->version.origin = htonl(s_versions[i].origin);
+        len += sizeof(*e);
+    }
+    xSemaphoreGive(s_lock);
+
+    send_packet(to, len);
+}
+
+static void send_object(const struct sockaddr_in *to, uint8_t obj)
+{
+    size_t len = put_header(GS_MSG_OBJECT, 1);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_versions[obj].counter == 0 || object_load(obj) != ESP_OK) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    size_t text_len = strlen(s_stored.text);
+    gs_object_t *o = (gs_object_t *)(s_tx + len);
+    o->obj = obj;
+    o->version.counter = htonl(s_stored.version.counter);
+    o->version.origin = htonl(s_stored.version.origin);
+    o->len = htons((uint16_t)text_len);
+    memcpy(s_tx + len + sizeof(*o), s_stored.text, text_len);
+    xSemaphoreGive(s_lock);
+
+    send_packet(to, len + sizeof(*o) + text_len);
+    s_stats.objects_tx++;
+}
+
+/**
+ * @brief Remember (or refresh) a peer address
+ */
+static void peer_seen(const struct sockaddr_in *addr, int64_t now_us)
+{
+    gs_peer_t *slot = NULL;
+    for (int i = 0; i < GOSSIP_MAX_PEERS; i++) {
+        gs_peer_t *p = &s_peers[i];
+        if (p->last_seen_us != 0 && p->addr.sin_addr.s_addr == addr->sin_addr.s_addr) {
+            p->last_seen_us = now_us;
+            return;
+        }
+        // Prefer a free slot, otherwise evict the stalest peer
+        if (slot == NULL || p->last_seen_us < slot->last_seen_us) {
+            slot = p;
+        }
+    }
+    slot->addr = *addr;
+    slot->addr.sin_port = htons(GOSSIP_PORT);
+    slot->last_seen_us = now_us;
+}
+
+static const gs_peer_t* pick_peer(int64_t now_us)
+{
+    const gs_peer_t *live[GOSSIP_MAX_PEERS];
+    int count = 0;
+    for (int i = 0; i < GOSSIP_MAX_PEERS; i++) {
+        gs_peer_t *p = &s_peers[i];
+        if (p->last_seen_us == 0) continue;
+        if (now_us - p->last_seen_us > (int64_t)GOSSIP_PEER_TIMEOUT_S * 1000000) {
+            p->last_seen_us = 0;
+            continue;
+        }
+        live[count++] = p;
+    }
+    s_stats.peers = count;
+    return count > 0 ? live[esp_random() % count] : NULL;
+}
+
+static void handle_digest(const struct sockaddr_in *from, const uint8_t *body, size_t len, uint8_t count)
+{
+    if (len < (size_t)count * sizeof(gs_digest_entry_t)) return;
+
+    uint32_t want = 0;
+    uint32_t push = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < count; i++) {
+        const gs_digest_entry_t *e = (const gs_digest_entry_t *)(body + i * sizeof(*e));
+        if (e->obj >= GOSSIP_OBJ_COUNT) continue;
+
+        gs_version_t remote = {
+            .counter = ntohl(e->version.counter),
+            .origin = ntohl(e->version.origin)
+        };
+        if (version_newer(&remote, &s_versions[e->obj]) &&
+            version_newer(&remote, &s_rejected[e->obj])) {
+            want |= 1UL << e->obj;
+        } else if (version_newer(&s_versions[e->obj], &remote)) {
+            push |= 1UL << e->obj;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    for (int i = 0; i < GOSSIP_OBJ_COUNT; i++) {
+        if (push & (1UL << i)) {
+            send_object(from, i);
+        }
+    }
+
+    if (want != 0) {
+        size_t n = put_header(GS_MSG_REQUEST, 0);
+        uint32_t wire = htonl(want);
+        memcpy(s_tx + n, &wire, sizeof(wire));
+        send_packet(from, n + sizeof(wire));
+    }
+}
+
+static void handle_request(const struct sockaddr_in *from, const uint8_t *body, size_t len)
+{
+    if (len < sizeof(uint32_t)) return;
+
+    uint32_t want;
+    memcpy(&want, body, sizeof(want));
+    want = ntohl(want);
+    for (int i = 0; i < GOSSIP_OBJ_COUNT; i++) {
+        if (want & (1UL << i)) {
+            send_object(from, i);
+        }
+    }
+}
+
+static void handle_object(const uint8_t *body, size_t len)
+{
+    if (len < sizeof(gs_object_t)) return;
+
+    const gs_object_t *o = (const gs_object_t *)body;
+    uint16_t text_len = ntohs(o->len);
+    if (o->obj >= GOSSIP_OBJ_COUNT || text_len > GS_TEXT_MAX ||
+        len < sizeof(*o) + text_len) {
+        return;
+    }
+
+    gs_version_t version = {
+        .counter = ntohl(o->version.counter),
+        .origin = ntohl(o->version.origin)
+    };
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool newer = version_newer(&version, &s_versions[o->obj]) &&
+                 version_newer(&version, &s_rejected[o->obj]);
+    xSemaphoreGive(s_lock);
+    if (!newer) {
+        return;     // Already have it (another peer was faster), or refused it
+    }
+    s_stats.objects_rx++;
+
+    // Text is copied out of s_rx so it stays valid while the owner parses it
+    char text[GS_TEXT_MAX + 1];
+    memcpy(text, body + sizeof(*o), text_len);
+    text[text_len] = '\0';
+
+    // A text the owner cannot parse is not adopted: the board keeps
+    // advertising what it runs, and remembers the version so it is not
+    // requested again
+    esp_err_t ret = object_apply(o->obj, text);
+    if (ret == ESP_ERR_INVALID_ARG || ret == ESP_ERR_INVALID_SIZE) {
+        ESP_LOGW(TAG, "Object %u v%lu rejected: %s", o->obj,
+                 (unsigned long)version.counter, esp_err_to_name(ret));
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_rejected[o->obj] = version;
+        s_stats.rejected++;
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    // A running sequence cannot be replaced, and a failed flash write may
+    // pass; keep the old version so the object is offered again next round
+    if (ret != ESP_OK) {
+        ESP_LOGD(TAG, "Object %u not applied (%s), retrying later", o->obj,
+                 esp_err_to_name(ret));
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (object_save(o->obj, &version, text) == ESP_OK) {
+        s_stats.applied++;
+        ESP_LOGI(TAG, "Object %u updated to v%lu from node %08lx", o->obj,
+                 (unsigned long)version.counter, (unsigned long)version.origin);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static void handle_packet(const struct sockaddr_in *from, size_t len, int64_t now_us)
+{
+    if (len < sizeof(gs_header_t)) return;
+
+    const gs_header_t *hdr = (const gs_header_t *)s_rx;
+    if (ntohl(hdr->magic) != GS_MAGIC || ntohl(hdr->node_id) == s_node_id) {
+        return;     // Not ours, or our own broadcast
+    }
+
+    s_stats.bytes_rx += len;
+    peer_seen(from, now_us);
+
+    const uint8_t *body = s_rx + sizeof(*hdr);
+    size_t body_len = len - sizeof(*hdr);
+    switch (hdr->type) {
+        case GS_MSG_DIGEST:  handle_digest(from, body, body_len, hdr->count); break;
+        case GS_MSG_REQUEST: handle_request(from, body, body_len); break;
+        case GS_MSG_OBJECT:  handle_object(body, body_len); break;
+        default: break;
+    }
+}
+
+/**
+ * @brief Gossip task: one digest per round, answer peers in between
+ */
+static void gossip_task(void *arg)
+{
+    int64_t next_round_us = esp_timer_get_time();
+    struct sockaddr_in broadcast = {
+        .sin_family = AF_INET,
+        .sin_port = htons(GOSSIP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_BROADCAST)
+    };
+
+    while (1) {
+        int64_t now_us = esp_timer_get_time();
+        int64_t wait_us = next_round_us - now_us;
+        if (wait_us < 0) wait_us = 0;
+
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(s_sock, &rfds);
+        struct timeval tv = { .tv_sec = wait_us / 1000000, .tv_usec = wait_us % 1000000 };
+
+        if (select(s_sock + 1, &rfds, NULL, NULL, &tv) > 0) {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            int n = recvfrom(s_sock, s_rx, sizeof(s_rx), 0, (struct sockaddr *)&from, &from_len);
+            if (n > 0) {
+                handle_packet(&from, n, esp_timer_get_time());
+            }
+            continue;
+        }
+
+        now_us = esp_timer_get_time();
+        next_round_us = now_us + (int64_t)GOSSIP_PERIOD_MS * 1000;
+        s_stats.rounds++;
+
+        const gs_peer_t *peer = pick_peer(now_us);
+        if (peer == NULL || s_stats.rounds % GOSSIP_ANNOUNCE_ROUNDS == 0) {
+            send_digest(&broadcast);
+        } else {
+            send_digest(&peer->addr);
+        }
+    }
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t gossip_init(void)
+{
+    if (s_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    s_node_id = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) |
+                ((uint32_t)mac[4] << 8) | mac[5];
+
+    memset(s_versions, 0, sizeof(s_versions));
+    memset(s_rejected, 0, sizeof(s_rejected));
+    memset(s_peers, 0, sizeof(s_peers));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.node_id = s_node_id;
+
+    for (int i = 0; i < GOSSIP_OBJ_COUNT; i++) {
+        if (object_load(i) == ESP_OK) {
+            s_versions[i] = s_stored.version;
+            if (s_stored.version.counter > s_clock) {
+                s_clock = s_stored.version.counter;
+            }
+        }
+    }
+
+    s_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    int enable = 1;
+    setsockopt(s_sock, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(GOSSIP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    if (bind(s_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "Failed to bind port %d: errno %d", GOSSIP_PORT, errno);
+        close(s_sock);
+        s_sock = -1;
+        return ESP_FAIL;
+    }
+
+    BaseType_t ok = xTaskCreate(gossip_task, "gossip", GOSSIP_TASK_STACK_SIZE,
+                                NULL, GOSSIP_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create gossip task");
+        close(s_sock);
+        s_sock = -1;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Gossip started (node %08lx, clock %lu)",
+             (unsigned long)s_node_id, (unsigned long)s_clock);
+    return ESP_OK;
+}
+
+esp_err_t gossip_publish(uint8_t obj, const char *text)
+{
+    if (obj >= GOSSIP_OBJ_COUNT || text == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    gs_version_t version = { .counter = s_clock + 1, .origin = s_node_id };
+    esp_err_t ret = object_save(obj, &version, text);
+    xSemaphoreGive(s_lock);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Object %u published as v%lu", obj, (unsigned long)version.counter);
+    }
+    return ret;
+}
+
+void gossip_get_stats(gossip_stats_t *out)
+{
+    *out = s_stats;
+    if (s_lock == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < GOSSIP_OBJ_COUNT; i++) {
+        out->versions[i] = s_versions[i].counter;
+    }
+    xSemaphoreGive(s_lock);
+}
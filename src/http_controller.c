@@ -3,28 +3,97 @@
  * @brief HTTP server and REST API controller implementation
  * 
  * REST API Endpoints:
- *   GET /              - Home page with UI
+ *   GET /              - Home page with UI (index.html from the assets partition)
+ *   GET /ui/{file}          - Other UI assets from the assets partition
+ *   POST /assets            - Replace the UI asset archive (binary body)
+ *   GET /assets/status      - UI asset archive state
+ *   GET /powerfail/status   - Power-fail flush and recovery counters
+ *   GET /pool/status        - Connection pools and heap fragmentation
+ *   GET /uart/status        - Wired UART link counters and command-to-edge times
+ *   GET /wifi/status        - Access point, roaming and link gaps
+ *   GET /wifi/profile?name=latency|balanced|low_power - Radio profile
  *   GET /relay/{id}/toggle  - Toggle relay and return new state
  *   GET /relay/{id}/status  - Get relay status
  *   GET /relay/{id}/on      - Turn relay ON
  *   GET /relay/{id}/off     - Turn relay OFF
+ *   GET /relay/{id}/pulse?ms=N - Momentary ON pulse of N milliseconds
+ *   POST /seq/{slot}        - Upload a sequence (text body, see config.h)
+ *   GET /seq/{slot}/run     - Start a stored sequence
+ *   GET /seq/{slot}/cancel  - Cancel a running sequence
+ *   GET /seq/{slot}/status  - Sequence progress
+ *   GET /thermostat/status  - Thermostat state and loop statistics
+ *   GET /thermostat/set?sp=C&enabled=0|1 - Change thermostat settings
+ *   POST /solar/rules       - Replace sunrise/sunset rules (text body)
+ *   GET /solar/status       - Today's sun times and rule count
+ *   GET /failover/status    - Hot-standby pair state and counters
+ *   GET /gossip/status      - Config gossip peers, versions and traffic
+ *   POST /webhooks          - Replace webhook target URLs (text body)
+ *   GET /webhooks/status    - Webhook delivery counters
+ *   POST /telemetry         - Set the telemetry collector URL (text body)
+ *   GET /telemetry/status   - Telemetry buffer and upload counters
+ *   GET /shadow?enabled=0|1&reset=1 - Shadow (dry-run) switch and counters
+ *   GET /relay/meta         - Channel names, groups and weights (ETag)
+ *   GET /relay/state?v=N    - State version, changes since N or bitmask
  *   GET /relay/all/status   - Get all relay statuses
  *   GET /relay/all/on       - Turn all relays ON
  *   GET /relay/all/off      - Turn all relays OFF
+ * 
+ * Relay commands run in shadow (dry-run) mode when the request carries
+ * "X-Shadow: 1" or the global switch is on; see relay_shadow_begin().
+ *
+ * Each connection gets a session context from a block pool sized to
+ * HTTP_MAX_CONNECTIONS, so opening and closing sockets never touches the
+ * heap.
  */
 
 #include "http_controller.h"
 #include "relay_service.h"
+#include "sequencer.h"
+#include "thermostat.h"
+#include "solar_schedule.h"
+#include "failover.h"
+#include "gossip.h"
+#include "webhook.h"
+#include "telemetry.h"
+#include "ui_assets.h"
+#include "powerfail.h"
+#include "block_pool.h"
 #include "wifi_service.h"
+#include "uart_link.h"
 #include "ui_templates.h"
+#include "json_writer.h"
 #include "config.h"
 #include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
 #include <string.h>
 #include <stdlib.h>
 
 static const char *TAG = LOG_TAG_HTTP;
+
 static httpd_handle_t s_server = NULL;
 
+/**
+ * @brief A JSON response being written (see response_begin())
+ */
+typedef struct {
+    httpd_req_t *req;
+    bool chunked;               // Body outgrew buf, sent as HTTP chunks
+    json_writer_t w;
+    char buf[HTTP_RESPONSE_BUFFER_SIZE];
+} json_response_t;
+
+/**
+ * @brief Per-connection session context
+ */
+typedef struct {
+    int64_t opened_us;
+    uint32_t requests;          // JSON responses sent on this connection
+} http_session_t;
+
+static block_pool_t s_sessions;
+
 /*============================================================================
  * Helper Functions
  *============================================================================*/
@@ -54,10 +123,115 @@ static int extract_relay_id(const char *uri)
 }
 
 /**
- * @brief Send JSON response
+ * @brief Extract sequence slot from URI path
+ * 
+ * @param action Set to the text after the slot ("" if none)
  */
-static esp_err_t send_json_response(httpd_req_t *req, const char *json)
+static int extract_seq_slot(const char *uri, const char **action)
 {
+    // Expected format: /seq/{slot}[/action]
+    const char *p = strstr(uri, "/seq/");
+    if (p == NULL) return -1;
+    
+    p += 5; // Skip "/seq/"
+    
+    char *end;
+    long slot = strtol(p, &end, 10);
+    if (end == p || slot < 0 || slot >= SEQ_MAX_SLOTS) {
+        return -1;
+    }
+    
+    *action = (*end == '/') ? end + 1 : end;
+    return (int)slot;
+}
+
+/**
+ * @brief Receive the full request body as a NUL-terminated string
+ * 
+ * @return Bytes received, or -1 on socket error or if it does not fit
+ */
+static int recv_body(httpd_req_t *req, char *buf, size_t size)
+{
+    if (req->content_len >= size) {
+        return -1;
+    }
+    
+    size_t received = 0;
+    while (received < req->content_len) {
+        int n = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (n <= 0) {
+            if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+            return -1;
+        }
+        received += n;
+    }
+    buf[received] = '\0';
+    return (int)received;
+}
+
+/**
+ * @brief Return a session context to the pool (httpd free_ctx callback)
+ */
+static void session_free(void *ctx)
+{
+    http_session_t *sess = ctx;
+    ESP_LOGD(TAG, "Session closed after %lld ms, %lu requests",
+             (long long)((esp_timer_get_time() - sess->opened_us) / 1000),
+             (unsigned long)sess->requests);
+    block_pool_free(&s_sessions, sess);
+}
+
+/**
+ * @brief Attach a pooled context to a new connection (httpd open_fn)
+ * 
+ * @return ESP_FAIL to have the server close the socket if the pool is empty
+ */
+static esp_err_t session_open(httpd_handle_t hd, int sockfd)
+{
+    http_session_t *sess = block_pool_alloc(&s_sessions);
+    if (sess == NULL) {
+        ESP_LOGW(TAG, "No session context free, closing socket %d", sockfd);
+        return ESP_FAIL;
+    }
+    
+    sess->opened_us = esp_timer_get_time();
+    sess->requests = 0;
+    httpd_sess_set_ctx(hd, sockfd, sess, session_free);
+    return ESP_OK;
+}
+
+/**
+ * @brief JSON writer output: one response if the body fits the buffer,
+ *        HTTP chunks once it does not
+ */
+static esp_err_t response_flush(void *ctx, const char *data, size_t len, bool last)
+{
+    json_response_t *resp = ctx;
+    
+    if (last && !resp->chunked) {
+        return httpd_resp_send(resp->req, data, len);
+    }
+    
+    resp->chunked = true;
+    esp_err_t ret = (len > 0) ? httpd_resp_send_chunk(resp->req, data, len) : ESP_OK;
+    if (ret == ESP_OK && last) {
+        ret = httpd_resp_send_chunk(resp->req, NULL, 0);
+    }
+    return ret;
+}
+
+/**
+ * @brief Set the JSON headers and open the response object
+ * 
+ * @return Writer for the object's members; finish with response_end()
+ */
+static json_writer_t *response_begin(httpd_req_t *req, json_response_t *resp)
+{
+    http_session_t *sess = req->sess_ctx;
+    if (sess != NULL) {
+        sess->requests++;
+    }
+    
     httpd_resp_set_type(req, "application/json");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     
@@ -65,81 +239,257 @@ static esp_err_t send_json_response(httpd_req_t *req, const char *json)
     httpd_resp_set_hdr(req, "Connection", "keep-alive");
 #endif
     
-    return httpd_resp_sendstr(req, json);
+    if (relay_shadow_active()) {
+        httpd_resp_set_hdr(req, SHADOW_HEADER, "1");
+    }
+    
+    resp->req = req;
+    resp->chunked = false;
+    json_writer_init(&resp->w, resp->buf, sizeof(resp->buf), response_flush, resp);
+    json_object_begin(&resp->w, NULL);
+    return &resp->w;
+}
+
+/**
+ * @brief Close the response object and send what is left of it
+ */
+static esp_err_t response_end(json_response_t *resp)
+{
+    if (relay_shadow_active()) {
+        // Tag shadow results in the object as well as the header
+        json_bool(&resp->w, "shadow", true);
+    }
+    json_object_end(&resp->w);
+    
+    esp_err_t ret = json_writer_end(&resp->w);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Response to %s not completed: %s", resp->req->uri, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/**
+ * @brief Send {"error":message} with an HTTP status line
+ */
+static esp_err_t send_json_error(httpd_req_t *req, const char *status, const char *message)
+{
+    json_response_t resp;
+    httpd_resp_set_status(req, status);
+    json_writer_t *w = response_begin(req, &resp);
+    json_string(w, "error", message);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Send {"success":true,"message":message}
+ */
+static esp_err_t send_json_success(httpd_req_t *req, const char *message)
+{
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_bool(w, "success", true);
+    json_string(w, "message", message);
+    return response_end(&resp);
+}
+
+/**
+ * @brief "power" object: used and budget watts, loads shed, commands rejected
+ */
+static void write_power(json_writer_t *w, const relay_power_t *power)
+{
+    json_object_begin(w, "power");
+    json_uint(w, "used_w", power->used_w);
+    json_uint(w, "budget_w", power->budget_w);
+    json_uint(w, "shed", power->shed_count);
+    json_uint(w, "rejected", power->reject_count);
+    json_object_end(w);
+}
+
+/**
+ * @brief "outputs" object: output driver counters and pulse end lateness
+ */
+static void write_outputs(json_writer_t *w, const relay_output_stats_t *os)
+{
+    json_object_begin(w, "outputs");
+    json_uint(w, "frames", os->frames);
+    json_uint(w, "write_errors", os->write_errors);
+    json_uint(w, "verify_errors", os->verify_errors);
+    json_uint(w, "rollbacks", os->rollbacks);
+    json_uint(w, "rollback_failures", os->rollback_failures);
+    json_bool(w, "iram_profile", RELAY_IRAM_PROFILE);
+    json_uint(w, "pulse_ends", os->pulse_ends);
+    json_uint(w, "pulse_late_max_us", os->pulse_late_max_us);
+    json_array_begin(w, "pulse_late_hist");
+    for (int i = 0; i < RELAY_LATE_HIST_BUCKETS; i++) {
+        json_uint(w, NULL, os->pulse_late_hist[i]);
+    }
+    json_array_end(w);
+    json_object_end(w);
+}
+
+/**
+ * @brief Members of a relay status object: id, name, state
+ */
+static void write_relay(json_writer_t *w, int relay_id, const char *name, int state)
+{
+    json_int(w, "id", relay_id);
+    json_string(w, "name", name);
+    json_int(w, "state", state);
+}
+
+/**
+ * @brief Check if a request asks for shadow mode (header or global switch)
+ */
+static bool shadow_requested(httpd_req_t *req)
+{
+    if (relay_shadow_enabled()) {
+        return true;
+    }
+    
+    char value[4];
+    return httpd_req_get_hdr_value_str(req, SHADOW_HEADER, value, sizeof(value)) == ESP_OK &&
+           strcmp(value, "1") == 0;
+}
+
+/**
+ * @brief Run a relay command handler, inside a shadow scope if requested
+ */
+static esp_err_t run_relay_command(httpd_req_t *req, esp_err_t (*respond)(httpd_req_t *req))
+{
+    if (!shadow_requested(req)) {
+        return respond(req);
+    }
+    
+    if (relay_shadow_begin() != ESP_OK) {
+        return send_json_error(req, "503 Service Unavailable", "Shadow scope unavailable");
+    }
+    esp_err_t ret = respond(req);
+    relay_shadow_end();
+    return ret;
+}
+
+/**
+ * @brief Refuse a request that would drive outputs outside the relay service
+ * 
+ * Sequences, the thermostat and solar rules switch relays from their own
+ * tasks, which a shadow scope cannot follow.
+ * 
+ * @return true if the request was refused (response already sent)
+ */
+static bool shadow_refused(httpd_req_t *req, esp_err_t *ret)
+{
+    if (!shadow_requested(req)) {
+        return false;
+    }
+    
+    *ret = send_json_error(req, "409 Conflict", "Not available in shadow mode");
+    return true;
 }
 
 /*============================================================================
  * Route Handlers
  *============================================================================*/
 
+/**
+ * @brief Send a UI asset straight from the flash mapping
+ * 
+ * Answers 304 when the client already holds this version (ETag from the
+ * archive index), so a reload costs one short response.
+ */
+static esp_err_t send_asset(httpd_req_t *req, const ui_asset_t *asset)
+{
+    char etag[12];
+    char value[48];
+    snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)asset->etag);
+    
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    
+#if HTTP_KEEP_ALIVE
+    httpd_resp_set_hdr(req, "Connection", "keep-alive");
+#endif
+    
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) == ESP_OK &&
+        strcmp(value, etag) == 0) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    
+    if (asset->gzip) {
+        // Assets are stored compressed only; every current browser accepts gzip
+        if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", value, sizeof(value)) != ESP_ERR_NOT_FOUND &&
+            strstr(value, "gzip") == NULL) {
+            httpd_resp_set_status(req, "406 Not Acceptable");
+            return httpd_resp_sendstr(req, "gzip required");
+        }
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+    
+    httpd_resp_set_type(req, asset->content_type);
+    return httpd_resp_send(req, (const char *)asset->data, asset->len);
+}
+
 /**
  * @brief Home page handler - serves the UI
+ * 
+ * index.html from the assets partition when there is one, otherwise the
+ * built-in page.
  */
 static esp_err_t handler_home(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "GET /");
     
-    // Build response with current relay states
-    char response[3200];
-    
-    int s0 = relay_get_state(0);
-    int s1 = relay_get_state(1);
-    int s2 = relay_get_state(2);
-    int s3 = relay_get_state(3);
-    
-    snprintf(response, sizeof(response), HTML_PAGE,
-        wifi_get_ip_address(),
-        s0 ? "on" : "off", s0 ? "ON" : "OFF",
-        s1 ? "on" : "off", s1 ? "ON" : "OFF",
-        s2 ? "on" : "off", s2 ? "ON" : "OFF",
-        s3 ? "on" : "off", s3 ? "ON" : "OFF"
-    );
+    ui_asset_t asset;
+    if (ui_assets_find("index.html", &asset) == ESP_OK) {
+        return send_asset(req, &asset);
+    }
     
+    // Built-in page: constant, channels are loaded by the page itself
     httpd_resp_set_type(req, "text/html");
     
 #if HTTP_KEEP_ALIVE
     httpd_resp_set_hdr(req, "Connection", "keep-alive");
 #endif
     
-    return httpd_resp_sendstr(req, response);
+    return httpd_resp_send(req, HTML_PAGE, sizeof(HTML_PAGE) - 1);
 }
 
 /**
  * @brief Toggle relay handler
  */
-static esp_err_t handler_toggle(httpd_req_t *req)
+static esp_err_t respond_toggle(httpd_req_t *req)
 {
     int relay_id = extract_relay_id(req->uri);
     
     if (relay_id < 0) {
-        char error[64];
-        snprintf(error, sizeof(error), JSON_ERROR, "Invalid relay ID");
-        httpd_resp_set_status(req, "400 Bad Request");
-        return send_json_response(req, error);
+        return send_json_error(req, "400 Bad Request", "Invalid relay ID");
     }
     
     ESP_LOGI(TAG, "GET /relay/%d/toggle", relay_id);
     
     int new_state = relay_toggle(relay_id);
+    if (new_state == -2) {
+        return send_json_error(req, "500 Internal Server Error", "Output fault, change rolled back");
+    }
+    if (new_state < 0) {
+        return send_json_error(req, "409 Conflict", "Power budget exceeded");
+    }
+    
     const relay_info_t *info = relay_get_info(relay_id);
     if (info == NULL) {
-        char error[64];
-        snprintf(error, sizeof(error), JSON_ERROR, "Relay not found");
-        httpd_resp_set_status(req, "404 Not Found");
-        return send_json_response(req, error);
+        return send_json_error(req, "404 Not Found", "Relay not found");
     }
     
-    char response[HTTP_RESPONSE_BUFFER_SIZE];
-    snprintf(response, sizeof(response), JSON_RELAY_STATUS,
-        relay_id, info->name, new_state);
-    
-    return send_json_response(req, response);
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    write_relay(w, relay_id, info->name, new_state);
+    return response_end(&resp);
 }
 
 /**
  * @brief Get relay status handler
  */
-static esp_err_t handler_status(httpd_req_t *req)
+static esp_err_t respond_status(httpd_req_t *req)
 {
     int relay_id = extract_relay_id(req->uri);
     
@@ -147,128 +497,1042 @@ static esp_err_t handler_status(httpd_req_t *req)
         // All relays status
         ESP_LOGI(TAG, "GET /relay/all/status");
         
-        char response[512];
-        char *p = response;
-        
-        p += sprintf(p, "%s", JSON_ALL_STATUS_START);
+        // Streams in chunks once it outgrows the buffer, so any RELAY_COUNT fits
+        json_response_t resp;
+        json_writer_t *w = response_begin(req, &resp);
         
+        json_array_begin(w, "relays");
         for (int i = 0; i < RELAY_COUNT; i++) {
             const relay_info_t *info = relay_get_info(i);
-            if (i > 0) *p++ = ',';
-            p += sprintf(p, JSON_RELAY_STATUS, i, info->name, info->state);
+            json_object_begin(w, NULL);
+            write_relay(w, i, info->name, info->state);
+            json_object_end(w);
         }
+        json_array_end(w);
+        
+        relay_power_t power;
+        relay_get_power(&power);
+        write_power(w, &power);
         
-        sprintf(p, "%s", JSON_ALL_STATUS_END);
+        relay_output_stats_t outputs;
+        relay_get_output_stats(&outputs);
+        write_outputs(w, &outputs);
         
-        return send_json_response(req, response);
+        return response_end(&resp);
     }
     
     if (relay_id < 0) {
-        char error[64];
-        snprintf(error, sizeof(error), JSON_ERROR, "Invalid relay ID");
-        httpd_resp_set_status(req, "400 Bad Request");
-        return send_json_response(req, error);
+        return send_json_error(req, "400 Bad Request", "Invalid relay ID");
     }
     
     ESP_LOGI(TAG, "GET /relay/%d/status", relay_id);
     
     const relay_info_t *info = relay_get_info(relay_id);
     if (info == NULL) {
-        char error[64];
-        snprintf(error, sizeof(error), JSON_ERROR, "Relay not found");
-        httpd_resp_set_status(req, "404 Not Found");
-        return send_json_response(req, error);
+        return send_json_error(req, "404 Not Found", "Relay not found");
     }
     
-    char response[HTTP_RESPONSE_BUFFER_SIZE];
-    snprintf(response, sizeof(response), JSON_RELAY_STATUS,
-        relay_id, info->name, info->state);
-    
-    return send_json_response(req, response);
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    write_relay(w, relay_id, info->name, info->state);
+    return response_end(&resp);
 }
 
 /**
  * @brief Turn relay ON handler
  */
-static esp_err_t handler_on(httpd_req_t *req)
+static esp_err_t respond_on(httpd_req_t *req)
 {
     int relay_id = extract_relay_id(req->uri);
     
     if (relay_id == -2) {
         // All relays ON
         ESP_LOGI(TAG, "GET /relay/all/on");
-        relay_all_on();
+        esp_err_t ret = relay_all_on();
+        if (ret == ESP_ERR_NOT_ALLOWED) {
+            return send_json_error(req, "409 Conflict", "Power budget: some relays left OFF");
+        }
+        if (ret != ESP_OK) {
+            return send_json_error(req, "500 Internal Server Error", "Output fault, change rolled back");
+        }
         
-        char response[64];
-        snprintf(response, sizeof(response), JSON_SUCCESS, "All relays ON");
-        return send_json_response(req, response);
+        return send_json_success(req, "All relays ON");
     }
     
     if (relay_id < 0) {
-        char error[64];
-        snprintf(error, sizeof(error), JSON_ERROR, "Invalid relay ID");
-        httpd_resp_set_status(req, "400 Bad Request");
-        return send_json_response(req, error);
+        return send_json_error(req, "400 Bad Request", "Invalid relay ID");
     }
     
     ESP_LOGI(TAG, "GET /relay/%d/on", relay_id);
     
-    relay_set_state(relay_id, RELAY_ON);
+    esp_err_t ret = relay_set_state(relay_id, RELAY_ON);
+    if (ret == ESP_ERR_NOT_ALLOWED) {
+        return send_json_error(req, "409 Conflict", "Power budget exceeded");
+    }
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_ARG) {
+        return send_json_error(req, "500 Internal Server Error", "Output fault, change rolled back");
+    }
+    
     const relay_info_t *info = relay_get_info(relay_id);
     if (info == NULL) {
-        char error[64];
-        snprintf(error, sizeof(error), JSON_ERROR, "Relay not found");
-        httpd_resp_set_status(req, "404 Not Found");
-        return send_json_response(req, error);
+        return send_json_error(req, "404 Not Found", "Relay not found");
     }
     
-    char response[HTTP_RESPONSE_BUFFER_SIZE];
-    snprintf(response, sizeof(response), JSON_RELAY_STATUS,
-        relay_id, info->name, RELAY_ON);
-    
-    return send_json_response(req, response);
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    write_relay(w, relay_id, info->name, RELAY_ON);
+    return response_end(&resp);
 }
 
 /**
  * @brief Turn relay OFF handler
  */
-static esp_err_t handler_off(httpd_req_t *req)
+static esp_err_t respond_off(httpd_req_t *req)
 {
     int relay_id = extract_relay_id(req->uri);
     
     if (relay_id == -2) {
         // All relays OFF
         ESP_LOGI(TAG, "GET /relay/all/off");
-        relay_all_off();
+        if (relay_all_off() != ESP_OK) {
+            return send_json_error(req, "500 Internal Server Error", "Output fault, change rolled back");
+        }
         
-        char response[64];
-        snprintf(response, sizeof(response), JSON_SUCCESS, "All relays OFF");
-        return send_json_response(req, response);
+        return send_json_success(req, "All relays OFF");
     }
     
     if (relay_id < 0) {
-        char error[64];
-        snprintf(error, sizeof(error), JSON_ERROR, "Invalid relay ID");
-        httpd_resp_set_status(req, "400 Bad Request");
-        return send_json_response(req, error);
+        return send_json_error(req, "400 Bad Request", "Invalid relay ID");
     }
     
     ESP_LOGI(TAG, "GET /relay/%d/off", relay_id);
     
-    relay_set_state(relay_id, RELAY_OFF);
+    esp_err_t ret = relay_set_state(relay_id, RELAY_OFF);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_ARG) {
+        return send_json_error(req, "500 Internal Server Error", "Output fault, change rolled back");
+    }
+    
     const relay_info_t *info = relay_get_info(relay_id);
     if (info == NULL) {
-        char error[64];
-        snprintf(error, sizeof(error), JSON_ERROR, "Relay not found");
-        httpd_resp_set_status(req, "404 Not Found");
-        return send_json_response(req, error);
+        return send_json_error(req, "404 Not Found", "Relay not found");
+    }
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    write_relay(w, relay_id, info->name, RELAY_OFF);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Momentary pulse handler
+ * 
+ * Arms the pulse and returns immediately; the OFF edge is driven by the
+ * relay service timer, not by this handler or the client.
+ */
+static esp_err_t respond_pulse(httpd_req_t *req)
+{
+    int relay_id = extract_relay_id(req->uri);
+    
+    if (relay_id < 0) {
+        return send_json_error(req, "400 Bad Request", "Invalid relay ID");
+    }
+    
+    // Optional ?ms=N, defaults to RELAY_PULSE_DEFAULT_MS
+    uint32_t duration_ms = RELAY_PULSE_DEFAULT_MS;
+    char query[32];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "ms", value, sizeof(value)) == ESP_OK) {
+        char *end = NULL;
+        unsigned long ms = strtoul(value, &end, 10);
+        if (end == value || *end != '\0') {
+            return send_json_error(req, "400 Bad Request", "Invalid pulse duration");
+        }
+        if (ms < RELAY_PULSE_MIN_MS || ms > RELAY_PULSE_MAX_MS) {
+            return send_json_error(req, "400 Bad Request", "Pulse duration out of range");
+        }
+        duration_ms = (uint32_t)ms;
+    }
+    
+    ESP_LOGI(TAG, "GET /relay/%d/pulse?ms=%lu", relay_id, (unsigned long)duration_ms);
+    
+    esp_err_t ret = relay_pulse(relay_id, duration_ms);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        return send_json_error(req, "409 Conflict", "Relay busy");
+    }
+    if (ret == ESP_ERR_NOT_ALLOWED) {
+        return send_json_error(req, "409 Conflict", "Power budget exceeded");
+    }
+    if (ret == ESP_FAIL || ret == ESP_ERR_INVALID_RESPONSE) {
+        return send_json_error(req, "500 Internal Server Error", "Output fault, change rolled back");
+    }
+    if (ret != ESP_OK) {
+        return send_json_error(req, "500 Internal Server Error", "Pulse failed");
+    }
+    
+    const relay_info_t *info = relay_get_info(relay_id);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    write_relay(w, relay_id, info->name, RELAY_ON);
+    json_uint(w, "pulse_ms", duration_ms);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Relay command handlers - each runs in a shadow scope when asked
+ */
+static esp_err_t handler_toggle(httpd_req_t *req) { return run_relay_command(req, respond_toggle); }
+static esp_err_t handler_status(httpd_req_t *req) { return run_relay_command(req, respond_status); }
+static esp_err_t handler_on(httpd_req_t *req) { return run_relay_command(req, respond_on); }
+static esp_err_t handler_off(httpd_req_t *req) { return run_relay_command(req, respond_off); }
+static esp_err_t handler_pulse(httpd_req_t *req) { return run_relay_command(req, respond_pulse); }
+
+/**
+ * @brief Members of the channel metadata object
+ * 
+ * {"groups":["name",...],"relays":[["name",group index,watts],...]}
+ */
+static void write_meta(json_writer_t *w)
+{
+    const char *groups[RELAY_COUNT];
+    int group_of[RELAY_COUNT];
+    int group_count = 0;
+    
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        const char *group = relay_get_info(i)->group;
+        int g = 0;
+        while (g < group_count && strcmp(groups[g], group) != 0) g++;
+        if (g == group_count) groups[group_count++] = group;
+        group_of[i] = g;
+    }
+    
+    json_array_begin(w, "groups");
+    for (int g = 0; g < group_count; g++) {
+        json_string(w, NULL, groups[g]);
+    }
+    json_array_end(w);
+    
+    json_array_begin(w, "relays");
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        const relay_info_t *info = relay_get_info(i);
+        json_array_begin(w, NULL);
+        json_string(w, NULL, info->name);
+        json_int(w, NULL, group_of[i]);
+        json_uint(w, NULL, info->power_w);
+        json_array_end(w);
+    }
+    json_array_end(w);
+}
+
+/**
+ * @brief JSON writer output that only feeds a CRC
+ */
+static esp_err_t meta_crc(void *ctx, const char *data, size_t len, bool last)
+{
+    uint32_t *crc = ctx;
+    (void)last;
+    *crc = esp_rom_crc32_le(*crc, (const uint8_t *)data, len);
+    return ESP_OK;
+}
+
+/**
+ * @brief Channel metadata handler (GET /relay/meta)
+ * 
+ * Names, groups and load weights never change at run time, so the list is
+ * revalidated by ETag like a UI asset; the UI fetches it once and polls
+ * only /relay/state. The ETag is a CRC of the body from a first pass of
+ * the writer, taken once; the body itself is streamed per request rather
+ * than held in RAM.
+ */
+static esp_err_t handler_meta(httpd_req_t *req)
+{
+    static char etag[12] = "";
+    char value[16];
+    
+    ESP_LOGI(TAG, "GET /relay/meta");
+    
+    if (etag[0] == '\0') {
+        json_writer_t w;
+        char buf[64];
+        uint32_t crc = 0;
+        
+        json_writer_init(&w, buf, sizeof(buf), meta_crc, &crc);
+        json_object_begin(&w, NULL);
+        write_meta(&w);
+        json_object_end(&w);
+        json_writer_end(&w);
+        snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)crc);
+    }
+    
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) == ESP_OK &&
+        strcmp(value, etag) == 0) {
+#if HTTP_KEEP_ALIVE
+        httpd_resp_set_hdr(req, "Connection", "keep-alive");
+#endif
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    write_meta(w);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Versioned relay state handler (GET /relay/state?v=N)
+ * 
+ * N is the version the client last saw. A current client gets just the
+ * version back; one a few changes behind gets those changes from the
+ * change journal; anything else, and a request without N, gets the full
+ * state as a hex bitmask.
+ * Responses stay a few dozen bytes whatever RELAY_COUNT is.
+ */
+static esp_err_t respond_state(httpd_req_t *req)
+{
+    char query[32];
+    char value[12];
+    bool known = false;
+    uint32_t since = 0;
+    
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "v", value, sizeof(value)) == ESP_OK) {
+        since = strtoul(value, NULL, 10);
+        known = true;
+    }
+    
+    relay_power_t power;
+    relay_get_power(&power);
+    uint32_t version = relay_get_version();
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    
+    if (!known || since != version) {
+        relay_event_t events[HTTP_STATE_MAX_CHANGES];
+        uint32_t cursor = since;
+        uint32_t lost = 1;
+        size_t count = 0;
+        
+        if (known && since < version && version - since <= HTTP_STATE_MAX_CHANGES) {
+            count = relay_read_events(&cursor, events, HTTP_STATE_MAX_CHANGES, &lost);
+        }
+        
+        if (count > 0 && lost == 0) {
+            // Changes since the client's version (cursor may pass version)
+            json_uint(w, "v", cursor);
+            json_uint(w, "p", power.used_w);
+            json_array_begin(w, "c");
+            for (size_t i = 0; i < count; i++) {
+                json_uint(w, NULL, events[i].relay_id);
+                json_uint(w, NULL, events[i].state);
+            }
+            json_array_end(w);
+        } else {
+            // Full state; a change racing this loop is resent next poll
+            char mask[(RELAY_COUNT + 3) / 4 + 1];
+            int digits = (RELAY_COUNT + 3) / 4;
+            for (int d = digits - 1; d >= 0; d--) {
+                int nibble = 0;
+                for (int b = 0; b < 4 && d * 4 + b < RELAY_COUNT; b++) {
+                    nibble |= (relay_get_info(d * 4 + b)->state == RELAY_ON) << b;
+                }
+                mask[digits - 1 - d] = "0123456789abcdef"[nibble];
+            }
+            mask[digits] = '\0';
+            json_uint(w, "v", version);
+            json_uint(w, "p", power.used_w);
+            json_string(w, "m", mask);
+        }
+    } else {
+        json_uint(w, "v", version);
+        json_uint(w, "p", power.used_w);
+    }
+    
+    return response_end(&resp);
+}
+
+static esp_err_t handler_state(httpd_req_t *req) { return run_relay_command(req, respond_state); }
+
+/**
+ * @brief Sequence upload handler (POST /seq/{slot})
+ */
+static esp_err_t handler_seq_upload(httpd_req_t *req)
+{
+    const char *action;
+    int slot = extract_seq_slot(req->uri, &action);
+    
+    if (slot < 0 || action[0] != '\0') {
+        return send_json_error(req, "400 Bad Request", "Invalid sequence slot");
+    }
+    
+    if (req->content_len > SEQ_MAX_TEXT_LEN) {
+        return send_json_error(req, "413 Payload Too Large", "Sequence too long");
+    }
+    
+    char text[SEQ_MAX_TEXT_LEN + 1];
+    int received = recv_body(req, text, sizeof(text));
+    if (received < 0) {
+        return ESP_FAIL;
+    }
+    
+    ESP_LOGI(TAG, "POST /seq/%d (%d bytes)", slot, received);
+    
+    esp_err_t ret = sequencer_store(slot, text);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        return send_json_error(req, "409 Conflict", "Sequence running");
+    }
+    if (ret != ESP_OK) {
+        return send_json_error(req, "400 Bad Request", "Invalid sequence");
+    }
+    
+    gossip_publish(GOSSIP_OBJ_SEQ(slot), text);
+    
+    return send_json_success(req, "Sequence stored");
+}
+
+/**
+ * @brief Sequence control handler (GET /seq/{slot}/{run|cancel|status})
+ */
+static esp_err_t handler_seq(httpd_req_t *req)
+{
+    const char *action;
+    int slot = extract_seq_slot(req->uri, &action);
+    
+    if (slot < 0) {
+        return send_json_error(req, "400 Bad Request", "Invalid sequence slot");
+    }
+    
+    ESP_LOGI(TAG, "GET /seq/%d/%s", slot, action);
+    
+    esp_err_t ret = ESP_OK;
+    if (strncmp(action, "run", 3) == 0) {
+        if (shadow_refused(req, &ret)) return ret;
+        ret = sequencer_start(slot);
+    } else if (strncmp(action, "cancel", 6) == 0) {
+        ret = sequencer_cancel(slot);
+    } else if (strncmp(action, "status", 6) != 0) {
+        return send_json_error(req, "404 Not Found", "Unknown action");
+    }
+    
+    if (ret == ESP_ERR_NOT_FOUND) {
+        return send_json_error(req, "404 Not Found", "Sequence empty");
+    }
+    if (ret != ESP_OK) {
+        return send_json_error(req, "409 Conflict", "Sequence busy or not running");
+    }
+    
+    seq_progress_t progress;
+    sequencer_get_progress(slot, &progress);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_int(w, "slot", slot);
+    json_string(w, "state", sequencer_state_name(progress.state));
+    json_uint(w, "step", progress.step);
+    json_uint(w, "steps", progress.step_count);
+    json_uint(w, "loops", progress.loops);
+    json_uint(w, "elapsed_ms", progress.elapsed_ms);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Thermostat handler (GET /thermostat/{status|set})
+ * 
+ * set accepts any of: sp=<degrees C>, enabled=<0|1>. Without a sensor
+ * the thermostat is not running and set is refused with 409.
+ */
+static esp_err_t handler_thermostat(httpd_req_t *req)
+{
+    const char *action = req->uri + strlen("/thermostat/");
+    
+    if (strncmp(action, "set", 3) == 0) {
+        char query[64];
+        char value[16];
+        esp_err_t ret = ESP_OK;
+        
+        if (shadow_refused(req, &ret)) return ret;
+        
+        if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+            if (httpd_query_key_value(query, "sp", value, sizeof(value)) == ESP_OK) {
+                char *end = NULL;
+                float sp = strtof(value, &end);
+                ret = (end != value && *end == '\0') ?
+                      thermostat_set_setpoint(sp) : ESP_ERR_INVALID_ARG;
+            }
+            if (ret == ESP_OK && httpd_query_key_value(query, "enabled", value, sizeof(value)) == ESP_OK) {
+                if (strcmp(value, "0") == 0 || strcmp(value, "1") == 0) {
+                    ret = thermostat_set_enabled(value[0] == '1');
+                } else {
+                    ret = ESP_ERR_INVALID_ARG;
+                }
+            }
+        }
+        
+        if (ret == ESP_ERR_INVALID_STATE) {
+            return send_json_error(req, "409 Conflict", "No thermostat sensor");
+        }
+        if (ret != ESP_OK) {
+            return send_json_error(req, "400 Bad Request", "Invalid thermostat setting");
+        }
+        ESP_LOGI(TAG, "GET /thermostat/set");
+    } else if (strncmp(action, "status", 6) != 0) {
+        return send_json_error(req, "404 Not Found", "Unknown action");
+    }
+    
+    thermo_status_t status;
+    thermostat_get_status(&status);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_string(w, "sensor", status.sensor ? status.sensor : "none");
+    json_int(w, "enabled", status.enabled);
+    json_int(w, "sensor_ok", status.sensor_ok);
+    json_int(w, "failsafe", status.failsafe);
+    json_float(w, "setpoint", status.setpoint_c, 2);
+    json_float(w, "temp", status.temp_c, 2);
+    json_uint(w, "stages", status.stages_on);
+    json_uint(w, "iterations", status.iterations);
+    json_array_begin(w, "switches");
+    json_uint(w, NULL, status.switch_count[0]);
+    json_uint(w, NULL, status.switch_count[1]);
+    json_array_end(w);
+    json_uint(w, "sensor_errors", status.sensor_errors);
+    json_uint(w, "relay_errors", status.relay_errors);
+    json_uint(w, "max_jitter_us", status.max_jitter_us);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Solar rules upload handler (POST /solar/rules)
+ */
+static esp_err_t handler_solar_rules(httpd_req_t *req)
+{
+    esp_err_t ret;
+    if (shadow_refused(req, &ret)) return ret;
+    
+    if (req->content_len > SOLAR_MAX_TEXT_LEN) {
+        return send_json_error(req, "413 Payload Too Large", "Rules too long");
+    }
+    
+    char text[SOLAR_MAX_TEXT_LEN + 1];
+    int received = recv_body(req, text, sizeof(text));
+    if (received < 0) {
+        return ESP_FAIL;
+    }
+    
+    ESP_LOGI(TAG, "POST /solar/rules (%d bytes)", received);
+    
+    if (solar_schedule_set_rules(text) != ESP_OK) {
+        return send_json_error(req, "400 Bad Request", "Invalid rules");
+    }
+    
+    gossip_publish(GOSSIP_OBJ_SOLAR_RULES, text);
+    
+    return send_json_success(req, "Rules stored");
+}
+
+/**
+ * @brief Solar status handler (GET /solar/status)
+ */
+static esp_err_t handler_solar_status(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "GET /solar/status");
+    
+    solar_status_t status;
+    solar_schedule_get_status(&status);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_int(w, "time_valid", status.time_valid);
+    json_int(w, "year", status.year);
+    json_int(w, "day", status.yday + 1);
+    json_int(w, "sunrise_min", status.today.sunrise_min);
+    json_int(w, "sunset_min", status.today.sunset_min);
+    json_uint(w, "rules", status.rule_count);
+    json_uint(w, "fired", status.fired);
+    json_uint(w, "failed", status.failed);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Failover status handler (GET /failover/status)
+ */
+static esp_err_t handler_failover_status(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "GET /failover/status");
+    
+    failover_status_t status;
+    failover_get_status(&status);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_int(w, "enabled", FAILOVER_ENABLE);
+    json_string(w, "state", failover_state_name(status.state));
+    json_uint(w, "term", status.term);
+    json_uint(w, "version", status.version);
+    json_int(w, "peer_seen", status.peer_seen);
+    json_uint(w, "peer_age_ms", status.peer_age_ms);
+    json_array_begin(w, "heartbeats");
+    json_uint(w, NULL, status.heartbeats_tx);
+    json_uint(w, NULL, status.heartbeats_rx);
+    json_array_end(w);
+    json_array_begin(w, "deltas");
+    json_uint(w, NULL, status.deltas_tx);
+    json_uint(w, NULL, status.deltas_rx);
+    json_array_end(w);
+    json_uint(w, "resyncs", status.resyncs);
+    json_uint(w, "apply_errors", status.apply_errors);
+    json_uint(w, "takeovers", status.takeovers);
+    json_uint(w, "last_takeover_ms", status.last_takeover_ms);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Gossip status handler (GET /gossip/status)
+ */
+static esp_err_t handler_gossip_status(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "GET /gossip/status");
+    
+    gossip_stats_t stats;
+    gossip_get_stats(&stats);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_hex(w, "node", stats.node_id, 8);
+    json_uint(w, "peers", stats.peers);
+    json_uint(w, "rounds", stats.rounds);
+    json_array_begin(w, "objects");
+    json_uint(w, NULL, stats.objects_tx);
+    json_uint(w, NULL, stats.objects_rx);
+    json_uint(w, NULL, stats.applied);
+    json_array_end(w);
+    json_uint(w, "rejected", stats.rejected);
+    json_array_begin(w, "bytes");
+    json_uint(w, NULL, stats.bytes_tx);
+    json_uint(w, NULL, stats.bytes_rx);
+    json_array_end(w);
+    json_array_begin(w, "versions");
+    for (int i = 0; i < GOSSIP_OBJ_COUNT; i++) {
+        json_uint(w, NULL, stats.versions[i]);
+    }
+    json_array_end(w);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Webhook targets handler (POST /webhooks)
+ */
+static esp_err_t handler_webhooks(httpd_req_t *req)
+{
+    char text[WEBHOOK_MAX_TARGETS * (WEBHOOK_URL_MAX_LEN + 1)];
+    
+    if (req->content_len >= sizeof(text)) {
+        return send_json_error(req, "413 Payload Too Large", "Target list too long");
+    }
+    
+    int received = recv_body(req, text, sizeof(text));
+    if (received < 0) {
+        return ESP_FAIL;
+    }
+    
+    ESP_LOGI(TAG, "POST /webhooks (%d bytes)", received);
+    
+    if (webhook_set_targets(text) != ESP_OK) {
+        return send_json_error(req, "400 Bad Request", "Invalid target list");
+    }
+    
+    return send_json_success(req, "Targets stored");
+}
+
+/**
+ * @brief Webhook status handler (GET /webhooks/status)
+ */
+static esp_err_t handler_webhooks_status(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "GET /webhooks/status");
+    
+    webhook_status_t status;
+    webhook_get_status(&status);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_uint(w, "journal_lost", status.journal_lost);
+    json_array_begin(w, "targets");
+    for (int i = 0; i < status.target_count; i++) {
+        const webhook_target_status_t *t = &status.targets[i];
+        json_object_begin(w, NULL);
+        json_string(w, "url", t->url);
+        json_uint(w, "queued", t->queued);
+        json_uint(w, "delivered", t->delivered);
+        json_uint(w, "batches", t->batches);
+        json_uint(w, "failures", t->failures);
+        json_uint(w, "dropped", t->dropped);
+        json_int(w, "last_status", t->last_status);
+        json_object_end(w);
+    }
+    json_array_end(w);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Telemetry collector handler (POST /telemetry)
+ */
+static esp_err_t handler_telemetry(httpd_req_t *req)
+{
+    char url[TELEMETRY_URL_MAX_LEN];
+    
+    if (req->content_len >= sizeof(url)) {
+        return send_json_error(req, "413 Payload Too Large", "URL too long");
+    }
+    
+    int received = recv_body(req, url, sizeof(url));
+    if (received < 0) {
+        return ESP_FAIL;
+    }
+    
+    // Tolerate a trailing newline from curl -d @file
+    while (received > 0 && (url[received - 1] == '\n' || url[received - 1] == '\r')) {
+        url[--received] = '\0';
+    }
+    
+    ESP_LOGI(TAG, "POST /telemetry (%d bytes)", received);
+    
+    if (telemetry_set_url(url) != ESP_OK) {
+        return send_json_error(req, "400 Bad Request", "Invalid collector URL");
+    }
+    
+    return send_json_success(req, "Collector stored");
+}
+
+/**
+ * @brief Telemetry status handler (GET /telemetry/status)
+ */
+static esp_err_t handler_telemetry_status(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "GET /telemetry/status");
+    
+    telemetry_status_t status;
+    telemetry_get_status(&status);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_string(w, "url", status.url);
+    json_uint(w, "buffered", status.buffered);
+    json_uint(w, "samples", status.samples);
+    json_uint(w, "sent", status.sent);
+    json_uint(w, "dropped", status.dropped);
+    json_uint(w, "batches", status.batches);
+    json_uint(w, "failures", status.failures);
+    json_uint(w, "bytes_sent", status.bytes_sent);
+    json_uint(w, "retry_in_s", status.retry_in_s);
+    json_uint(w, "sample_us", status.sample_us);
+    json_uint(w, "max_sample_us", status.max_sample_us);
+    json_int(w, "last_status", status.last_status);
+    return response_end(&resp);
+}
+
+/**
+ * @brief UI asset handler (GET /ui/{file})
+ */
+static esp_err_t handler_ui_asset(httpd_req_t *req)
+{
+    const char *name = req->uri + strlen("/ui/");
+    char file[48];
+    size_t len = strcspn(name, "?");
+    
+    ui_asset_t asset;
+    if (len == 0 || len >= sizeof(file)) {
+        return httpd_resp_send_404(req);
     }
+    memcpy(file, name, len);
+    file[len] = '\0';
     
-    char response[HTTP_RESPONSE_BUFFER_SIZE];
-    snprintf(response, sizeof(response), JSON_RELAY_STATUS,
-        relay_id, info->name, RELAY_OFF);
+    if (ui_assets_find(file, &asset) != ESP_OK) {
+        return httpd_resp_send_404(req);
+    }
+    return send_asset(req, &asset);
+}
+
+/**
+ * @brief Asset archive upload handler (POST /assets)
+ * 
+ * Streams the body into the assets partition in ASSETS_UPLOAD_CHUNK
+ * pieces, so an archive of any size needs only this stack buffer.
+ */
+static esp_err_t handler_assets_upload(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "POST /assets (%u bytes)", (unsigned)req->content_len);
+    
+    esp_err_t ret = ui_assets_update_begin(req->content_len);
+    if (ret != ESP_OK) {
+        if (ret == ESP_ERR_NOT_FOUND) {
+            return send_json_error(req, "404 Not Found", "No assets partition");
+        }
+        return send_json_error(req, "413 Payload Too Large", "Archive too large");
+    }
     
-    return send_json_response(req, response);
+    char buf[ASSETS_UPLOAD_CHUNK];
+    size_t remaining = req->content_len;
+    while (remaining > 0) {
+        int n = httpd_req_recv(req, buf, remaining < sizeof(buf) ? remaining : sizeof(buf));
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) {
+            ui_assets_update_abort();
+            return ESP_FAIL;
+        }
+        if (ui_assets_update_write(buf, n) != ESP_OK) {
+            ui_assets_update_abort();
+            return send_json_error(req, "400 Bad Request", "Invalid archive");
+        }
+        remaining -= n;
+    }
+    
+    if (ui_assets_update_finish() != ESP_OK) {
+        return send_json_error(req, "400 Bad Request", "Archive failed verification");
+    }
+    
+    return send_json_success(req, "Assets installed");
+}
+
+/**
+ * @brief Asset archive status handler (GET /assets/status)
+ */
+static esp_err_t handler_assets_status(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "GET /assets/status");
+    
+    ui_assets_status_t status;
+    ui_assets_get_status(&status);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_int(w, "valid", status.valid);
+    json_int(w, "updating", status.updating);
+    json_uint(w, "files", status.files);
+    json_uint(w, "bytes", status.bytes);
+    json_uint(w, "partition", status.partition_size);
+    json_hex(w, "crc", status.crc, 8);
+    json_uint(w, "updates", status.updates);
+    json_uint(w, "failed", status.failed_updates);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Power-fail flush status handler (GET /powerfail/status)
+ */
+static esp_err_t handler_powerfail_status(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "GET /powerfail/status");
+    
+    powerfail_status_t status;
+    powerfail_get_status(&status);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_int(w, "enabled", POWERFAIL_ENABLE);
+    json_int(w, "armed", status.armed);
+    json_int(w, "failing", status.failing);
+    json_string(w, "recovered", status.recovered_from);
+    json_uint(w, "states", status.recovered.states);
+    json_uint(w, "version", status.recovered.version);
+    json_uint(w, "commands", status.recovered.commands);
+    json_uint(w, "warnings", status.warnings);
+    json_uint(w, "flushes", status.flushes);
+    json_uint(w, "erases", status.erases);
+    json_uint(w, "isr_us", status.isr_us);
+    json_uint(w, "flash_us", status.flash_us);
+    json_uint(w, "holdup_us", POWERFAIL_HOLDUP_US);
+    json_uint(w, "slots_free", status.slots_free);
+    json_uint(w, "slots", status.slots);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Pool and heap status handler (GET /pool/status)
+ */
+static esp_err_t handler_pool_status(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "GET /pool/status");
+    
+    block_pool_heap_t heap;
+    block_pool_get_heap(&heap);
+    block_pool_stats_t pools[BLOCK_POOL_MAX_REPORTED];
+    size_t count = block_pool_get_stats(pools, BLOCK_POOL_MAX_REPORTED);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_object_begin(w, "heap");
+    json_uint(w, "free", heap.free);
+    json_uint(w, "min_free", heap.min_free);
+    json_uint(w, "largest", heap.largest);
+    json_object_end(w);
+    json_array_begin(w, "pools");
+    for (size_t i = 0; i < count; i++) {
+        const block_pool_stats_t *p = &pools[i];
+        json_object_begin(w, NULL);
+        json_string(w, "name", p->name);
+        json_uint(w, "block", p->block_size);
+        json_uint(w, "count", p->count);
+        json_uint(w, "in_use", p->in_use);
+        json_uint(w, "peak", p->peak);
+        json_uint(w, "allocs", p->allocs);
+        json_uint(w, "failures", p->failures);
+        json_object_end(w);
+    }
+    json_array_end(w);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Wired UART link status handler (GET /uart/status)
+ */
+static esp_err_t handler_uart_status(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "GET /uart/status");
+    
+    uart_link_stats_t stats;
+    uart_link_get_stats(&stats);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_int(w, "enabled", UART_LINK_ENABLE);
+    json_uint(w, "baud", UART_LINK_BAUD);
+    json_uint(w, "requests", stats.requests);
+    json_uint(w, "retries", stats.retries);
+    json_uint(w, "crc_errors", stats.crc_errors);
+    json_uint(w, "framing_errors", stats.framing_errors);
+    json_uint(w, "overruns", stats.overruns);
+    json_uint(w, "edges", stats.edges);
+    json_uint(w, "avg_edge_us", stats.edges ? stats.total_edge_us / stats.edges : 0);
+    json_uint(w, "max_edge_us", stats.max_edge_us);
+    json_array_begin(w, "edge_hist");
+    for (int i = 0; i < UART_LINK_HIST_BUCKETS; i++) {
+        json_uint(w, NULL, stats.edge_hist[i]);
+    }
+    json_array_end(w);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Access point and roaming status handler (GET /wifi/status)
+ */
+static esp_err_t handler_wifi_status(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "GET /wifi/status");
+    
+    wifi_roam_status_t status;
+    wifi_get_roam_status(&status);
+    
+    char bssid[18];
+    snprintf(bssid, sizeof(bssid), MACSTR, MAC2STR(status.bssid));
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_int(w, "connected", status.connected);
+    json_int(w, "rssi", status.rssi);
+    json_string(w, "bssid", bssid);
+    json_uint(w, "channel", status.channel);
+    json_int(w, "roam", status.roam_enabled);
+    json_int(w, "roaming", status.roaming);
+    json_int(w, "rrm", status.rrm);
+    json_int(w, "btm", status.btm);
+    json_uint(w, "roams", status.roams);
+    json_uint(w, "roam_failures", status.roam_failures);
+    json_uint(w, "scans", status.scans);
+    json_uint(w, "candidates", status.candidates);
+    json_uint(w, "disconnects", status.disconnects);
+    json_uint(w, "max_gap_ms", status.max_gap_ms);
+    json_array_begin(w, "gaps");
+    for (uint8_t i = 0; i < status.gap_count; i++) {
+        const wifi_gap_t *g = &status.gaps[i];
+        json_object_begin(w, NULL);
+        json_uint(w, "t", g->uptime_s);
+        json_uint(w, "ms", g->gap_ms);
+        json_string(w, "kind", g->kind);
+        json_int(w, "from", g->from_rssi);
+        json_int(w, "to", g->to_rssi);
+        json_uint(w, "channel", g->channel);
+        json_object_end(w);
+    }
+    json_array_end(w);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Radio profile handler (GET /wifi/profile?name=...)
+ * 
+ * Without a query it only reports the active profile.
+ */
+static esp_err_t handler_wifi_profile(httpd_req_t *req)
+{
+    char query[32];
+    char value[16];
+    
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "name", value, sizeof(value)) == ESP_OK) {
+        wifi_profile_t profile = wifi_profile_from_name(value);
+        if (profile == WIFI_PROFILE_COUNT) {
+            return send_json_error(req, "400 Bad Request", "Unknown profile");
+        }
+        wifi_set_profile(profile);
+    }
+    
+    ESP_LOGI(TAG, "GET /wifi/profile");
+    
+    wifi_profile_status_t status;
+    wifi_get_profile(&status);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_string(w, "profile", status.name);
+    json_string(w, "ps", status.ps);
+    json_uint(w, "listen_interval", status.listen_interval);
+    json_fixed(w, "tx_power_dbm", status.tx_power_qdbm * 25L, 2);
+    json_uint(w, "changes", status.changes);
+    return response_end(&resp);
+}
+
+/**
+ * @brief Shadow mode handler (GET /shadow?enabled=0|1&reset=1)
+ * 
+ * Without a query it only reports. reset=1 copies the live relay states
+ * into the shadow model and zeroes its counters.
+ */
+static esp_err_t handler_shadow(httpd_req_t *req)
+{
+    char query[32];
+    char value[4];
+    
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "enabled", value, sizeof(value)) == ESP_OK) {
+            relay_shadow_set_enabled(atoi(value) != 0);
+        }
+        if (httpd_query_key_value(query, "reset", value, sizeof(value)) == ESP_OK &&
+            atoi(value) != 0) {
+            relay_shadow_reset();
+        }
+    }
+    
+    ESP_LOGI(TAG, "GET /shadow");
+    
+    relay_shadow_status_t status;
+    relay_shadow_get_status(&status);
+    
+    json_response_t resp;
+    json_writer_t *w = response_begin(req, &resp);
+    json_int(w, "enabled", status.enabled);
+    json_uint(w, "commands", status.commands);
+    json_uint(w, "events", status.events);
+    json_uint(w, "saves", status.saves);
+    json_uint(w, "mask", status.mask);
+    write_power(w, &status.power);
+    return response_end(&resp);
 }
 
 /*============================================================================
@@ -303,6 +1567,49 @@ static const httpd_uri_t uri_off_1 = { .uri = "/relay/1/off", .method = HTTP_GET
 static const httpd_uri_t uri_off_2 = { .uri = "/relay/2/off", .method = HTTP_GET, .handler = handler_off, .user_ctx = NULL };
 static const httpd_uri_t uri_off_3 = { .uri = "/relay/3/off", .method = HTTP_GET, .handler = handler_off, .user_ctx = NULL };
 
+static const httpd_uri_t uri_pulse_0 = { .uri = "/relay/0/pulse", .method = HTTP_GET, .handler = handler_pulse, .user_ctx = NULL };
+static const httpd_uri_t uri_pulse_1 = { .uri = "/relay/1/pulse", .method = HTTP_GET, .handler = handler_pulse, .user_ctx = NULL };
+static const httpd_uri_t uri_pulse_2 = { .uri = "/relay/2/pulse", .method = HTTP_GET, .handler = handler_pulse, .user_ctx = NULL };
+static const httpd_uri_t uri_pulse_3 = { .uri = "/relay/3/pulse", .method = HTTP_GET, .handler = handler_pulse, .user_ctx = NULL };
+
+// Sequencer endpoints match any slot; the handler parses slot and action
+static const httpd_uri_t uri_seq_upload = { .uri = "/seq/*", .method = HTTP_POST, .handler = handler_seq_upload, .user_ctx = NULL };
+static const httpd_uri_t uri_seq = { .uri = "/seq/*", .method = HTTP_GET, .handler = handler_seq, .user_ctx = NULL };
+static const httpd_uri_t uri_thermostat = { .uri = "/thermostat/*", .method = HTTP_GET, .handler = handler_thermostat, .user_ctx = NULL };
+static const httpd_uri_t uri_solar_rules = { .uri = "/solar/rules", .method = HTTP_POST, .handler = handler_solar_rules, .user_ctx = NULL };
+static const httpd_uri_t uri_solar_status = { .uri = "/solar/status", .method = HTTP_GET, .handler = handler_solar_status, .user_ctx = NULL };
+
+// Failover endpoint
+static const httpd_uri_t uri_failover_status = { .uri = "/failover/status", .method = HTTP_GET, .handler = handler_failover_status, .user_ctx = NULL };
+
+// Gossip endpoint
+static const httpd_uri_t uri_gossip_status = { .uri = "/gossip/status", .method = HTTP_GET, .handler = handler_gossip_status, .user_ctx = NULL };
+
+// Webhook endpoints
+static const httpd_uri_t uri_webhooks = { .uri = "/webhooks", .method = HTTP_POST, .handler = handler_webhooks, .user_ctx = NULL };
+static const httpd_uri_t uri_webhooks_status = { .uri = "/webhooks/status", .method = HTTP_GET, .handler = handler_webhooks_status, .user_ctx = NULL };
+static const httpd_uri_t uri_telemetry = { .uri = "/telemetry", .method = HTTP_POST, .handler = handler_telemetry, .user_ctx = NULL };
+static const httpd_uri_t uri_telemetry_status = { .uri = "/telemetry/status", .method = HTTP_GET, .handler = handler_telemetry_status, .user_ctx = NULL };
+
+// UI asset endpoints
+static const httpd_uri_t uri_ui_asset = { .uri = "/ui/*", .method = HTTP_GET, .handler = handler_ui_asset, .user_ctx = NULL };
+static const httpd_uri_t uri_assets_upload = { .uri = "/assets", .method = HTTP_POST, .handler = handler_assets_upload, .user_ctx = NULL };
+static const httpd_uri_t uri_assets_status = { .uri = "/assets/status", .method = HTTP_GET, .handler = handler_assets_status, .user_ctx = NULL };
+
+// Power-fail flush endpoint
+static const httpd_uri_t uri_powerfail_status = { .uri = "/powerfail/status", .method = HTTP_GET, .handler = handler_powerfail_status, .user_ctx = NULL };
+static const httpd_uri_t uri_pool_status = { .uri = "/pool/status", .method = HTTP_GET, .handler = handler_pool_status, .user_ctx = NULL };
+static const httpd_uri_t uri_uart_status = { .uri = "/uart/status", .method = HTTP_GET, .handler = handler_uart_status, .user_ctx = NULL };
+static const httpd_uri_t uri_wifi_status = { .uri = "/wifi/status", .method = HTTP_GET, .handler = handler_wifi_status, .user_ctx = NULL };
+static const httpd_uri_t uri_wifi_profile = { .uri = "/wifi/profile", .method = HTTP_GET, .handler = handler_wifi_profile, .user_ctx = NULL };
+
+// Shadow mode endpoint
+static const httpd_uri_t uri_shadow = { .uri = "/shadow", .method = HTTP_GET, .handler = handler_shadow, .user_ctx = NULL };
+
+// Metadata and versioned state for the web UI
+static const httpd_uri_t uri_meta = { .uri = "/relay/meta", .method = HTTP_GET, .handler = handler_meta, .user_ctx = NULL };
+static const httpd_uri_t uri_state = { .uri = "/relay/state", .method = HTTP_GET, .handler = handler_state, .user_ctx = NULL };
+
 static const httpd_uri_t uri_status_all = { .uri = "/relay/all/status", .method = HTTP_GET, .handler = handler_status, .user_ctx = NULL };
 static const httpd_uri_t uri_on_all = { .uri = "/relay/all/on", .method = HTTP_GET, .handler = handler_on, .user_ctx = NULL };
 static const httpd_uri_t uri_off_all = { .uri = "/relay/all/off", .method = HTTP_GET, .handler = handler_off, .user_ctx = NULL };
@@ -323,18 +1630,31 @@ esp_err_t http_controller_init(void)
         vTaskDelay(pdMS_TO_TICKS(100));
     }
     
+    // Session contexts come from a pool made once; a restarted server reuses it
+    if (s_sessions.base == NULL) {
+        esp_err_t ret = block_pool_init(&s_sessions, "http_session", sizeof(http_session_t),
+                                        HTTP_MAX_CONNECTIONS);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     
     // Apply configuration from config.h
     config.max_open_sockets = HTTP_MAX_CONNECTIONS;
     config.task_priority = HTTP_TASK_PRIORITY;
     config.stack_size = HTTP_TASK_STACK_SIZE;
-    config.max_uri_handlers = 20;
+    config.max_uri_handlers = HTTP_MAX_URI_HANDLERS;
     
     // Timeouts to prevent socket leaks
-    config.recv_wait_timeout = 10;  // 10 second receive timeout
-    config.send_wait_timeout = 10;  // 10 second send timeout
+    config.recv_wait_timeout = HTTP_SOCKET_TIMEOUT_S;
+    config.send_wait_timeout = HTTP_SOCKET_TIMEOUT_S;
     config.lru_purge_enable = true; // Purge least recently used connections
+    config.open_fn = session_open;
+    
+    // Wildcard matching for /seq/*; plain URIs still match exactly
+    config.uri_match_fn = httpd_uri_match_wildcard;
     
 #if HTTP_KEEP_ALIVE
     config.keep_alive_enable = true;
@@ -383,6 +1703,62 @@ esp_err_t http_controller_init(void)
     httpd_register_uri_handler(s_server, &uri_off_3);
     httpd_register_uri_handler(s_server, &uri_off_all);
     
+    // Pulse endpoints
+    httpd_register_uri_handler(s_server, &uri_pulse_0);
+    httpd_register_uri_handler(s_server, &uri_pulse_1);
+    httpd_register_uri_handler(s_server, &uri_pulse_2);
+    httpd_register_uri_handler(s_server, &uri_pulse_3);
+    
+    // Sequencer endpoints
+    httpd_register_uri_handler(s_server, &uri_seq_upload);
+    httpd_register_uri_handler(s_server, &uri_seq);
+    
+    // Thermostat endpoints
+    httpd_register_uri_handler(s_server, &uri_thermostat);
+    
+    // Solar schedule endpoints
+    httpd_register_uri_handler(s_server, &uri_solar_rules);
+    httpd_register_uri_handler(s_server, &uri_solar_status);
+    
+    // Failover endpoint
+    httpd_register_uri_handler(s_server, &uri_failover_status);
+    
+    // Gossip endpoint
+    httpd_register_uri_handler(s_server, &uri_gossip_status);
+    
+    // Webhook endpoints
+    httpd_register_uri_handler(s_server, &uri_webhooks);
+    httpd_register_uri_handler(s_server, &uri_webhooks_status);
+    
+    // Telemetry endpoints
+    httpd_register_uri_handler(s_server, &uri_telemetry);
+    httpd_register_uri_handler(s_server, &uri_telemetry_status);
+    
+    // UI asset endpoints
+    httpd_register_uri_handler(s_server, &uri_ui_asset);
+    httpd_register_uri_handler(s_server, &uri_assets_upload);
+    httpd_register_uri_handler(s_server, &uri_assets_status);
+    
+    // Power-fail flush endpoint
+    httpd_register_uri_handler(s_server, &uri_powerfail_status);
+    
+    // Pool status endpoint
+    httpd_register_uri_handler(s_server, &uri_pool_status);
+    
+    // Wired UART link endpoint
+    httpd_register_uri_handler(s_server, &uri_uart_status);
+    
+    // WiFi roaming status and radio profile endpoints
+    httpd_register_uri_handler(s_server, &uri_wifi_status);
+    httpd_register_uri_handler(s_server, &uri_wifi_profile);
+    
+    // Shadow mode endpoint
+    httpd_register_uri_handler(s_server, &uri_shadow);
+    
+    // Web UI metadata and state endpoints
+    httpd_register_uri_handler(s_server, &uri_meta);
+    httpd_register_uri_handler(s_server, &uri_state);
+    
     ESP_LOGI(TAG, "HTTP server started on port %d", config.server_port);
     ESP_LOGI(TAG, "Endpoints registered:");
     ESP_LOGI(TAG, "  GET /                    - Home page UI");
@@ -390,6 +1766,29 @@ esp_err_t http_controller_init(void)
     ESP_LOGI(TAG, "  GET /relay/{0-3}/status  - Get status");
     ESP_LOGI(TAG, "  GET /relay/{0-3}/on      - Turn ON");
     ESP_LOGI(TAG, "  GET /relay/{0-3}/off     - Turn OFF");
+    ESP_LOGI(TAG, "  GET /relay/{0-3}/pulse   - Momentary pulse (?ms=N)");
+    ESP_LOGI(TAG, "  POST /seq/{slot}         - Upload sequence");
+    ESP_LOGI(TAG, "  GET /seq/{slot}/run      - Run/cancel/status sequence");
+    ESP_LOGI(TAG, "  GET /thermostat/status   - Thermostat status (/set to change)");
+    ESP_LOGI(TAG, "  POST /solar/rules        - Sunrise/sunset rules");
+    ESP_LOGI(TAG, "  GET /solar/status        - Sun times");
+    ESP_LOGI(TAG, "  GET /failover/status     - Failover pair state");
+    ESP_LOGI(TAG, "  GET /gossip/status       - Config gossip state");
+    ESP_LOGI(TAG, "  POST /webhooks           - Webhook targets");
+    ESP_LOGI(TAG, "  GET /webhooks/status     - Webhook delivery");
+    ESP_LOGI(TAG, "  POST /telemetry          - Telemetry collector");
+    ESP_LOGI(TAG, "  GET /telemetry/status    - Telemetry upload");
+    ESP_LOGI(TAG, "  GET /ui/{file}           - UI assets");
+    ESP_LOGI(TAG, "  POST /assets             - Replace UI asset archive");
+    ESP_LOGI(TAG, "  GET /assets/status       - UI asset archive");
+    ESP_LOGI(TAG, "  GET /powerfail/status    - Power-fail flush");
+    ESP_LOGI(TAG, "  GET /pool/status         - Connection pools, heap");
+    ESP_LOGI(TAG, "  GET /uart/status         - Wired UART link");
+    ESP_LOGI(TAG, "  GET /wifi/status         - AP, roaming, link gaps");
+    ESP_LOGI(TAG, "  GET /wifi/profile        - Radio profile (?name=...)");
+    ESP_LOGI(TAG, "  GET /shadow              - Shadow (dry-run) mode");
+    ESP_LOGI(TAG, "  GET /relay/meta          - Channel metadata");
+    ESP_LOGI(TAG, "  GET /relay/state?v=N     - Versioned state");
     ESP_LOGI(TAG, "  GET /relay/all/status    - All statuses");
     ESP_LOGI(TAG, "  GET /relay/all/on        - All ON");
     ESP_LOGI(TAG, "  GET /relay/all/off       - All OFF");
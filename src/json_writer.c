@@ -0,0 +1,280 @@
+/**
+ * @file json_writer.c
+ * @brief Bounded streaming JSON writer implementation
+ *
+ * Everything goes through put(), which copies into the buffer and flushes
+ * it whenever it fills; nothing is ever written past buf + size. Numbers
+ * are converted into a small stack array, least significant digit first,
+ * with no format string to parse (tools/json_bench.c compares the two).
+ */
+
+#include "json_writer.h"
+#include <math.h>
+#include <string.h>
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+static void put(json_writer_t *w, const char *data, size_t n)
+{
+    while (n > 0 && w->err == ESP_OK) {
+        // A fixed buffer keeps its last byte for the terminating NUL
+        size_t space = w->size - w->len - (w->flush == NULL ? 1 : 0);
+        size_t take = (n < space) ? n : space;
+
+        memcpy(w->buf + w->len, data, take);
+        w->len += take;
+        data += take;
+        n -= take;
+
+        if (n > 0) {
+            if (w->flush == NULL) {
+                w->err = ESP_ERR_INVALID_SIZE;
+            } else {
+                w->err = w->flush(w->ctx, w->buf, w->len, false);
+                w->len = 0;
+            }
+        }
+    }
+}
+
+static inline void put_char(json_writer_t *w, char c)
+{
+    if (w->len + 1 < w->size && w->err == ESP_OK) {
+        w->buf[w->len++] = c;
+    } else {
+        put(w, &c, 1);
+    }
+}
+
+/**
+ * @brief Comma if the level already has a member, then "key":
+ */
+static void member(json_writer_t *w, const char *key)
+{
+    uint32_t bit = 1UL << w->depth;
+    if (w->members & bit) {
+        put_char(w, ',');
+    }
+    w->members |= bit;
+
+    if (key != NULL) {
+        put_char(w, '"');
+        put(w, key, strlen(key));
+        put(w, "\":", 2);
+    }
+}
+
+static void open_level(json_writer_t *w, const char *key, char c)
+{
+    member(w, key);
+    put_char(w, c);
+    if (w->depth >= JSON_WRITER_MAX_DEPTH) {
+        w->err = ESP_ERR_INVALID_SIZE;
+        return;
+    }
+    w->depth++;
+    w->members &= ~(1UL << w->depth);
+}
+
+static void close_level(json_writer_t *w, char c)
+{
+    if (w->depth == 0) {
+        w->err = ESP_ERR_INVALID_SIZE;
+        return;
+    }
+    w->depth--;
+    put_char(w, c);
+}
+
+static void put_uint(json_writer_t *w, unsigned long value)
+{
+    char digits[20];
+    int n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    put(w, digits + sizeof(digits) - n, n);
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+void json_writer_init(json_writer_t *w, char *buf, size_t size, json_flush_t flush, void *ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->size = size;
+    w->flush = flush;
+    w->ctx = ctx;
+    w->err = (size < 2) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+esp_err_t json_writer_end(json_writer_t *w)
+{
+    if (w->err == ESP_OK && w->depth != 0) {
+        w->err = ESP_ERR_INVALID_SIZE;
+    }
+
+    if (w->flush == NULL) {
+        if (w->size > 0) {
+            w->buf[w->len] = '\0';
+        }
+    } else if (w->err == ESP_OK) {
+        w->err = w->flush(w->ctx, w->buf, w->len, true);
+        w->len = 0;
+    }
+    return w->err;
+}
+
+void json_object_begin(json_writer_t *w, const char *key)
+{
+    open_level(w, key, '{');
+}
+
+void json_object_end(json_writer_t *w)
+{
+    close_level(w, '}');
+}
+
+void json_array_begin(json_writer_t *w, const char *key)
+{
+    open_level(w, key, '[');
+}
+
+void json_array_end(json_writer_t *w)
+{
+    close_level(w, ']');
+}
+
+void json_string(json_writer_t *w, const char *key, const char *value)
+{
+    member(w, key);
+    if (value == NULL) {
+        put(w, "null", 4);
+        return;
+    }
+
+    put_char(w, '"');
+    const char *run = value;
+    for (const char *p = value; ; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        // Copy the plain run, then the escape (or stop at the NUL)
+        put(w, run, p - run);
+        run = p + 1;
+        if (c == '\0') break;
+
+        char esc[6] = { '\\', (char)c };
+        size_t n = 2;
+        switch (c) {
+        case '"':  case '\\':  break;
+        case '\n': esc[1] = 'n'; break;
+        case '\r': esc[1] = 'r'; break;
+        case '\t': esc[1] = 't'; break;
+        case '\b': esc[1] = 'b'; break;
+        case '\f': esc[1] = 'f'; break;
+        default:
+            memcpy(esc + 1, "u00", 3);
+            esc[4] = HEX_DIGITS[c >> 4];
+            esc[5] = HEX_DIGITS[c & 0xf];
+            n = 6;
+            break;
+        }
+        put(w, esc, n);
+    }
+    put_char(w, '"');
+}
+
+void json_int(json_writer_t *w, const char *key, long value)
+{
+    member(w, key);
+    if (value < 0) {
+        put_char(w, '-');
+        put_uint(w, 0UL - (unsigned long)value);
+    } else {
+        put_uint(w, (unsigned long)value);
+    }
+}
+
+void json_uint(json_writer_t *w, const char *key, unsigned long value)
+{
+    member(w, key);
+    put_uint(w, value);
+}
+
+void json_bool(json_writer_t *w, const char *key, bool value)
+{
+    member(w, key);
+    if (value) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void json_fixed(json_writer_t *w, const char *key, long value, unsigned decimals)
+{
+    unsigned long scale = 1;
+    unsigned long magnitude = (value < 0) ? 0UL - (unsigned long)value : (unsigned long)value;
+
+    if (decimals > 9) decimals = 9;
+    for (unsigned i = 0; i < decimals; i++) scale *= 10;
+
+    member(w, key);
+    if (value < 0) {
+        put_char(w, '-');
+    }
+    put_uint(w, magnitude / scale);
+    if (decimals == 0) {
+        return;
+    }
+
+    char frac[10];
+    unsigned long rest = magnitude % scale;
+    frac[0] = '.';
+    for (unsigned i = decimals; i > 0; i--) {
+        frac[i] = (char)('0' + rest % 10);
+        rest /= 10;
+    }
+    put(w, frac, decimals + 1);
+}
+
+void json_float(json_writer_t *w, const char *key, float value, unsigned decimals)
+{
+    double scaled = value;
+
+    if (decimals > 9) decimals = 9;
+    for (unsigned i = 0; i < decimals; i++) scaled *= 10.0;
+
+    // JSON has no NaN or infinity; past the range of long there is no fixed form
+    if (!isfinite(scaled) || fabs(scaled) >= 2147483647.0) {
+        member(w, key);
+        put(w, "null", 4);
+        return;
+    }
+    json_fixed(w, key, (long)(scaled < 0 ? scaled - 0.5 : scaled + 0.5), decimals);
+}
+
+void json_hex(json_writer_t *w, const char *key, unsigned long value, unsigned digits)
+{
+    char hex[2 + 2 * sizeof(unsigned long)];
+    unsigned n = 0;
+
+    if (digits > 2 * sizeof(unsigned long)) digits = 2 * sizeof(unsigned long);
+    do {
+        hex[sizeof(hex) - 1 - ++n] = HEX_DIGITS[value & 0xf];
+        value >>= 4;
+    } while (value != 0 || n < digits);
+    hex[sizeof(hex) - 2 - n] = '"';
+    hex[sizeof(hex) - 1] = '"';
+
+    member(w, key);
+    put(w, hex + sizeof(hex) - 2 - n, n + 2);
+}
@@ -9,6 +9,8 @@
  *   - REST API for relay control
  *   - Web UI with toggle buttons
  *   - State persistence across reboots
+ *   - State flush on power failure
+ *   - Wired UART control link (works without WiFi)
  *   - Configurable parameters
  *   - Auto WiFi reconnection
  *   - HTTP server watchdog
@@ -28,6 +30,17 @@
 #include "config.h"
 #include "wifi_service.h"
 #include "relay_service.h"
+#include "powerfail.h"
+#include "sequencer.h"
+#include "thermostat.h"
+#include "solar_schedule.h"
+#include "modbus_server.h"
+#include "uart_link.h"
+#include "failover.h"
+#include "gossip.h"
+#include "webhook.h"
+#include "telemetry.h"
+#include "ui_assets.h"
 #include "http_controller.h"
 
 static const char *TAG = LOG_TAG_MAIN;
@@ -51,6 +64,22 @@ static esp_err_t init_nvs(void)
 /**
  * @brief Print startup banner
  */
+/**
+ * @brief Check whether a wired controller uses the UART link
+ * 
+ * @return true once the link has answered a request since boot
+ */
+static bool uart_link_in_use(void)
+{
+#if UART_LINK_ENABLE
+    uart_link_stats_t stats;
+    uart_link_get_stats(&stats);
+    return stats.requests > 0;
+#else
+    return false;
+#endif
+}
+
 static void print_banner(void)
 {
     printf("\n");
@@ -79,24 +108,94 @@ void app_main(void)
     
     // Step 2: Initialize relay service
     ESP_LOGI(TAG, "[2/4] Initializing relay service...");
+#if POWERFAIL_ENABLE
+    // Before the relay service, which restores from its record
+    if (powerfail_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Power-fail flush unavailable");
+    }
+#endif
     ESP_ERROR_CHECK(relay_service_init());
+    ESP_ERROR_CHECK(sequencer_init());
     ESP_LOGI(TAG, "Relay service initialized");
     
+#if UART_LINK_ENABLE && !FAILOVER_ENABLE
+    // Before WiFi, so a wired controller can switch relays while the board
+    // is joining the network: wifi_service_init() blocks until it has
+    // joined, however long that takes
+    if (uart_link_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Wired UART link unavailable");
+    }
+#endif
+    
     // Step 3: Connect to WiFi
     ESP_LOGI(TAG, "[3/4] Connecting to WiFi...");
-    esp_err_t wifi_ret = wifi_service_init();
-    if (wifi_ret != ESP_OK) {
-        ESP_LOGE(TAG, "WiFi connection failed! Restarting in 5 seconds...");
-        vTaskDelay(pdMS_TO_TICKS(5000));
-        esp_restart();
-    }
+    ESP_ERROR_CHECK(wifi_service_init());
     ESP_LOGI(TAG, "WiFi connected");
     
+#if GOSSIP_ENABLE
+    // Standby boards gossip too, so they hold current config on takeover
+    if (gossip_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Config gossip unavailable");
+    }
+#endif
+    
+#if FAILOVER_ENABLE
+    // A standby board mirrors relay state and parks here until its peer
+    // fails, so nothing below drives relays or serves the API twice
+    ESP_ERROR_CHECK(failover_init());
+    failover_wait_active();
+#if UART_LINK_ENABLE
+    // Only the active board of a pair takes wired commands
+    if (uart_link_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Wired UART link unavailable");
+    }
+#endif
+#endif
+    
+    // Automatic control only runs on the active board, and only with a
+    // real temperature sensor (THERMO_SENSOR)
+    const thermo_sensor_t *thermo_sensor = thermostat_board_sensor();
+    if (thermo_sensor != NULL) {
+        ESP_ERROR_CHECK(thermostat_init(thermo_sensor));
+    } else {
+        ESP_LOGW(TAG, "No thermostat sensor, thermostat not started");
+    }
+    
+    // Solar schedule needs the network for SNTP
+    if (solar_schedule_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Solar schedule unavailable");
+    }
+    
+#if ASSETS_ENABLE
+    // UI files from flash; without them the built-in page is served
+    if (ui_assets_init() != ESP_OK) {
+        ESP_LOGW(TAG, "UI assets unavailable, serving the built-in page");
+    }
+#endif
+    
     // Step 4: Start HTTP server
     ESP_LOGI(TAG, "[4/4] Starting HTTP server...");
     ESP_ERROR_CHECK(http_controller_init());
     ESP_LOGI(TAG, "HTTP server started");
     
+#if MODBUS_ENABLE
+    if (modbus_server_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Modbus TCP server unavailable");
+    }
+#endif
+    
+#if WEBHOOK_ENABLE
+    if (webhook_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Webhook notifications unavailable");
+    }
+#endif
+    
+#if TELEMETRY_ENABLE
+    if (telemetry_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Telemetry agent unavailable");
+    }
+#endif
+    
     // Print access information
     printf("\n");
     printf("╔═══════════════════════════════════════╗\n");
@@ -110,8 +209,10 @@ void app_main(void)
     printf("║  GET /relay/{0-3}/status              ║\n");
     printf("║  GET /relay/{0-3}/on                  ║\n");
     printf("║  GET /relay/{0-3}/off                 ║\n");
+    printf("║  GET /relay/{0-3}/pulse?ms=N          ║\n");
     printf("║  GET /relay/all/on                    ║\n");
     printf("║  GET /relay/all/off                   ║\n");
+    printf("║  POST /seq/{slot}, GET /seq/{slot}/run║\n");
     printf("╚═══════════════════════════════════════╝\n");
     printf("\n");
     
@@ -123,17 +224,24 @@ void app_main(void)
     
     // Main loop - monitors system health
     while (1) {
-        vTaskDelay(pdMS_TO_TICKS(10000)); // Check every 10 seconds
+        vTaskDelay(pdMS_TO_TICKS(WIFI_CHECK_INTERVAL_MS));
         
         // Check WiFi status
         if (!wifi_is_connected()) {
-            wifi_disconnect_seconds += 10;
+            wifi_disconnect_seconds += WIFI_CHECK_INTERVAL_MS / 1000;
             ESP_LOGW(TAG, "WiFi disconnected for %d seconds", wifi_disconnect_seconds);
             
-            // If WiFi disconnected for more than 5 minutes, restart ESP
-            if (wifi_disconnect_seconds >= 300) {
-                ESP_LOGE(TAG, "WiFi disconnected too long, restarting...");
-                esp_restart();
+            // If WiFi stays down too long, restart ESP. Not while a wired
+            // controller is using the UART link: the reboot would cut it off
+            // too, and the WiFi driver keeps trying to rejoin on its own
+            if (wifi_disconnect_seconds >= WIFI_RESTART_AFTER_S) {
+                if (!uart_link_in_use()) {
+                    ESP_LOGE(TAG, "WiFi disconnected too long, restarting...");
+                    esp_restart();
+                }
+                if (wifi_disconnect_seconds < WIFI_RESTART_AFTER_S + WIFI_CHECK_INTERVAL_MS / 1000) {
+                    ESP_LOGW(TAG, "WiFi disconnected too long, not restarting: UART link in use");
+                }
             }
         } else {
             if (wifi_disconnect_seconds > 0) {
@@ -143,7 +251,7 @@ void app_main(void)
         }
         
         // Check HTTP server health every 60 seconds
-        http_check_counter += 10;
+        http_check_counter += WIFI_CHECK_INTERVAL_MS / 1000;
         if (http_check_counter >= 60) {
             http_check_counter = 0;
             
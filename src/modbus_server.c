@@ -0,0 +1,439 @@
+/**
+ * @file modbus_server.c
+ * @brief Modbus TCP server implementation
+ *
+ * One task multiplexes the listening socket and up to MODBUS_MAX_CLIENTS
+ * masters with select(). Each master owns a fixed receive buffer large
+ * enough for one maximum-size ADU, taken from a block pool when it
+ * connects and returned when it leaves; pipelined requests are handled in
+ * order from the same buffer. Responses are built in a single shared
+ * transmit buffer since only this task touches it.
+ */
+
+#include "modbus_server.h"
+#include "relay_service.h"
+#include "block_pool.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include <string.h>
+
+static const char *TAG = LOG_TAG_MODBUS;
+
+#define MBAP_HEADER_LEN     7           // Transaction, protocol, length, unit
+#define MODBUS_PDU_MAX      253
+#define MODBUS_ADU_MAX      (MBAP_HEADER_LEN + MODBUS_PDU_MAX)
+
+// Function codes
+#define FC_READ_COILS           0x01
+#define FC_READ_DISCRETE        0x02
+#define FC_READ_INPUT_REGS      0x04
+#define FC_WRITE_SINGLE_COIL    0x05
+#define FC_WRITE_MULTI_COILS    0x0F
+
+// Exception codes
+#define EX_ILLEGAL_FUNCTION     0x01
+#define EX_ILLEGAL_ADDRESS      0x02
+#define EX_ILLEGAL_VALUE        0x03
+#define EX_DEVICE_FAILURE       0x04
+#define EX_DEVICE_BUSY          0x06
+
+/**
+ * @brief Per-master connection state
+ */
+typedef struct {
+    int fd;
+    uint16_t len;               // Bytes buffered
+    int64_t last_rx_us;
+    uint8_t rx[MODBUS_ADU_MAX];
+} mb_client_t;
+
+static block_pool_t s_client_pool;
+static mb_client_t *s_clients[MODBUS_MAX_CLIENTS];    // NULL when the slot is free
+static uint8_t s_tx[MODBUS_ADU_MAX];
+static modbus_stats_t s_stats;
+static TaskHandle_t s_task = NULL;
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)(v & 0xFF);
+}
+
+/**
+ * @brief Build an exception response PDU
+ */
+static int exception(uint8_t fc, uint8_t code, uint8_t *out)
+{
+    out[0] = fc | 0x80;
+    out[1] = code;
+    s_stats.exceptions++;
+    return 2;
+}
+
+/**
+ * @brief Read one input register
+ */
+static uint16_t input_register(uint16_t addr)
+{
+    relay_power_t power;
+    uint64_t uptime_s;
+
+    switch (addr) {
+        case 0:  return (uint16_t)relay_get_mask();
+        case 1:  relay_get_power(&power); return (uint16_t)power.used_w;
+        case 2:  relay_get_power(&power); return (uint16_t)power.budget_w;
+        case 3:  relay_get_power(&power); return (uint16_t)power.shed_count;
+        case 4:  relay_get_power(&power); return (uint16_t)power.reject_count;
+        case 5:
+        case 6:
+            uptime_s = (uint64_t)esp_timer_get_time() / 1000000;
+            return (uint16_t)(addr == 5 ? uptime_s : uptime_s >> 16);
+        case 7:  return (uint16_t)s_stats.requests;
+        case 8:  return (uint16_t)(s_stats.requests >> 16);
+        case 9:  return (uint16_t)s_stats.exceptions;
+        case 10: return (uint16_t)(s_stats.max_service_us > 0xFFFF ? 0xFFFF : s_stats.max_service_us);
+        case 11: return s_stats.clients;
+        case 12: return (uint16_t)(esp_get_free_heap_size() / 1024);
+        default: return 0;
+    }
+}
+
+/**
+ * @brief Execute one request PDU
+ *
+ * @return Response PDU length
+ */
+static int handle_pdu(const uint8_t *pdu, int len, uint8_t *out)
+{
+    uint8_t fc = pdu[0];
+    uint16_t start, qty;
+
+    switch (fc) {
+        case FC_READ_COILS:
+        case FC_READ_DISCRETE: {
+            if (len != 5) return exception(fc, EX_ILLEGAL_VALUE, out);
+            start = get_u16(pdu + 1);
+            qty = get_u16(pdu + 3);
+            if (qty < 1 || qty > 2000) return exception(fc, EX_ILLEGAL_VALUE, out);
+            if (start + qty > RELAY_COUNT) return exception(fc, EX_ILLEGAL_ADDRESS, out);
+
+            uint32_t bits = relay_get_mask() >> start;
+            uint8_t bytes = (qty + 7) / 8;
+            out[0] = fc;
+            out[1] = bytes;
+            for (int i = 0; i < bytes; i++) {
+                out[2 + i] = (uint8_t)(bits >> (8 * i));
+            }
+            // Unused high bits of the last byte must be zero
+            if (qty % 8) out[1 + bytes] &= (uint8_t)((1U << (qty % 8)) - 1);
+            return 2 + bytes;
+        }
+
+        case FC_READ_INPUT_REGS: {
+            if (len != 5) return exception(fc, EX_ILLEGAL_VALUE, out);
+            start = get_u16(pdu + 1);
+            qty = get_u16(pdu + 3);
+            if (qty < 1 || qty > 125) return exception(fc, EX_ILLEGAL_VALUE, out);
+            if (start + qty > MODBUS_INPUT_REG_COUNT) return exception(fc, EX_ILLEGAL_ADDRESS, out);
+
+            out[0] = fc;
+            out[1] = (uint8_t)(qty * 2);
+            for (int i = 0; i < qty; i++) {
+                put_u16(out + 2 + 2 * i, input_register(start + i));
+            }
+            return 2 + qty * 2;
+        }
+
+        case FC_WRITE_SINGLE_COIL: {
+            if (len != 5) return exception(fc, EX_ILLEGAL_VALUE, out);
+            start = get_u16(pdu + 1);
+            uint16_t value = get_u16(pdu + 3);
+            if (value != 0xFF00 && value != 0x0000) return exception(fc, EX_ILLEGAL_VALUE, out);
+            if (start >= RELAY_COUNT) return exception(fc, EX_ILLEGAL_ADDRESS, out);
+
+            uint32_t bit = 1UL << start;
+            if (relay_set_mask(bit, value ? bit : 0, true) != ESP_OK) {
+                return exception(fc, EX_DEVICE_FAILURE, out);
+            }
+            memcpy(out, pdu, 5);    // Echo request
+            return 5;
+        }
+
+        case FC_WRITE_MULTI_COILS: {
+            if (len < 6) return exception(fc, EX_ILLEGAL_VALUE, out);
+            start = get_u16(pdu + 1);
+            qty = get_u16(pdu + 3);
+            uint8_t bytes = pdu[5];
+            if (qty < 1 || qty > 1968 || bytes != (qty + 7) / 8 || len != 6 + bytes) {
+                return exception(fc, EX_ILLEGAL_VALUE, out);
+            }
+            if (start + qty > RELAY_COUNT) return exception(fc, EX_ILLEGAL_ADDRESS, out);
+
+            uint32_t values = 0;
+            for (int i = 0; i < bytes; i++) {
+                values |= (uint32_t)pdu[6 + i] << (8 * i);
+            }
+            uint32_t mask = ((1UL << qty) - 1) << start;
+            values = (values << start) & mask;
+
+            // One all-or-nothing frame: a coil the power budget refuses
+            // fails the whole write instead of leaving it half applied
+            if (relay_set_mask_atomic(mask, values, true) != ESP_OK) {
+                return exception(fc, EX_DEVICE_FAILURE, out);
+            }
+            memcpy(out, pdu, 5);    // Echo start and quantity
+            return 5;
+        }
+
+        default:
+            return exception(fc, EX_ILLEGAL_FUNCTION, out);
+    }
+}
+
+/**
+ * @brief Close a master connection and free its slot
+ */
+static void client_close(int slot)
+{
+    close(s_clients[slot]->fd);
+    block_pool_free(&s_client_pool, s_clients[slot]);
+    s_clients[slot] = NULL;
+    s_stats.clients--;
+    ESP_LOGI(TAG, "Master disconnected (%u connected)", s_stats.clients);
+}
+
+/**
+ * @brief Process every complete ADU in a master's buffer
+ *
+ * @return false if the connection must be closed
+ */
+static bool client_process(mb_client_t *c)
+{
+    uint16_t off = 0;
+
+    while (c->len - off >= MBAP_HEADER_LEN) {
+        const uint8_t *adu = c->rx + off;
+        uint16_t protocol = get_u16(adu + 2);
+        uint16_t length = get_u16(adu + 4);     // Unit id + PDU
+
+        if (protocol != 0 || length < 2 || length > MODBUS_PDU_MAX + 1) {
+            ESP_LOGW(TAG, "Malformed MBAP header, closing");
+            return false;
+        }
+        if (c->len - off < 6 + length) break;   // Wait for the rest
+
+        int64_t t0 = esp_timer_get_time();
+        uint8_t unit = adu[6];
+        int pdu_len = length - 1;
+
+        if (unit == MODBUS_UNIT_ID || unit == 0 || unit == 0xFF) {
+            // Modbus has no per-request tag; only the global switch applies
+            // and a command that cannot get a shadow scope is refused, not run live
+            int resp_len;
+            if (!relay_shadow_enabled()) {
+                resp_len = handle_pdu(adu + MBAP_HEADER_LEN, pdu_len, s_tx + MBAP_HEADER_LEN);
+            } else if (relay_shadow_begin() == ESP_OK) {
+                resp_len = handle_pdu(adu + MBAP_HEADER_LEN, pdu_len, s_tx + MBAP_HEADER_LEN);
+                relay_shadow_end();
+            } else {
+                resp_len = exception(adu[MBAP_HEADER_LEN], EX_DEVICE_BUSY, s_tx + MBAP_HEADER_LEN);
+            }
+
+            memcpy(s_tx, adu, 4);               // Transaction + protocol id
+            put_u16(s_tx + 4, (uint16_t)(resp_len + 1));
+            s_tx[6] = unit;
+
+            int total = MBAP_HEADER_LEN + resp_len;
+            if (send(c->fd, s_tx, total, 0) != total) {
+                return false;
+            }
+
+            uint32_t service_us = (uint32_t)(esp_timer_get_time() - t0);
+            s_stats.requests++;
+            s_stats.total_service_us += service_us;
+            if (service_us > s_stats.max_service_us) {
+                s_stats.max_service_us = service_us;
+            }
+            int bucket = 0;
+            while (bucket < MODBUS_HIST_BUCKETS - 1 && service_us >= (32u << bucket)) {
+                bucket++;
+            }
+            s_stats.service_hist[bucket]++;
+        }
+
+        off += 6 + length;
+    }
+
+    // Keep a partial trailing frame at the start of the buffer
+    if (off > 0) {
+        memmove(c->rx, c->rx + off, c->len - off);
+        c->len -= off;
+    }
+    return true;
+}
+
+/**
+ * @brief Accept a new master into a free slot
+ */
+static void accept_client(int listen_fd)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int fd = accept(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    if (fd < 0) return;
+
+    for (int i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+        if (s_clients[i] == NULL) {
+            mb_client_t *c = block_pool_alloc(&s_client_pool);
+            if (c == NULL) break;
+
+            int nodelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+            c->fd = fd;
+            c->len = 0;
+            c->last_rx_us = esp_timer_get_time();
+            s_clients[i] = c;
+            s_stats.clients++;
+            ESP_LOGI(TAG, "Master connected from %s (%u connected)",
+                     inet_ntoa(addr.sin_addr), s_stats.clients);
+            return;
+        }
+    }
+
+    ESP_LOGW(TAG, "Too many masters, refusing %s", inet_ntoa(addr.sin_addr));
+    close(fd);
+}
+
+/**
+ * @brief Server task
+ */
+static void modbus_task(void *arg)
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_fd < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(MODBUS_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 2) != 0) {
+        ESP_LOGE(TAG, "Failed to listen on port %d: errno %d", MODBUS_PORT, errno);
+        close(listen_fd);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    ESP_LOGI(TAG, "Modbus TCP server listening on port %d", MODBUS_PORT);
+
+    while (1) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(listen_fd, &rfds);
+        int max_fd = listen_fd;
+
+        for (int i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+            if (s_clients[i] != NULL) {
+                FD_SET(s_clients[i]->fd, &rfds);
+                if (s_clients[i]->fd > max_fd) max_fd = s_clients[i]->fd;
+            }
+        }
+
+        struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+        int ready = select(max_fd + 1, &rfds, NULL, NULL, &tv);
+        if (ready < 0) {
+            ESP_LOGE(TAG, "select failed: errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        int64_t now_us = esp_timer_get_time();
+
+        for (int i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+            mb_client_t *c = s_clients[i];
+            if (c == NULL) continue;
+
+            if (!FD_ISSET(c->fd, &rfds)) {
+                if (now_us - c->last_rx_us > (int64_t)MODBUS_IDLE_TIMEOUT_S * 1000000) {
+                    ESP_LOGI(TAG, "Master idle, closing");
+                    client_close(i);
+                }
+                continue;
+            }
+
+            int n = recv(c->fd, c->rx + c->len, sizeof(c->rx) - c->len, 0);
+            if (n <= 0) {
+                client_close(i);
+                continue;
+            }
+            c->len += n;
+            c->last_rx_us = now_us;
+
+            if (!client_process(c)) {
+                client_close(i);
+            }
+        }
+
+        if (FD_ISSET(listen_fd, &rfds)) {
+            accept_client(listen_fd);
+        }
+    }
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t modbus_server_init(void)
+{
+    if (s_task != NULL) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = block_pool_init(&s_client_pool, "modbus_client", sizeof(mb_client_t),
+                                    MODBUS_MAX_CLIENTS);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    for (int i = 0; i < MODBUS_MAX_CLIENTS; i++) {
+        s_clients[i] = NULL;
+    }
+    memset(&s_stats, 0, sizeof(s_stats));
+
+    BaseType_t ok = xTaskCreate(modbus_task, "modbus", MODBUS_TASK_STACK_SIZE,
+                                NULL, MODBUS_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create Modbus task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void modbus_server_get_stats(modbus_stats_t *out)
+{
+    *out = s_stats;
+}
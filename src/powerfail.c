@@ -0,0 +1,373 @@
+/**
+ * @file powerfail.c
+ * @brief Emergency flush of the relay state on a power-fail warning
+ *
+ * The flush is split so each part has a fixed, small cost:
+ *   - The interrupt (IRAM, flash cache may be off) copies the 32-byte
+ *     staged record into RTC slow memory and computes its CRC with the ROM
+ *     routine. No loops over variable data, no allocation, one spinlock.
+ *   - The flush task, at the highest application priority, programs that
+ *     record into the next slot of the partition. The slot was erased in
+ *     advance, so this is a single page program: no erase, no NVS, no
+ *     lookup.
+ * Both times are measured and reported by powerfail_get_status().
+ *
+ * Flash layout: the partition is an array of 32-byte slots written in
+ * order. A boot scan takes the last valid one; a torn write fails its CRC
+ * and is skipped. Used slots are erased (in the task, never on the flush
+ * path) once the relay service has committed newer state to NVS, and at
+ * boot if none are left.
+ *
+ * RTC slow memory survives esp_restart() and most brownout resets but not
+ * a full power cut, so at boot a valid RTC record is the newest copy and
+ * the flash slots are the fallback. Records are checked by CRC: RTC memory
+ * holds random data after power-on.
+ */
+
+#include "powerfail.h"
+#include "config.h"
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stddef.h>
+#include <string.h>
+
+static const char *TAG = LOG_TAG_POWERFAIL;
+
+#define RECORD_MAGIC        0x31524650          // "PFR1"
+#define SLOT_LEN            sizeof(powerfail_record_t)
+#define NOTIFY_FLUSH        (1u << 0)           // Program the RTC record into flash
+#define NOTIFY_ERASE        (1u << 1)           // Used slots are redundant
+
+_Static_assert(sizeof(powerfail_record_t) == 32, "record must fill one slot");
+
+// Survives esp_restart(); random after power-on, so always CRC checked
+static RTC_NOINIT_ATTR powerfail_record_t s_rtc_record;
+
+// Guards the staged record, the RTC record and s_failing against the ISR
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static powerfail_record_t s_staged;
+static bool s_staged_valid = false;
+static volatile bool s_failing = false;
+
+static const esp_partition_t *s_part = NULL;
+static uint16_t s_slots = 0;
+static uint16_t s_next_slot = 0;                // First pre-erased slot
+static TaskHandle_t s_task = NULL;
+
+static bool s_recovered = false;
+static powerfail_status_t s_status = { .recovered_from = "none" };
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+static uint32_t IRAM_ATTR record_crc(const powerfail_record_t *rec)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)rec, offsetof(powerfail_record_t, crc));
+}
+
+static bool record_valid(const powerfail_record_t *rec)
+{
+    return rec->magic == RECORD_MAGIC && rec->crc == record_crc(rec);
+}
+
+/**
+ * @brief Copy the staged state into RTC memory; call with s_lock held
+ */
+static void IRAM_ATTR capture(uint32_t cause, int64_t now_us)
+{
+    s_rtc_record = s_staged;
+    s_rtc_record.uptime_ms = (uint32_t)(now_us / 1000);
+    s_rtc_record.cause = cause;
+    s_rtc_record.crc = record_crc(&s_rtc_record);
+}
+
+/**
+ * @brief Power-fail warning (supply monitor output falling edge)
+ */
+static void IRAM_ATTR powerfail_isr(void *arg)
+{
+    int64_t start = esp_timer_get_time();
+
+    taskENTER_CRITICAL_ISR(&s_lock);
+    bool first = !s_failing;
+    s_failing = true;
+    if (first && s_staged_valid) {
+        capture(POWERFAIL_CAUSE_WARNING, start);
+    }
+    taskEXIT_CRITICAL_ISR(&s_lock);
+    if (!first) {
+        return;                                 // Bounce on a falling supply
+    }
+
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(s_task, NOTIFY_FLUSH, eSetBits, &woken);
+
+    uint32_t took = (uint32_t)(esp_timer_get_time() - start);
+    s_status.warnings++;
+    if (took > s_status.isr_us) {
+        s_status.isr_us = took;
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * @brief esp_restart(): leave the staged state in RTC memory
+ */
+static void powerfail_shutdown(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    if (s_staged_valid && !s_failing) {
+        capture(POWERFAIL_CAUSE_RESTART, esp_timer_get_time());
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+/**
+ * @brief Program the RTC record into the next pre-erased slot
+ */
+static void flush_slot(void)
+{
+    powerfail_record_t rec = s_rtc_record;
+    if (!record_valid(&rec) || s_part == NULL) {
+        return;
+    }
+    if (s_next_slot >= s_slots) {
+        ESP_LOGE(TAG, "No erased slot left, record kept in RTC memory only");
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = esp_partition_write(s_part, (size_t)s_next_slot * SLOT_LEN, &rec, SLOT_LEN);
+    uint32_t took = (uint32_t)(esp_timer_get_time() - start);
+
+    // A failed program leaves the slot unusable either way
+    s_next_slot++;
+    if (took > s_status.flash_us) {
+        s_status.flash_us = took;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Flush failed: %s", esp_err_to_name(ret));
+        return;
+    }
+    s_status.flushes++;
+    ESP_LOGW(TAG, "Power failing: states 0x%02lX flushed in %lu us",
+             (unsigned long)rec.states, (unsigned long)took);
+    if (took > POWERFAIL_HOLDUP_US) {
+        ESP_LOGW(TAG, "Flush took longer than the %d us hold-up", POWERFAIL_HOLDUP_US);
+    }
+}
+
+/**
+ * @brief Erase the used slots so the next flush finds a blank one
+ */
+static void erase_slots(void)
+{
+    if (s_part == NULL || s_next_slot == 0) {
+        return;
+    }
+    size_t len = (size_t)s_next_slot * SLOT_LEN;
+    len = (len + s_part->erase_size - 1) / s_part->erase_size * s_part->erase_size;
+
+    esp_err_t ret = esp_partition_erase_range(s_part, 0, len);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Slot erase failed: %s", esp_err_to_name(ret));
+        return;
+    }
+    s_next_slot = 0;
+    s_status.erases++;
+}
+
+/**
+ * @brief Find the newest flash record and the first blank slot
+ */
+static void scan_slots(powerfail_record_t *newest, bool *found)
+{
+    powerfail_record_t rec;
+    uint8_t blank[SLOT_LEN];
+    memset(blank, 0xFF, sizeof(blank));
+
+    *found = false;
+    s_next_slot = 0;
+    for (uint16_t i = 0; i < s_slots; i++) {
+        if (esp_partition_read(s_part, (size_t)i * SLOT_LEN, &rec, SLOT_LEN) != ESP_OK) {
+            break;
+        }
+        if (memcmp(&rec, blank, SLOT_LEN) == 0) {
+            break;
+        }
+        s_next_slot = i + 1;
+        if (record_valid(&rec)) {
+            *newest = rec;
+            *found = true;
+        }
+    }
+}
+
+/**
+ * @brief Flush on a warning, erase used slots after a commit
+ */
+static void powerfail_task(void *arg)
+{
+    for (;;) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+
+        if (bits & NOTIFY_FLUSH) {
+            // A pending erase predates this record, so it is dropped
+            flush_slot();
+
+            // A dip rather than a cut: carry on once the supply is back
+            while (gpio_get_level(POWERFAIL_GPIO) == 0) {
+                vTaskDelay(pdMS_TO_TICKS(POWERFAIL_RECHECK_MS));
+            }
+            taskENTER_CRITICAL(&s_lock);
+            s_failing = false;
+            taskEXIT_CRITICAL(&s_lock);
+            ESP_LOGW(TAG, "Supply back after a power-fail warning");
+        } else if (bits & NOTIFY_ERASE) {
+            erase_slots();
+        }
+    }
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t powerfail_init(void)
+{
+    if (s_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (record_valid(&s_rtc_record)) {
+        s_status.recovered = s_rtc_record;
+        s_status.recovered_from = "rtc";
+        s_recovered = true;
+    }
+
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, POWERFAIL_PARTITION_SUBTYPE,
+                                      POWERFAIL_PARTITION_LABEL);
+    if (s_part == NULL) {
+        ESP_LOGW(TAG, "No '%s' partition, records kept in RTC memory only",
+                 POWERFAIL_PARTITION_LABEL);
+    } else {
+        s_slots = (uint16_t)(s_part->size / SLOT_LEN);
+        powerfail_record_t rec;
+        bool found;
+        scan_slots(&rec, &found);
+        if (found && !s_recovered) {
+            s_status.recovered = rec;
+            s_status.recovered_from = "flash";
+            s_recovered = true;
+        }
+        // Keep a record until NVS has caught up with it
+        if (s_next_slot == s_slots && !found) {
+            erase_slots();
+        }
+    }
+
+    if (s_recovered) {
+        ESP_LOGW(TAG, "Record from %s: states 0x%02lX, %lu changes, %lu commands (%s at %lu ms)",
+                 s_status.recovered_from, (unsigned long)s_status.recovered.states,
+                 (unsigned long)s_status.recovered.version,
+                 (unsigned long)s_status.recovered.commands,
+                 s_status.recovered.cause == POWERFAIL_CAUSE_WARNING ? "power fail" : "restart",
+                 (unsigned long)s_status.recovered.uptime_ms);
+    }
+
+    BaseType_t ok = xTaskCreate(powerfail_task, "powerfail", POWERFAIL_TASK_STACK_SIZE,
+                                NULL, POWERFAIL_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create power-fail task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = esp_register_shutdown_handler(powerfail_shutdown);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Restart handler not registered: %s", esp_err_to_name(ret));
+    }
+
+    // Open-drain supervisor output, held HIGH by the pull-up while the supply is good
+    gpio_config_t io_conf = {
+        .pin_bit_mask = (1ULL << POWERFAIL_GPIO),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_NEGEDGE
+    };
+    ret = gpio_config(&io_conf);
+    if (ret == ESP_OK) {
+        ret = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+        if (ret == ESP_ERR_INVALID_STATE) {
+            ret = ESP_OK;                       // Installed by another driver
+        }
+    }
+    if (ret == ESP_OK) {
+        ret = gpio_isr_handler_add(POWERFAIL_GPIO, powerfail_isr, NULL);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Power-fail input on GPIO %d unavailable: %s",
+                 POWERFAIL_GPIO, esp_err_to_name(ret));
+        return ret;
+    }
+    s_status.armed = true;
+
+    if (gpio_get_level(POWERFAIL_GPIO) == 0) {
+        ESP_LOGW(TAG, "Power-fail input is LOW at boot");
+    }
+    ESP_LOGI(TAG, "Power-fail flush armed on GPIO %d, %u of %u slots free",
+             POWERFAIL_GPIO, (unsigned)(s_slots - s_next_slot), (unsigned)s_slots);
+    return ESP_OK;
+}
+
+bool powerfail_recover(powerfail_record_t *out)
+{
+    if (!s_recovered) {
+        return false;
+    }
+    *out = s_status.recovered;
+    return true;
+}
+
+void powerfail_stage(uint32_t states, uint32_t version, uint32_t commands, uint32_t saves)
+{
+    taskENTER_CRITICAL(&s_lock);
+    s_staged.magic = RECORD_MAGIC;
+    s_staged.states = states;
+    s_staged.version = version;
+    s_staged.commands = commands;
+    s_staged.saves = saves;
+    s_staged_valid = true;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+void powerfail_committed(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    bool failing = s_failing;
+    if (!failing) {
+        s_rtc_record.magic = 0;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (!failing && s_next_slot > 0 && s_task != NULL) {
+        xTaskNotify(s_task, NOTIFY_ERASE, eSetBits);
+    }
+}
+
+void powerfail_get_status(powerfail_status_t *out)
+{
+    *out = s_status;
+    out->failing = s_failing;
+    out->slots = s_slots;
+    out->slots_free = (uint16_t)(s_slots - s_next_slot);
+}
@@ -1,37 +1,135 @@
 /**
  * @file relay_service.c
  * @brief Relay control service implementation
+ *
+ * Every switching command is a batch applied as one output frame: the
+ * power budget is planned for the whole batch, the outputs are written and
+ * read back, and only then do the model, journal and NVS follow. A failed
+ * output puts the previous frame back, so the model never claims a state
+ * the outputs do not have.
  */
 
 #include "relay_service.h"
+#include "powerfail.h"
 #include "config.h"
 #include "driver/gpio.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+#if RELAY_IRAM_PROFILE
+#include "esp_attr.h"
+#include "hal/gpio_ll.h"
+
+#if !CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+#error "RELAY_IRAM_PROFILE needs CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD (sdkconfig.iram.defaults)"
+#endif
+
+// Code that runs with the state lock held or in the esp_timer interrupt;
+// tools/iram_check.py checks that it reaches nothing in flash
+#define RELAY_IRAM_ATTR         IRAM_ATTR
+
+// Pulse ends switch from the esp_timer interrupt, on time during NVS commits
+#define PULSE_DISPATCH          ESP_TIMER_ISR
+#define PULSE_ENTER_CRITICAL()  taskENTER_CRITICAL_ISR(&state_lock)
+#define PULSE_EXIT_CRITICAL()   taskEXIT_CRITICAL_ISR(&state_lock)
+#else
+#define RELAY_IRAM_ATTR
+#define PULSE_DISPATCH          ESP_TIMER_TASK
+#define PULSE_ENTER_CRITICAL()  taskENTER_CRITICAL(&state_lock)
+#define PULSE_EXIT_CRITICAL()   taskEXIT_CRITICAL(&state_lock)
+#endif
 
 static const char *TAG = LOG_TAG_RELAY;
 
 // Relay configuration array
-static relay_info_t relays[RELAY_COUNT] = {
-    { .gpio_pin = RELAY_1_GPIO, .name = RELAY_1_NAME, .state = RELAY_DEFAULT_STATE },
-    { .gpio_pin = RELAY_2_GPIO, .name = RELAY_2_NAME, .state = RELAY_DEFAULT_STATE },
-    { .gpio_pin = RELAY_3_GPIO, .name = RELAY_3_NAME, .state = RELAY_DEFAULT_STATE },
-    { .gpio_pin = RELAY_4_GPIO, .name = RELAY_4_NAME, .state = RELAY_DEFAULT_STATE }
+static const relay_info_t relay_config[RELAY_COUNT] = {
+    { .gpio_pin = RELAY_1_GPIO, .name = RELAY_1_NAME, .group = RELAY_1_GROUP, .state = RELAY_OFF,
+      .power_w = RELAY_1_POWER_W, .priority = RELAY_1_PRIORITY },
+    { .gpio_pin = RELAY_2_GPIO, .name = RELAY_2_NAME, .group = RELAY_2_GROUP, .state = RELAY_OFF,
+      .power_w = RELAY_2_POWER_W, .priority = RELAY_2_PRIORITY },
+    { .gpio_pin = RELAY_3_GPIO, .name = RELAY_3_NAME, .group = RELAY_3_GROUP, .state = RELAY_OFF,
+      .power_w = RELAY_3_POWER_W, .priority = RELAY_3_PRIORITY },
+    { .gpio_pin = RELAY_4_GPIO, .name = RELAY_4_NAME, .group = RELAY_4_GROUP, .state = RELAY_OFF,
+      .power_w = RELAY_4_POWER_W, .priority = RELAY_4_PRIORITY }
 };
 
-// Last toggle time for debouncing
-static uint32_t last_toggle_time[RELAY_COUNT] = {0};
+/**
+ * @brief Everything a command reads or changes
+ * 
+ * The live model drives the GPIOs and NVS. The shadow model runs the same
+ * code for dry-run commands; only the output and flash calls are skipped.
+ * Both models are statics in DRAM, as is everything else the frame code
+ * reads (the relay names are only used by the logging around it).
+ */
+typedef struct {
+    relay_info_t relays[RELAY_COUNT];
+    bool drives_outputs;                        // false for the shadow model
+    
+    // Last toggle time for debouncing
+    uint32_t last_toggle_time[RELAY_COUNT];
+    
+    // Momentary pulse state (expiry runs in the esp_timer task, or in its
+    // interrupt with RELAY_IRAM_PROFILE)
+    esp_timer_handle_t pulse_timers[RELAY_COUNT];
+    bool pulse_active[RELAY_COUNT];
+    int64_t pulse_start_us[RELAY_COUNT];
+    int64_t pulse_deadline_us[RELAY_COUNT];
+    
+    // Power budget: running total of ON loads, kept in step with every change
+    uint32_t load_w;
+    uint32_t shed_count;
+    uint32_t reject_count;
+    
+    // State change journal (ring, guarded by state_lock)
+    relay_event_t event_log[RELAY_EVENT_LOG_SIZE];
+    uint32_t event_seq;                         // Changes recorded since boot
+    
+    uint32_t commands;                          // Switching commands accepted
+    uint32_t saves;                             // State saves (simulated in shadow)
+    uint8_t saved_states;                       // Last packed state saved
+} relay_model_t;
+
+static relay_model_t live = { .drives_outputs = true };
+static relay_model_t shadow = { .drives_outputs = false };
+
+// Shadow scopes: tasks whose commands currently run against the shadow model
+static TaskHandle_t shadow_tasks[SHADOW_MAX_SCOPES];
+static bool shadow_enabled = false;
 
 // LED state
 static bool led_initialized = false;
 
+// Guards relay state, load total and pulse flags across tasks
+static portMUX_TYPE state_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t priority_order[RELAY_COUNT];     // Highest priority first
+
+static relay_output_stats_t output_stats;       // Guarded by state_lock
+
+#define ALL_RELAYS_MASK     ((1UL << RELAY_COUNT) - 1)
+
 /*============================================================================
  * Private Functions
  *============================================================================*/
 
+/**
+ * @brief Model used by commands from the calling task
+ */
+static relay_model_t *current_model(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < SHADOW_MAX_SCOPES; i++) {
+        if (shadow_tasks[i] == self) return &shadow;
+    }
+    return &live;
+}
+
 /**
  * @brief Initialize the built-in LED
  */
@@ -54,15 +152,18 @@ static void init_led(void)
 
 /**
  * @brief Blink the built-in LED to indicate state change
+ * 
+ * The shadow model waits out the same blink without touching the LED, so
+ * a shadow command costs the handler what a live one does.
  */
-static void blink_led(void)
+static void blink_led(const relay_model_t *m)
 {
     if (!led_initialized) return;
     
     for (int i = 0; i < LED_BLINK_COUNT; i++) {
-        gpio_set_level(LED_BUILTIN_GPIO, 1);
+        if (m->drives_outputs) gpio_set_level(LED_BUILTIN_GPIO, 1);
         vTaskDelay(pdMS_TO_TICKS(LED_BLINK_ON_MS));
-        gpio_set_level(LED_BUILTIN_GPIO, 0);
+        if (m->drives_outputs) gpio_set_level(LED_BUILTIN_GPIO, 0);
         if (i < LED_BLINK_COUNT - 1) {
             vTaskDelay(pdMS_TO_TICKS(LED_BLINK_ON_MS));
         }
@@ -70,38 +171,562 @@ static void blink_led(void)
 }
 
 /**
- * @brief Apply relay state to GPIO
+ * @brief GPIO level that drives a relay to a state
  */
-static void apply_gpio_state(uint8_t relay_id)
+static inline int RELAY_IRAM_ATTR relay_level(bool on)
 {
-    if (relay_id >= RELAY_COUNT) return;
-    
-    int gpio_level;
-    
 #if RELAY_ACTIVE_LOW
     // Active LOW: Relay ON when GPIO is LOW
-    gpio_level = (relays[relay_id].state == RELAY_ON) ? 0 : 1;
+    return on ? 0 : 1;
 #else
     // Active HIGH: Relay ON when GPIO is HIGH
-    gpio_level = (relays[relay_id].state == RELAY_ON) ? 1 : 0;
+    return on ? 1 : 0;
+#endif
+}
+
+/**
+ * @brief Drive one output pin
+ * 
+ * The IRAM profile writes the GPIO register directly: gpio_set_level()
+ * lives in flash, and gpio_config() has already checked the pins.
+ */
+static inline esp_err_t RELAY_IRAM_ATTR output_set_level(uint8_t pin, int level)
+{
+#if RELAY_IRAM_PROFILE
+    gpio_ll_set_level(&GPIO, pin, level);
+    return ESP_OK;
+#else
+    return gpio_set_level(pin, level);
 #endif
+}
+
+/**
+ * @brief Read one output pin back (input stage kept on, see init)
+ */
+static inline int RELAY_IRAM_ATTR output_get_level(uint8_t pin)
+{
+#if RELAY_IRAM_PROFILE
+    return gpio_ll_get_level(&GPIO, pin);
+#else
+    return gpio_get_level(pin);
+#endif
+}
+
+/**
+ * @brief Packed relay states of a model, bit N = relay N (lock held)
+ */
+static uint32_t RELAY_IRAM_ATTR model_frame(const relay_model_t *m)
+{
+    uint32_t frame = 0;
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        if (m->relays[i].state == RELAY_ON) {
+            frame |= (1UL << i);
+        }
+    }
+    return frame;
+}
+
+/**
+ * @brief Relay changed by a frame, in switching order
+ * 
+ * OFF edges first, then ON edges in priority order, so the load never
+ * exceeds the budget part-way through a frame.
+ * 
+ * @param k Position, 0 .. RELAY_COUNT * 2 - 1
+ * @return Relay id, or -1 if the relay at this position does not change
+ */
+static int RELAY_IRAM_ATTR frame_order(uint32_t frame, uint32_t changed, int k)
+{
+    int i = (k < RELAY_COUNT) ? k : priority_order[k - RELAY_COUNT];
+    bool on = frame & (1UL << i);
+    if (!(changed & (1UL << i)) || on != (k >= RELAY_COUNT)) return -1;
+    return i;
+}
+
+/**
+ * @brief Output driver: drive the changed relays to their bits in frame
+ * 
+ * Writes the GPIOs, then reads them back (RELAY_VERIFY_OUTPUTS). Runs with
+ * the state lock held, which is fine for GPIO writes; a bus-attached
+ * expander would need a mutex around the frame instead. No-op for the
+ * shadow model.
+ * 
+ * @param written Set to the relays whose outputs were written (may be NULL)
+ * @return ESP_OK, the GPIO driver's error, or ESP_ERR_INVALID_RESPONSE if
+ *         an output reads back wrong
+ */
+static esp_err_t RELAY_IRAM_ATTR output_write(const relay_model_t *m, uint32_t frame,
+                                              uint32_t changed, uint32_t *written)
+{
+    uint32_t done = 0;
+    if (written != NULL) *written = 0;
+    if (!m->drives_outputs) return ESP_OK;
+    
+    for (int k = 0; k < RELAY_COUNT * 2; k++) {
+        int i = frame_order(frame, changed, k);
+        if (i < 0) continue;
+        esp_err_t ret = output_set_level(m->relays[i].gpio_pin, relay_level(frame & (1UL << i)));
+        if (ret != ESP_OK) {
+            output_stats.write_errors++;
+            return ret;
+        }
+        done |= (1UL << i);
+        if (written != NULL) *written = done;
+    }
+    
+#if RELAY_VERIFY_OUTPUTS
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        if (!(changed & (1UL << i))) continue;
+        if (output_get_level(m->relays[i].gpio_pin) != relay_level(frame & (1UL << i))) {
+            output_stats.verify_errors++;
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+#endif
+    return ESP_OK;
+}
+
+/**
+ * @brief Move the outputs from one frame to the next, or back on failure
+ * 
+ * Lock held. The caller updates the model only if this succeeds.
+ * 
+ * @param rolled_back Set to false if the previous frame could not be
+ *        restored either (the outputs may not match the model)
+ */
+static esp_err_t RELAY_IRAM_ATTR frame_write_locked(const relay_model_t *m, uint32_t before,
+                                                    uint32_t frame, bool *rolled_back)
+{
+    uint32_t changed = before ^ frame;
+    uint32_t written;
+    *rolled_back = true;
+    if (changed == 0) return ESP_OK;
     
-    gpio_set_level(relays[relay_id].gpio_pin, gpio_level);
+    esp_err_t ret = output_write(m, frame, changed, &written);
+    if (!m->drives_outputs) return ret;
+    
+    // Only the outputs already written need to go back
+    if (ret == ESP_OK) {
+        output_stats.frames++;
+    } else if (output_write(m, before, written, NULL) == ESP_OK) {
+        output_stats.rollbacks++;
+    } else {
+        output_stats.rollback_failures++;
+        *rolled_back = false;
+    }
+    return ret;
+}
+
+/**
+ * @brief Log a frame the outputs refused
+ */
+static void log_output_failure(const relay_model_t *m, esp_err_t ret, bool rolled_back)
+{
+    if (rolled_back) {
+        ESP_LOGE(TAG, "%sOutput write failed (%s), rolled back",
+                 m->drives_outputs ? "" : "[shadow] ", esp_err_to_name(ret));
+    } else {
+        ESP_LOGE(TAG, "Output write failed (%s), rollback failed: outputs may not match",
+                 esp_err_to_name(ret));
+    }
+}
+
+/**
+ * @brief Change a relay's model state and the load total (lock held)
+ */
+static void RELAY_IRAM_ATTR set_state_locked(relay_model_t *m, uint8_t relay_id, relay_state_t state)
+{
+    if (m->relays[relay_id].state == state) return;
+    
+    if (state == RELAY_ON) {
+        m->load_w += m->relays[relay_id].power_w;
+    } else {
+        m->load_w -= m->relays[relay_id].power_w;
+    }
+    m->relays[relay_id].state = state;
+    
+    // Journal the change; readers copy it out later under the same lock
+    m->event_seq++;
+    relay_event_t *event = &m->event_log[(m->event_seq - 1) % RELAY_EVENT_LOG_SIZE];
+    event->seq = m->event_seq;
+    event->time_us = esp_timer_get_time();
+    event->relay_id = relay_id;
+    event->state = state;
+}
+
+/**
+ * @brief Change a relay's model state and the load total
+ */
+static void set_state(relay_model_t *m, uint8_t relay_id, relay_state_t state)
+{
+    taskENTER_CRITICAL(&state_lock);
+    set_state_locked(m, relay_id, state);
+    taskEXIT_CRITICAL(&state_lock);
 }
 
 /**
  * @brief Check if enough time has passed since last toggle (debounce)
  */
-static bool debounce_check(uint8_t relay_id)
+static bool debounce_check(relay_model_t *m, uint8_t relay_id)
 {
     uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
-    if ((now - last_toggle_time[relay_id]) < RELAY_DEBOUNCE_MS) {
+    if ((now - m->last_toggle_time[relay_id]) < RELAY_DEBOUNCE_MS) {
         return false;
     }
-    last_toggle_time[relay_id] = now;
+    m->last_toggle_time[relay_id] = now;
     return true;
 }
 
+/**
+ * @brief Save the packed states of a model
+ * 
+ * The shadow model packs the same byte and counts the write but keeps it
+ * in RAM, so shadow traffic never wears the flash.
+ */
+static esp_err_t save_states(relay_model_t *m)
+{
+    // Pack all states into a single byte (4 relays = 4 bits)
+    // A pulsing relay is saved as OFF so a reboot never leaves it latched
+    uint8_t packed_states = 0;
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        if (m->relays[i].state == RELAY_ON && !m->pulse_active[i]) {
+            packed_states |= (1 << i);
+        }
+    }
+    
+    m->saves++;
+    m->saved_states = packed_states;
+    if (!m->drives_outputs) {
+        return ESP_OK;
+    }
+    
+#if POWERFAIL_ENABLE
+    // What a power cut must not lose, even if the NVS write below fails
+    taskENTER_CRITICAL(&state_lock);
+    uint32_t version = m->event_seq;
+    taskEXIT_CRITICAL(&state_lock);
+    powerfail_stage(packed_states, version, m->commands, m->saves);
+#endif
+    
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ret = nvs_set_u8(nvs_handle, NVS_KEY_RELAY_STATE, packed_states);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save states: %s", esp_err_to_name(ret));
+        nvs_close(nvs_handle);
+        return ret;
+    }
+    
+    ret = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+    
+#if POWERFAIL_ENABLE
+    if (ret == ESP_OK) {
+        powerfail_committed();
+    }
+#endif
+    
+    ESP_LOGD(TAG, "States saved: 0x%02X", packed_states);
+    return ret;
+}
+
+/**
+ * @brief Count a live pulse end in the lateness histogram (lock held)
+ */
+static void RELAY_IRAM_ATTR record_pulse_end_locked(int64_t late_us)
+{
+    uint32_t late = (late_us > 0) ? (uint32_t)late_us : 0;
+    int bucket = 0;
+    while (bucket < RELAY_LATE_HIST_BUCKETS - 1 && late >= (32UL << bucket)) {
+        bucket++;
+    }
+    output_stats.pulse_ends++;
+    output_stats.pulse_late_hist[bucket]++;
+    if (late > output_stats.pulse_late_max_us) {
+        output_stats.pulse_late_max_us = late;
+    }
+}
+
+/**
+ * @brief Pulse expiry - switches the relay back OFF
+ * 
+ * Runs in the esp_timer task, or in the esp_timer interrupt with
+ * RELAY_IRAM_PROFILE, where it logs nothing (output_stats counts both
+ * outcomes). The active flag is checked under the lock so an expiry
+ * racing with a cancel or an explicit command becomes a no-op. The
+ * argument is the relay id, offset by RELAY_COUNT for shadow pulses.
+ */
+static void RELAY_IRAM_ATTR pulse_timer_callback(void *arg)
+{
+    uintptr_t index = (uintptr_t)arg;
+    relay_model_t *m = (index >= RELAY_COUNT) ? &shadow : &live;
+    uint8_t relay_id = (uint8_t)(index % RELAY_COUNT);
+    int64_t width_us = -1;
+    esp_err_t ret = ESP_OK;
+    bool rolled_back = true;
+    
+    PULSE_ENTER_CRITICAL();
+    if (m->pulse_active[relay_id]) {
+        uint32_t before = model_frame(m);
+        ret = frame_write_locked(m, before, before & ~(1UL << relay_id), &rolled_back);
+        if (ret == ESP_OK) {
+            int64_t now = esp_timer_get_time();
+            set_state_locked(m, relay_id, RELAY_OFF);
+            m->pulse_active[relay_id] = false;
+            width_us = now - m->pulse_start_us[relay_id];
+            if (m->drives_outputs) {
+                record_pulse_end_locked(now - m->pulse_deadline_us[relay_id]);
+            }
+        }
+    }
+    PULSE_EXIT_CRITICAL();
+    
+    if (ret != ESP_OK) {
+        // Still pulsing: try again rather than leave the relay latched ON
+#if !RELAY_IRAM_PROFILE
+        log_output_failure(m, ret, rolled_back);
+#endif
+        esp_timer_start_once(m->pulse_timers[relay_id], RELAY_OUTPUT_RETRY_MS * 1000ULL);
+        return;
+    }
+#if RELAY_IRAM_PROFILE
+    (void)rolled_back;
+    (void)width_us;
+#else
+    if (width_us >= 0 && m->drives_outputs) {
+        ESP_LOGI(TAG, "%s pulse finished (%lld us)", 
+                 m->relays[relay_id].name, (long long)width_us);
+    }
+#endif
+}
+
+/**
+ * @brief Stop a running pulse without touching the relay output
+ * 
+ * @return true if a pulse was running
+ */
+static bool pulse_abort(relay_model_t *m, uint8_t relay_id)
+{
+    bool was_active;
+    
+    taskENTER_CRITICAL(&state_lock);
+    was_active = m->pulse_active[relay_id];
+    m->pulse_active[relay_id] = false;
+    taskEXIT_CRITICAL(&state_lock);
+    
+    if (was_active) {
+        esp_timer_stop(m->pulse_timers[relay_id]);
+        ESP_LOGI(TAG, "%s pulse cancelled", m->relays[relay_id].name);
+    }
+    return was_active;
+}
+
+/**
+ * @brief Plan a batch under the power budget (lock held, changes nothing)
+ * 
+ * OFF changes come first to free budget, then ON changes in priority
+ * order. The common case is a single comparison against the running
+ * total. Only when an ON change exceeds the budget are lower-priority
+ * loads shed, lowest priority first, and only if shedding can actually
+ * free enough; otherwise that change is rejected and the rest of the
+ * batch still goes ahead.
+ * 
+ * @param shed Set to the relays switched OFF to make room
+ * @param rejected Set to the ON changes refused
+ * @return Relay states after the batch
+ */
+static uint32_t RELAY_IRAM_ATTR plan_frame(const relay_model_t *m, uint32_t mask, uint32_t values,
+                           uint32_t *shed, uint32_t *rejected)
+{
+    uint32_t frame = model_frame(m) & ~(mask & ~values);
+    *shed = 0;
+    *rejected = 0;
+    
+#if POWER_BUDGET_W > 0
+    uint32_t load = 0;
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        if (frame & (1UL << i)) load += m->relays[i].power_w;
+    }
+#endif
+    
+    for (int k = 0; k < RELAY_COUNT; k++) {
+        uint8_t i = priority_order[k];
+        if (!(mask & values & (1UL << i)) || (frame & (1UL << i))) continue;
+        
+#if POWER_BUDGET_W > 0
+        const relay_info_t *req = &m->relays[i];
+        if (load + req->power_w > POWER_BUDGET_W) {
+            uint32_t sheddable = 0;
+            for (int j = 0; j < RELAY_COUNT; j++) {
+                if ((frame & (1UL << j)) && m->relays[j].priority < req->priority) {
+                    sheddable += m->relays[j].power_w;
+                }
+            }
+            if (load - sheddable + req->power_w > POWER_BUDGET_W) {
+                *rejected |= (1UL << i);
+                continue;
+            }
+            
+            // Walk from the lowest priority up until the request fits
+            for (int s = RELAY_COUNT - 1; s >= 0 && load + req->power_w > POWER_BUDGET_W; s--) {
+                uint8_t j = priority_order[s];
+                if (!(frame & (1UL << j)) || m->relays[j].priority >= req->priority) continue;
+                frame &= ~(1UL << j);
+                *shed |= (1UL << j);
+                load -= m->relays[j].power_w;
+            }
+        }
+        load += req->power_w;
+#endif
+        frame |= (1UL << i);
+    }
+    
+    // A load shed early in the batch may have fitted again later
+    *shed &= ~frame;
+    return frame;
+}
+
+/**
+ * @brief Plan, write and journal a batch (lock held)
+ * 
+ * The part of frame_apply() that runs with interrupts off, kept apart from
+ * the logging around it so the IRAM profile can place it in IRAM.
+ * 
+ * @param all_or_nothing Write nothing if the budget refuses any ON change
+ * @param toggle Flip the relays in mask (values is ignored); read under the
+ *        lock, so a concurrent change cannot be flipped back
+ * @param cancelled Set to the relays whose pending pulse the batch overrides
+ */
+static esp_err_t RELAY_IRAM_ATTR frame_commit_locked(relay_model_t *m, uint32_t mask,
+                                                     uint32_t values, bool all_or_nothing,
+                                                     bool toggle, uint32_t *shed,
+                                                     uint32_t *rejected, uint32_t *cancelled,
+                                                     bool *rolled_back)
+{
+    uint32_t before = model_frame(m);
+    if (toggle) {
+        values = ~before & mask;
+    }
+    uint32_t frame = plan_frame(m, mask, values, shed, rejected);
+    *cancelled = 0;
+    *rolled_back = false;
+    if (all_or_nothing && *rejected) {
+        *shed = 0;
+        return ESP_ERR_NOT_ALLOWED;
+    }
+    esp_err_t ret = frame_write_locked(m, before, frame, rolled_back);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    // An explicit command always wins over a pending pulse
+    uint32_t affected = (mask & ~*rejected) | *shed;
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        if ((affected & (1UL << i)) && m->pulse_active[i]) {
+            m->pulse_active[i] = false;
+            *cancelled |= (1UL << i);
+        }
+    }
+    // Journal in the order the outputs switched
+    for (int k = 0; k < RELAY_COUNT * 2; k++) {
+        int i = frame_order(frame, before ^ frame, k);
+        if (i >= 0) {
+            set_state_locked(m, i, (frame & (1UL << i)) ? RELAY_ON : RELAY_OFF);
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Apply a batch to a model as one output frame
+ * 
+ * Planning, the output write and the model update all happen under the
+ * state lock, so a pulse expiry cannot slip in between. On an output
+ * failure the model, journal and pulses are left untouched.
+ * 
+ * @param all_or_nothing Apply nothing if the budget refuses any ON change
+ * @param toggle Flip the relays in mask instead of setting them to values
+ * @return ESP_OK, ESP_ERR_NOT_ALLOWED if the budget refused some ON
+ *         changes (the rest applied, or nothing with all_or_nothing), or
+ *         the output error (nothing applied)
+ */
+static esp_err_t frame_apply(relay_model_t *m, uint32_t mask, uint32_t values,
+                             bool all_or_nothing, bool toggle)
+{
+    uint32_t shed, rejected, cancelled;
+    bool rolled_back;
+    
+    taskENTER_CRITICAL(&state_lock);
+    esp_err_t ret = frame_commit_locked(m, mask, values, all_or_nothing, toggle, &shed,
+                                        &rejected, &cancelled, &rolled_back);
+    taskEXIT_CRITICAL(&state_lock);
+    
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_ALLOWED) {
+        log_output_failure(m, ret, rolled_back);
+        return ret;
+    }
+    
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        if (cancelled & (1UL << i)) {
+            esp_timer_stop(m->pulse_timers[i]);
+            ESP_LOGI(TAG, "%s pulse cancelled", m->relays[i].name);
+        }
+        if (shed & (1UL << i)) {
+            m->shed_count++;
+            ESP_LOGW(TAG, "%s shed (%u W freed)", m->relays[i].name, m->relays[i].power_w);
+        }
+        if (rejected & (1UL << i)) {
+            m->reject_count++;
+            ESP_LOGW(TAG, "%s rejected: %u W more exceeds budget %u W",
+                     m->relays[i].name, m->relays[i].power_w, (unsigned)POWER_BUDGET_W);
+        }
+    }
+    return rejected ? ESP_ERR_NOT_ALLOWED : ESP_OK;
+}
+
+/**
+ * @brief Sort relays by priority once at init (stable, highest first)
+ */
+static void init_priority_order(void)
+{
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        int j = i;
+        while (j > 0 && relay_config[priority_order[j - 1]].priority < relay_config[i].priority) {
+            priority_order[j] = priority_order[j - 1];
+            j--;
+        }
+        priority_order[j] = i;
+    }
+}
+
+/**
+ * @brief Create the one-shot pulse timers of a model
+ */
+static esp_err_t create_pulse_timers(relay_model_t *m, uintptr_t index_base)
+{
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = pulse_timer_callback,
+            .arg = (void *)(index_base + i),
+            .dispatch_method = PULSE_DISPATCH,
+            .name = m->drives_outputs ? "relay_pulse" : "shadow_pulse"
+        };
+        
+        esp_err_t ret = esp_timer_create(&timer_args, &m->pulse_timers[i]);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create pulse timer for %s: %s", 
+                     m->relays[i].name, esp_err_to_name(ret));
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
 /*============================================================================
  * Public Functions
  *============================================================================*/
@@ -110,6 +735,9 @@ esp_err_t relay_service_init(void)
 {
     ESP_LOGI(TAG, "Initializing relay service...");
     
+    memcpy(live.relays, relay_config, sizeof(relay_config));
+    memcpy(shadow.relays, relay_config, sizeof(relay_config));
+    
     // Initialize built-in LED for status indication
     init_led();
     
@@ -117,11 +745,15 @@ esp_err_t relay_service_init(void)
     // Open-drain: LOW = 0V (relay ON), HIGH = float (relay module's pull-up pulls to 5V = relay OFF)
     for (int i = 0; i < RELAY_COUNT; i++) {
         // First set GPIO HIGH (will float in open-drain) before configuring
-        gpio_set_level(relays[i].gpio_pin, 1);
+        gpio_set_level(live.relays[i].gpio_pin, 1);
         
         gpio_config_t io_conf = {
-            .pin_bit_mask = (1ULL << relays[i].gpio_pin),
+            .pin_bit_mask = (1ULL << live.relays[i].gpio_pin),
+#if RELAY_VERIFY_OUTPUTS
+            .mode = GPIO_MODE_INPUT_OUTPUT_OD,  // Open-drain, input kept on for read-back
+#else
             .mode = GPIO_MODE_OUTPUT_OD,  // Open-drain output for 5V compatibility
+#endif
             .pull_up_en = GPIO_PULLUP_DISABLE,  // Rely on relay module's pull-up
             .pull_down_en = GPIO_PULLDOWN_DISABLE,
             .intr_type = GPIO_INTR_DISABLE
@@ -130,32 +762,90 @@ esp_err_t relay_service_init(void)
         esp_err_t ret = gpio_config(&io_conf);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "Failed to configure GPIO %d: %s", 
-                     relays[i].gpio_pin, esp_err_to_name(ret));
+                     live.relays[i].gpio_pin, esp_err_to_name(ret));
             return ret;
         }
         
         // Ensure GPIO is HIGH (floating) - relay OFF
-        gpio_set_level(relays[i].gpio_pin, 1);
+        gpio_set_level(live.relays[i].gpio_pin, 1);
         
         ESP_LOGI(TAG, "Configured GPIO %d for %s (open-drain)", 
-                 relays[i].gpio_pin, relays[i].name);
+                 live.relays[i].gpio_pin, live.relays[i].name);
     }
     
-    // Load saved states from NVS if persistence is enabled
+    // Create one-shot timers for momentary pulses
+    esp_err_t ret = create_pulse_timers(&live, 0);
+    if (ret == ESP_OK) {
+        ret = create_pulse_timers(&shadow, RELAY_COUNT);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    init_priority_order();
+    
+    // Load saved states if persistence is enabled: a record flushed at a
+    // power failure or restart is newer than NVS
+    ret = ESP_FAIL;
 #if RELAY_PERSIST_STATE
-    esp_err_t ret = relay_load_states();
+    bool recovered = false;
+#if POWERFAIL_ENABLE
+    powerfail_record_t record;
+    if (powerfail_recover(&record)) {
+        for (int i = 0; i < RELAY_COUNT; i++) {
+            set_state(&live, i, (record.states & (1 << i)) ? RELAY_ON : RELAY_OFF);
+        }
+        ESP_LOGI(TAG, "States recovered from power-fail record: 0x%02X", (unsigned)record.states);
+        recovered = true;
+        ret = ESP_OK;
+    }
+#endif
+    if (ret != ESP_OK) {
+        ret = relay_load_states();
+    }
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "No saved states found, using defaults");
     }
 #endif
+    if (ret != ESP_OK) {
+        for (int i = 0; i < RELAY_COUNT; i++) {
+            set_state(&live, i, RELAY_DEFAULT_STATE);
+        }
+    }
+    
+#if POWER_BUDGET_W > 0
+    // A restored state may predate a smaller budget; drop lowest priority first
+    for (int k = RELAY_COUNT - 1; k >= 0 && live.load_w > POWER_BUDGET_W; k--) {
+        uint8_t i = priority_order[k];
+        if (live.relays[i].state != RELAY_ON) continue;
+        set_state(&live, i, RELAY_OFF);
+        live.shed_count++;
+        ESP_LOGW(TAG, "%s kept OFF at boot (power budget)", live.relays[i].name);
+    }
+#endif
     
     // Apply initial states to all relays
+    taskENTER_CRITICAL(&state_lock);
+    ret = output_write(&live, model_frame(&live), ALL_RELAYS_MASK, NULL);
+    taskEXIT_CRITICAL(&state_lock);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Relay outputs did not take the initial states: %s", esp_err_to_name(ret));
+    }
     for (int i = 0; i < RELAY_COUNT; i++) {
-        apply_gpio_state(i);
         ESP_LOGI(TAG, "%s initialized: %s", 
-                 relays[i].name, 
-                 relays[i].state == RELAY_ON ? "ON" : "OFF");
+                 live.relays[i].name, 
+                 live.relays[i].state == RELAY_ON ? "ON" : "OFF");
+    }
+    
+#if RELAY_PERSIST_STATE
+    // Bring NVS up to date with a recovered record; committing it also
+    // releases the record, and a failed commit keeps it for the next boot
+    if (recovered) {
+        save_states(&live);
     }
+#endif
+    
+    relay_shadow_reset();
     
     ESP_LOGI(TAG, "Relay service initialized successfully");
     return ESP_OK;
@@ -168,29 +858,34 @@ int relay_toggle(uint8_t relay_id)
         return -1;
     }
     
+    relay_model_t *m = current_model();
+    
     // Debounce check
-    if (!debounce_check(relay_id)) {
-        ESP_LOGW(TAG, "Toggle ignored (debounce): %s", relays[relay_id].name);
-        return relays[relay_id].state;
+    if (!debounce_check(m, relay_id)) {
+        ESP_LOGW(TAG, "Toggle ignored (debounce): %s", m->relays[relay_id].name);
+        return m->relays[relay_id].state;
     }
     
-    // Toggle state
-    relays[relay_id].state = (relays[relay_id].state == RELAY_ON) ? RELAY_OFF : RELAY_ON;
-    apply_gpio_state(relay_id);
+    // Flipped from the state read under the lock, not from a copy taken here
+    esp_err_t ret = frame_apply(m, 1UL << relay_id, 0, false, true);
+    if (ret != ESP_OK) {
+        return (ret == ESP_ERR_NOT_ALLOWED) ? -1 : -2;
+    }
+    m->commands++;
     
     // Blink LED to indicate change
-    blink_led();
+    blink_led(m);
     
-    ESP_LOGI(TAG, "%s toggled to %s", 
-             relays[relay_id].name,
-             relays[relay_id].state == RELAY_ON ? "ON" : "OFF");
+    ESP_LOGI(TAG, "%s%s toggled to %s", m->drives_outputs ? "" : "[shadow] ",
+             m->relays[relay_id].name,
+             m->relays[relay_id].state == RELAY_ON ? "ON" : "OFF");
     
     // Save state to NVS
 #if RELAY_PERSIST_STATE
-    relay_save_states();
+    save_states(m);
 #endif
     
-    return relays[relay_id].state;
+    return m->relays[relay_id].state;
 }
 
 esp_err_t relay_set_state(uint8_t relay_id, relay_state_t state)
@@ -200,18 +895,24 @@ esp_err_t relay_set_state(uint8_t relay_id, relay_state_t state)
         return ESP_ERR_INVALID_ARG;
     }
     
-    relays[relay_id].state = state;
-    apply_gpio_state(relay_id);
+    relay_model_t *m = current_model();
+    
+    esp_err_t ret = frame_apply(m, 1UL << relay_id,
+                                (state == RELAY_ON) ? (1UL << relay_id) : 0, false, false);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    m->commands++;
     
     // Blink LED to indicate change
-    blink_led();
+    blink_led(m);
     
-    ESP_LOGI(TAG, "%s set to %s", 
-             relays[relay_id].name,
+    ESP_LOGI(TAG, "%s%s set to %s", m->drives_outputs ? "" : "[shadow] ",
+             m->relays[relay_id].name,
              state == RELAY_ON ? "ON" : "OFF");
     
 #if RELAY_PERSIST_STATE
-    relay_save_states();
+    save_states(m);
 #endif
     
     return ESP_OK;
@@ -224,7 +925,7 @@ int relay_get_state(uint8_t relay_id)
         return -1;
     }
     
-    return relays[relay_id].state;
+    return current_model()->relays[relay_id].state;
 }
 
 const relay_info_t* relay_get_info(uint8_t relay_id)
@@ -232,7 +933,7 @@ const relay_info_t* relay_get_info(uint8_t relay_id)
     if (relay_id >= RELAY_COUNT) {
         return NULL;
     }
-    return &relays[relay_id];
+    return &current_model()->relays[relay_id];
 }
 
 uint8_t relay_get_count(void)
@@ -242,35 +943,7 @@ uint8_t relay_get_count(void)
 
 esp_err_t relay_save_states(void)
 {
-    nvs_handle_t nvs_handle;
-    esp_err_t ret;
-    
-    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    // Pack all states into a single byte (4 relays = 4 bits)
-    uint8_t packed_states = 0;
-    for (int i = 0; i < RELAY_COUNT; i++) {
-        if (relays[i].state == RELAY_ON) {
-            packed_states |= (1 << i);
-        }
-    }
-    
-    ret = nvs_set_u8(nvs_handle, NVS_KEY_RELAY_STATE, packed_states);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to save states: %s", esp_err_to_name(ret));
-        nvs_close(nvs_handle);
-        return ret;
-    }
-    
-    ret = nvs_commit(nvs_handle);
-    nvs_close(nvs_handle);
-    
-    ESP_LOGD(TAG, "States saved: 0x%02X", packed_states);
-    return ret;
+    return save_states(current_model());
 }
 
 esp_err_t relay_load_states(void)
@@ -295,8 +968,9 @@ esp_err_t relay_load_states(void)
     
     // Unpack states
     for (int i = 0; i < RELAY_COUNT; i++) {
-        relays[i].state = (packed_states & (1 << i)) ? RELAY_ON : RELAY_OFF;
+        set_state(&live, i, (packed_states & (1 << i)) ? RELAY_ON : RELAY_OFF);
     }
+    live.saved_states = packed_states;
     
     ESP_LOGI(TAG, "States loaded: 0x%02X", packed_states);
     return ESP_OK;
@@ -304,14 +978,17 @@ esp_err_t relay_load_states(void)
 
 esp_err_t relay_all_off(void)
 {
-    ESP_LOGI(TAG, "Turning all relays OFF");
-    for (int i = 0; i < RELAY_COUNT; i++) {
-        relays[i].state = RELAY_OFF;
-        apply_gpio_state(i);
+    relay_model_t *m = current_model();
+    
+    ESP_LOGI(TAG, "%sTurning all relays OFF", m->drives_outputs ? "" : "[shadow] ");
+    esp_err_t ret = frame_apply(m, ALL_RELAYS_MASK, 0, false, false);
+    if (ret != ESP_OK) {
+        return ret;
     }
+    m->commands++;
     
 #if RELAY_PERSIST_STATE
-    relay_save_states();
+    save_states(m);
 #endif
     
     return ESP_OK;
@@ -319,15 +996,374 @@ esp_err_t relay_all_off(void)
 
 esp_err_t relay_all_on(void)
 {
-    ESP_LOGI(TAG, "Turning all relays ON");
+    relay_model_t *m = current_model();
+    
+    ESP_LOGI(TAG, "%sTurning all relays ON", m->drives_outputs ? "" : "[shadow] ");
+    
+    // Highest priority first so the budget goes to the most important loads
+    esp_err_t ret = frame_apply(m, ALL_RELAYS_MASK, ALL_RELAYS_MASK, false, false);
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_ALLOWED) {
+        return ret;
+    }
+    m->commands++;
+    
+#if RELAY_PERSIST_STATE
+    save_states(m);
+#endif
+    
+    return ret;
+}
+
+/**
+ * @brief relay_set_mask(), relay_set_mask_atomic() and relay_toggle_mask()
+ */
+static esp_err_t set_mask(uint32_t mask, uint32_t values, bool persist, bool all_or_nothing,
+                          bool toggle)
+{
+    if (mask >> RELAY_COUNT) {
+        ESP_LOGE(TAG, "Invalid relay mask: 0x%02lX", (unsigned long)mask);
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    relay_model_t *m = current_model();
+    
+    // Switch OFF first to free budget, then ON in priority order
+    esp_err_t ret = frame_apply(m, mask, values, all_or_nothing, toggle);
+    if (ret != ESP_OK && (ret != ESP_ERR_NOT_ALLOWED || all_or_nothing)) {
+        return ret;
+    }
+    m->commands++;
+    
+    ESP_LOGD(TAG, "Mask applied: mask=0x%02lX %s=0x%02lX", (unsigned long)mask,
+             toggle ? "now" : "values",
+             (unsigned long)((toggle ? model_frame(m) : values) & mask));
+    
+#if RELAY_PERSIST_STATE
+    if (persist) {
+        save_states(m);
+    }
+#else
+    (void)persist;
+#endif
+    
+    return ret;
+}
+
+esp_err_t relay_set_mask(uint32_t mask, uint32_t values, bool persist)
+{
+    return set_mask(mask, values, persist, false, false);
+}
+
+esp_err_t relay_set_mask_atomic(uint32_t mask, uint32_t values, bool persist)
+{
+    return set_mask(mask, values, persist, true, false);
+}
+
+esp_err_t relay_toggle_mask(uint32_t mask, bool persist)
+{
+    return set_mask(mask, 0, persist, false, true);
+}
+
+void relay_txn_begin(relay_txn_t *txn)
+{
+    txn->mask = 0;
+    txn->values = 0;
+}
+
+esp_err_t relay_txn_stage(relay_txn_t *txn, uint8_t relay_id, relay_state_t state)
+{
+    if (relay_id >= RELAY_COUNT) {
+        ESP_LOGE(TAG, "Invalid relay ID: %d", relay_id);
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    txn->mask |= (1UL << relay_id);
+    if (state == RELAY_ON) {
+        txn->values |= (1UL << relay_id);
+    } else {
+        txn->values &= ~(1UL << relay_id);
+    }
+    return ESP_OK;
+}
+
+esp_err_t relay_txn_commit(relay_txn_t *txn, bool persist)
+{
+    uint32_t mask = txn->mask;
+    uint32_t values = txn->values;
+    
+    relay_txn_begin(txn);
+    return relay_set_mask_atomic(mask, values, persist);
+}
+
+void relay_get_output_stats(relay_output_stats_t *out)
+{
+    taskENTER_CRITICAL(&state_lock);
+    *out = output_stats;
+    taskEXIT_CRITICAL(&state_lock);
+}
+
+uint32_t relay_get_mask(void)
+{
+    const relay_model_t *m = current_model();
+    uint32_t mask = 0;
     for (int i = 0; i < RELAY_COUNT; i++) {
-        relays[i].state = RELAY_ON;
-        apply_gpio_state(i);
+        if (m->relays[i].state == RELAY_ON) {
+            mask |= (1UL << i);
+        }
+    }
+    return mask;
+}
+
+esp_err_t relay_pulse(uint8_t relay_id, uint32_t duration_ms)
+{
+    if (relay_id >= RELAY_COUNT) {
+        ESP_LOGE(TAG, "Invalid relay ID: %d", relay_id);
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (duration_ms < RELAY_PULSE_MIN_MS || duration_ms > RELAY_PULSE_MAX_MS) {
+        ESP_LOGE(TAG, "Invalid pulse duration: %lu ms", (unsigned long)duration_ms);
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    relay_model_t *m = current_model();
+    
+    if (m->pulse_timers[relay_id] == NULL || m->pulse_active[relay_id]) {
+        ESP_LOGW(TAG, "Pulse rejected (busy): %s", m->relays[relay_id].name);
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (!debounce_check(m, relay_id)) {
+        ESP_LOGW(TAG, "Pulse ignored (debounce): %s", m->relays[relay_id].name);
+        return ESP_ERR_INVALID_STATE;
     }
     
+    // Drop a stale expiry that may still be queued from an aborted pulse
+    esp_timer_stop(m->pulse_timers[relay_id]);
+    
+    relay_state_t prev_state = m->relays[relay_id].state;
+    int64_t start_us;
+    
+    esp_err_t ret = frame_apply(m, 1UL << relay_id, 1UL << relay_id, false, false);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    taskENTER_CRITICAL(&state_lock);
+    m->pulse_active[relay_id] = true;
+    start_us = esp_timer_get_time();
+    m->pulse_start_us[relay_id] = start_us;
+    m->pulse_deadline_us[relay_id] = start_us + (int64_t)duration_ms * 1000;
+    taskEXIT_CRITICAL(&state_lock);
+    
+    // Arm relative to the actual edge so the set-up time is not added
+    int64_t remaining_us = (int64_t)duration_ms * 1000 - (esp_timer_get_time() - start_us);
+    if (remaining_us < 0) {
+        remaining_us = 0;
+    }
+    
+    ret = esp_timer_start_once(m->pulse_timers[relay_id], (uint64_t)remaining_us);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to arm pulse timer: %s", esp_err_to_name(ret));
+        taskENTER_CRITICAL(&state_lock);
+        m->pulse_active[relay_id] = false;
+        taskEXIT_CRITICAL(&state_lock);
+        frame_apply(m, 1UL << relay_id, 0, false, false);
+        return ret;
+    }
+    m->commands++;
+    
+    ESP_LOGI(TAG, "%s%s pulse started (%lu ms)", m->drives_outputs ? "" : "[shadow] ",
+             m->relays[relay_id].name, (unsigned long)duration_ms);
+    
+    // Only touch flash when the saved state changes (relay was latched ON);
+    // the common OFF->pulse->OFF case needs no write at all
 #if RELAY_PERSIST_STATE
-    relay_save_states();
+    if (prev_state == RELAY_ON) {
+        save_states(m);
+    }
+#else
+    (void)prev_state;
 #endif
     
     return ESP_OK;
 }
+
+esp_err_t relay_pulse_cancel(uint8_t relay_id)
+{
+    if (relay_id >= RELAY_COUNT) {
+        ESP_LOGE(TAG, "Invalid relay ID: %d", relay_id);
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    relay_model_t *m = current_model();
+    
+    if (!m->pulse_active[relay_id]) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    // Cancels the pulse only once the output is OFF
+    esp_err_t ret = frame_apply(m, 1UL << relay_id, 0, false, false);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    m->commands++;
+    
+    return ESP_OK;
+}
+
+bool relay_is_pulsing(uint8_t relay_id)
+{
+    if (relay_id >= RELAY_COUNT) {
+        return false;
+    }
+    return current_model()->pulse_active[relay_id];
+}
+
+void relay_get_power(relay_power_t *out)
+{
+    const relay_model_t *m = current_model();
+    
+    taskENTER_CRITICAL(&state_lock);
+    out->used_w = m->load_w;
+    taskEXIT_CRITICAL(&state_lock);
+    
+    out->budget_w = POWER_BUDGET_W;
+    out->shed_count = m->shed_count;
+    out->reject_count = m->reject_count;
+}
+
+size_t relay_read_events(uint32_t *cursor, relay_event_t *out, size_t max, uint32_t *lost)
+{
+    const relay_model_t *m = current_model();
+    size_t count = 0;
+    uint32_t missed = 0;
+    
+    taskENTER_CRITICAL(&state_lock);
+    uint32_t oldest = (m->event_seq > RELAY_EVENT_LOG_SIZE) ? m->event_seq - RELAY_EVENT_LOG_SIZE : 0;
+    if (*cursor < oldest) {
+        missed = oldest - *cursor;
+        *cursor = oldest;
+    }
+    while (*cursor < m->event_seq && count < max) {
+        out[count++] = m->event_log[*cursor % RELAY_EVENT_LOG_SIZE];
+        (*cursor)++;
+    }
+    taskEXIT_CRITICAL(&state_lock);
+    
+    if (lost != NULL) {
+        *lost = missed;
+    }
+    return count;
+}
+
+uint32_t relay_get_version(void)
+{
+    const relay_model_t *m = current_model();
+    
+    taskENTER_CRITICAL(&state_lock);
+    uint32_t version = m->event_seq;
+    taskEXIT_CRITICAL(&state_lock);
+    
+    return version;
+}
+
+esp_err_t relay_shadow_begin(void)
+{
+    if (relay_shadow_active()) {
+        return ESP_OK;
+    }
+    
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    
+    taskENTER_CRITICAL(&state_lock);
+    for (int i = 0; i < SHADOW_MAX_SCOPES; i++) {
+        if (shadow_tasks[i] == NULL) {
+            shadow_tasks[i] = self;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&state_lock);
+    
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "No free shadow scope (SHADOW_MAX_SCOPES %d)", SHADOW_MAX_SCOPES);
+    }
+    return ret;
+}
+
+void relay_shadow_end(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    
+    taskENTER_CRITICAL(&state_lock);
+    for (int i = 0; i < SHADOW_MAX_SCOPES; i++) {
+        if (shadow_tasks[i] == self) {
+            shadow_tasks[i] = NULL;
+        }
+    }
+    taskEXIT_CRITICAL(&state_lock);
+}
+
+bool relay_shadow_active(void)
+{
+    return current_model() == &shadow;
+}
+
+void relay_shadow_set_enabled(bool enabled)
+{
+    if (enabled && !shadow_enabled) {
+        relay_shadow_reset();
+    }
+    shadow_enabled = enabled;
+    ESP_LOGW(TAG, "Shadow mode %s", enabled ? "ON: commands no longer drive outputs" : "OFF");
+}
+
+bool relay_shadow_enabled(void)
+{
+    return shadow_enabled;
+}
+
+void relay_shadow_reset(void)
+{
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        pulse_abort(&shadow, i);
+    }
+    
+    taskENTER_CRITICAL(&state_lock);
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        shadow.relays[i].state = live.relays[i].state;
+        shadow.last_toggle_time[i] = 0;
+    }
+    shadow.load_w = live.load_w;
+    shadow.saved_states = live.saved_states;
+    shadow.shed_count = 0;
+    shadow.reject_count = 0;
+    shadow.event_seq = 0;
+    shadow.commands = 0;
+    shadow.saves = 0;
+    taskEXIT_CRITICAL(&state_lock);
+}
+
+void relay_shadow_get_status(relay_shadow_status_t *out)
+{
+    out->enabled = shadow_enabled;
+    
+    taskENTER_CRITICAL(&state_lock);
+    out->commands = shadow.commands;
+    out->events = shadow.event_seq;
+    out->saves = shadow.saves;
+    out->mask = 0;
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        if (shadow.relays[i].state == RELAY_ON) {
+            out->mask |= (1UL << i);
+        }
+    }
+    out->power.used_w = shadow.load_w;
+    taskEXIT_CRITICAL(&state_lock);
+    
+    out->power.budget_w = POWER_BUDGET_W;
+    out->power.shed_count = shadow.shed_count;
+    out->power.reject_count = shadow.reject_count;
+}
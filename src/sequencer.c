@@ -0,0 +1,537 @@
+/**
+ * @file sequencer.c
+ * @brief On-device relay sequencer implementation
+ *
+ * All running slots share one one-shot esp_timer that is always armed for
+ * the earliest pending deadline. Deadlines are absolute (start time plus
+ * the sum of all waits), so long sequences do not accumulate drift. The
+ * timer callback only wakes the sequencer task, which takes the lock and
+ * runs the due steps, so the esp_timer task never blocks on a mutex or
+ * on flash. Relay states and stored programs are written to NVS outside
+ * the lock.
+ */
+
+#include "sequencer.h"
+#include "relay_service.h"
+#include "config.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+static const char *TAG = LOG_TAG_SEQ;
+
+// Longest single wait step; longer waits are split into several steps
+#define SEQ_WAIT_STEP_MAX_MS    0xFFFF
+
+// Sequencer task notification bits
+#define NOTIFY_DUE              (1UL << 0)  // A deadline passed
+#define NOTIFY_SAVE             (1UL << 1)  // A slot finished: persist the relays
+
+/**
+ * @brief Runtime state of one slot
+ */
+typedef struct {
+    seq_step_t steps[SEQ_MAX_STEPS];
+    uint8_t count;
+    uint8_t pc;
+    seq_state_t state;
+    uint16_t loop_left[SEQ_MAX_STEPS];  // Remaining passes + 1, 0 = not armed
+    uint32_t loops;
+    int64_t start_us;
+    int64_t stop_us;
+    int64_t deadline_us;
+    bool storing;                       // NVS write of a new program in progress
+} seq_slot_t;
+
+static seq_slot_t s_slots[SEQ_MAX_SLOTS];
+static esp_timer_handle_t s_timer = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_task = NULL;
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+/**
+ * @brief Build the NVS key for a slot
+ */
+static void slot_key(uint8_t slot, char *key, size_t len)
+{
+    snprintf(key, len, "%s%u", NVS_KEY_SEQ_PREFIX, slot);
+}
+
+/**
+ * @brief Parse "MASK=VAL" (hex) into two bytes
+ */
+static bool parse_mask_value(const char *p, uint8_t *mask, uint8_t *value)
+{
+    char *end;
+    unsigned long m = strtoul(p, &end, 16);
+    if (end == p || *end != '=') return false;
+    p = end + 1;
+    unsigned long v = strtoul(p, &end, 16);
+    if (end == p || (*end != '\0' && *end != ',')) return false;
+    if (m > 0xFF || (m >> RELAY_COUNT) || (v & ~m)) return false;
+    *mask = (uint8_t)m;
+    *value = (uint8_t)v;
+    return true;
+}
+
+/**
+ * @brief Parse the text format into steps
+ */
+static esp_err_t parse_program(const char *text, seq_step_t *steps, uint8_t *count)
+{
+    uint8_t n = 0;
+    const char *p = text;
+
+    while (*p != '\0') {
+        const char *arg = strchr(p, ':');
+        const char *next = strchr(p, ',');
+        if (next == NULL) next = p + strlen(p);
+        if (arg == NULL || arg > next) {
+            ESP_LOGE(TAG, "Parse error near '%.*s'", (int)(next - p), p);
+            return ESP_ERR_INVALID_ARG;
+        }
+        arg++;
+
+        size_t op_len = (size_t)(arg - p - 1);
+        char *end;
+        seq_step_t step = {0};
+
+        if ((op_len == 2 && strncmp(p, "on", 2) == 0) ||
+            (op_len == 3 && strncmp(p, "off", 3) == 0)) {
+            unsigned long id = strtoul(arg, &end, 10);
+            if (end == arg || end != next || id >= RELAY_COUNT) {
+                ESP_LOGE(TAG, "Invalid relay in '%.*s'", (int)(next - p), p);
+                return ESP_ERR_INVALID_ARG;
+            }
+            step.op = SEQ_OP_SET;
+            step.mask = (uint8_t)(1U << id);
+            step.arg = (op_len == 2) ? step.mask : 0;
+        } else if ((op_len == 3 && strncmp(p, "set", 3) == 0) ||
+                   (op_len == 5 && strncmp(p, "abort", 5) == 0)) {
+            uint8_t mask, value;
+            if (!parse_mask_value(arg, &mask, &value)) {
+                ESP_LOGE(TAG, "Invalid mask in '%.*s'", (int)(next - p), p);
+                return ESP_ERR_INVALID_ARG;
+            }
+            step.op = (op_len == 3) ? SEQ_OP_SET : SEQ_OP_ABORT_IF;
+            step.mask = mask;
+            step.arg = value;
+        } else if (op_len == 4 && strncmp(p, "wait", 4) == 0) {
+            unsigned long ms = strtoul(arg, &end, 10);
+            if (end == arg || end != next) {
+                ESP_LOGE(TAG, "Invalid wait in '%.*s'", (int)(next - p), p);
+                return ESP_ERR_INVALID_ARG;
+            }
+            // Split long waits so each step still fits in 16 bits
+            while (ms > SEQ_WAIT_STEP_MAX_MS) {
+                if (n >= SEQ_MAX_STEPS) return ESP_ERR_INVALID_SIZE;
+                steps[n].op = SEQ_OP_WAIT;
+                steps[n].mask = 0;
+                steps[n].arg = SEQ_WAIT_STEP_MAX_MS;
+                n++;
+                ms -= SEQ_WAIT_STEP_MAX_MS;
+            }
+            step.op = SEQ_OP_WAIT;
+            step.arg = (uint16_t)ms;
+        } else if (op_len == 4 && strncmp(p, "loop", 4) == 0) {
+            unsigned long target = strtoul(arg, &end, 10);
+            if (end == arg || *end != '*') {
+                ESP_LOGE(TAG, "Invalid loop in '%.*s'", (int)(next - p), p);
+                return ESP_ERR_INVALID_ARG;
+            }
+            const char *cnt = end + 1;
+            unsigned long passes = strtoul(cnt, &end, 10);
+            if (end == cnt || end != next || target >= n || passes > 0xFFFF) {
+                ESP_LOGE(TAG, "Invalid loop in '%.*s'", (int)(next - p), p);
+                return ESP_ERR_INVALID_ARG;
+            }
+            // A forever loop must wait somewhere or it would spin the timer task
+            bool has_wait = false;
+            for (unsigned long i = target; i < n; i++) {
+                if (steps[i].op == SEQ_OP_WAIT && steps[i].arg > 0) has_wait = true;
+            }
+            if (passes == 0 && !has_wait) {
+                ESP_LOGE(TAG, "Endless loop without wait");
+                return ESP_ERR_INVALID_ARG;
+            }
+            step.op = SEQ_OP_LOOP;
+            step.mask = (uint8_t)target;
+            step.arg = (uint16_t)passes;
+        } else {
+            ESP_LOGE(TAG, "Unknown step '%.*s'", (int)(next - p), p);
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        if (n >= SEQ_MAX_STEPS) {
+            ESP_LOGE(TAG, "Too many steps (max %d)", SEQ_MAX_STEPS);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        steps[n++] = step;
+
+        p = (*next == ',') ? next + 1 : next;
+    }
+
+    *count = n;
+    return ESP_OK;
+}
+
+/**
+ * @brief Arm the shared timer for the earliest deadline (lock held)
+ */
+static void rearm_timer(void)
+{
+    int64_t earliest = INT64_MAX;
+    for (int i = 0; i < SEQ_MAX_SLOTS; i++) {
+        if (s_slots[i].state == SEQ_STATE_RUNNING && s_slots[i].deadline_us < earliest) {
+            earliest = s_slots[i].deadline_us;
+        }
+    }
+
+    esp_timer_stop(s_timer);
+    if (earliest == INT64_MAX) return;
+
+    int64_t delay_us = earliest - esp_timer_get_time();
+    if (delay_us < 0) delay_us = 0;
+    esp_timer_start_once(s_timer, (uint64_t)delay_us);
+}
+
+/**
+ * @brief Stop a slot and record why (lock held)
+ */
+static void finish_slot(uint8_t slot, seq_state_t state)
+{
+    seq_slot_t *s = &s_slots[slot];
+    s->state = state;
+    s->stop_us = esp_timer_get_time();
+
+#if RELAY_PERSIST_STATE
+    // Steps are applied without flash writes; the task persists the end
+    // result once, after the lock is released
+    xTaskNotify(s_task, NOTIFY_SAVE, eSetBits);
+#endif
+
+    ESP_LOGI(TAG, "Sequence %u %s after %lu ms (step %u/%u)", slot,
+             sequencer_state_name(state),
+             (unsigned long)((s->stop_us - s->start_us) / 1000),
+             s->pc, s->count);
+}
+
+/**
+ * @brief Execute steps of a slot until the next wait or the end (lock held)
+ */
+static void run_slot(uint8_t slot)
+{
+    seq_slot_t *s = &s_slots[slot];
+
+    while (s->pc < s->count) {
+        const seq_step_t *step = &s->steps[s->pc];
+
+        switch (step->op) {
+            case SEQ_OP_SET: {
+                esp_err_t ret = relay_set_mask(step->mask, step->arg, false);
+                if (ret != ESP_OK) {
+                    // Later steps assume this one took effect
+                    ESP_LOGE(TAG, "Sequence %u: step %u refused: %s", slot, s->pc,
+                             esp_err_to_name(ret));
+                    finish_slot(slot, SEQ_STATE_FAILED);
+                    return;
+                }
+                s->pc++;
+                break;
+            }
+
+            case SEQ_OP_WAIT:
+                s->pc++;
+                s->deadline_us += (int64_t)step->arg * 1000;
+                if (step->arg > 0) return;
+                break;
+
+            case SEQ_OP_LOOP:
+                if (step->arg == 0) {
+                    s->pc = step->mask;
+                    s->loops++;
+                    break;
+                }
+                if (s->loop_left[s->pc] == 0) {
+                    s->loop_left[s->pc] = step->arg;
+                }
+                if (--s->loop_left[s->pc] > 0) {
+                    s->pc = step->mask;
+                    s->loops++;
+                } else {
+                    s->pc++;
+                }
+                break;
+
+            case SEQ_OP_ABORT_IF:
+                if ((relay_get_mask() & step->mask) == step->arg) {
+                    finish_slot(slot, SEQ_STATE_ABORTED);
+                    return;
+                }
+                s->pc++;
+                break;
+
+            default:
+                ESP_LOGE(TAG, "Sequence %u: bad opcode %u", slot, step->op);
+                finish_slot(slot, SEQ_STATE_ABORTED);
+                return;
+        }
+    }
+
+    finish_slot(slot, SEQ_STATE_DONE);
+}
+
+/**
+ * @brief Shared timer callback - wakes the sequencer task
+ */
+static void sequencer_timer_callback(void *arg)
+{
+    xTaskNotify(s_task, NOTIFY_DUE, eSetBits);
+}
+
+/**
+ * @brief Advance every slot that is due, persist finished runs
+ */
+static void sequencer_task(void *arg)
+{
+    for (;;) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+
+        if (bits & NOTIFY_DUE) {
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            int64_t now = esp_timer_get_time();
+            for (int i = 0; i < SEQ_MAX_SLOTS; i++) {
+                if (s_slots[i].state == SEQ_STATE_RUNNING && s_slots[i].deadline_us <= now) {
+                    run_slot(i);
+                }
+            }
+            rearm_timer();
+            xSemaphoreGive(s_lock);
+        }
+
+#if RELAY_PERSIST_STATE
+        // A slot that finished above notified this task again; the bit is
+        // picked up on the next pass without waiting
+        if (bits & NOTIFY_SAVE) {
+            relay_save_states();
+        }
+#endif
+    }
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t sequencer_init(void)
+{
+    ESP_LOGI(TAG, "Initializing sequencer...");
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = sequencer_timer_callback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sequencer"
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &s_timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    memset(s_slots, 0, sizeof(s_slots));
+
+    BaseType_t ok = xTaskCreate(sequencer_task, "sequencer", SEQ_TASK_STACK_SIZE,
+                                NULL, SEQ_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create sequencer task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    nvs_handle_t nvs_handle;
+    ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "No stored sequences: %s", esp_err_to_name(ret));
+        return ESP_OK;
+    }
+
+    for (uint8_t i = 0; i < SEQ_MAX_SLOTS; i++) {
+        char key[16];
+        slot_key(i, key, sizeof(key));
+
+        size_t len = sizeof(s_slots[i].steps);
+        if (nvs_get_blob(nvs_handle, key, s_slots[i].steps, &len) == ESP_OK &&
+            len % sizeof(seq_step_t) == 0) {
+            s_slots[i].count = len / sizeof(seq_step_t);
+            ESP_LOGI(TAG, "Sequence %u loaded (%u steps)", i, s_slots[i].count);
+        }
+    }
+    nvs_close(nvs_handle);
+
+    return ESP_OK;
+}
+
+esp_err_t sequencer_store(uint8_t slot, const char *text)
+{
+    if (slot >= SEQ_MAX_SLOTS || text == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    seq_step_t steps[SEQ_MAX_STEPS];
+    uint8_t count = 0;
+    esp_err_t ret = parse_program(text, steps, &count);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Reserve the slot; the flash write runs without the lock so timer
+    // steps of other slots are not held up behind it
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_slots[slot].state == SEQ_STATE_RUNNING || s_slots[slot].storing) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_slots[slot].storing = true;
+    xSemaphoreGive(s_lock);
+
+    nvs_handle_t nvs_handle;
+    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret == ESP_OK) {
+        char key[16];
+        slot_key(slot, key, sizeof(key));
+        if (count == 0) {
+            ret = nvs_erase_key(nvs_handle, key);
+            if (ret == ESP_ERR_NVS_NOT_FOUND) ret = ESP_OK;
+        } else {
+            ret = nvs_set_blob(nvs_handle, key, steps, count * sizeof(seq_step_t));
+        }
+        if (ret == ESP_OK) {
+            ret = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (ret == ESP_OK) {
+        memset(&s_slots[slot], 0, sizeof(s_slots[slot]));
+        memcpy(s_slots[slot].steps, steps, count * sizeof(seq_step_t));
+        s_slots[slot].count = count;
+        ESP_LOGI(TAG, "Sequence %u stored (%u steps, %u bytes)",
+                 slot, count, (unsigned)(count * sizeof(seq_step_t)));
+    } else {
+        s_slots[slot].storing = false;
+        ESP_LOGE(TAG, "Failed to save sequence %u: %s", slot, esp_err_to_name(ret));
+    }
+    xSemaphoreGive(s_lock);
+
+    return ret;
+}
+
+esp_err_t sequencer_start(uint8_t slot)
+{
+    if (slot >= SEQ_MAX_SLOTS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    seq_slot_t *s = &s_slots[slot];
+    if (s->count == 0) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (s->state == SEQ_STATE_RUNNING || s->storing) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(s->loop_left, 0, sizeof(s->loop_left));
+    s->pc = 0;
+    s->loops = 0;
+    s->state = SEQ_STATE_RUNNING;
+    s->start_us = esp_timer_get_time();
+    s->deadline_us = s->start_us;
+
+    ESP_LOGI(TAG, "Sequence %u started (%u steps)", slot, s->count);
+
+    // Leading steps run right away; the timer takes over at the first wait
+    run_slot(slot);
+    rearm_timer();
+
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+esp_err_t sequencer_cancel(uint8_t slot)
+{
+    if (slot >= SEQ_MAX_SLOTS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    if (s_slots[slot].state != SEQ_STATE_RUNNING) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    finish_slot(slot, SEQ_STATE_CANCELLED);
+    rearm_timer();
+
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+esp_err_t sequencer_get_progress(uint8_t slot, seq_progress_t *out)
+{
+    if (slot >= SEQ_MAX_SLOTS || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    const seq_slot_t *s = &s_slots[slot];
+    out->state = s->state;
+    out->step = s->pc;
+    out->step_count = s->count;
+    out->loops = s->loops;
+
+    if (s->state == SEQ_STATE_IDLE) {
+        out->elapsed_ms = 0;
+    } else {
+        int64_t end = (s->state == SEQ_STATE_RUNNING) ? esp_timer_get_time() : s->stop_us;
+        out->elapsed_ms = (uint32_t)((end - s->start_us) / 1000);
+    }
+
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+const char* sequencer_state_name(seq_state_t state)
+{
+    switch (state) {
+        case SEQ_STATE_IDLE:      return "idle";
+        case SEQ_STATE_RUNNING:   return "running";
+        case SEQ_STATE_DONE:      return "done";
+        case SEQ_STATE_CANCELLED: return "cancelled";
+        case SEQ_STATE_ABORTED:   return "aborted";
+        case SEQ_STATE_FAILED:    return "failed";
+        default:                  return "unknown";
+    }
+}
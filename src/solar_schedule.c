@@ -0,0 +1,396 @@
+/**
+ * @file solar_schedule.c
+ * @brief Sunrise/sunset relay scheduling implementation
+ *
+ * The wall clock comes from SNTP. Once per local day the sun times are
+ * computed with the NOAA solar calculator series; the rule check then only compares
+ * integer minutes. A rule fires when its trigger minute is crossed between
+ * two checks, so nothing is replayed after a reboot.
+ */
+
+#include "solar_schedule.h"
+#include "relay_service.h"
+#include "config.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <math.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = LOG_TAG_SOLAR;
+
+#define MINUTES_PER_DAY     1440
+#define DEG_TO_RAD          (M_PI / 180.0)
+#define MIN_VALID_YEAR      2024        // Clock not yet synchronised before this
+#define JD_J2000            2451545.0   // Julian day of 2000-01-01 12:00 UTC
+#define SUN_EVENT_PASSES    3           // Refinements of each event time
+
+static solar_rule_t s_rules[SOLAR_MAX_RULES];
+static solar_status_t s_status;
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_task = NULL;
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+/**
+ * @brief Local time offset from UTC in minutes for a given instant
+ */
+static int utc_offset_minutes(time_t now)
+{
+    struct tm lt, gt;
+    localtime_r(&now, &lt);
+    gmtime_r(&now, &gt);
+
+    int diff = (lt.tm_hour - gt.tm_hour) * 60 + (lt.tm_min - gt.tm_min);
+    if (lt.tm_year != gt.tm_year) {
+        diff += (lt.tm_year > gt.tm_year) ? MINUTES_PER_DAY : -MINUTES_PER_DAY;
+    } else if (lt.tm_yday != gt.tm_yday) {
+        diff += (lt.tm_yday - gt.tm_yday) * MINUTES_PER_DAY;
+    }
+    return diff;
+}
+
+/**
+ * @brief Parse rule text into rules
+ */
+static esp_err_t parse_rules(const char *text, solar_rule_t *rules, uint8_t *count)
+{
+    uint8_t n = 0;
+    const char *p = text;
+
+    while (*p != '\0') {
+        solar_rule_t rule = {0};
+        char *end;
+
+        if (strncmp(p, "sunrise", 7) == 0) {
+            rule.event = SOLAR_EVENT_SUNRISE;
+            p += 7;
+        } else if (strncmp(p, "sunset", 6) == 0) {
+            rule.event = SOLAR_EVENT_SUNSET;
+            p += 6;
+        } else {
+            ESP_LOGE(TAG, "Expected sunrise/sunset near '%s'", p);
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        if (*p == '+' || *p == '-') {
+            long offset = strtol(p, &end, 10);
+            if (end == p + 1 || offset < -720 || offset > 720) {
+                ESP_LOGE(TAG, "Invalid offset near '%s'", p);
+                return ESP_ERR_INVALID_ARG;
+            }
+            rule.offset_min = (int16_t)offset;
+            p = end;
+        }
+
+        bool on;
+        if (strncmp(p, ":on:", 4) == 0) {
+            on = true;
+            p += 4;
+        } else if (strncmp(p, ":off:", 5) == 0) {
+            on = false;
+            p += 5;
+        } else {
+            ESP_LOGE(TAG, "Expected :on:/:off: near '%s'", p);
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        unsigned long id = strtoul(p, &end, 10);
+        if (end == p || id >= RELAY_COUNT || (*end != ',' && *end != '\0')) {
+            ESP_LOGE(TAG, "Invalid relay near '%s'", p);
+            return ESP_ERR_INVALID_ARG;
+        }
+        rule.mask = (uint8_t)(1U << id);
+        rule.values = on ? rule.mask : 0;
+
+        if (n >= SOLAR_MAX_RULES) {
+            ESP_LOGE(TAG, "Too many rules (max %d)", SOLAR_MAX_RULES);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        rules[n++] = rule;
+
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    *count = n;
+    return ESP_OK;
+}
+
+/**
+ * @brief Recompute today's sun times (lock held)
+ */
+static void update_day_table(const struct tm *lt, time_t now)
+{
+    s_status.year = lt->tm_year + 1900;
+    s_status.yday = lt->tm_yday;
+    solar_compute_day(lt->tm_yday, s_status.year, SOLAR_LATITUDE, SOLAR_LONGITUDE,
+                      utc_offset_minutes(now), &s_status.today);
+
+    ESP_LOGI(TAG, "Sun times for %04d day %d: sunrise %02d:%02d, sunset %02d:%02d",
+             s_status.year, s_status.yday + 1,
+             s_status.today.sunrise_min / 60, s_status.today.sunrise_min % 60,
+             s_status.today.sunset_min / 60, s_status.today.sunset_min % 60);
+}
+
+/**
+ * @brief UTC minute of sunrise or sunset on the day starting at Julian day jd0
+ *
+ * Sun declination and equation of time come from the Julian-century
+ * series of the NOAA solar calculator. They are evaluated at the event
+ * itself, refined from solar noon, because near the polar circles a day's
+ * drift in declination moves the events by many minutes.
+ *
+ * @return false if the sun does not cross the horizon (polar day/night)
+ */
+static bool sun_event_utc(double jd0, double lat, double lon, bool rising, double *utc_min)
+{
+    double t = 720.0 - 4.0 * lon;
+    for (int pass = 0; pass < SUN_EVENT_PASSES; pass++) {
+        double jc = (jd0 + t / MINUTES_PER_DAY - JD_J2000) / 36525.0;
+
+        double l0 = fmod(280.46646 + jc * (36000.76983 + jc * 0.0003032), 360.0);
+        double m = (357.52911 + jc * (35999.05029 - 0.0001537 * jc)) * DEG_TO_RAD;
+        double e = 0.016708634 - jc * (0.000042037 + 0.0000001267 * jc);
+        double c = sin(m) * (1.914602 - jc * (0.004817 + 0.000014 * jc))
+                   + sin(2 * m) * (0.019993 - 0.000101 * jc) + sin(3 * m) * 0.000289;
+        double omega = (125.04 - 1934.136 * jc) * DEG_TO_RAD;
+        double app_long = (l0 + c - 0.00569 - 0.00478 * sin(omega)) * DEG_TO_RAD;
+        double obliq = (23.0 + (26.0 + (21.448 - jc * (46.815 + jc * (0.00059 - jc * 0.001813)))
+                        / 60.0) / 60.0 + 0.00256 * cos(omega)) * DEG_TO_RAD;
+
+        // Declination (radians) and equation of time (minutes)
+        double decl = asin(sin(obliq) * sin(app_long));
+        double y = tan(obliq / 2) * tan(obliq / 2);
+        double l0_r = l0 * DEG_TO_RAD;
+        double eqtime = 4.0 / DEG_TO_RAD *
+                        (y * sin(2 * l0_r) - 2 * e * sin(m) + 4 * e * y * sin(m) * cos(2 * l0_r)
+                         - 0.5 * y * y * sin(4 * l0_r) - 1.25 * e * e * sin(2 * m));
+
+        // Hour angle for the sun's upper limb at the horizon (refraction included)
+        double lat_r = lat * DEG_TO_RAD;
+        double cos_ha = cos(90.833 * DEG_TO_RAD) / (cos(lat_r) * cos(decl))
+                        - tan(lat_r) * tan(decl);
+        if (cos_ha > 1.0 || cos_ha < -1.0) {
+            return false;
+        }
+        double ha = acos(cos_ha) / DEG_TO_RAD;
+        t = 720.0 - 4.0 * (rising ? lon + ha : lon - ha) - eqtime;
+    }
+    *utc_min = t;
+    return true;
+}
+
+/**
+ * @brief Fire every rule whose trigger minute lies in (last_min, now_min] (lock held)
+ */
+static void check_rules(int last_min, int now_min)
+{
+    for (int i = 0; i < s_status.rule_count; i++) {
+        const solar_rule_t *rule = &s_rules[i];
+        int base = (rule->event == SOLAR_EVENT_SUNRISE) ?
+                   s_status.today.sunrise_min : s_status.today.sunset_min;
+        if (base < 0) continue;     // No such event today (polar day/night)
+
+        int trigger = base + rule->offset_min;
+        if (trigger < 0) trigger = 0;
+        if (trigger >= MINUTES_PER_DAY) trigger = MINUTES_PER_DAY - 1;
+
+        if (last_min < trigger && trigger <= now_min) {
+            ESP_LOGI(TAG, "Rule %d fired at %02d:%02d (%s%+d)", i,
+                     now_min / 60, now_min % 60,
+                     rule->event == SOLAR_EVENT_SUNRISE ? "sunrise" : "sunset",
+                     rule->offset_min);
+            esp_err_t ret = relay_set_mask(rule->mask, rule->values, true);
+            if (ret != ESP_OK) {
+                ESP_LOGW(TAG, "Rule %d refused: %s", i, esp_err_to_name(ret));
+                s_status.failed++;
+            }
+            s_status.fired++;
+        }
+    }
+}
+
+/**
+ * @brief Schedule task - minute-resolution rule check
+ */
+static void solar_task(void *arg)
+{
+    int last_min = -1;
+    bool first = true;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(SOLAR_CHECK_PERIOD_MS));
+
+        time_t now = time(NULL);
+        struct tm lt;
+        localtime_r(&now, &lt);
+        if (lt.tm_year + 1900 < MIN_VALID_YEAR) continue;
+
+        int now_min = lt.tm_hour * 60 + lt.tm_min;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+
+        if (!s_status.time_valid) {
+            ESP_LOGI(TAG, "Clock synchronised");
+            s_status.time_valid = true;
+        }
+
+        if (lt.tm_yday != s_status.yday || lt.tm_year + 1900 != s_status.year) {
+            update_day_table(&lt, now);
+            // A new day starts from midnight; on boot do not replay the past
+            last_min = first ? now_min : -1;
+        }
+        first = false;
+
+        if (now_min != last_min) {
+            check_rules(last_min, now_min);
+            last_min = now_min;
+        }
+
+        xSemaphoreGive(s_lock);
+    }
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+void solar_compute_day(int yday, int year, double lat, double lon,
+                       int utc_offset_min, solar_day_t *out)
+{
+    // Julian day at 00:00 UTC of the date (proleptic Gregorian calendar)
+    int y = year - 1;
+    double jd0 = 1721425.5 + 365.0 * y + y / 4 - y / 100 + y / 400 + yday;
+
+    double rise_utc, set_utc;
+    if (!sun_event_utc(jd0, lat, lon, true, &rise_utc) ||
+        !sun_event_utc(jd0, lat, lon, false, &set_utc)) {
+        out->sunrise_min = -1;
+        out->sunset_min = -1;
+        return;
+    }
+
+    int rise = (int)lround(rise_utc) + utc_offset_min;
+    int set = (int)lround(set_utc) + utc_offset_min;
+
+    out->sunrise_min = (int16_t)(((rise % MINUTES_PER_DAY) + MINUTES_PER_DAY) % MINUTES_PER_DAY);
+    out->sunset_min = (int16_t)(((set % MINUTES_PER_DAY) + MINUTES_PER_DAY) % MINUTES_PER_DAY);
+}
+
+esp_err_t solar_schedule_init(void)
+{
+    ESP_LOGI(TAG, "Initializing solar schedule (%.4f, %.4f)...",
+             SOLAR_LATITUDE, SOLAR_LONGITUDE);
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(&s_status, 0, sizeof(s_status));
+    s_status.yday = -1;
+    s_status.today.sunrise_min = -1;
+    s_status.today.sunset_min = -1;
+
+    setenv("TZ", SOLAR_TIMEZONE, 1);
+    tzset();
+
+    // Requires esp_netif (started by the WiFi service)
+    esp_sntp_config_t sntp_config = ESP_NETIF_SNTP_DEFAULT_CONFIG(SOLAR_SNTP_SERVER);
+    esp_err_t ret = esp_netif_sntp_init(&sntp_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start SNTP: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        size_t len = sizeof(s_rules);
+        if (nvs_get_blob(nvs_handle, NVS_KEY_SOLAR_RULES, s_rules, &len) == ESP_OK &&
+            len % sizeof(solar_rule_t) == 0) {
+            s_status.rule_count = len / sizeof(solar_rule_t);
+            ESP_LOGI(TAG, "%u rules loaded", s_status.rule_count);
+        }
+        nvs_close(nvs_handle);
+    }
+
+    BaseType_t ok = xTaskCreate(solar_task, "solar", SOLAR_TASK_STACK_SIZE,
+                                NULL, SOLAR_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create schedule task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t solar_schedule_set_rules(const char *text)
+{
+    if (text == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    solar_rule_t rules[SOLAR_MAX_RULES];
+    uint8_t count = 0;
+    esp_err_t ret = parse_rules(text, rules, &count);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    nvs_handle_t nvs_handle;
+    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    if (count == 0) {
+        ret = nvs_erase_key(nvs_handle, NVS_KEY_SOLAR_RULES);
+        if (ret == ESP_ERR_NVS_NOT_FOUND) ret = ESP_OK;
+    } else {
+        ret = nvs_set_blob(nvs_handle, NVS_KEY_SOLAR_RULES, rules, count * sizeof(solar_rule_t));
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save rules: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    memcpy(s_rules, rules, count * sizeof(solar_rule_t));
+    s_status.rule_count = count;
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "%u rules stored", count);
+    return ESP_OK;
+}
+
+void solar_schedule_get_status(solar_status_t *out)
+{
+    if (s_lock == NULL) {
+        memset(out, 0, sizeof(*out));
+        out->yday = -1;
+        out->today.sunrise_min = -1;
+        out->today.sunset_min = -1;
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_status;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,492 @@
+/**
+ * @file telemetry.c
+ * @brief Periodic telemetry push implementation
+ *
+ * A lowest-priority task takes a sample every TELEMETRY_SAMPLE_S and
+ * encodes it straight into a fixed RAM ring, so buffered telemetry costs
+ * 48 bytes per sample whatever happens to the network. Every
+ * TELEMETRY_PUSH_S the buffered samples are POSTed in batches of up to
+ * TELEMETRY_BATCH_MAX. A failed POST leaves the samples in the ring and
+ * backs off exponentially; when the ring is full the oldest sample is
+ * dropped and counted.
+ *
+ * Batch body (application/octet-stream, all fields little-endian):
+ *   Header, 24 bytes:
+ *     0  "RTM1"            4  version (1)      5  record length (48)
+ *     6  u16 record count  8  u32 node id      12 u32 first sample number
+ *     16 u32 samples dropped since boot         20 u16 sample interval (s)
+ *     22 u16 reserved
+ *   Record, 48 bytes:
+ *     0  u32 uptime (s)    4  u32 free heap    8  u32 minimum free heap
+ *     12 i8 RSSI (dBm)     13 u8 relay mask    14 u8 flags (see FLAG_*)
+ *     15 u8 WiFi disconnects
+ *     16 u16 power used (W)                     18 i16 temperature (0.01 C,
+ *                                                  -32768 without a reading)
+ *     20 u16 relay changes 22 u16 loads shed   24 u16 commands rejected
+ *     26 u16 Modbus requests                    28 u16 Modbus exceptions
+ *     30 u16 webhook events dropped
+ *     32 u16[8] Modbus service time histogram (see MODBUS_HIST_BUCKETS)
+ *   Counters from byte 15 on are deltas since the previous sample and
+ *   saturate rather than wrap. Sample numbers are consecutive, so a gap
+ *   between batches means samples were dropped.
+ */
+
+#include "telemetry.h"
+#include "relay_service.h"
+#include "wifi_service.h"
+#include "thermostat.h"
+#include "failover.h"
+#include "modbus_server.h"
+#include "webhook.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_http_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = LOG_TAG_TELEMETRY;
+
+#define TM_VERSION          1
+#define HEADER_LEN          24
+#define RECORD_LEN          48
+#define BODY_MAX            (HEADER_LEN + TELEMETRY_BATCH_MAX * RECORD_LEN)
+#define TEMP_NONE           (-32768)
+
+// Record flags
+#define FLAG_WIFI           0x01        // Station connected
+#define FLAG_ACTIVE         0x02        // Active board of a failover pair
+#define FLAG_THERMO         0x04        // Thermostat enabled
+#define FLAG_FAILSAFE       0x08        // Thermostat in sensor failsafe
+
+/**
+ * @brief Counter values at the previous sample
+ */
+typedef struct {
+    uint32_t relay_cursor;
+    uint32_t shed;
+    uint32_t rejected;
+    uint32_t disconnects;
+    uint32_t mb_requests;
+    uint32_t mb_exceptions;
+    uint32_t mb_hist[MODBUS_HIST_BUCKETS];
+    uint32_t wh_dropped;
+} tm_counters_t;
+
+static TaskHandle_t s_task = NULL;
+static SemaphoreHandle_t s_lock = NULL;     // Status and URL
+static telemetry_status_t s_status;
+static uint32_t s_node_id = 0;
+static tm_counters_t s_prev;
+
+// Ring of encoded samples; only the telemetry task touches it
+static uint8_t s_ring[TELEMETRY_BUFFER_SAMPLES][RECORD_LEN];
+static uint16_t s_head = 0;                 // Oldest buffered sample
+static uint32_t s_head_seq = 0;             // Sample number of s_head
+
+static uint8_t s_body[BODY_MAX];
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/**
+ * @brief Saturating 16-bit delta; a counter that went backwards was reset
+ */
+static uint16_t delta16(uint32_t now, uint32_t *prev)
+{
+    uint32_t d = (now >= *prev) ? now - *prev : now;
+    *prev = now;
+    return d > 0xFFFF ? 0xFFFF : (uint16_t)d;
+}
+
+static esp_err_t check_url(const char *url)
+{
+    if (strlen(url) >= TELEMETRY_URL_MAX_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (url[0] != '\0' && strncmp(url, "http://", 7) != 0 && strncmp(url, "https://", 8) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strpbrk(url, "\" \r\n") != NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+static void load_url(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+
+    char url[TELEMETRY_URL_MAX_LEN];
+    size_t len = sizeof(url);
+    if (nvs_get_str(nvs_handle, NVS_KEY_TELEMETRY, url, &len) == ESP_OK &&
+        check_url(url) == ESP_OK) {
+        strcpy(s_status.url, url);
+        ESP_LOGI(TAG, "Collector: %s", url);
+    }
+    nvs_close(nvs_handle);
+}
+
+/**
+ * @brief Count relay changes since the last sample from the journal
+ */
+static uint32_t count_relay_changes(void)
+{
+    relay_event_t events[8];
+    uint32_t lost;
+    uint32_t total = 0;
+    size_t n;
+
+    while ((n = relay_read_events(&s_prev.relay_cursor, events, 8, &lost)) > 0 || lost > 0) {
+        total += n + lost;
+        if (n == 0) break;
+    }
+    return total;
+}
+
+/**
+ * @brief Gather one sample and encode it into a record
+ */
+static void encode_sample(uint8_t *rec)
+{
+    wifi_stats_t wifi;
+    relay_power_t power;
+    thermo_status_t thermo;
+    modbus_stats_t mb;
+    webhook_status_t wh;
+
+    wifi_get_stats(&wifi);
+    relay_get_power(&power);
+    thermostat_get_status(&thermo);
+    modbus_server_get_stats(&mb);
+    webhook_get_status(&wh);
+
+    uint8_t flags = 0;
+    if (wifi.connected) flags |= FLAG_WIFI;
+    if (failover_is_active()) flags |= FLAG_ACTIVE;
+    if (thermo.enabled) flags |= FLAG_THERMO;
+    if (thermo.failsafe) flags |= FLAG_FAILSAFE;
+
+    int16_t temp = TEMP_NONE;
+    if (thermo.sensor_ok && thermo.iterations > 0) {
+        temp = (int16_t)(thermo.temp_c * 100.0f);
+    }
+
+    uint32_t wh_dropped = 0;
+    for (int i = 0; i < wh.target_count; i++) {
+        wh_dropped += wh.targets[i].dropped;
+    }
+
+    uint16_t disconnect_delta = delta16(wifi.disconnects, &s_prev.disconnects);
+
+    put_u32(rec + 0, (uint32_t)(esp_timer_get_time() / 1000000));
+    put_u32(rec + 4, esp_get_free_heap_size());
+    put_u32(rec + 8, esp_get_minimum_free_heap_size());
+    rec[12] = (uint8_t)wifi.rssi;
+    rec[13] = (uint8_t)relay_get_mask();
+    rec[14] = flags;
+    rec[15] = disconnect_delta > 0xFF ? 0xFF : (uint8_t)disconnect_delta;
+    put_u16(rec + 16, power.used_w > 0xFFFF ? 0xFFFF : (uint16_t)power.used_w);
+    put_u16(rec + 18, (uint16_t)temp);
+    uint32_t changes = count_relay_changes();
+    put_u16(rec + 20, changes > 0xFFFF ? 0xFFFF : (uint16_t)changes);
+    put_u16(rec + 22, delta16(power.shed_count, &s_prev.shed));
+    put_u16(rec + 24, delta16(power.reject_count, &s_prev.rejected));
+    put_u16(rec + 26, delta16(mb.requests, &s_prev.mb_requests));
+    put_u16(rec + 28, delta16(mb.exceptions, &s_prev.mb_exceptions));
+    put_u16(rec + 30, delta16(wh_dropped, &s_prev.wh_dropped));
+    for (int i = 0; i < MODBUS_HIST_BUCKETS; i++) {
+        put_u16(rec + 32 + i * 2, delta16(mb.service_hist[i], &s_prev.mb_hist[i]));
+    }
+}
+
+/**
+ * @brief Take a sample into the ring, dropping the oldest when full
+ */
+static void take_sample(void)
+{
+    int64_t t0 = esp_timer_get_time();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint16_t count = s_status.buffered;
+    if (count == TELEMETRY_BUFFER_SAMPLES) {
+        s_head = (s_head + 1) % TELEMETRY_BUFFER_SAMPLES;
+        s_head_seq++;
+        count--;
+        s_status.dropped++;
+    }
+    xSemaphoreGive(s_lock);
+
+    encode_sample(s_ring[(s_head + count) % TELEMETRY_BUFFER_SAMPLES]);
+
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - t0);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_status.buffered = count + 1;
+    s_status.samples++;
+    s_status.sample_us = elapsed;
+    if (elapsed > s_status.max_sample_us) {
+        s_status.max_sample_us = elapsed;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+/**
+ * @brief Copy the oldest buffered samples into s_body
+ *
+ * @return Number of samples in the batch
+ */
+static uint16_t build_batch(uint16_t buffered, uint32_t dropped, size_t *len)
+{
+    uint16_t count = buffered;
+    if (count > TELEMETRY_BATCH_MAX) count = TELEMETRY_BATCH_MAX;
+
+    memcpy(s_body, "RTM1", 4);
+    s_body[4] = TM_VERSION;
+    s_body[5] = RECORD_LEN;
+    put_u16(s_body + 6, count);
+    put_u32(s_body + 8, s_node_id);
+    put_u32(s_body + 12, s_head_seq);
+    put_u32(s_body + 16, dropped);
+    put_u16(s_body + 20, TELEMETRY_SAMPLE_S);
+    put_u16(s_body + 22, 0);
+
+    for (uint16_t i = 0; i < count; i++) {
+        memcpy(s_body + HEADER_LEN + i * RECORD_LEN,
+               s_ring[(s_head + i) % TELEMETRY_BUFFER_SAMPLES], RECORD_LEN);
+    }
+
+    *len = HEADER_LEN + (size_t)count * RECORD_LEN;
+    return count;
+}
+
+/**
+ * @brief POST a binary body; returns the HTTP status or -1 on transport error
+ */
+static int post_binary(const char *url, const uint8_t *body, size_t len)
+{
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_POST,
+        .timeout_ms = TELEMETRY_TIMEOUT_MS,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return -1;
+    }
+
+    esp_http_client_set_header(client, "Content-Type", "application/octet-stream");
+    esp_http_client_set_post_field(client, (const char *)body, (int)len);
+
+    int status = -1;
+    if (esp_http_client_perform(client) == ESP_OK) {
+        status = esp_http_client_get_status_code(client);
+    }
+    esp_http_client_cleanup(client);
+    return status;
+}
+
+/**
+ * @brief Upload buffered samples until the ring is empty or a POST fails
+ *
+ * @return true if everything was delivered
+ */
+static bool push_samples(void)
+{
+    char url[TELEMETRY_URL_MAX_LEN];
+
+    while (1) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        uint16_t buffered = s_status.buffered;
+        uint32_t dropped = s_status.dropped;
+        strcpy(url, s_status.url);
+        xSemaphoreGive(s_lock);
+
+        if (buffered == 0 || url[0] == '\0') {
+            return true;
+        }
+
+        size_t len;
+        uint16_t count = build_batch(buffered, dropped, &len);
+        int status = post_binary(url, s_body, len);
+        bool ok = status >= 200 && status < 300;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_status.last_status = status;
+        if (ok) {
+            s_head = (s_head + count) % TELEMETRY_BUFFER_SAMPLES;
+            s_head_seq += count;
+            s_status.buffered -= count;
+            s_status.sent += count;
+            s_status.batches++;
+            s_status.bytes_sent += len;
+        } else {
+            s_status.failures++;
+        }
+        xSemaphoreGive(s_lock);
+
+        if (!ok) {
+            ESP_LOGD(TAG, "%s: status %d, %u sample(s) buffered", url, status, buffered);
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Sampling and upload task
+ */
+static void telemetry_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    int64_t next_push_us = esp_timer_get_time() + (int64_t)TELEMETRY_PUSH_S * 1000000;
+    uint8_t failures = 0;
+
+    while (1) {
+        // Fixed cadence even when a POST takes a while
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(TELEMETRY_SAMPLE_S * 1000));
+
+        take_sample();
+
+        int64_t now_us = esp_timer_get_time();
+        if (now_us < next_push_us) {
+            continue;
+        }
+
+        if (push_samples()) {
+            failures = 0;
+            next_push_us = now_us + (int64_t)TELEMETRY_PUSH_S * 1000000;
+        } else {
+            // Exponential backoff with up to 25% jitter; checked once per sample
+            if (failures < 16) failures++;
+            uint32_t delay_s = TELEMETRY_RETRY_BASE_S << (failures - 1);
+            if (delay_s > TELEMETRY_RETRY_MAX_S) delay_s = TELEMETRY_RETRY_MAX_S;
+            delay_s += esp_random() % (delay_s / 4 + 1);
+            next_push_us = now_us + (int64_t)delay_s * 1000000;
+        }
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_status.retry_in_s = failures > 0 ? (uint32_t)((next_push_us - now_us) / 1000000) : 0;
+        xSemaphoreGive(s_lock);
+    }
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t telemetry_init(void)
+{
+    if (s_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    s_node_id = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) |
+                ((uint32_t)mac[4] << 8) | mac[5];
+
+    s_status.last_status = 0;
+    load_url();
+
+    // Start counter deltas from the current values
+    wifi_stats_t wifi;
+    relay_power_t power;
+    modbus_stats_t mb;
+    wifi_get_stats(&wifi);
+    relay_get_power(&power);
+    modbus_server_get_stats(&mb);
+    s_prev.disconnects = wifi.disconnects;
+    s_prev.shed = power.shed_count;
+    s_prev.rejected = power.reject_count;
+    s_prev.mb_requests = mb.requests;
+    s_prev.mb_exceptions = mb.exceptions;
+    memcpy(s_prev.mb_hist, mb.service_hist, sizeof(s_prev.mb_hist));
+    count_relay_changes();
+
+    BaseType_t ok = xTaskCreate(telemetry_task, "telemetry", TELEMETRY_TASK_STACK_SIZE,
+                                NULL, TELEMETRY_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create telemetry task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Sampling every %ds, %d sample buffer (%d bytes)",
+             TELEMETRY_SAMPLE_S, TELEMETRY_BUFFER_SAMPLES,
+             TELEMETRY_BUFFER_SAMPLES * RECORD_LEN);
+    return ESP_OK;
+}
+
+esp_err_t telemetry_set_url(const char *url)
+{
+    if (s_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = check_url(url);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    strcpy(s_status.url, url);
+    xSemaphoreGive(s_lock);
+
+    nvs_handle_t nvs_handle;
+    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_str(nvs_handle, NVS_KEY_TELEMETRY, url);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save collector: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Collector set to \"%s\"", url);
+    return ESP_OK;
+}
+
+void telemetry_get_status(telemetry_status_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (s_lock == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_status;
+    xSemaphoreGive(s_lock);
+}
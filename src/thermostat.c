@@ -0,0 +1,432 @@
+/**
+ * @file thermostat.c
+ * @brief Closed-loop thermostat implementation
+ *
+ * A dedicated task wakes every THERMO_PERIOD_MS with vTaskDelayUntil(),
+ * reads the sensor and decides the fan stages. All state is static; the
+ * loop allocates nothing. Relays are only written when the decision
+ * changes, so a manual override holds until the next transition. Stages
+ * switch on from the bottom and off from the top, so stage 2 never runs
+ * without stage 1.
+ */
+
+#include "thermostat.h"
+#include "relay_service.h"
+#include "config.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <math.h>
+#include <string.h>
+#if THERMO_SENSOR == THERMO_SENSOR_NTC
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#endif
+
+static const char *TAG = LOG_TAG_THERMO;
+
+#define THERMO_STAGES       2
+#define THERMO_PERIOD_US    ((int64_t)THERMO_PERIOD_MS * 1000)
+
+#define NTC_SUPPLY_MV       3300        // Divider supply (ratiometric)
+#define NTC_SAMPLES         4           // ADC reads averaged per sample
+
+/**
+ * @brief Persisted settings (NVS blob)
+ */
+typedef struct __attribute__((packed)) {
+    int16_t setpoint_centi;
+    uint8_t enabled;
+} thermo_settings_t;
+
+static const uint8_t stage_relay[THERMO_STAGES] = {
+    THERMO_STAGE1_RELAY, THERMO_STAGE2_RELAY
+};
+
+static thermo_sensor_t s_sensor;
+static TaskHandle_t s_task = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+
+// Settings (written by API, read by the task)
+static volatile bool s_enabled = THERMO_DEFAULT_ENABLED;
+static volatile float s_setpoint_c = THERMO_DEFAULT_SETPOINT;
+
+// Control state (owned by the task, read by the API under s_lock)
+static thermo_status_t s_status;
+static bool s_stage_on[THERMO_STAGES];
+static int64_t s_stage_changed_us[THERMO_STAGES];
+static uint32_t s_consecutive_errors = 0;
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+/**
+ * @brief Save setpoint and enable flag to NVS
+ */
+static esp_err_t save_settings(void)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    thermo_settings_t settings = {
+        .setpoint_centi = (int16_t)(s_setpoint_c * 100.0f),
+        .enabled = s_enabled ? 1 : 0
+    };
+    ret = nvs_set_blob(nvs_handle, NVS_KEY_THERMO, &settings, sizeof(settings));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save settings: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/**
+ * @brief Load setpoint and enable flag from NVS
+ */
+static void load_settings(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+
+    thermo_settings_t settings;
+    size_t len = sizeof(settings);
+    if (nvs_get_blob(nvs_handle, NVS_KEY_THERMO, &settings, &len) == ESP_OK &&
+        len == sizeof(settings)) {
+        s_setpoint_c = settings.setpoint_centi / 100.0f;
+        s_enabled = settings.enabled != 0;
+        ESP_LOGI(TAG, "Settings loaded: setpoint=%.2f enabled=%d",
+                 s_setpoint_c, s_enabled);
+    }
+    nvs_close(nvs_handle);
+}
+
+/**
+ * @brief Whether stage i has been held long enough to switch
+ */
+static bool stage_may_switch(int i, int64_t now_us, bool force)
+{
+    if (force) return true;
+    int64_t held_us = now_us - s_stage_changed_us[i];
+    int64_t min_us = (int64_t)(s_stage_on[i] ? THERMO_MIN_ON_S : THERMO_MIN_OFF_S) * 1000000;
+    return held_us >= min_us;
+}
+
+/**
+ * @brief Drive the fan relays to the requested number of stages
+ *
+ * Stage 1 only goes OFF once stage 2 is off, and stage 2 only comes ON
+ * once stage 1 runs (in the same pass when forced). The change is written
+ * as one all-or-nothing relay frame; if the relay service refuses it,
+ * nothing is committed and the next pass tries again.
+ *
+ * @param force Ignore minimum run/rest times (disable and fail-safe)
+ */
+static void apply_stages(uint8_t stages, int64_t now_us, bool force)
+{
+    bool next[THERMO_STAGES];
+    uint32_t mask = 0;
+    uint32_t values = 0;
+
+    memcpy(next, s_stage_on, sizeof(next));
+    for (int i = THERMO_STAGES - 1; i >= 0; i--) {
+        if (i < stages || !next[i] || !stage_may_switch(i, now_us, force)) continue;
+        bool upper_on = (i + 1 < THERMO_STAGES) && (force ? next[i + 1] : s_stage_on[i + 1]);
+        if (upper_on) continue;
+        next[i] = false;
+    }
+    for (int i = 0; i < THERMO_STAGES; i++) {
+        if (i >= stages || next[i] || !stage_may_switch(i, now_us, force)) continue;
+        bool lower_on = (i == 0) || (force ? next[i - 1] : s_stage_on[i - 1]);
+        if (!lower_on) continue;
+        next[i] = true;
+    }
+
+    for (int i = 0; i < THERMO_STAGES; i++) {
+        if (next[i] == s_stage_on[i]) continue;
+        mask |= 1UL << stage_relay[i];
+        if (next[i]) values |= 1UL << stage_relay[i];
+    }
+    if (mask == 0) return;
+
+    esp_err_t ret = relay_set_mask_atomic(mask, values, true);
+    if (ret != ESP_OK) {
+        s_status.relay_errors++;
+        ESP_LOGW(TAG, "Stage change refused: %s", esp_err_to_name(ret));
+        return;
+    }
+
+    uint8_t on = 0;
+    for (int i = 0; i < THERMO_STAGES; i++) {
+        if (next[i] != s_stage_on[i]) {
+            s_stage_on[i] = next[i];
+            s_stage_changed_us[i] = now_us;
+            if (next[i]) s_status.switch_count[i]++;
+        }
+        if (s_stage_on[i]) on++;
+    }
+    ESP_LOGI(TAG, "Stages: %u (T=%.2f, SP=%.2f)", on, s_status.temp_c, s_setpoint_c);
+}
+
+/**
+ * @brief One control loop pass
+ */
+static void control_step(int64_t now_us)
+{
+    uint8_t stages = 0;
+    for (int i = 0; i < THERMO_STAGES; i++) {
+        if (s_stage_on[i]) stages = i + 1;
+    }
+
+    if (!s_enabled) {
+        if (stages > 0) {
+            apply_stages(0, now_us, true);
+        }
+        return;
+    }
+
+    float temp_c;
+    if (s_sensor.read(s_sensor.ctx, &temp_c) != ESP_OK) {
+        s_status.sensor_errors++;
+        s_consecutive_errors++;
+        if (s_consecutive_errors >= THERMO_SENSOR_MAX_FAILS && !s_status.failsafe) {
+            ESP_LOGE(TAG, "Sensor '%s' failed %lu times, entering fail-safe",
+                     s_sensor.name, (unsigned long)s_consecutive_errors);
+            s_status.failsafe = true;
+            apply_stages(THERMO_FAILSAFE_ON ? THERMO_STAGES : 0, now_us, true);
+        }
+        return;
+    }
+
+    if (s_status.failsafe) {
+        ESP_LOGI(TAG, "Sensor recovered, leaving fail-safe");
+        s_status.failsafe = false;
+    }
+    s_consecutive_errors = 0;
+    s_status.temp_c = temp_c;
+
+    // Per-stage hysteresis band around setpoint + offset
+    uint8_t want = 0;
+    float setpoint = s_setpoint_c;
+    for (int i = 0; i < THERMO_STAGES; i++) {
+        float center = setpoint + (i == 0 ? 0.0f : THERMO_STAGE2_OFFSET_C);
+        bool on = s_stage_on[i];
+        if (!on && temp_c >= center + THERMO_HYSTERESIS_C) on = true;
+        if (on && temp_c <= center - THERMO_HYSTERESIS_C) on = false;
+        if (on) want = i + 1;
+    }
+
+    apply_stages(want, now_us, false);
+}
+
+/**
+ * @brief Fixed-rate control task
+ */
+static void thermostat_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    int64_t last_us = esp_timer_get_time();
+
+    while (1) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(THERMO_PERIOD_MS));
+
+        int64_t now_us = esp_timer_get_time();
+        int64_t jitter_us = (now_us - last_us) - THERMO_PERIOD_US;
+        if (jitter_us < 0) jitter_us = -jitter_us;
+        last_us = now_us;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        control_step(now_us);
+        s_status.iterations++;
+        if ((uint32_t)jitter_us > s_status.max_jitter_us) {
+            s_status.max_jitter_us = (uint32_t)jitter_us;
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+#if THERMO_SENSOR == THERMO_SENSOR_NTC
+static adc_oneshot_unit_handle_t s_adc = NULL;
+static adc_cali_handle_t s_adc_cali = NULL;
+
+/**
+ * @brief NTC divider read: averaged ADC millivolts to degrees C (Beta model)
+ */
+static esp_err_t ntc_read(void *ctx, float *temp_c)
+{
+    int sum_mv = 0;
+    for (int i = 0; i < NTC_SAMPLES; i++) {
+        int raw, mv;
+        esp_err_t ret = adc_oneshot_read(s_adc, THERMO_NTC_ADC_CHANNEL, &raw);
+        if (ret == ESP_OK) {
+            ret = adc_cali_raw_to_voltage(s_adc_cali, raw, &mv);
+        }
+        if (ret != ESP_OK) return ret;
+        sum_mv += mv;
+    }
+    int mv = sum_mv / NTC_SAMPLES;
+
+    // Open or shorted thermistor
+    if (mv < 50 || mv > NTC_SUPPLY_MV - 50) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    float r_ohm = THERMO_NTC_SERIES_OHM * mv / (float)(NTC_SUPPLY_MV - mv);
+    float inv_t = 1.0f / 298.15f + logf(r_ohm / THERMO_NTC_R25_OHM) / THERMO_NTC_BETA;
+    *temp_c = 1.0f / inv_t - 273.15f;
+    return ESP_OK;
+}
+
+static const thermo_sensor_t s_ntc_sensor = {
+    .name = "ntc",
+    .read = ntc_read,
+    .ctx = NULL
+};
+
+/**
+ * @brief Set up the ADC1 channel and its calibration
+ */
+static esp_err_t ntc_init(void)
+{
+    adc_oneshot_unit_init_cfg_t unit_cfg = { .unit_id = ADC_UNIT_1 };
+    esp_err_t ret = adc_oneshot_new_unit(&unit_cfg, &s_adc);
+    if (ret != ESP_OK) return ret;
+
+    adc_oneshot_chan_cfg_t chan_cfg = {
+        .atten = ADC_ATTEN_DB_12,
+        .bitwidth = ADC_BITWIDTH_DEFAULT
+    };
+    ret = adc_oneshot_config_channel(s_adc, THERMO_NTC_ADC_CHANNEL, &chan_cfg);
+    if (ret != ESP_OK) return ret;
+
+    adc_cali_line_fitting_config_t cali_cfg = {
+        .unit_id = ADC_UNIT_1,
+        .atten = ADC_ATTEN_DB_12,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+        .default_vref = 1100        // Used when eFuse holds no Vref
+    };
+    return adc_cali_create_scheme_line_fitting(&cali_cfg, &s_adc_cali);
+}
+#endif
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t thermostat_init(const thermo_sensor_t *sensor)
+{
+    if (sensor == NULL || sensor->read == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ESP_LOGI(TAG, "Initializing thermostat (sensor: %s)...", sensor->name);
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_sensor = *sensor;
+    memset(&s_status, 0, sizeof(s_status));
+    memset(s_stage_on, 0, sizeof(s_stage_on));
+    load_settings();
+
+    // Allow the first switch right away
+    int64_t now_us = esp_timer_get_time();
+    for (int i = 0; i < THERMO_STAGES; i++) {
+        s_stage_changed_us[i] = now_us - (int64_t)THERMO_MIN_OFF_S * 1000000;
+    }
+
+    BaseType_t ok = xTaskCreate(thermostat_task, "thermostat", THERMO_TASK_STACK_SIZE,
+                                NULL, THERMO_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create thermostat task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Thermostat %s, setpoint %.2f C",
+             s_enabled ? "enabled" : "disabled", s_setpoint_c);
+    return ESP_OK;
+}
+
+esp_err_t thermostat_set_enabled(bool enabled)
+{
+    if (s_task == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_enabled = enabled;
+    ESP_LOGI(TAG, "Thermostat %s", enabled ? "enabled" : "disabled");
+    return save_settings();
+}
+
+esp_err_t thermostat_set_setpoint(float setpoint_c)
+{
+    if (s_task == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!isfinite(setpoint_c) || setpoint_c < 0.0f || setpoint_c > 60.0f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_setpoint_c = setpoint_c;
+    ESP_LOGI(TAG, "Setpoint: %.2f C", setpoint_c);
+    return save_settings();
+}
+
+void thermostat_get_status(thermo_status_t *out)
+{
+    if (s_task == NULL) {
+        memset(out, 0, sizeof(*out));
+        out->setpoint_c = s_setpoint_c;
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_status;
+    out->sensor = s_sensor.name;
+    out->sensor_ok = (s_consecutive_errors == 0);
+    out->stages_on = 0;
+    for (int i = 0; i < THERMO_STAGES; i++) {
+        if (s_stage_on[i]) out->stages_on++;
+    }
+    xSemaphoreGive(s_lock);
+
+    out->enabled = s_enabled;
+    out->setpoint_c = s_setpoint_c;
+}
+
+const thermo_sensor_t* thermostat_board_sensor(void)
+{
+#if THERMO_SENSOR == THERMO_SENSOR_NTC
+    static bool s_ntc_ready = false;
+    if (!s_ntc_ready) {
+        esp_err_t ret = ntc_init();
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "NTC sensor on ADC1 channel %d unavailable: %s",
+                     THERMO_NTC_ADC_CHANNEL, esp_err_to_name(ret));
+            return NULL;
+        }
+        s_ntc_ready = true;
+    }
+    return &s_ntc_sensor;
+#else
+    return NULL;
+#endif
+}
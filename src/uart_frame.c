@@ -0,0 +1,148 @@
+/**
+ * @file uart_frame.c
+ * @brief COBS framing with a CRC-16 for the wired UART link
+ *
+ * The CRC uses a 16-entry nibble table: 32 bytes of flash instead of the
+ * usual 512, at two lookups per byte, which is plenty for frames of a few
+ * dozen bytes.
+ */
+
+#include "uart_frame.h"
+#include <string.h>
+
+static const uint16_t CRC16_NIBBLE[16] = {
+    0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+    0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+/**
+ * @brief Decode a COBS block in place
+ *
+ * @return Decoded length, or -1 if a code byte points past the end
+ */
+static int cobs_decode(uint8_t *buf, size_t len)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < len) {
+        uint8_t code = buf[in++];
+        if (code == 0 || in + code - 1 > len) {
+            return -1;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            buf[out++] = buf[in++];
+        }
+        // A short block stands for a zero, unless it ends the frame
+        if (code < 0xFF && in < len) {
+            buf[out++] = 0;
+        }
+    }
+    return (int)out;
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+uint16_t uart_frame_crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ CRC16_NIBBLE[crc & 0x0F];
+        crc = (crc >> 4) ^ CRC16_NIBBLE[crc & 0x0F];
+    }
+    return crc;
+}
+
+size_t uart_frame_encode(const uint8_t *payload, size_t len, uint8_t *out)
+{
+    if (len > UART_FRAME_PAYLOAD_MAX) {
+        return 0;
+    }
+
+    uint8_t raw[UART_FRAME_PAYLOAD_MAX + 2];
+    uint16_t crc = uart_frame_crc16(payload, len);
+    memcpy(raw, payload, len);
+    raw[len] = (uint8_t)(crc & 0xFF);
+    raw[len + 1] = (uint8_t)(crc >> 8);
+    len += 2;
+
+    // Each block is a code byte (distance to the next zero) and its data
+    size_t code_at = 0;
+    size_t n = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (raw[i] == 0) {
+            out[code_at] = (uint8_t)(n - code_at);
+            code_at = n++;
+        } else {
+            out[n++] = raw[i];
+        }
+    }
+    out[code_at] = (uint8_t)(n - code_at);
+    out[n++] = 0;
+    return n;
+}
+
+void uart_frame_decoder_init(uart_frame_decoder_t *d)
+{
+    d->len = 0;
+    d->discard = false;
+}
+
+void uart_frame_abort(uart_frame_decoder_t *d)
+{
+    d->len = 0;
+    d->discard = true;
+}
+
+int uart_frame_feed(uart_frame_decoder_t *d, const uint8_t *data, size_t len,
+                    size_t *consumed, const uint8_t **payload)
+{
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+
+        if (byte != 0) {
+            if (d->len < sizeof(d->buf)) {
+                d->buf[d->len++] = byte;
+            } else {
+                d->discard = true;      // Too long: drop it at the delimiter
+            }
+            continue;
+        }
+
+        // Delimiter: the frame is complete
+        *consumed = i + 1;
+        size_t frame_len = d->len;
+        bool discard = d->discard;
+        d->len = 0;
+        d->discard = false;
+
+        if (discard) {
+            return UART_FRAME_ERR_FRAMING;
+        }
+        if (frame_len == 0) {
+            continue;
+        }
+
+        int n = cobs_decode(d->buf, frame_len);
+        if (n < 3) {
+            return UART_FRAME_ERR_FRAMING;
+        }
+        n -= 2;
+        uint16_t crc = (uint16_t)(d->buf[n] | (d->buf[n + 1] << 8));
+        if (crc != uart_frame_crc16(d->buf, n)) {
+            return UART_FRAME_ERR_CRC;
+        }
+        *payload = d->buf;
+        return n;
+    }
+
+    *consumed = len;
+    return UART_FRAME_MORE;
+}
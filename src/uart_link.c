@@ -0,0 +1,372 @@
+/**
+ * @file uart_link.c
+ * @brief Wired UART control link implementation
+ *
+ * The UART driver's interrupt moves received bytes into its ring buffer
+ * and posts an event to a queue; the link task blocks on that queue and
+ * never polls. The RX timeout is cut to UART_LINK_RX_TIMEOUT_CHARS so the
+ * event for a frame's last byte comes almost at once. Frames are decoded,
+ * executed and answered on this task, one at a time, from fixed buffers.
+ */
+
+#include "uart_link.h"
+#include "uart_frame.h"
+#include "relay_service.h"
+#include "config.h"
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+#if RELAY_IRAM_PROFILE
+#if !CONFIG_UART_ISR_IN_IRAM
+#error "RELAY_IRAM_PROFILE needs CONFIG_UART_ISR_IN_IRAM (sdkconfig.iram.defaults)"
+#endif
+// The driver's interrupt keeps filling the ring buffer while flash is written
+#define UART_LINK_INTR_FLAGS    ESP_INTR_FLAG_IRAM
+#else
+#define UART_LINK_INTR_FLAGS    0
+#endif
+
+static const char *TAG = LOG_TAG_UART_LINK;
+
+static QueueHandle_t s_queue = NULL;
+static TaskHandle_t s_task = NULL;
+static uart_frame_decoder_t s_decoder;
+static uart_link_stats_t s_stats;
+
+// Last switching request and its reply, for retries
+static uint8_t s_last_req[UART_FRAME_PAYLOAD_MAX];
+static int s_last_req_len;
+static uint8_t s_last_reply[UART_FRAME_PAYLOAD_MAX];
+static int s_last_reply_len;
+static int64_t s_last_us;
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/**
+ * @brief Result code for a relay_set_mask() error
+ */
+static uint8_t result_of(esp_err_t err)
+{
+    switch (err) {
+        case ESP_OK:                return UART_LINK_OK;
+        case ESP_ERR_INVALID_ARG:   return UART_LINK_BAD_RELAY;
+        case ESP_ERR_NOT_ALLOWED:   return UART_LINK_BUDGET;
+        default:                    return UART_LINK_OUTPUT_FAULT;
+    }
+}
+
+static void record_edge(int64_t rx_us)
+{
+    uint32_t edge_us = (uint32_t)(esp_timer_get_time() - rx_us);
+    s_stats.edges++;
+    s_stats.total_edge_us += edge_us;
+    if (edge_us > s_stats.max_edge_us) {
+        s_stats.max_edge_us = edge_us;
+    }
+    int bucket = 0;
+    while (bucket < UART_LINK_HIST_BUCKETS - 1 && edge_us >= (32u << bucket)) {
+        bucket++;
+    }
+    s_stats.edge_hist[bucket]++;
+}
+
+/**
+ * @brief Execute one request
+ *
+ * @param changed Set if relays were switched (and need saving)
+ * @return Reply payload length
+ */
+static int handle_request(const uint8_t *req, int len, uint8_t *reply, int64_t rx_us, bool *changed)
+{
+    uint8_t cmd = req[1];
+    uint8_t result = UART_LINK_OK;
+    uint32_t mask = 0;
+    uint32_t values = 0;
+    bool toggle = false;
+    int extra = 0;
+
+    *changed = false;
+
+    switch (cmd) {
+        case UART_LINK_CMD_SET:
+            if (len != 4 || req[3] > 1) {
+                result = UART_LINK_BAD_REQUEST;
+            } else if (req[2] >= RELAY_COUNT) {
+                result = UART_LINK_BAD_RELAY;
+            } else {
+                mask = 1UL << req[2];
+                values = req[3] ? mask : 0;
+            }
+            break;
+
+        case UART_LINK_CMD_TOGGLE:
+            if (len != 3) {
+                result = UART_LINK_BAD_REQUEST;
+            } else if (req[2] >= RELAY_COUNT) {
+                result = UART_LINK_BAD_RELAY;
+            } else {
+                mask = 1UL << req[2];
+                toggle = true;          // Flipped under the relay service lock
+            }
+            break;
+
+        case UART_LINK_CMD_MASK:
+            if (len != 10) {
+                result = UART_LINK_BAD_REQUEST;
+            } else {
+                mask = get_u32(req + 2);
+                values = get_u32(req + 6);
+            }
+            break;
+
+        case UART_LINK_CMD_STATUS:
+            if (len != 2) {
+                result = UART_LINK_BAD_REQUEST;
+                break;
+            }
+            reply[7] = RELAY_COUNT;
+            put_u32(reply + 8, relay_get_version());
+            put_u32(reply + 12, s_stats.requests);
+            put_u32(reply + 16, s_stats.crc_errors + s_stats.framing_errors + s_stats.overruns);
+            put_u32(reply + 20, s_stats.max_edge_us);
+            extra = 17;
+            break;
+
+        default:
+            result = UART_LINK_BAD_REQUEST;
+            break;
+    }
+
+    // One relay_set_mask() or relay_toggle_mask() for every switching
+    // command: one output frame, no blink, no debounce; NVS is saved once
+    // the reply is out
+    if (result == UART_LINK_OK && mask != 0) {
+        esp_err_t err = toggle ? relay_toggle_mask(mask, false)
+                               : relay_set_mask(mask, values, false);
+        result = result_of(err);
+        if (err == ESP_OK || err == ESP_ERR_NOT_ALLOWED) {
+            record_edge(rx_us);
+            *changed = true;
+        }
+    }
+
+    reply[0] = req[0];
+    reply[1] = cmd | UART_LINK_REPLY;
+    reply[2] = result;
+    put_u32(reply + 3, relay_get_mask());
+    s_stats.requests++;
+    return 7 + extra;
+}
+
+static void send_reply(const uint8_t *reply, int len)
+{
+    uint8_t wire[UART_FRAME_WIRE_MAX];
+    size_t n = uart_frame_encode(reply, len, wire);
+    uart_write_bytes(UART_LINK_PORT, wire, n);
+}
+
+/**
+ * @brief Answer one decoded request
+ */
+static void process_frame(const uint8_t *req, int len, int64_t rx_us)
+{
+    uint8_t reply[UART_FRAME_PAYLOAD_MAX];
+    bool changed = false;
+
+    if (len < 2) {
+        s_stats.framing_errors++;
+        return;
+    }
+
+    // A retry of the last switching request gets the same reply
+    if (len == s_last_req_len && memcmp(req, s_last_req, len) == 0 &&
+        rx_us - s_last_us < (int64_t)UART_LINK_RETRY_WINDOW_MS * 1000) {
+        s_stats.retries++;
+        send_reply(s_last_reply, s_last_reply_len);
+        return;
+    }
+
+    // The link has no per-request tag; only the global switch applies and
+    // a command that cannot get a shadow scope is refused, not run live
+    bool shadow = relay_shadow_enabled();
+    int reply_len;
+    if (!shadow) {
+        reply_len = handle_request(req, len, reply, rx_us, &changed);
+    } else if (relay_shadow_begin() == ESP_OK) {
+        reply_len = handle_request(req, len, reply, rx_us, &changed);
+    } else {
+        reply[0] = req[0];
+        reply[1] = req[1] | UART_LINK_REPLY;
+        reply[2] = UART_LINK_BUSY;
+        put_u32(reply + 3, relay_get_mask());
+        reply_len = 7;
+        shadow = false;
+    }
+
+    send_reply(reply, reply_len);
+
+#if RELAY_PERSIST_STATE
+    if (changed) {
+        relay_save_states();
+    }
+#endif
+    if (shadow) {
+        relay_shadow_end();
+    }
+
+    if (req[1] == UART_LINK_CMD_STATUS) {
+        s_last_req_len = 0;
+    } else {
+        memcpy(s_last_req, req, len);
+        s_last_req_len = len;
+        memcpy(s_last_reply, reply, reply_len);
+        s_last_reply_len = reply_len;
+        s_last_us = rx_us;
+    }
+}
+
+/**
+ * @brief Read what the driver has buffered and answer every complete frame
+ */
+static void read_frames(size_t available, int64_t rx_us)
+{
+    uint8_t rx[64];
+
+    while (available > 0) {
+        int n = uart_read_bytes(UART_LINK_PORT, rx, available < sizeof(rx) ? available : sizeof(rx), 0);
+        if (n <= 0) {
+            return;
+        }
+        available -= n;
+
+        size_t off = 0;
+        while (off < (size_t)n) {
+            size_t used;
+            const uint8_t *payload;
+            int len = uart_frame_feed(&s_decoder, rx + off, n - off, &used, &payload);
+            off += used;
+
+            if (len > 0) {
+                process_frame(payload, len, rx_us);
+            } else if (len == UART_FRAME_ERR_CRC) {
+                s_stats.crc_errors++;
+            } else if (len == UART_FRAME_ERR_FRAMING) {
+                s_stats.framing_errors++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Link task: sleeps on the driver's event queue
+ */
+static void uart_link_task(void *arg)
+{
+    uart_event_t event;
+
+    ESP_LOGI(TAG, "Wired link on UART%d (TX %d, RX %d, %d baud)",
+             UART_LINK_PORT, UART_LINK_TX_GPIO, UART_LINK_RX_GPIO, UART_LINK_BAUD);
+
+    while (1) {
+        if (xQueueReceive(s_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        int64_t rx_us = esp_timer_get_time();
+
+        switch (event.type) {
+            case UART_DATA:
+                read_frames(event.size, rx_us);
+                break;
+
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                // Bytes were lost: start over at the next delimiter
+                ESP_LOGW(TAG, "RX overrun, input flushed");
+                uart_flush_input(UART_LINK_PORT);
+                xQueueReset(s_queue);
+                uart_frame_abort(&s_decoder);
+                s_stats.overruns++;
+                break;
+
+            case UART_FRAME_ERR:
+            case UART_PARITY_ERR:
+                uart_frame_abort(&s_decoder);
+                s_stats.framing_errors++;
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t uart_link_init(void)
+{
+    if (s_task != NULL) {
+        return ESP_OK;
+    }
+
+    const uart_config_t config = {
+        .baud_rate = UART_LINK_BAUD,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+
+    // No TX buffer: a reply fits the hardware FIFO, so writes do not block
+    esp_err_t ret = uart_driver_install(UART_LINK_PORT, UART_LINK_RX_BUFFER, 0,
+                                        UART_LINK_QUEUE_LEN, &s_queue, UART_LINK_INTR_FLAGS);
+    if (ret == ESP_OK) ret = uart_param_config(UART_LINK_PORT, &config);
+    if (ret == ESP_OK) ret = uart_set_pin(UART_LINK_PORT, UART_LINK_TX_GPIO, UART_LINK_RX_GPIO,
+                                          UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    if (ret == ESP_OK) ret = uart_set_rx_timeout(UART_LINK_PORT, UART_LINK_RX_TIMEOUT_CHARS);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "UART%d setup failed: %s", UART_LINK_PORT, esp_err_to_name(ret));
+        return ret;
+    }
+
+    uart_frame_decoder_init(&s_decoder);
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_last_req_len = 0;
+
+    BaseType_t ok = xTaskCreate(uart_link_task, "uart_link", UART_LINK_TASK_STACK_SIZE,
+                                NULL, UART_LINK_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create UART link task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void uart_link_get_stats(uart_link_stats_t *out)
+{
+    *out = s_stats;
+}
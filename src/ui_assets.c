@@ -0,0 +1,347 @@
+/**
+ * @file ui_assets.c
+ * @brief Web UI assets served from a memory-mapped flash partition
+ *
+ * The archive is mapped read-only into the data address space once, so
+ * serving a file is an index lookup plus httpd_resp_send() straight from
+ * the mapping: no heap, no copy, no snprintf. ETags come from the index,
+ * so revalidation costs no flash reads at all.
+ *
+ * Updates stream into the same partition. Each flash sector is erased as
+ * the upload reaches it, so no RAM buffer is needed and an interrupted
+ * upload wastes no erase cycles beyond the data received. The archive is
+ * verified from flash before it is mapped; a bad or partial upload is
+ * invalidated and the HTTP server falls back to the built-in page.
+ *
+ * Archive format (built by tools/mkassets.py, all fields little-endian):
+ *   Header, 16 bytes:
+ *     0  "RUA1"            4  u16 version (1)  6  u16 file count
+ *     8  u32 archive length, header included
+ *     12 u32 CRC32 of bytes 16..length
+ *   Index, 64 bytes per file, sorted by name:
+ *     0  name, NUL-padded (at most 47 characters)
+ *     48 u32 data offset from the archive start
+ *     52 u32 stored length
+ *     56 u32 CRC32 of the stored bytes (used as the ETag)
+ *     60 u8 encoding (0 identity, 1 gzip)
+ *     61 u8 content type (index into CONTENT_TYPES)
+ *     62 u16 reserved
+ *   Data: stored files, each starting on a 4-byte boundary
+ */
+
+#include "ui_assets.h"
+#include "config.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = LOG_TAG_ASSETS;
+
+#define ARCHIVE_VERSION     1
+#define HEADER_LEN          16
+#define ENTRY_LEN           64
+#define NAME_LEN            48
+
+static const char *const CONTENT_TYPES[] = {
+    "application/octet-stream",
+    "text/html; charset=utf-8",
+    "application/javascript",
+    "text/css",
+    "application/json",
+    "image/svg+xml",
+    "image/png",
+    "image/x-icon",
+};
+#define CONTENT_TYPE_COUNT  (sizeof(CONTENT_TYPES) / sizeof(CONTENT_TYPES[0]))
+
+static const esp_partition_t *s_part = NULL;
+static esp_partition_mmap_handle_t s_map_handle;
+static const uint8_t *s_map = NULL;         // NULL while unmapped
+static bool s_valid = false;
+
+// Upload in progress
+static bool s_updating = false;
+static size_t s_expect_len = 0;
+static size_t s_written = 0;
+static size_t s_erased_to = 0;
+static uint8_t s_head[HEADER_LEN];          // First bytes, checked early
+
+static ui_assets_status_t s_status;
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Check an archive header against the partition
+ *
+ * @param len Bytes the archive is expected to occupy (0 to skip)
+ */
+static esp_err_t check_header(const uint8_t *head, size_t len)
+{
+    uint32_t total = get_u32(head + 8);
+    uint16_t count = get_u16(head + 6);
+
+    if (memcmp(head, "RUA1", 4) != 0 || get_u16(head + 4) != ARCHIVE_VERSION) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (total > s_part->size || total < HEADER_LEN + (uint32_t)count * ENTRY_LEN ||
+        count > ASSETS_MAX_FILES || (len != 0 && total != len)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Verify a mapped archive: header, CRC and every index entry
+ */
+static esp_err_t verify_archive(const uint8_t *map)
+{
+    esp_err_t ret = check_header(map, 0);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    uint32_t total = get_u32(map + 8);
+    uint16_t count = get_u16(map + 6);
+    if (esp_rom_crc32_le(0, map + HEADER_LEN, total - HEADER_LEN) != get_u32(map + 12)) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    uint32_t data_start = HEADER_LEN + (uint32_t)count * ENTRY_LEN;
+    for (int i = 0; i < count; i++) {
+        const uint8_t *e = map + HEADER_LEN + i * ENTRY_LEN;
+        uint32_t offset = get_u32(e + 48);
+        uint32_t length = get_u32(e + 52);
+        if (memchr(e, '\0', NAME_LEN) == NULL || e[0] == '\0' ||
+            offset < data_start || offset > total || length > total - offset ||
+            e[60] > 1 || e[61] >= CONTENT_TYPE_COUNT) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (i > 0 && strcmp((const char *)e - ENTRY_LEN, (const char *)e) >= 0) {
+            return ESP_ERR_INVALID_ARG;     // Index must be sorted
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Map the partition and adopt its archive if it verifies
+ */
+static esp_err_t map_archive(void)
+{
+    const void *ptr;
+    esp_err_t ret = esp_partition_mmap(s_part, 0, s_part->size, ESP_PARTITION_MMAP_DATA,
+                                       &ptr, &s_map_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map partition: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    s_map = ptr;
+
+    ret = verify_archive(s_map);
+    if (ret != ESP_OK) {
+        s_valid = false;
+        return ret;
+    }
+
+    s_valid = true;
+    s_status.files = get_u16(s_map + 6);
+    s_status.bytes = get_u32(s_map + 8);
+    s_status.crc = get_u32(s_map + 12);
+    return ESP_OK;
+}
+
+static void unmap_archive(void)
+{
+    if (s_map != NULL) {
+        esp_partition_munmap(s_map_handle);
+        s_map = NULL;
+    }
+    s_valid = false;
+    s_status.files = 0;
+    s_status.bytes = 0;
+    s_status.crc = 0;
+}
+
+/**
+ * @brief Make the partition unusable until the next good upload
+ *
+ * Erasing the first sector destroys the header; the rest is left alone.
+ */
+static void invalidate(void)
+{
+    esp_partition_erase_range(s_part, 0, s_part->erase_size);
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t ui_assets_init(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ASSETS_PARTITION_SUBTYPE,
+                                      ASSETS_PARTITION_LABEL);
+    if (s_part == NULL) {
+        ESP_LOGW(TAG, "No '%s' partition", ASSETS_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_status.partition_size = s_part->size;
+
+    esp_err_t ret = map_archive();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "No valid archive in '%s' (%s)",
+                 ASSETS_PARTITION_LABEL, esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "%u files, %lu of %lu bytes, crc %08lx",
+             s_status.files, (unsigned long)s_status.bytes,
+             (unsigned long)s_status.partition_size, (unsigned long)s_status.crc);
+    return ESP_OK;
+}
+
+esp_err_t ui_assets_find(const char *name, ui_asset_t *out)
+{
+    if (!s_valid) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Binary search of the sorted index
+    int lo = 0;
+    int hi = (int)get_u16(s_map + 6) - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const uint8_t *e = s_map + HEADER_LEN + mid * ENTRY_LEN;
+        int cmp = strcmp(name, (const char *)e);
+        if (cmp == 0) {
+            out->data = s_map + get_u32(e + 48);
+            out->len = get_u32(e + 52);
+            out->etag = get_u32(e + 56);
+            out->gzip = e[60] == 1;
+            out->content_type = CONTENT_TYPES[e[61]];
+            return ESP_OK;
+        }
+        if (cmp < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t ui_assets_update_begin(size_t total_len)
+{
+    if (s_part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (total_len < HEADER_LEN || total_len > s_part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Nothing may read the mapping while its sectors are rewritten
+    unmap_archive();
+
+    s_updating = true;
+    s_expect_len = total_len;
+    s_written = 0;
+    s_erased_to = 0;
+    ESP_LOGI(TAG, "Update started (%u bytes)", (unsigned)total_len);
+    return ESP_OK;
+}
+
+esp_err_t ui_assets_update_write(const void *data, size_t len)
+{
+    if (!s_updating) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > s_expect_len - s_written) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Reject a wrong file before anything is erased beyond the first sector
+    if (s_written < HEADER_LEN) {
+        size_t n = (len < HEADER_LEN - s_written) ? len : HEADER_LEN - s_written;
+        memcpy(s_head + s_written, data, n);
+        if (s_written + n == HEADER_LEN && check_header(s_head, s_expect_len) != ESP_OK) {
+            ESP_LOGW(TAG, "Upload is not a valid archive");
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    while (s_erased_to < s_written + len) {
+        esp_err_t ret = esp_partition_erase_range(s_part, s_erased_to, s_part->erase_size);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Erase at 0x%x failed: %s", (unsigned)s_erased_to, esp_err_to_name(ret));
+            return ret;
+        }
+        s_erased_to += s_part->erase_size;
+    }
+
+    esp_err_t ret = esp_partition_write(s_part, s_written, data, len);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Write at 0x%x failed: %s", (unsigned)s_written, esp_err_to_name(ret));
+        return ret;
+    }
+    s_written += len;
+    return ESP_OK;
+}
+
+esp_err_t ui_assets_update_finish(void)
+{
+    if (!s_updating) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_updating = false;
+
+    esp_err_t ret = (s_written == s_expect_len) ? map_archive() : ESP_ERR_INVALID_SIZE;
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Update rejected: %s", esp_err_to_name(ret));
+        unmap_archive();
+        invalidate();
+        s_status.failed_updates++;
+        return ret;
+    }
+
+    s_status.updates++;
+    ESP_LOGI(TAG, "Update installed: %u files, %lu bytes, crc %08lx",
+             s_status.files, (unsigned long)s_status.bytes, (unsigned long)s_status.crc);
+    return ESP_OK;
+}
+
+void ui_assets_update_abort(void)
+{
+    if (!s_updating) {
+        return;
+    }
+    s_updating = false;
+    s_status.failed_updates++;
+    ESP_LOGW(TAG, "Update aborted after %u of %u bytes",
+             (unsigned)s_written, (unsigned)s_expect_len);
+
+    // Nothing erased yet (e.g. a wrong file): the old archive is intact
+    if (s_erased_to == 0) {
+        map_archive();
+        return;
+    }
+    invalidate();
+}
+
+void ui_assets_get_status(ui_assets_status_t *out)
+{
+    *out = s_status;
+    out->valid = s_valid;
+    out->updating = s_updating;
+}
@@ -0,0 +1,385 @@
+/**
+ * @file webhook.c
+ * @brief Outbound webhook notification implementation
+ *
+ * The relay service journals every state change into a RAM ring while it
+ * already holds its state lock. This task wakes every WEBHOOK_BATCH_MS,
+ * copies new changes into a bounded queue per target and POSTs up to
+ * WEBHOOK_BATCH_MAX of them per request. The blocking HTTP client only
+ * ever runs here, at low priority, so a slow or dead endpoint cannot
+ * delay a relay command.
+ *
+ * Batch body:
+ *   {"node":"192.168.1.100","dropped":0,"events":[
+ *     {"seq":12,"relay":0,"name":"Light 1","state":"on","uptime_ms":53120}]}
+ * "seq" is gap-free unless events were dropped, which "dropped" counts.
+ */
+
+#include "webhook.h"
+#include "relay_service.h"
+#include "wifi_service.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_http_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = LOG_TAG_WEBHOOK;
+
+#define TARGETS_TEXT_MAX    (WEBHOOK_MAX_TARGETS * (WEBHOOK_URL_MAX_LEN + 1))
+#define EVENT_JSON_MAX      96
+#define BODY_MAX            (96 + WEBHOOK_BATCH_MAX * EVENT_JSON_MAX)
+
+static const char JSON_BATCH_START[] = "{\"node\":\"%s\",\"dropped\":%lu,\"events\":[";
+static const char JSON_BATCH_EVENT[] =
+"%s{\"seq\":%lu,\"relay\":%u,\"name\":\"%s\",\"state\":\"%s\",\"uptime_ms\":%lu}";
+static const char JSON_BATCH_END[] = "]}";
+
+/**
+ * @brief Queued state change
+ */
+typedef struct {
+    uint32_t seq;
+    uint32_t time_ms;
+    uint8_t relay_id;
+    uint8_t state;
+} wh_event_t;
+
+/**
+ * @brief Target with its bounded event queue
+ */
+typedef struct {
+    webhook_target_status_t status;
+    wh_event_t queue[WEBHOOK_QUEUE_LEN];
+    uint16_t head;              // Oldest queued event
+    uint8_t attempts;           // Failed attempts for the current batch
+    int64_t next_try_us;
+} wh_target_t;
+
+static TaskHandle_t s_task = NULL;
+static SemaphoreHandle_t s_lock = NULL;     // Targets and queues
+static wh_target_t s_targets[WEBHOOK_MAX_TARGETS];
+static uint8_t s_target_count = 0;
+static uint32_t s_generation = 0;           // Bumped when targets change
+static uint32_t s_cursor = 0;               // Relay journal position
+static uint32_t s_journal_lost = 0;
+
+static char s_body[BODY_MAX];
+
+/*============================================================================
+ * Private Functions
+ *============================================================================*/
+
+/**
+ * @brief Parse URL list into targets (caller holds s_lock)
+ */
+static esp_err_t parse_targets(const char *text, wh_target_t *out, uint8_t *count)
+{
+    uint8_t n = 0;
+    const char *p = text;
+
+    while (*p) {
+        while (*p == ',' || *p == '\n' || *p == '\r' || *p == ' ') p++;
+        if (*p == '\0') break;
+
+        size_t len = strcspn(p, ",\n\r ");
+        if (n >= WEBHOOK_MAX_TARGETS || len >= WEBHOOK_URL_MAX_LEN) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if ((strncmp(p, "http://", 7) != 0 && strncmp(p, "https://", 8) != 0) ||
+            memchr(p, '"', len) != NULL) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        memset(&out[n], 0, sizeof(out[n]));
+        memcpy(out[n].status.url, p, len);
+        out[n].status.url[len] = '\0';
+        n++;
+        p += len;
+    }
+
+    *count = n;
+    return ESP_OK;
+}
+
+static void load_targets(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+
+    char text[TARGETS_TEXT_MAX];
+    size_t len = sizeof(text);
+    if (nvs_get_str(nvs_handle, NVS_KEY_WEBHOOKS, text, &len) == ESP_OK &&
+        parse_targets(text, s_targets, &s_target_count) == ESP_OK) {
+        ESP_LOGI(TAG, "Loaded %u webhook target(s)", s_target_count);
+    }
+    nvs_close(nvs_handle);
+}
+
+/**
+ * @brief Move new relay changes into every target queue
+ */
+static void collect_events(void)
+{
+    relay_event_t events[8];
+    uint32_t lost;
+    size_t n;
+
+    while ((n = relay_read_events(&s_cursor, events, 8, &lost)) > 0 || lost > 0) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_journal_lost += lost;
+        for (int t = 0; t < s_target_count; t++) {
+            wh_target_t *target = &s_targets[t];
+            target->status.dropped += lost;
+
+            for (size_t i = 0; i < n; i++) {
+                // Full queue: drop the oldest, the newest state matters more
+                if (target->status.queued == WEBHOOK_QUEUE_LEN) {
+                    target->head = (target->head + 1) % WEBHOOK_QUEUE_LEN;
+                    target->status.queued--;
+                    target->status.dropped++;
+                }
+                wh_event_t *e = &target->queue[(target->head + target->status.queued) % WEBHOOK_QUEUE_LEN];
+                e->seq = events[i].seq;
+                e->time_ms = (uint32_t)(events[i].time_us / 1000);
+                e->relay_id = events[i].relay_id;
+                e->state = events[i].state;
+                target->status.queued++;
+            }
+        }
+        xSemaphoreGive(s_lock);
+
+        if (n == 0) break;
+    }
+}
+
+/**
+ * @brief Render the oldest queued events of a target (caller holds s_lock)
+ *
+ * @return Number of events in the batch
+ */
+static uint16_t build_batch(const wh_target_t *target)
+{
+    uint16_t count = target->status.queued;
+    if (count > WEBHOOK_BATCH_MAX) count = WEBHOOK_BATCH_MAX;
+
+    int len = snprintf(s_body, sizeof(s_body), JSON_BATCH_START,
+                       wifi_get_ip_address(), (unsigned long)target->status.dropped);
+
+    for (uint16_t i = 0; i < count; i++) {
+        const wh_event_t *e = &target->queue[(target->head + i) % WEBHOOK_QUEUE_LEN];
+        const relay_info_t *info = relay_get_info(e->relay_id);
+        len += snprintf(s_body + len, sizeof(s_body) - len, JSON_BATCH_EVENT,
+                        i > 0 ? "," : "", (unsigned long)e->seq, e->relay_id,
+                        info ? info->name : "", e->state == RELAY_ON ? "on" : "off",
+                        (unsigned long)e->time_ms);
+    }
+    snprintf(s_body + len, sizeof(s_body) - len, JSON_BATCH_END);
+
+    return count;
+}
+
+/**
+ * @brief POST a body; returns the HTTP status or -1 on transport error
+ */
+static int post_json(const char *url, const char *body)
+{
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_POST,
+        .timeout_ms = WEBHOOK_TIMEOUT_MS,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return -1;
+    }
+
+    esp_http_client_set_header(client, "Content-Type", "application/json");
+    esp_http_client_set_post_field(client, body, strlen(body));
+
+    int status = -1;
+    if (esp_http_client_perform(client) == ESP_OK) {
+        status = esp_http_client_get_status_code(client);
+    }
+    esp_http_client_cleanup(client);
+    return status;
+}
+
+/**
+ * @brief Try to deliver one batch to a target
+ *
+ * @return true if a batch was accepted and more events may be waiting
+ */
+static bool deliver(int index, int64_t now_us)
+{
+    char url[WEBHOOK_URL_MAX_LEN];
+
+    // Render under the lock, POST without it so the API never waits on
+    // the network
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    wh_target_t *target = &s_targets[index];
+    if (target->status.queued == 0 || now_us < target->next_try_us) {
+        xSemaphoreGive(s_lock);
+        return false;
+    }
+    uint16_t count = build_batch(target);
+    uint32_t generation = s_generation;
+    strcpy(url, target->status.url);
+    xSemaphoreGive(s_lock);
+
+    int status = post_json(url, s_body);
+    bool ok = status >= 200 && status < 300;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (generation != s_generation) {
+        xSemaphoreGive(s_lock);
+        return false;   // Targets were replaced meanwhile
+    }
+
+    target->status.last_status = status;
+    if (ok) {
+        target->head = (target->head + count) % WEBHOOK_QUEUE_LEN;
+        target->status.queued -= count;
+        target->status.delivered += count;
+        target->status.batches++;
+        target->attempts = 0;
+        target->next_try_us = 0;
+    } else {
+        target->status.failures++;
+        target->attempts++;
+        if (target->attempts >= WEBHOOK_MAX_ATTEMPTS) {
+            ESP_LOGW(TAG, "%s: giving up on %u event(s) after %u attempts",
+                     url, count, target->attempts);
+            target->head = (target->head + count) % WEBHOOK_QUEUE_LEN;
+            target->status.queued -= count;
+            target->status.dropped += count;
+            target->attempts = 0;
+            target->next_try_us = 0;
+        } else {
+            // Exponential backoff with up to 25% jitter
+            uint32_t delay_ms = WEBHOOK_RETRY_BASE_MS << (target->attempts - 1);
+            if (delay_ms > WEBHOOK_RETRY_MAX_MS) delay_ms = WEBHOOK_RETRY_MAX_MS;
+            delay_ms += esp_random() % (delay_ms / 4 + 1);
+            target->next_try_us = now_us + (int64_t)delay_ms * 1000;
+            ESP_LOGD(TAG, "%s: status %d, retry in %lu ms", url, status, (unsigned long)delay_ms);
+        }
+    }
+    bool more = ok && target->status.queued > 0;
+    xSemaphoreGive(s_lock);
+    return more;
+}
+
+/**
+ * @brief Delivery task
+ */
+static void webhook_task(void *arg)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(WEBHOOK_BATCH_MS));
+
+        collect_events();
+
+        // A backlog is drained batch by batch while the target keeps
+        // accepting; the journal is emptied between POSTs so a slow
+        // endpoint does not make it overflow
+        for (int i = 0; i < WEBHOOK_MAX_TARGETS; i++) {
+            while (i < s_target_count && deliver(i, esp_timer_get_time())) {
+                collect_events();
+            }
+        }
+    }
+}
+
+/*============================================================================
+ * Public Functions
+ *============================================================================*/
+
+esp_err_t webhook_init(void)
+{
+    if (s_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    load_targets();
+
+    BaseType_t ok = xTaskCreate(webhook_task, "webhook", WEBHOOK_TASK_STACK_SIZE,
+                                NULL, WEBHOOK_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create webhook task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t webhook_set_targets(const char *text)
+{
+    if (s_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (strlen(text) >= TARGETS_TEXT_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    static wh_target_t parsed[WEBHOOK_MAX_TARGETS];
+    uint8_t count = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t ret = parse_targets(text, parsed, &count);
+    if (ret == ESP_OK) {
+        memcpy(s_targets, parsed, sizeof(parsed));
+        s_target_count = count;
+        s_generation++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    nvs_handle_t nvs_handle;
+    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_str(nvs_handle, NVS_KEY_WEBHOOKS, text);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save targets: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "%u webhook target(s) set", count);
+    return ESP_OK;
+}
+
+void webhook_get_status(webhook_status_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (s_lock == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    out->target_count = s_target_count;
+    out->journal_lost = s_journal_lost;
+    for (int i = 0; i < s_target_count; i++) {
+        out->targets[i] = s_targets[i].status;
+    }
+    xSemaphoreGive(s_lock);
+}
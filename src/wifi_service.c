@@ -1,30 +1,571 @@
 /**
  * @file wifi_service.c
  * @brief WiFi connection service implementation
+ *
+ * Roaming is driven by the driver's RSSI threshold event, so a station
+ * with a good signal costs nothing: the roam task sleeps until the RSSI
+ * falls below WIFI_ROAM_RSSI_LOW and only then polls it. While the signal
+ * is weak it keeps a cache of the APs of our SSID, refreshed when older
+ * than WIFI_ROAM_SCAN_MAX_AGE_S from the channels in the AP's 802.11k
+ * neighbor report (or a full scan), and moves to the strongest one that
+ * beats the current AP by WIFI_ROAM_HYSTERESIS_DB. The move is a BSS
+ * transition query (802.11v) if the AP supports it, so the network picks
+ * the target, else a reassociation pinned to the candidate's BSSID and
+ * channel, which skips the connect scan and is a fast transition (802.11r)
+ * between APs of one mobility domain.
  */
 
 #include "wifi_service.h"
 #include "config.h"
+#include "sdkconfig.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_mac.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "nvs.h"
 #include <string.h>
+#if WIFI_ROAM_ENABLE && CONFIG_ESP_WIFI_11KV_SUPPORT
+#include "esp_rrm.h"
+#include "esp_wnm.h"
+#endif
 
 static const char *TAG = LOG_TAG_WIFI;
 
 // Event group bits
 #define WIFI_CONNECTED_BIT  BIT0
-#define WIFI_FAIL_BIT       BIT1
+
+// With failover the board boots on its own address; the active board of
+// the pair claims STATIC_IP later via wifi_set_ip_address()
+#if FAILOVER_ENABLE
+#define BOOT_IP             FAILOVER_NODE_IP
+#else
+#define BOOT_IP             STATIC_IP
+#endif
+
+#if WIFI_ROAM_ENABLE
+// Roam task notification bits
+#define NOTIFY_CHECK        (1u << 0)   // RSSI fell below the threshold
+#define NOTIFY_SCAN_DONE    (1u << 1)
+#define NOTIFY_NEIGHBORS    (1u << 2)   // 802.11k neighbor report arrived
+
+#define EID_NEIGHBOR_REPORT 52
+#define NEIGHBOR_MAX_CHANNELS 4         // Channels scanned from one report
+#define SEARCH_TIMEOUT_US   (5 * 1000000LL)   // A report or scan that never came
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+    int64_t seen_us;
+} roam_candidate_t;
+#endif
 
 // Module state
 static EventGroupHandle_t s_wifi_event_group = NULL;
 static int s_retry_count = 0;
+static uint32_t s_disconnects = 0;
 static bool s_is_connected = false;
 static char s_ip_address[16] = "0.0.0.0";
+static esp_netif_t *s_sta_netif = NULL;
+
+// Link gaps, written by the event handler, read by the status endpoint
+static portMUX_TYPE s_gap_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_link_lost_us = -1;         // Disconnected since (-1: linked or never linked)
+static wifi_gap_t s_gaps[WIFI_ROAM_LOG_LEN];
+static uint8_t s_gap_next = 0;
+static uint8_t s_gap_count = 0;
+static uint32_t s_max_gap_ms = 0;
+
+/**
+ * @brief Radio settings of one profile
+ */
+typedef struct {
+    const char *name;
+    wifi_ps_type_t ps;
+    const char *ps_name;
+    uint16_t listen_interval;   // Only used by WIFI_PS_MAX_MODEM
+    int8_t tx_dbm;
+} profile_def_t;
+
+static const profile_def_t s_profiles[WIFI_PROFILE_COUNT] = {
+    [WIFI_PROFILE_LATENCY]   = { "latency",   WIFI_PS_NONE,      "none",      3, WIFI_PROFILE_TX_DBM },
+    [WIFI_PROFILE_BALANCED]  = { "balanced",  WIFI_PS_MIN_MODEM, "min_modem", 3, WIFI_PROFILE_TX_DBM },
+    [WIFI_PROFILE_LOW_POWER] = { "low_power", WIFI_PS_MAX_MODEM, "max_modem",
+                                 WIFI_PROFILE_LOW_POWER_LISTEN, WIFI_PROFILE_LOW_POWER_TX_DBM },
+};
+
+static wifi_profile_t s_profile = WIFI_PROFILE_DEFAULT;
+static uint32_t s_profile_changes = 0;
+static esp_timer_handle_t s_reassoc_timer = NULL;
+
+#if WIFI_ROAM_ENABLE
+static TaskHandle_t s_roam_task = NULL;
+static roam_candidate_t s_candidates[WIFI_ROAM_MAX_CANDIDATES];
+static uint8_t s_candidate_count = 0;
+static wifi_ap_record_t s_scan_records[WIFI_ROAM_MAX_CANDIDATES];
+static int64_t s_scanned_us = -1;           // Last completed search
+static int64_t s_search_us = -1;            // Search under way since (-1: none)
+static uint8_t s_scan_channels[NEIGHBOR_MAX_CHANNELS];
+static uint8_t s_scan_channel_count = 0;    // 0: scan all channels
+static uint8_t s_scan_channel_next = 0;
+static bool s_weak = false;                 // RSSI below the threshold at the last check
+
+static volatile bool s_roaming = false;
+static const char *s_roam_method = NULL;
+static roam_candidate_t s_roam_target;
+static int8_t s_roam_from_rssi = 0;
+static int64_t s_roam_started_us = -1;
+static int64_t s_btm_deadline_us = -1;      // Reassociate ourselves if not steered by then
+static int64_t s_last_roam_us = -1;
+static uint32_t s_roams = 0;
+static uint32_t s_roam_failures = 0;
+static uint32_t s_scans = 0;
+#endif
+
+/*============================================================================
+ * Link Gaps
+ *============================================================================*/
+
+static void record_gap(const char *kind, int8_t from_rssi)
+{
+    wifi_ap_record_t ap;
+    int64_t now = esp_timer_get_time();
+    uint32_t gap_ms = (uint32_t)((now - s_link_lost_us) / 1000);
+    
+    memset(&ap, 0, sizeof(ap));
+    esp_wifi_sta_get_ap_info(&ap);
+    
+    taskENTER_CRITICAL(&s_gap_lock);
+    s_gaps[s_gap_next] = (wifi_gap_t){
+        .uptime_s = (uint32_t)(now / 1000000),
+        .gap_ms = gap_ms,
+        .kind = kind,
+        .from_rssi = from_rssi,
+        .to_rssi = ap.rssi,
+        .channel = ap.primary,
+    };
+    s_gap_next = (s_gap_next + 1) % WIFI_ROAM_LOG_LEN;
+    if (s_gap_count < WIFI_ROAM_LOG_LEN) {
+        s_gap_count++;
+    }
+    if (gap_ms > s_max_gap_ms) {
+        s_max_gap_ms = gap_ms;
+    }
+    taskEXIT_CRITICAL(&s_gap_lock);
+    
+    if (from_rssi != 0) {
+        ESP_LOGI(TAG, "Roamed to " MACSTR " ch %u by %s: %d -> %d dBm, link down %lu ms",
+                 MAC2STR(ap.bssid), ap.primary, kind, from_rssi, ap.rssi,
+                 (unsigned long)gap_ms);
+    } else {
+        ESP_LOGI(TAG, "Link back on " MACSTR " ch %u (%d dBm) after %lu ms",
+                 MAC2STR(ap.bssid), ap.primary, ap.rssi, (unsigned long)gap_ms);
+    }
+}
+
+#if WIFI_ROAM_ENABLE
+/*============================================================================
+ * Roaming
+ *============================================================================*/
+
+/**
+ * @brief Drop the BSSID pin of a roam so reconnects pick the best AP again
+ */
+static void roam_unpin(void)
+{
+    wifi_config_t cfg;
+    
+    if (esp_wifi_get_config(WIFI_IF_STA, &cfg) == ESP_OK && cfg.sta.bssid_set) {
+        cfg.sta.bssid_set = false;
+        cfg.sta.channel = 0;
+        esp_wifi_set_config(WIFI_IF_STA, &cfg);
+    }
+}
+
+static void roam_failed(const char *why)
+{
+    ESP_LOGW(TAG, "Roam to " MACSTR " failed (%s)", MAC2STR(s_roam_target.bssid), why);
+    s_roaming = false;
+    s_roam_failures++;
+    s_last_roam_us = esp_timer_get_time();
+    roam_unpin();
+}
+
+static void scan_start(uint8_t channel)
+{
+    wifi_scan_config_t scan = {
+        .ssid = (uint8_t *)WIFI_SSID,
+        .channel = channel,                 // 0: all channels
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time.active = { .min = WIFI_ROAM_SCAN_DWELL_MS / 2, .max = WIFI_ROAM_SCAN_DWELL_MS },
+    };
+    
+    esp_err_t ret = esp_wifi_scan_start(&scan, false);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Roam scan not started: %s", esp_err_to_name(ret));
+        s_search_us = -1;
+    }
+}
+
+/**
+ * @brief Look for candidates: neighbor report if the AP offers one, else a scan
+ */
+static void search_start(int64_t now)
+{
+    s_search_us = now;
+    s_scans++;
+    
+#if CONFIG_ESP_WIFI_11KV_SUPPORT
+    // The report arrives as WIFI_EVENT_STA_NEIGHBOR_REP; its channels are scanned then
+    if (esp_rrm_is_rrm_supported_connection() && esp_rrm_send_neighbor_report_request() == 0) {
+        ESP_LOGD(TAG, "Neighbor report requested");
+        return;
+    }
+#endif
+    s_scan_channel_count = 0;
+    scan_start(0);
+}
+
+#if CONFIG_ESP_WIFI_11KV_SUPPORT
+/**
+ * @brief Take the channels of a neighbor report (runs in the event handler)
+ */
+static void neighbors_parse(const wifi_event_neighbor_report_t *rep)
+{
+    const uint8_t *pos = rep->report;
+    const uint8_t *end = rep->report + rep->report_len;
+    uint8_t count = 0;
+    
+    // Neighbor Report elements: BSSID(6) BSSID info(4) op class(1) channel(1) PHY(1) ...
+    while (end - pos >= 2 && end - pos >= 2 + pos[1]) {
+        uint8_t id = pos[0];
+        uint8_t len = pos[1];
+        if (id == EID_NEIGHBOR_REPORT && len >= 13) {
+            uint8_t channel = pos[2 + 11];
+            bool known = false;
+            for (uint8_t i = 0; i < count; i++) {
+                known |= (s_scan_channels[i] == channel);
+            }
+            if (!known && count < NEIGHBOR_MAX_CHANNELS) {
+                s_scan_channels[count++] = channel;
+            }
+        }
+        pos += 2 + len;
+    }
+    s_scan_channel_count = count;
+}
+#endif
+
+/**
+ * @brief Start the scan of a neighbor report's channels (all if it listed none)
+ */
+static void neighbors_scan(void)
+{
+    s_scan_channel_next = 0;
+    ESP_LOGD(TAG, "Neighbor report: %u channels", s_scan_channel_count);
+    scan_start(s_scan_channel_count > 0 ? s_scan_channels[0] : 0);
+}
+
+/**
+ * @brief Merge the finished scan into the candidate cache
+ */
+static void scan_done(void)
+{
+    uint16_t n = WIFI_ROAM_MAX_CANDIDATES;
+    int64_t now = esp_timer_get_time();
+    
+    // Also frees the driver's result list
+    if (esp_wifi_scan_get_ap_records(&n, s_scan_records) != ESP_OK) {
+        n = 0;
+    }
+    
+    for (uint16_t i = 0; i < n; i++) {
+        const wifi_ap_record_t *r = &s_scan_records[i];
+        int slot = -1;
+        for (int k = 0; k < s_candidate_count; k++) {
+            if (memcmp(s_candidates[k].bssid, r->bssid, 6) == 0) {
+                slot = k;
+                break;
+            }
+        }
+        if (slot < 0 && s_candidate_count < WIFI_ROAM_MAX_CANDIDATES) {
+            slot = s_candidate_count++;
+        }
+        if (slot < 0) {
+            // Full: replace the entry seen longest ago
+            slot = 0;
+            for (int k = 1; k < s_candidate_count; k++) {
+                if (s_candidates[k].seen_us < s_candidates[slot].seen_us) {
+                    slot = k;
+                }
+            }
+        }
+        memcpy(s_candidates[slot].bssid, r->bssid, 6);
+        s_candidates[slot].channel = r->primary;
+        s_candidates[slot].rssi = r->rssi;
+        s_candidates[slot].seen_us = now;
+    }
+    
+    if (s_search_us >= 0 && s_scan_channel_count > 0 &&
+        ++s_scan_channel_next < s_scan_channel_count) {
+        scan_start(s_scan_channels[s_scan_channel_next]);
+        return;
+    }
+    s_search_us = -1;
+    s_scanned_us = now;
+}
+
+/**
+ * @brief Strongest fresh candidate that beats the current AP by the hysteresis
+ */
+static const roam_candidate_t *roam_best(const wifi_ap_record_t *ap, int64_t now)
+{
+    const roam_candidate_t *best = NULL;
+    
+    for (int i = 0; i < s_candidate_count; i++) {
+        const roam_candidate_t *c = &s_candidates[i];
+        if (now - c->seen_us > (int64_t)WIFI_ROAM_SCAN_MAX_AGE_S * 1000000 ||
+            memcmp(c->bssid, ap->bssid, 6) == 0 ||
+            c->rssi < ap->rssi + WIFI_ROAM_HYSTERESIS_DB) {
+            continue;
+        }
+        if (best == NULL || c->rssi > best->rssi) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Move to the target by reassociating with its BSSID and channel
+ */
+static void roam_reassociate(void)
+{
+    wifi_config_t cfg;
+    
+    s_roam_method = "reassoc";
+    s_btm_deadline_us = -1;
+    if (esp_wifi_get_config(WIFI_IF_STA, &cfg) != ESP_OK) {
+        roam_failed("no config");
+        return;
+    }
+    memcpy(cfg.sta.bssid, s_roam_target.bssid, 6);
+    cfg.sta.bssid_set = true;
+    cfg.sta.channel = s_roam_target.channel;
+    esp_wifi_set_config(WIFI_IF_STA, &cfg);
+    
+    ESP_LOGI(TAG, "Roaming to " MACSTR " ch %u (%d dBm, now %d dBm)",
+             MAC2STR(s_roam_target.bssid), s_roam_target.channel,
+             s_roam_target.rssi, s_roam_from_rssi);
+    // The driver leaves the current AP and joins the target (FT if both offer it)
+    if (esp_wifi_connect() != ESP_OK) {
+        roam_failed("connect");
+    }
+}
+
+static void roam_start(const roam_candidate_t *target, int8_t rssi, int64_t now)
+{
+    s_roam_target = *target;
+    s_roam_from_rssi = rssi;
+    s_roam_started_us = now;
+    s_roaming = true;
+    
+#if CONFIG_ESP_WIFI_11KV_SUPPORT
+    // Let the network steer us; it knows the AP loads and may pick another AP
+    if (esp_wnm_is_btm_supported_connection() &&
+        esp_wnm_send_bss_transition_mgmt_query(REASON_RSSI, NULL, 0) == 0) {
+        s_roam_method = "btm";
+        s_btm_deadline_us = now + (int64_t)WIFI_ROAM_BTM_WAIT_MS * 1000;
+        ESP_LOGI(TAG, "BSS transition query sent (%d dBm)", rssi);
+        return;
+    }
+#endif
+    roam_reassociate();
+}
+
+static void roam_check(void)
+{
+    wifi_ap_record_t ap;
+    int64_t now = esp_timer_get_time();
+    
+    if (s_roaming) {
+        if (s_btm_deadline_us >= 0 && s_is_connected && now >= s_btm_deadline_us) {
+            ESP_LOGI(TAG, "Not steered by the AP, reassociating");
+            roam_reassociate();
+        } else if (!s_is_connected &&
+                   now - s_roam_started_us > (int64_t)WIFI_ROAM_TIMEOUT_MS * 1000) {
+            roam_failed("timeout");
+            esp_wifi_connect();
+        }
+        return;
+    }
+    if (!s_is_connected || esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+    if (ap.rssi >= WIFI_ROAM_RSSI_LOW) {
+        if (s_weak) {
+            // Good again: back to sleeping until the driver reports a drop
+            s_weak = false;
+            esp_wifi_set_rssi_threshold(WIFI_ROAM_RSSI_LOW);
+        }
+        return;
+    }
+    s_weak = true;
+    
+    if (s_search_us >= 0) {
+        if (now - s_search_us > SEARCH_TIMEOUT_US) {
+            ESP_LOGW(TAG, "No neighbor report or scan result, scanning all channels");
+            s_search_us = now;
+            s_scan_channel_count = 0;
+            scan_start(0);
+        }
+        return;
+    }
+    if (s_last_roam_us >= 0 && now - s_last_roam_us < (int64_t)WIFI_ROAM_MIN_INTERVAL_S * 1000000) {
+        return;
+    }
+    if (s_scanned_us < 0 || now - s_scanned_us > (int64_t)WIFI_ROAM_SCAN_MAX_AGE_S * 1000000) {
+        search_start(now);
+        return;
+    }
+    
+    const roam_candidate_t *best = roam_best(&ap, now);
+    if (best != NULL) {
+        roam_start(best, ap.rssi, now);
+    }
+}
+
+static void roam_task(void *arg)
+{
+    (void)arg;
+    
+    for (;;) {
+        uint32_t bits = 0;
+        // Asleep while the signal is good; the driver's threshold event wakes us
+        TickType_t wait = portMAX_DELAY;
+        if (s_btm_deadline_us >= 0 && s_roaming) {
+            wait = pdMS_TO_TICKS(WIFI_ROAM_BTM_WAIT_MS);
+        } else if (s_weak || s_roaming || s_search_us >= 0) {
+            wait = pdMS_TO_TICKS(WIFI_ROAM_CHECK_MS);
+        }
+        xTaskNotifyWait(0, UINT32_MAX, &bits, wait);
+        
+        if (bits & NOTIFY_NEIGHBORS) {
+            neighbors_scan();
+        }
+        if (bits & NOTIFY_SCAN_DONE) {
+            scan_done();
+        }
+        roam_check();
+    }
+}
+
+/**
+ * @brief Roam-related part of the disconnect event
+ *
+ * @return true if the disconnect is the start of a roam (no reconnect)
+ */
+static bool roam_on_disconnect(bool was_connected)
+{
+    if (!s_roaming) {
+        roam_unpin();
+        return false;
+    }
+    if (was_connected) {
+        // Left the old AP; the driver is joining the target
+        return true;
+    }
+    roam_failed("join");
+    return false;
+}
+#endif // WIFI_ROAM_ENABLE
+
+/*============================================================================
+ * Radio Profiles
+ *============================================================================*/
+
+/**
+ * @brief Load the saved profile from NVS
+ */
+static void profile_load(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+
+    uint8_t value;
+    if (nvs_get_u8(nvs_handle, NVS_KEY_WIFI_PROFILE, &value) == ESP_OK &&
+        value < WIFI_PROFILE_COUNT) {
+        s_profile = (wifi_profile_t)value;
+    }
+    nvs_close(nvs_handle);
+}
+
+/**
+ * @brief Save the active profile to NVS
+ */
+static esp_err_t profile_save(void)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_u8(nvs_handle, NVS_KEY_WIFI_PROFILE, (uint8_t)s_profile);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save radio profile: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/**
+ * @brief Apply the power-save mode and TX power of the active profile
+ *
+ * Both take effect at once; the listen interval is part of the STA config.
+ */
+static esp_err_t profile_apply(void)
+{
+    const profile_def_t *def = &s_profiles[s_profile];
+
+    esp_err_t ret = esp_wifi_set_ps(def->ps);
+    if (ret == ESP_OK) {
+        // The driver takes 0.25 dBm units and clamps to what the chip supports
+        ret = esp_wifi_set_max_tx_power((int8_t)(def->tx_dbm * 4));
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to apply radio profile %s: %s", def->name, esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Radio profile %s: ps=%s listen=%u tx=%d dBm",
+             def->name, def->ps_name, def->listen_interval, def->tx_dbm);
+    return ESP_OK;
+}
+
+/**
+ * @brief Reassociate so the AP learns the new listen interval
+ *
+ * The disconnect handler reconnects as after any drop.
+ */
+static void profile_reassoc_cb(void *arg)
+{
+    (void)arg;
+    if (s_is_connected) {
+        ESP_LOGI(TAG, "Reassociating for listen interval %u",
+                 s_profiles[s_profile].listen_interval);
+        esp_wifi_disconnect();
+    }
+}
 
 /*============================================================================
  * Event Handlers
@@ -40,8 +581,20 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                 esp_wifi_connect();
                 break;
                 
-            case WIFI_EVENT_STA_DISCONNECTED:
+            case WIFI_EVENT_STA_DISCONNECTED: {
+                bool was_connected = s_is_connected;
                 s_is_connected = false;
+                s_disconnects++;
+                if (s_link_lost_us < 0) {
+                    s_link_lost_us = esp_timer_get_time();
+                }
+#if WIFI_ROAM_ENABLE
+                if (roam_on_disconnect(was_connected)) {
+                    break;
+                }
+#else
+                (void)was_connected;
+#endif
                 // Always keep trying to reconnect (infinite retries)
                 ESP_LOGW(TAG, "Disconnected, reconnecting in %dms...", WIFI_RETRY_DELAY_MS);
                 vTaskDelay(pdMS_TO_TICKS(WIFI_RETRY_DELAY_MS));
@@ -53,6 +606,24 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                     s_retry_count = 100;
                 }
                 break;
+            }
+                
+#if WIFI_ROAM_ENABLE
+            case WIFI_EVENT_STA_BSS_RSSI_LOW:
+                xTaskNotify(s_roam_task, NOTIFY_CHECK, eSetBits);
+                break;
+                
+            case WIFI_EVENT_SCAN_DONE:
+                xTaskNotify(s_roam_task, NOTIFY_SCAN_DONE, eSetBits);
+                break;
+                
+#if CONFIG_ESP_WIFI_11KV_SUPPORT
+            case WIFI_EVENT_STA_NEIGHBOR_REP:
+                neighbors_parse((const wifi_event_neighbor_report_t *)event_data);
+                xTaskNotify(s_roam_task, NOTIFY_NEIGHBORS, eSetBits);
+                break;
+#endif
+#endif
                 
             default:
                 break;
@@ -65,6 +636,27 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
             ESP_LOGI(TAG, "Connected! IP: %s (after %d retries)", s_ip_address, s_retry_count);
             s_retry_count = 0;
             s_is_connected = true;
+            
+            if (s_link_lost_us >= 0) {
+#if WIFI_ROAM_ENABLE
+                if (s_roaming) {
+                    s_roaming = false;
+                    s_roams++;
+                    s_last_roam_us = esp_timer_get_time();
+                    record_gap(s_roam_method, s_roam_from_rssi);
+                } else {
+                    record_gap("reconnect", 0);
+                }
+#else
+                record_gap("reconnect", 0);
+#endif
+                s_link_lost_us = -1;
+            }
+#if WIFI_ROAM_ENABLE
+            // One-shot in the driver: arm it again for this AP
+            s_weak = false;
+            esp_wifi_set_rssi_threshold(WIFI_ROAM_RSSI_LOW);
+#endif
             xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
         }
     }
@@ -89,15 +681,16 @@ esp_err_t wifi_service_init(void)
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
+    s_sta_netif = sta_netif;
 
 #if USE_STATIC_IP
     // Configure static IP
-    ESP_LOGI(TAG, "Configuring static IP: %s", STATIC_IP);
+    ESP_LOGI(TAG, "Configuring static IP: %s", BOOT_IP);
     esp_netif_dhcpc_stop(sta_netif);  // Stop DHCP client
     
     esp_netif_ip_info_t ip_info;
     memset(&ip_info, 0, sizeof(ip_info));
-    ip_info.ip.addr = esp_ip4addr_aton(STATIC_IP);
+    ip_info.ip.addr = esp_ip4addr_aton(BOOT_IP);
     ip_info.gw.addr = esp_ip4addr_aton(STATIC_GATEWAY);
     ip_info.netmask.addr = esp_ip4addr_aton(STATIC_SUBNET);
     
@@ -120,6 +713,13 @@ esp_err_t wifi_service_init(void)
     ESP_ERROR_CHECK(esp_event_handler_instance_register(
         IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL, NULL));
     
+    profile_load();
+    const esp_timer_create_args_t reassoc_args = {
+        .callback = profile_reassoc_cb,
+        .name = "wifi_reassoc",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&reassoc_args, &s_reassoc_timer));
+    
     // Configure WiFi
     wifi_config_t wifi_config = {
         .sta = {
@@ -127,33 +727,40 @@ esp_err_t wifi_service_init(void)
             .password = WIFI_PASSWORD,
             .threshold.authmode = WIFI_AUTH_WPA2_PSK,
             .sae_pwe_h2e = WPA3_SAE_PWE_BOTH,
+            // Join the strongest AP of the SSID, not the first one found
+            .scan_method = WIFI_ALL_CHANNEL_SCAN,
+            .sort_method = WIFI_CONNECT_AP_BY_SIGNAL,
+            .listen_interval = s_profiles[s_profile].listen_interval,
+#if WIFI_ROAM_ENABLE
+            .rm_enabled = 1,
+            .btm_enabled = 1,
+            .ft_enabled = 1,
+#endif
         },
     };
     
+#if WIFI_ROAM_ENABLE
+    BaseType_t ok = xTaskCreate(roam_task, "wifi_roam", WIFI_ROAM_TASK_STACK_SIZE,
+                                NULL, WIFI_ROAM_TASK_PRIORITY, &s_roam_task);
+    if (ok != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create roam task");
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
+    profile_apply();
     
     ESP_LOGI(TAG, "Connecting to SSID: %s", WIFI_SSID);
     
-    // Wait for connection or failure
-    EventBits_t bits = xEventGroupWaitBits(
-        s_wifi_event_group,
-        WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-        pdFALSE,
-        pdFALSE,
-        portMAX_DELAY
-    );
-    
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "WiFi service initialized successfully");
-        return ESP_OK;
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGE(TAG, "Failed to connect to WiFi");
-        return ESP_FAIL;
-    }
+    // Wait for the connection; the event handler retries without limit
+    xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdFALSE,
+                        portMAX_DELAY);
     
-    return ESP_ERR_TIMEOUT;
+    ESP_LOGI(TAG, "WiFi service initialized successfully");
+    return ESP_OK;
 }
 
 bool wifi_is_connected(void)
@@ -166,6 +773,134 @@ const char* wifi_get_ip_address(void)
     return s_ip_address;
 }
 
+void wifi_get_stats(wifi_stats_t *out)
+{
+    wifi_ap_record_t ap;
+    
+    out->connected = s_is_connected;
+    out->rssi = 0;
+    out->disconnects = s_disconnects;
+    if (s_is_connected && esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        out->rssi = ap.rssi;
+    }
+}
+
+void wifi_get_roam_status(wifi_roam_status_t *out)
+{
+    wifi_ap_record_t ap;
+    
+    memset(out, 0, sizeof(*out));
+    out->connected = s_is_connected;
+    out->disconnects = s_disconnects;
+    if (s_is_connected && esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        out->rssi = ap.rssi;
+        memcpy(out->bssid, ap.bssid, sizeof(out->bssid));
+        out->channel = ap.primary;
+    }
+    
+#if WIFI_ROAM_ENABLE
+    out->roam_enabled = true;
+    out->roaming = s_roaming;
+    out->roams = s_roams;
+    out->roam_failures = s_roam_failures;
+    out->scans = s_scans;
+    out->candidates = s_candidate_count;
+#if CONFIG_ESP_WIFI_11KV_SUPPORT
+    if (s_is_connected) {
+        out->rrm = esp_rrm_is_rrm_supported_connection();
+        out->btm = esp_wnm_is_btm_supported_connection();
+    }
+#endif
+#endif
+    
+    taskENTER_CRITICAL(&s_gap_lock);
+    out->max_gap_ms = s_max_gap_ms;
+    out->gap_count = s_gap_count;
+    for (uint8_t i = 0; i < s_gap_count; i++) {
+        out->gaps[i] = s_gaps[(s_gap_next + WIFI_ROAM_LOG_LEN - 1 - i) % WIFI_ROAM_LOG_LEN];
+    }
+    taskEXIT_CRITICAL(&s_gap_lock);
+}
+
+esp_err_t wifi_set_profile(wifi_profile_t profile)
+{
+    if (profile >= WIFI_PROFILE_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (profile == s_profile) {
+        return ESP_OK;
+    }
+    
+    uint16_t old_listen = s_profiles[s_profile].listen_interval;
+    s_profile = profile;
+    s_profile_changes++;
+    
+    esp_err_t ret = profile_apply();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    const profile_def_t *def = &s_profiles[profile];
+    wifi_config_t cfg;
+    if (def->listen_interval != old_listen && esp_wifi_get_config(WIFI_IF_STA, &cfg) == ESP_OK) {
+        cfg.sta.listen_interval = def->listen_interval;
+        esp_wifi_set_config(WIFI_IF_STA, &cfg);
+        // Leave time for the HTTP reply before the link drops
+        if (s_is_connected) {
+            esp_timer_stop(s_reassoc_timer);
+            esp_timer_start_once(s_reassoc_timer, WIFI_PROFILE_REASSOC_DELAY_MS * 1000ULL);
+        }
+    }
+    
+    profile_save();
+    return ESP_OK;
+}
+
+wifi_profile_t wifi_profile_from_name(const char *name)
+{
+    for (int i = 0; i < WIFI_PROFILE_COUNT; i++) {
+        if (strcmp(name, s_profiles[i].name) == 0) {
+            return (wifi_profile_t)i;
+        }
+    }
+    return WIFI_PROFILE_COUNT;
+}
+
+void wifi_get_profile(wifi_profile_status_t *out)
+{
+    const profile_def_t *def = &s_profiles[s_profile];
+    
+    out->profile = s_profile;
+    out->name = def->name;
+    out->ps = def->ps_name;
+    out->listen_interval = def->listen_interval;
+    out->changes = s_profile_changes;
+    if (esp_wifi_get_max_tx_power(&out->tx_power_qdbm) != ESP_OK) {
+        out->tx_power_qdbm = (int8_t)(def->tx_dbm * 4);
+    }
+}
+
+esp_err_t wifi_set_ip_address(const char *ip)
+{
+    if (s_sta_netif == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    esp_netif_ip_info_t ip_info;
+    esp_err_t ret = esp_netif_get_ip_info(s_sta_netif, &ip_info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    ip_info.ip.addr = esp_ip4addr_aton(ip);
+    ret = esp_netif_set_ip_info(s_sta_netif, &ip_info);
+    if (ret == ESP_OK) {
+        snprintf(s_ip_address, sizeof(s_ip_address), "%s", ip);
+        ESP_LOGI(TAG, "IP address changed to %s", ip);
+    }
+    return ret;
+}
+
 void wifi_disconnect(void)
 {
     esp_wifi_disconnect();
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""
+Host simulation of the config gossip protocol (src/gossip.c).
+
+Models N boards running push-pull anti-entropy in rounds: each board sends
+its version digest to one random peer from a bounded peer table, the peer
+pushes newer objects and requests older ones. One board publishes an
+object and the simulation counts rounds until every board holds it, plus
+the bytes sent. Message sizes follow the wire format in src/gossip.c.
+
+Usage:
+    python3 tools/gossip_sim.py --nodes 100 --loss 0.1 --trials 20
+"""
+
+import argparse
+import random
+import statistics
+
+# Wire sizes (see gs_header_t, gs_digest_entry_t, gs_object_t)
+HEADER_BYTES = 10
+DIGEST_ENTRY_BYTES = 9
+OBJECT_HEADER_BYTES = 11
+REQUEST_BYTES = HEADER_BYTES + 4
+OBJECT_COUNT = 5                        # SEQ_MAX_SLOTS + solar rules
+DIGEST_BYTES = HEADER_BYTES + OBJECT_COUNT * DIGEST_ENTRY_BYTES
+
+
+def run_trial(nodes, peers, loss, text_len, max_rounds, rng):
+    object_bytes = HEADER_BYTES + OBJECT_HEADER_BYTES + text_len
+    tables = [rng.sample([p for p in range(nodes) if p != n], min(peers, nodes - 1))
+              for n in range(nodes)]
+    has = [False] * nodes
+    has[0] = True                       # Board 0 publishes
+    sent = 0
+
+    def delivered():
+        return rng.random() >= loss
+
+    for rnd in range(1, max_rounds + 1):
+        order = list(range(nodes))
+        rng.shuffle(order)
+        for node in order:
+            peer = rng.choice(tables[node])
+            sent += DIGEST_BYTES
+            if not delivered():
+                continue
+            if has[peer] and not has[node]:
+                # Peer pushes the newer object back
+                sent += object_bytes
+                if delivered():
+                    has[node] = True
+            elif has[node] and not has[peer]:
+                # Peer requests it, sender answers
+                sent += REQUEST_BYTES
+                if delivered():
+                    sent += object_bytes
+                    if delivered():
+                        has[peer] = True
+        if all(has):
+            return rnd, sent
+    return None, sent
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--nodes", type=int, default=100)
+    parser.add_argument("--peers", type=int, default=16, help="GOSSIP_MAX_PEERS")
+    parser.add_argument("--loss", type=float, default=0.0, help="datagram loss rate")
+    parser.add_argument("--period-ms", type=int, default=1000, help="GOSSIP_PERIOD_MS")
+    parser.add_argument("--text-len", type=int, default=40, help="object text bytes")
+    parser.add_argument("--trials", type=int, default=20)
+    parser.add_argument("--max-rounds", type=int, default=200)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    rounds, traffic = [], []
+    for _ in range(args.trials):
+        r, sent = run_trial(args.nodes, args.peers, args.loss, args.text_len,
+                            args.max_rounds, rng)
+        if r is None:
+            print("trial did not converge within %d rounds" % args.max_rounds)
+            continue
+        rounds.append(r)
+        traffic.append(sent)
+
+    if not rounds:
+        return
+
+    mean_rounds = statistics.mean(rounds)
+    print("nodes=%d peers=%d loss=%.2f trials=%d" %
+          (args.nodes, args.peers, args.loss, len(rounds)))
+    print("convergence: mean %.1f rounds (%.1f s), worst %d rounds (%.1f s)" %
+          (mean_rounds, mean_rounds * args.period_ms / 1000.0,
+           max(rounds), max(rounds) * args.period_ms / 1000.0))
+    print("traffic: %.0f bytes per node until converged, %d bytes per node "
+          "per idle round" % (statistics.mean(traffic) / args.nodes, DIGEST_BYTES))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+"""
+Check that the firmware's IRAM code reaches nothing in flash.
+
+While flash is written (every NVS set that changes a value) the flash
+cache is off, and code that then runs - interrupts allocated with
+ESP_INTR_FLAG_IRAM, esp_timer ISR callbacks - must not fetch a single
+instruction or constant through it. The roots are the functions src/*.c
+defines with IRAM_ATTR or RELAY_IRAM_ATTR. Starting from each, the check
+disassembles the function, follows every call into other IRAM code and
+reports:
+  - a root that the link placed in flash (the attribute did not take),
+  - a call or jump into flash code (IROM),
+  - a literal that points into flash code or flash-mapped data (DROM:
+    const tables, format strings) or external RAM, which is cached too.
+ROM, IRAM, DRAM, RTC memory and peripheral registers are fine. A register
+call whose target was not loaded from a literal cannot be followed and is
+listed as a warning. A float constant can look like a DROM address; the
+report shows the instruction, so such a case is easy to tell.
+
+In a build without RELAY_IRAM_PROFILE, RELAY_IRAM_ATTR is empty and only
+the IRAM_ATTR roots are checked.
+
+The esp32dev_iram PlatformIO environment runs this after every link and
+fails the build on a finding. By hand:
+    python3 tools/iram_check.py .pio/build/esp32dev_iram/firmware.elf
+    python3 tools/iram_check.py --objdump ~/.platformio/packages/toolchain-xtensa-esp-elf/bin/xtensa-esp32-elf-objdump firmware.elf
+"""
+
+import argparse
+import glob
+import os
+import re
+import struct
+import subprocess
+import sys
+
+# ESP32 address map (technical reference manual, "System and Memory")
+REGIONS = (
+    (0x3F400000, 0x3F800000, "flash data (DROM)", False),
+    (0x3F800000, 0x3FC00000, "external RAM", False),
+    (0x3FF00000, 0x3FF80000, "peripherals", True),
+    (0x3FF80000, 0x40000000, "DRAM", True),
+    (0x40000000, 0x40070000, "ROM", True),
+    (0x40070000, 0x400C0000, "IRAM", True),
+    (0x400C0000, 0x400C2000, "RTC fast memory", True),
+    (0x400C2000, 0x40C00000, "flash code (IROM)", False),
+    (0x50000000, 0x50002000, "RTC slow memory", True),
+)
+IRAM = (0x40070000, 0x400C0000)
+
+ROOT = re.compile(r"\b(RELAY_)?IRAM_ATTR\s+(\w+)\s*\(")
+FUNC = re.compile(r"^([0-9a-f]{8}) <([^>]+)>:$")
+INSN = re.compile(r"^\s*([0-9a-f]{8}):\s+(?:[0-9a-f]{4,6}\s+)?(\S+)\s*(.*)$")
+TARGET = re.compile(r"\b([0-9a-f]{8})\b")
+DIRECT = ("call0", "call4", "call8", "call12", "j")
+INDIRECT = ("callx0", "callx4", "callx8", "callx12", "jx")
+
+
+def region(addr):
+    for lo, hi, name, safe in REGIONS:
+        if lo <= addr < hi:
+            return name, safe
+    return None, True           # Plain numbers, not addresses
+
+
+class Elf:
+    """Just enough of an ELF32 little-endian reader: sections and symbols."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError("%s: not a 32-bit little-endian ELF" % path)
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.data, 0x2E)
+        raw = [struct.unpack_from("<IIIIIIIIII", self.data, shoff + i * shentsize)
+               for i in range(shnum)]
+        names = raw[shstrndx][4]
+        self.sections = []
+        for name, kind, _, addr, offset, size, link, _, _, _ in raw:
+            self.sections.append({"name": self._str(names + name), "type": kind, "addr": addr,
+                                  "offset": offset, "size": size, "link": link})
+        self.symbols = {}
+        for sec in self.sections:
+            if sec["type"] != 2:        # SHT_SYMTAB
+                continue
+            strtab = self.sections[sec["link"]]["offset"]
+            for off in range(sec["offset"], sec["offset"] + sec["size"], 16):
+                name, value, size, info, _, _ = struct.unpack_from("<IIIBBH", self.data, off)
+                if info & 0xF == 2 and name:            # STT_FUNC
+                    self.symbols.setdefault(self._str(strtab + name), (value, size))
+
+    def _str(self, off):
+        return self.data[off:self.data.index(b"\0", off)].decode()
+
+    def word(self, addr):
+        for sec in self.sections:
+            if sec["type"] not in (0, 8) and sec["addr"] <= addr < sec["addr"] + sec["size"] - 3:
+                return struct.unpack_from("<I", self.data, sec["offset"] + addr - sec["addr"])[0]
+        return None
+
+    def section_of(self, addr):
+        for sec in self.sections:
+            if sec["addr"] and sec["addr"] <= addr < sec["addr"] + sec["size"]:
+                return sec["name"]
+        return "?"
+
+    def find(self, name):
+        """Address of a function, also under a GCC clone name (foo.isra.0)."""
+        if name in self.symbols:
+            return self.symbols[name][0]
+        for sym, (value, _) in self.symbols.items():
+            if sym.startswith(name + "."):
+                return value
+        return None
+
+
+def disassemble(objdump, elf_path, elf):
+    """IRAM code as {start: (name, [(addr, mnemonic, operands)])}."""
+    sections = [s["name"] for s in elf.sections
+                if s["type"] == 1 and IRAM[0] <= s["addr"] < IRAM[1] and s["size"]]
+    args = [objdump, "-d"] + ["-j%s" % s for s in sections] + [elf_path]
+    out = subprocess.run(args, capture_output=True, text=True, check=True).stdout
+    funcs, current = {}, None
+    for line in out.splitlines():
+        m = FUNC.match(line)
+        if m:
+            current = funcs.setdefault(int(m.group(1), 16), (m.group(2), []))
+            continue
+        m = INSN.match(line)
+        if m and current is not None:
+            current[1].append((int(m.group(1), 16), m.group(2), m.group(3)))
+    return funcs
+
+
+def source_roots(src_dir):
+    """[(file, function, profile_only)] for every IRAM-attributed definition."""
+    roots = []
+    for path in sorted(glob.glob(os.path.join(src_dir, "*.c"))):
+        with open(path) as f:
+            for line in f:
+                if line.lstrip().startswith("#"):
+                    continue
+                for relay, name in ROOT.findall(line):
+                    roots.append((os.path.basename(path), name, bool(relay)))
+    return roots
+
+
+def check(elf, funcs, roots, profile, out=sys.stdout):
+    """Walk the call graph from the roots; return the number of findings."""
+    starts = sorted(funcs)
+
+    def containing(addr):
+        lo, hi = 0, len(starts)
+        while lo < hi:
+            mid = (lo + hi) // 2
+            if starts[mid] <= addr:
+                lo = mid + 1
+            else:
+                hi = mid
+        return starts[lo - 1] if lo else None
+
+    findings, warnings, checked = [], [], set()
+    work = []
+    for src, name, profile_only in roots:
+        if profile_only and not profile:
+            continue
+        addr = elf.find(name)
+        if addr is None:
+            out.write("note: %s %s() not in the symbol table (inlined into its callers)\n" % (src, name))
+            continue
+        if not IRAM[0] <= addr < IRAM[1]:
+            where, _ = region(addr)
+            findings.append("%s() is in %s (0x%08x), not IRAM" % (name, where, addr))
+            continue
+        work.append((containing(addr), [name]))
+
+    while work:
+        start, chain = work.pop()
+        if start is None or start in checked:
+            continue
+        checked.add(start)
+        name, insns = funcs[start]
+        path = " <- ".join(reversed(chain))
+        literals = {}               # Register -> value of its last l32r
+        for addr, mnem, ops in insns:
+            if mnem == "l32r":
+                reg = ops.split(",")[0].strip()
+                m = TARGET.search(ops.split(",", 1)[1]) if "," in ops else None
+                value = elf.word(int(m.group(1), 16)) if m else None
+                if value is None:
+                    continue
+                literals[reg] = value
+                where, safe = region(value)
+                if not safe:
+                    findings.append("%s: 0x%08x l32r loads 0x%08x, %s (%s)"
+                                    % (path, addr, value, where, elf.section_of(value)))
+                elif IRAM[0] <= value < IRAM[1] and value in funcs:
+                    work.append((value, chain + [funcs[value][0]]))
+            elif mnem in DIRECT:
+                m = TARGET.search(ops)
+                if not m:
+                    continue
+                target = int(m.group(1), 16)
+                if start <= target < start + 0x10000 and containing(target) == start:
+                    continue                            # Branch inside the function
+                where, safe = region(target)
+                if not safe:
+                    findings.append("%s: 0x%08x %s into %s (0x%08x)" % (path, addr, mnem, where, target))
+                elif IRAM[0] <= target < IRAM[1]:
+                    callee = containing(target)
+                    if callee is not None:
+                        work.append((callee, chain + [funcs[callee][0]]))
+            elif mnem in INDIRECT:
+                reg = ops.strip()
+                if reg not in literals and mnem != "jx":
+                    warnings.append("%s: 0x%08x %s %s, target unknown" % (path, addr, mnem, reg))
+
+    for w in warnings:
+        out.write("warning: %s\n" % w)
+    for f in findings:
+        out.write("error: %s\n" % f)
+    out.write("iram_check: %d root(s), %d IRAM function(s) checked, %d finding(s)\n"
+              % (len(roots), len(checked), len(findings)))
+    return len(findings)
+
+
+def in_iram(elf, name):
+    addr = elf.find(name)
+    return addr is not None and IRAM[0] <= addr < IRAM[1]
+
+
+def run(elf_path, objdump, src_dir, out=sys.stdout):
+    elf = Elf(elf_path)
+    roots = source_roots(src_dir)
+    # The profile is on when any RELAY_IRAM_ATTR function made it to IRAM;
+    # then all of them must have
+    profile = any(in_iram(elf, name) for _, name, relay in roots if relay)
+    if not profile:
+        out.write("iram_check: RELAY_IRAM_PROFILE is off in this build, "
+                  "checking the IRAM_ATTR functions only\n")
+    return check(elf, disassemble(objdump, elf_path, elf), roots, profile, out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("elf")
+    parser.add_argument("--objdump", default="xtensa-esp32-elf-objdump")
+    parser.add_argument("--src", default=os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                      "..", "src"))
+    args = parser.parse_args()
+    return 1 if run(args.elf, args.objdump, args.src) else 0
+
+
+def pio_post_link(source, target, env):
+    tool = env.subst("$OBJCOPY")
+    objdump = tool.replace("objcopy", "objdump") if "objcopy" in tool else "xtensa-esp32-elf-objdump"
+    return 1 if run(str(target[0]), objdump, env.subst("$PROJECT_DIR/src")) else 0
+
+
+try:
+    Import("env")               # noqa: F821 - run as a PlatformIO extra script
+except NameError:
+    if __name__ == "__main__":
+        sys.exit(main())
+else:
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", pio_post_link)      # noqa: F821
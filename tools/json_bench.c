@@ -0,0 +1,248 @@
+/**
+ * @file json_bench.c
+ * @brief Compare the JSON writer with the printf templates it replaced
+ *
+ * Builds three API responses both ways, checks that the bodies are
+ * identical, and times each:
+ *   all      /relay/all/status for -n relays (strings, nested arrays)
+ *   numbers  /powerfail/status (fifteen integers and one string)
+ *   floats   /thermostat/status (two %.2f temperatures)
+ * The templates run into a buffer big enough for the body, as the old
+ * handlers assumed; the writer runs with the firmware's 512-byte buffer
+ * and a sink standing in for httpd_resp_send_chunk(), so flushing is
+ * part of its time. The timings are from the host, so only the ratio
+ * means anything for the board.
+ *
+ * Build (from the repository root):
+ *   gcc -O2 -Iinclude -Itools/relay_sim/port -o json_bench \
+ *       tools/json_bench.c src/json_writer.c -lm
+ * Usage:
+ *   json_bench [-n RELAYS] [-i ITERATIONS]
+ */
+
+#include "json_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WRITER_BUFFER       512         // HTTP_RESPONSE_BUFFER_SIZE
+#define BODY_MAX            (1 << 20)
+
+typedef struct {
+    char name[32];
+    int state;
+} relay_t;
+
+static relay_t *s_relays;
+static int s_relay_count = 4;
+
+static char s_body[BODY_MAX];           // Where the sink reassembles the writer's output
+static size_t s_body_len;
+
+/*============================================================================
+ * The replaced templates (ui_templates.h before the writer)
+ *============================================================================*/
+
+static const char JSON_RELAY_STATUS[] =
+"{\"id\":%d,\"name\":\"%s\",\"state\":%d}";
+static const char JSON_ALL_STATUS_START[] = "{\"relays\":[";
+static const char JSON_ALL_STATUS_END[] =
+"],\"power\":{\"used_w\":%lu,\"budget_w\":%lu,\"shed\":%lu,\"rejected\":%lu}}";
+static const char JSON_POWERFAIL_STATUS[] =
+"{\"enabled\":%d,\"armed\":%d,\"failing\":%d,\"recovered\":\"%s\",\"states\":%lu,"
+"\"version\":%lu,\"commands\":%lu,\"warnings\":%lu,\"flushes\":%lu,\"erases\":%lu,"
+"\"isr_us\":%lu,\"flash_us\":%lu,\"holdup_us\":%lu,\"slots_free\":%u,\"slots\":%u}";
+static const char JSON_THERMO_STATUS[] =
+"{\"enabled\":%d,\"sensor_ok\":%d,\"failsafe\":%d,\"setpoint\":%.2f,\"temp\":%.2f,"
+"\"stages\":%u,\"iterations\":%lu,\"switches\":[%lu,%lu],\"sensor_errors\":%lu,\"max_jitter_us\":%lu}";
+
+static size_t all_printf(char *out)
+{
+    char *p = out;
+    p += sprintf(p, "%s", JSON_ALL_STATUS_START);
+    for (int i = 0; i < s_relay_count; i++) {
+        if (i > 0) *p++ = ',';
+        p += sprintf(p, JSON_RELAY_STATUS, i, s_relays[i].name, s_relays[i].state);
+    }
+    p += sprintf(p, JSON_ALL_STATUS_END, 150UL, 2000UL, 3UL, 1UL);
+    return p - out;
+}
+
+static size_t numbers_printf(char *out)
+{
+    return snprintf(out, BODY_MAX, JSON_POWERFAIL_STATUS, 1, 1, 0, "flash",
+                    5UL, 12UL, 40UL, 2UL, 1UL, 0UL, 14UL, 0UL, 5000UL, 127U, 128U);
+}
+
+static size_t floats_printf(char *out)
+{
+    return snprintf(out, BODY_MAX, JSON_THERMO_STATUS, 1, 1, 0, 24.5, 26.137,
+                    1U, 86400UL, 31UL, 4UL, 0UL, 212UL);
+}
+
+/*============================================================================
+ * The writer, as the handlers now use it
+ *============================================================================*/
+
+static esp_err_t sink(void *ctx, const char *data, size_t len, bool last)
+{
+    (void)ctx;
+    (void)last;
+    memcpy(s_body + s_body_len, data, len);
+    s_body_len += len;
+    return ESP_OK;
+}
+
+static size_t all_writer(char *out)
+{
+    char buf[WRITER_BUFFER];
+    json_writer_t w;
+
+    (void)out;
+    s_body_len = 0;
+    json_writer_init(&w, buf, sizeof(buf), sink, NULL);
+    json_object_begin(&w, NULL);
+    json_array_begin(&w, "relays");
+    for (int i = 0; i < s_relay_count; i++) {
+        json_object_begin(&w, NULL);
+        json_int(&w, "id", i);
+        json_string(&w, "name", s_relays[i].name);
+        json_int(&w, "state", s_relays[i].state);
+        json_object_end(&w);
+    }
+    json_array_end(&w);
+    json_object_begin(&w, "power");
+    json_uint(&w, "used_w", 150);
+    json_uint(&w, "budget_w", 2000);
+    json_uint(&w, "shed", 3);
+    json_uint(&w, "rejected", 1);
+    json_object_end(&w);
+    json_object_end(&w);
+    json_writer_end(&w);
+    return s_body_len;
+}
+
+static size_t numbers_writer(char *out)
+{
+    char buf[WRITER_BUFFER];
+    json_writer_t w;
+
+    (void)out;
+    s_body_len = 0;
+    json_writer_init(&w, buf, sizeof(buf), sink, NULL);
+    json_object_begin(&w, NULL);
+    json_int(&w, "enabled", 1);
+    json_int(&w, "armed", 1);
+    json_int(&w, "failing", 0);
+    json_string(&w, "recovered", "flash");
+    json_uint(&w, "states", 5);
+    json_uint(&w, "version", 12);
+    json_uint(&w, "commands", 40);
+    json_uint(&w, "warnings", 2);
+    json_uint(&w, "flushes", 1);
+    json_uint(&w, "erases", 0);
+    json_uint(&w, "isr_us", 14);
+    json_uint(&w, "flash_us", 0);
+    json_uint(&w, "holdup_us", 5000);
+    json_uint(&w, "slots_free", 127);
+    json_uint(&w, "slots", 128);
+    json_object_end(&w);
+    json_writer_end(&w);
+    return s_body_len;
+}
+
+static size_t floats_writer(char *out)
+{
+    char buf[WRITER_BUFFER];
+    json_writer_t w;
+
+    (void)out;
+    s_body_len = 0;
+    json_writer_init(&w, buf, sizeof(buf), sink, NULL);
+    json_object_begin(&w, NULL);
+    json_int(&w, "enabled", 1);
+    json_int(&w, "sensor_ok", 1);
+    json_int(&w, "failsafe", 0);
+    json_float(&w, "setpoint", 24.5f, 2);
+    json_float(&w, "temp", 26.137f, 2);
+    json_uint(&w, "stages", 1);
+    json_uint(&w, "iterations", 86400);
+    json_array_begin(&w, "switches");
+    json_uint(&w, NULL, 31);
+    json_uint(&w, NULL, 4);
+    json_array_end(&w);
+    json_uint(&w, "sensor_errors", 0);
+    json_uint(&w, "max_jitter_us", 212);
+    json_object_end(&w);
+    json_writer_end(&w);
+    return s_body_len;
+}
+
+/*============================================================================
+ * Timing
+ *============================================================================*/
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double time_ns(size_t (*build)(char *), char *out, long iterations)
+{
+    volatile size_t total = 0;
+    double start = now_ns();
+    for (long i = 0; i < iterations; i++) {
+        total += build(out);
+    }
+    (void)total;
+    return (now_ns() - start) / iterations;
+}
+
+static void compare(const char *name, size_t (*old)(char *), size_t (*new)(char *), long iterations)
+{
+    static char expect[BODY_MAX];
+    size_t expect_len = old(expect);
+    size_t len = new(NULL);
+    bool same = (len == expect_len && memcmp(s_body, expect, len) == 0);
+
+    double t_old = time_ns(old, expect, iterations);
+    double t_new = time_ns(new, NULL, iterations);
+    printf("%-8s %7zu %12.0f %12.0f %7.2fx  %s\n", name, len, t_old, t_new,
+           t_new > 0 ? t_old / t_new : 0.0, same ? "identical" : "DIFFERENT");
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = 200000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            s_relay_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            iterations = atol(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: json_bench [-n RELAYS] [-i ITERATIONS]\n");
+            return 2;
+        }
+    }
+    if (s_relay_count < 1 || s_relay_count > 4096 || iterations < 1) {
+        fprintf(stderr, "json_bench: -n 1..4096, -i 1 or more\n");
+        return 2;
+    }
+
+    s_relays = calloc(s_relay_count, sizeof(*s_relays));
+    for (int i = 0; i < s_relay_count; i++) {
+        snprintf(s_relays[i].name, sizeof(s_relays[i].name), "%s %d", (i & 2) ? "Fan" : "Light", i + 1);
+        s_relays[i].state = i & 1;
+    }
+
+    printf("%-8s %7s %12s %12s %8s\n", "body", "bytes", "printf ns", "writer ns", "speedup");
+    compare("all", all_printf, all_writer, iterations / (1 + s_relay_count / 16));
+    compare("numbers", numbers_printf, numbers_writer, iterations);
+    compare("floats", floats_printf, floats_writer, iterations);
+    free(s_relays);
+    return 0;
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Build the UI asset archive for the assets partition (see src/ui_assets.c).
+
+Every file under the source directory is stored once, gzip-compressed
+where that helps (text formats), behind a sorted 64-byte-per-file index
+whose CRC32s serve as ETags. Output is deterministic: the same files give
+the same archive and the same ETags.
+
+Usage:
+    python3 tools/mkassets.py ui -o assets.bin
+    python3 tools/mkassets.py ui -o assets.bin --upload 192.168.1.100
+    esptool.py write_flash 0x190000 assets.bin     # First install over USB
+"""
+
+import argparse
+import gzip
+import http.client
+import os
+import struct
+import sys
+import zlib
+
+HEADER = struct.Struct("<4sHHII")               # 16 bytes
+ENTRY = struct.Struct("<48sIIIBBH")             # 64 bytes
+PARTITION_SIZE = 0x6f000                        # partitions.csv "assets"
+MAX_FILES = 64                                  # ASSETS_MAX_FILES
+
+# Order must match CONTENT_TYPES in src/ui_assets.c
+TYPES = {".html": 1, ".htm": 1, ".js": 2, ".css": 3, ".json": 4, ".svg": 5,
+         ".png": 6, ".ico": 7}
+COMPRESSIBLE = {1, 2, 3, 4, 5}
+
+
+def collect(root):
+    files = []
+    for dirpath, _, names in os.walk(root):
+        for name in names:
+            path = os.path.join(dirpath, name)
+            rel = os.path.relpath(path, root).replace(os.sep, "/")
+            if len(rel.encode()) > 47:
+                sys.exit("name too long (47 bytes max): %s" % rel)
+            files.append((rel, path))
+    files.sort(key=lambda f: f[0].encode())     # Byte order, as strcmp() sees it
+    if not files:
+        sys.exit("no files in %s" % root)
+    if len(files) > MAX_FILES:
+        sys.exit("%d files, at most %d fit the index" % (len(files), MAX_FILES))
+    return files
+
+
+def build(files):
+    index = []
+    blobs = []
+    offset = HEADER.size + ENTRY.size * len(files)
+    report = []
+    for rel, path in files:
+        raw = open(path, "rb").read()
+        ctype = TYPES.get(os.path.splitext(rel)[1].lower(), 0)
+        stored, encoding = raw, 0
+        if ctype in COMPRESSIBLE:
+            packed = gzip.compress(raw, compresslevel=9, mtime=0)
+            if len(packed) < len(raw):
+                stored, encoding = packed, 1
+        pad = (-offset) % 4
+        blobs.append(b"\0" * pad + stored)
+        offset += pad
+        index.append(ENTRY.pack(rel.encode(), offset, len(stored), zlib.crc32(stored),
+                                encoding, ctype, 0))
+        report.append((rel, len(raw), len(stored), zlib.crc32(stored)))
+        offset += len(stored)
+
+    body = b"".join(index) + b"".join(blobs)
+    total = HEADER.size + len(body)
+    return HEADER.pack(b"RUA1", 1, len(files), total, zlib.crc32(body)) + body, report
+
+
+def upload(host, archive):
+    port = 80
+    if ":" in host:
+        host, port = host.rsplit(":", 1)
+    conn = http.client.HTTPConnection(host, int(port), timeout=60)
+    conn.request("POST", "/assets", body=archive,
+                 headers={"Content-Type": "application/octet-stream"})
+    resp = conn.getresponse()
+    print("upload: %d %s" % (resp.status, resp.read().decode(errors="replace")))
+    return resp.status == 200
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("source", help="directory holding the UI files")
+    parser.add_argument("-o", "--output", default="assets.bin")
+    parser.add_argument("--upload", metavar="HOST[:PORT]",
+                        help="also POST the archive to a running board")
+    args = parser.parse_args()
+
+    archive, report = build(collect(args.source))
+    if len(archive) > PARTITION_SIZE:
+        sys.exit("archive is %d bytes, partition holds %d" % (len(archive), PARTITION_SIZE))
+
+    with open(args.output, "wb") as f:
+        f.write(archive)
+    for rel, raw, stored, crc in report:
+        print("%-32s %7d -> %7d bytes  etag %08x" % (rel, raw, stored, crc))
+    print("%s: %d files, %d bytes (%.0f%% of the partition)"
+          % (args.output, len(report), len(archive), 100.0 * len(archive) / PARTITION_SIZE))
+
+    if args.upload and not upload(args.upload, archive):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+"""
+Modbus TCP master for the relay board (src/modbus_server.c), and its poll bench.
+
+Speaks the function codes the board serves: 01 read coils, 02 read
+discrete inputs, 04 read input registers, 05 write single coil and 0F
+write multiple coils. Exception responses are printed with their code
+and make the exit status 1.
+
+poll keeps up to --depth requests in flight on one connection (the
+server handles pipelined requests in order) and reports polls per
+second, the round trip percentiles and any exceptions, then reads the
+board's own counters (input registers 7-10). check runs every function
+code once, including requests the board must refuse, and compares the
+answers with what was written. Works against a board or relay_host -m
+(tools/relay_sim/relay_host.c). Only the standard library is needed.
+
+Usage:
+    python3 tools/modbus_client.py 192.168.1.100 coils
+    python3 tools/modbus_client.py 192.168.1.100 registers
+    python3 tools/modbus_client.py 192.168.1.100 write-coil 2 on
+    python3 tools/modbus_client.py 192.168.1.100 write-coils 0 1010
+    python3 tools/modbus_client.py 192.168.1.100 poll --count 2000 --depth 8
+    python3 tools/modbus_client.py 127.0.0.1:1502 check
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+FC_READ_COILS, FC_READ_DISCRETE, FC_READ_INPUT_REGS = 0x01, 0x02, 0x04
+FC_WRITE_SINGLE_COIL, FC_WRITE_MULTI_COILS = 0x05, 0x0F
+EXCEPTIONS = {1: "illegal function", 2: "illegal address", 3: "illegal value",
+              4: "device failure", 6: "device busy"}
+REGISTERS = ("relay mask", "power used W", "power budget W", "loads shed",
+             "commands rejected", "uptime s (low)", "uptime s (high)", "requests (low)",
+             "requests (high)", "exceptions", "max service us", "masters", "free heap KB")
+UNIT = 1
+
+
+class ModbusError(Exception):
+    def __init__(self, fc, code):
+        super().__init__("exception %d (%s) to function 0x%02X" %
+                         (code, EXCEPTIONS.get(code, "?"), fc))
+        self.code = code
+
+
+class Master:
+    """One TCP connection; requests are matched to responses by transaction id"""
+
+    def __init__(self, host, port, timeout=2.0):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.tid = 0
+        self.rx = b""
+
+    def send(self, pdu):
+        self.tid = (self.tid + 1) & 0xFFFF
+        self.sock.sendall(struct.pack(">HHHB", self.tid, 0, len(pdu) + 1, UNIT) + pdu)
+        return self.tid
+
+    def receive(self):
+        """Next response as (transaction id, pdu)"""
+        while True:
+            if len(self.rx) >= 7:
+                tid, _, length, _ = struct.unpack(">HHHB", self.rx[:7])
+                if len(self.rx) >= 6 + length:
+                    pdu = self.rx[7:6 + length]
+                    self.rx = self.rx[6 + length:]
+                    return tid, pdu
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError("connection closed by the board")
+            self.rx += data
+
+    def request(self, pdu):
+        tid = self.send(pdu)
+        got, resp = self.receive()
+        if got != tid:
+            raise ConnectionError("transaction %d answered for %d" % (got, tid))
+        return check(pdu[0], resp)
+
+
+def check(fc, resp):
+    """Raise ModbusError for an exception response"""
+    if resp[0] == fc | 0x80:
+        raise ModbusError(fc, resp[1])
+    if resp[0] != fc:
+        raise ConnectionError("function 0x%02X answered with 0x%02X" % (fc, resp[0]))
+    return resp
+
+
+def read_bits(m, fc, start, count):
+    resp = m.request(struct.pack(">BHH", fc, start, count))
+    return [(resp[2 + i // 8] >> (i % 8)) & 1 for i in range(count)]
+
+
+def read_registers(m, start, count):
+    resp = m.request(struct.pack(">BHH", FC_READ_INPUT_REGS, start, count))
+    return list(struct.unpack(">%dH" % count, resp[2:2 + 2 * count]))
+
+
+def write_coil(m, addr, on):
+    m.request(struct.pack(">BHH", FC_WRITE_SINGLE_COIL, addr, 0xFF00 if on else 0))
+
+
+def write_coils(m, start, bits):
+    packed = bytearray((len(bits) + 7) // 8)
+    for i, b in enumerate(bits):
+        packed[i // 8] |= b << (i % 8)
+    m.request(struct.pack(">BHHB", FC_WRITE_MULTI_COILS, start, len(bits), len(packed)) +
+              bytes(packed))
+
+
+def percentile(sorted_values, pct):
+    return sorted_values[min(len(sorted_values) - 1, int(len(sorted_values) * pct / 100))]
+
+
+def poll(m, fc, count, depth):
+    """Pipelined reads; returns polls per second"""
+    pdu = struct.pack(">BHH", fc, 0, 1 if fc == FC_READ_INPUT_REGS else 4)
+    sent_at = {}
+    rtts, exceptions = [], {}
+    t0 = time.monotonic()
+    sent = 0
+    while sent < count or sent_at:
+        while sent < count and len(sent_at) < depth:
+            sent_at[m.send(pdu)] = time.monotonic()
+            sent += 1
+        tid, resp = m.receive()
+        rtts.append((time.monotonic() - sent_at.pop(tid)) * 1000.0)
+        try:
+            check(fc, resp)
+        except ModbusError as e:
+            exceptions[e.code] = exceptions.get(e.code, 0) + 1
+    elapsed = time.monotonic() - t0
+
+    rtts.sort()
+    print("%6s %6s %9s %8s %8s %8s %8s" %
+          ("polls", "depth", "polls/s", "p50 ms", "p90 ms", "p99 ms", "max ms"))
+    print("%6d %6d %9.0f %8.3f %8.3f %8.3f %8.3f" %
+          (count, depth, count / elapsed, percentile(rtts, 50), percentile(rtts, 90),
+           percentile(rtts, 99), rtts[-1]))
+    for code, n in sorted(exceptions.items()):
+        print("exception %d (%s): %d" % (code, EXCEPTIONS.get(code, "?"), n))
+    regs = read_registers(m, 7, 4)
+    print("board: %d requests, %d exceptions, max service %d us" %
+          (regs[0] | regs[1] << 16, regs[2], regs[3]))
+    return 1 if exceptions else 0
+
+
+def self_check(m):
+    """Every function code once, plus requests the board must refuse"""
+    failures = 0
+
+    def expect(name, ok):
+        nonlocal failures
+        print("%-44s %s" % (name, "ok" if ok else "FAIL"))
+        failures += not ok
+
+    def refused(name, pdu, code):
+        try:
+            m.request(pdu)
+            expect(name, False)
+        except ModbusError as e:
+            expect(name, e.code == code)
+
+    write_coils(m, 0, [1, 0, 1, 0])
+    expect("0F write 1010, 01 reads it back", read_bits(m, FC_READ_COILS, 0, 4) == [1, 0, 1, 0])
+    expect("02 matches 01", read_bits(m, FC_READ_DISCRETE, 0, 4) == [1, 0, 1, 0])
+    write_coil(m, 1, True)
+    write_coil(m, 0, False)
+    expect("05 on 1, off 0", read_bits(m, FC_READ_COILS, 0, 4) == [0, 1, 1, 0])
+    expect("04 register 0 is the relay mask", read_registers(m, 0, 1) == [0b0110])
+    write_coils(m, 1, [0, 0])
+    expect("0F at an offset (coils 1-2 off)", read_bits(m, FC_READ_COILS, 0, 4) == [0] * 4)
+
+    refused("01 past the last coil: exception 2",
+            struct.pack(">BHH", FC_READ_COILS, 3, 2), 2)
+    refused("04 past the last register: exception 2",
+            struct.pack(">BHH", FC_READ_INPUT_REGS, 0, len(REGISTERS) + 1), 2)
+    refused("05 with value 0x1234: exception 3",
+            struct.pack(">BHH", FC_WRITE_SINGLE_COIL, 0, 0x1234), 3)
+    refused("0F with a wrong byte count: exception 3",
+            struct.pack(">BHHB", FC_WRITE_MULTI_COILS, 0, 4, 2) + b"\x00\x00", 3)
+    refused("03 (not served): exception 1", struct.pack(">BHH", 0x03, 0, 1), 1)
+
+    # Pipelined: all sent before any answer is read, answered in order
+    tids = [m.send(struct.pack(">BHH", FC_WRITE_SINGLE_COIL, i % 4, 0xFF00 if i < 4 else 0))
+            for i in range(6)]
+    tids.append(m.send(struct.pack(">BHH", FC_READ_COILS, 0, 4)))
+    answers = [m.receive() for _ in tids]
+    expect("7 pipelined requests answered in order", [t for t, _ in answers] == tids)
+    expect("pipelined writes applied in order", answers[-1][1][2] & 0x0F == 0b1100)
+    write_coils(m, 0, [0] * 4)
+    return 1 if failures else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("host", help="board address, optionally host:port (default port 502)")
+    sub = parser.add_subparsers(dest="command", required=True)
+    for name in ("coils", "inputs", "registers"):
+        p = sub.add_parser(name)
+        p.add_argument("start", type=int, nargs="?", default=0)
+        p.add_argument("count", type=int, nargs="?")
+    p = sub.add_parser("write-coil")
+    p.add_argument("addr", type=int)
+    p.add_argument("state", choices=("on", "off"))
+    p = sub.add_parser("write-coils")
+    p.add_argument("start", type=int)
+    p.add_argument("bits", help="coil states from start on, e.g. 1010")
+    p = sub.add_parser("poll")
+    p.add_argument("--count", type=int, default=1000)
+    p.add_argument("--depth", type=int, default=1, help="requests in flight")
+    p.add_argument("--fc", type=lambda s: int(s, 0), default=FC_READ_COILS,
+                   choices=(FC_READ_COILS, FC_READ_DISCRETE, FC_READ_INPUT_REGS))
+    sub.add_parser("check")
+    args = parser.parse_args()
+
+    host, _, port = args.host.partition(":")
+    m = Master(host, int(port or 502))
+    result = 0
+    try:
+        if args.command in ("coils", "inputs"):
+            fc = FC_READ_COILS if args.command == "coils" else FC_READ_DISCRETE
+            bits = read_bits(m, fc, args.start, args.count or 4 - args.start)
+            for i, b in enumerate(bits):
+                print("%d %s" % (args.start + i, "on" if b else "off"))
+        elif args.command == "registers":
+            count = args.count or len(REGISTERS) - args.start
+            for i, v in enumerate(read_registers(m, args.start, count)):
+                name = REGISTERS[args.start + i] if args.start + i < len(REGISTERS) else ""
+                print("%2d %6d  %s" % (args.start + i, v, name))
+        elif args.command == "write-coil":
+            write_coil(m, args.addr, args.state == "on")
+        elif args.command == "write-coils":
+            write_coils(m, args.start, [int(c) for c in args.bits])
+        elif args.command == "poll":
+            result = poll(m, args.fc, args.count, args.depth)
+        else:
+            result = self_check(m)
+    except ModbusError as e:
+        print(e)
+        result = 1
+    sys.exit(result)
+
+
+if __name__ == "__main__":
+    main()
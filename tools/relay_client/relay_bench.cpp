@@ -0,0 +1,135 @@
+/**
+ * @file relay_bench.cpp
+ * @brief Throughput comparison: relay_client.hpp against one connection per call
+ *
+ * Sends N status requests to one board three ways:
+ *   naive  - new TCP connection per request, like curl in a loop
+ *   pooled - relay::Client, waiting for each response before the next
+ *   async  - relay::Client with up to --window requests outstanding
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -pthread tools/relay_client/relay_bench.cpp -o relay_bench
+ * Usage:
+ *   ./relay_bench 192.168.1.100 [-n 500] [-w 16] [-c 2] [-d 8]
+ */
+
+#include "relay_client.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+/**
+ * @brief One blocking request on a fresh connection; returns the HTTP status
+ */
+static int naive_get(const sockaddr_in &addr, const std::string &host, const std::string &path)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (const sockaddr *)&addr, sizeof(addr)) != 0) {
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    std::string req = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+    (void)!send(fd, req.data(), req.size(), MSG_NOSIGNAL);
+
+    std::string in;
+    char buf[2048];
+    relay::Response r;
+    bool close_after;
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        in.append(buf, (size_t)n);
+        if (relay::detail::parse_response(in, r, close_after) > 0) break;
+    }
+    close(fd);
+    return r.status;
+}
+
+static void report(const char *mode, int n, int ok, double ms)
+{
+    std::printf("%-7s %6d requests  %6d ok  %9.1f ms  %9.0f req/s  %7.3f ms/req\n",
+                mode, n, ok, ms, n * 1000.0 / ms, ms / n);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s host[:port] [-n N] [-w window] [-c conns] [-d depth]\n", argv[0]);
+        return 2;
+    }
+    std::string host = argv[1];
+    int count = 500;
+    int window = 16;
+    relay::Options options;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        int value = std::atoi(argv[i + 1]);
+        if (flag == "-n") count = value;
+        else if (flag == "-w") window = value;
+        else if (flag == "-c") options.connections = (unsigned)value;
+        else if (flag == "-d") options.pipeline_depth = (unsigned)value;
+    }
+
+    relay::Client client(options);
+    relay::Device board = client.device(host);
+    const std::string path = "/relay/0/status";
+
+    // Resolve the same address for the naive loop
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    size_t colon = host.rfind(':');
+    std::string name = colon == std::string::npos ? host : host.substr(0, colon);
+    addr.sin_port = htons(colon == std::string::npos ? options.port
+                                                     : (uint16_t)std::atoi(host.c_str() + colon + 1));
+    if (inet_pton(AF_INET, name.c_str(), &addr.sin_addr) != 1) {
+        std::fprintf(stderr, "naive mode needs a numeric IPv4 address\n");
+        return 2;
+    }
+
+    auto t0 = Clock::now();
+    int ok = 0;
+    for (int i = 0; i < count; i++) {
+        if (naive_get(addr, host, path) == 200) ok++;
+    }
+    report("naive", count, ok, ms_since(t0));
+
+    t0 = Clock::now();
+    ok = 0;
+    for (int i = 0; i < count; i++) {
+        if (board.get(path).get().ok()) ok++;
+    }
+    report("pooled", count, ok, ms_since(t0));
+
+    // Keep a fixed window of requests in flight; each completion submits the next
+    std::mutex lock;
+    std::condition_variable done_cv;
+    std::atomic<int> submitted{0}, completed{0}, succeeded{0};
+    std::function<void()> submit_one = [&]() {
+        if (submitted.fetch_add(1) >= count) return;
+        board.get(path, [&](const relay::Response &r) {
+            if (r.ok()) succeeded++;
+            if (completed.fetch_add(1) + 1 == count) {
+                std::lock_guard<std::mutex> guard(lock);
+                done_cv.notify_one();
+            } else {
+                submit_one();
+            }
+        });
+    };
+    t0 = Clock::now();
+    for (int i = 0; i < std::min(window, count); i++) submit_one();
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        done_cv.wait(guard, [&] { return completed.load() >= count; });
+    }
+    report("async", count, succeeded.load(), ms_since(t0));
+    return 0;
+}
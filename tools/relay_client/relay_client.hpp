@@ -0,0 +1,744 @@
+/**
+ * @file relay_client.hpp
+ * @brief Header-only C++17 client for the relay controller REST API
+ *
+ * One Client owns a background I/O thread and a pool of persistent
+ * keep-alive connections per board. Calls never block: each returns a
+ * std::future<Response> or invokes a callback.
+ *
+ * - Requests to the same board are spread over at most
+ *   Options::connections sockets. Each socket pipelines up to
+ *   Options::pipeline_depth requests.
+ * - Requests that arrive while the pool is busy are queued. They are
+ *   written to the next free socket together, in one send(), so a burst
+ *   of commands costs one TCP segment rather than one round trip each.
+ *
+ * Keep connections * boards below HTTP_MAX_CONNECTIONS on the board
+ * (4 by default). The server drops its least recently used socket when
+ * it runs out.
+ *
+ * A request that was written but not answered is failed, not resent,
+ * because most commands (toggle, pulse) are not idempotent. The one
+ * exception is a reused keep-alive socket that the board closed before
+ * sending any byte back; its requests are resent once.
+ *
+ * Example:
+ *   relay::Client client;
+ *   relay::Device board = client.device("192.168.1.100");
+ *   auto on = board.on(0);
+ *   board.pulse(2, 500, [](const relay::Response &r) { ... });
+ *   if (on.get().ok()) ...
+ *
+ * Callbacks run on the I/O thread and must not block.
+ */
+
+#ifndef RELAY_CLIENT_HPP
+#define RELAY_CLIENT_HPP
+
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace relay {
+
+/**
+ * @brief Result of one request
+ *
+ * status is the HTTP status, or 0 with error set on transport failure or
+ * timeout.
+ */
+struct Response {
+    int status = 0;
+    std::string body;
+    std::string error;
+
+    bool ok() const { return status >= 200 && status < 300; }
+
+    /**
+     * @brief Integer value of the first "key":N in the JSON body
+     */
+    long field(const std::string &key, long fallback = -1) const
+    {
+        std::string needle = "\"" + key + "\":";
+        size_t pos = body.find(needle);
+        if (pos == std::string::npos) {
+            return fallback;
+        }
+        const char *start = body.c_str() + pos + needle.size();
+        char *end = nullptr;
+        long value = std::strtol(start, &end, 10);
+        return end == start ? fallback : value;
+    }
+};
+
+using Callback = std::function<void(const Response &)>;
+
+/**
+ * @brief Client tuning
+ */
+struct Options {
+    uint16_t port = 80;
+    unsigned connections = 2;       // Sockets per board
+    unsigned pipeline_depth = 8;    // Requests in flight per socket
+    unsigned timeout_ms = 5000;     // Per request, from submission
+};
+
+namespace detail {
+
+using Clock = std::chrono::steady_clock;
+
+struct Request {
+    std::string wire;
+    std::promise<Response> promise;
+    Callback callback;
+    Clock::time_point deadline;
+    bool resent = false;
+
+    void complete(Response r)
+    {
+        if (callback) {
+            callback(r);
+        } else {
+            promise.set_value(std::move(r));
+        }
+    }
+};
+
+using RequestPtr = std::unique_ptr<Request>;
+
+struct Conn {
+    int fd = -1;
+    bool connecting = false;
+    bool reused = false;            // Idle keep-alive socket picked up again
+    bool got_bytes = false;         // Any response byte since (re)use
+    std::string out;
+    size_t out_off = 0;
+    std::string in;
+    std::deque<RequestPtr> inflight;
+};
+
+struct Board {
+    std::string host;
+    sockaddr_in addr{};
+    std::deque<RequestPtr> queue;   // Guarded by Client::lock_
+    std::deque<Conn> conns;         // I/O thread only
+};
+
+inline void fail(RequestPtr &req, const char *error)
+{
+    Response r;
+    r.error = error;
+    req->complete(std::move(r));
+}
+
+/**
+ * @brief Decode a chunked body starting at pos
+ *
+ * The firmware sends bodies longer than HTTP_RESPONSE_BUFFER_SIZE as
+ * chunks of that size.
+ *
+ * @return Offset just past the body, 0 if incomplete, -1 if malformed
+ */
+inline long parse_chunked(const std::string &buf, size_t pos, std::string &body)
+{
+    body.clear();
+    while (true) {
+        size_t eol = buf.find("\r\n", pos);
+        if (eol == std::string::npos) {
+            return buf.size() - pos > 16 ? -1 : 0;
+        }
+        char *end;
+        unsigned long size = std::strtoul(buf.c_str() + pos, &end, 16);
+        if (end == buf.c_str() + pos) {
+            return -1;
+        }
+        pos = eol + 2;
+        if (size == 0) {
+            break;
+        }
+        if (buf.size() < pos + size + 2) {
+            return 0;
+        }
+        if (buf.compare(pos + size, 2, "\r\n") != 0) {
+            return -1;
+        }
+        body.append(buf, pos, size);
+        pos += size + 2;
+    }
+
+    // Trailer lines (none from the firmware), then an empty line
+    while (true) {
+        size_t eol = buf.find("\r\n", pos);
+        if (eol == std::string::npos) {
+            return 0;
+        }
+        bool empty = (eol == pos);
+        pos = eol + 2;
+        if (empty) {
+            return (long)pos;
+        }
+    }
+}
+
+/**
+ * @brief Parse one complete response off the front of buf
+ *
+ * @return Bytes consumed, 0 if incomplete, -1 if malformed
+ */
+inline long parse_response(const std::string &buf, Response &out, bool &close_after)
+{
+    size_t head_end = buf.find("\r\n\r\n");
+    if (head_end == std::string::npos) {
+        return buf.size() > 8192 ? -1 : 0;
+    }
+    if (buf.compare(0, 5, "HTTP/") != 0) {
+        return -1;
+    }
+
+    size_t sp = buf.find(' ');
+    out.status = std::atoi(buf.c_str() + sp + 1);
+
+    long content_length = -1;
+    bool chunked = false;
+    close_after = false;
+    size_t line = buf.find("\r\n") + 2;
+    while (line < head_end) {
+        size_t eol = buf.find("\r\n", line);
+        std::string header = buf.substr(line, eol - line);
+        for (size_t i = 0; i < header.size() && header[i] != ':'; i++) {
+            header[i] = (char)std::tolower((unsigned char)header[i]);
+        }
+        if (header.compare(0, 15, "content-length:") == 0) {
+            content_length = std::atol(header.c_str() + 15);
+        } else if (header.compare(0, 18, "transfer-encoding:") == 0 &&
+                   header.find("chunked") != std::string::npos) {
+            chunked = true;
+        } else if (header.compare(0, 11, "connection:") == 0 &&
+                   header.find("close") != std::string::npos) {
+            close_after = true;
+        }
+        line = eol + 2;
+    }
+    if (chunked) {
+        return parse_chunked(buf, head_end + 4, out.body);
+    }
+    if (content_length < 0) {
+        return -1;          // Content-Length or chunks; the firmware sends one
+    }
+
+    size_t total = head_end + 4 + (size_t)content_length;
+    if (buf.size() < total) {
+        return 0;
+    }
+    out.body = buf.substr(head_end + 4, (size_t)content_length);
+    return (long)total;
+}
+
+} // namespace detail
+
+class Client;
+
+/**
+ * @brief Handle to one board; cheap to copy
+ *
+ * Every call has a future and a callback form.
+ */
+class Device {
+public:
+    std::future<Response> get(const std::string &path);
+    std::future<Response> post(const std::string &path, const std::string &body);
+    void get(const std::string &path, Callback cb);
+    void post(const std::string &path, const std::string &body, Callback cb);
+
+    // Relays (id 0-3)
+    std::future<Response> toggle(int id) { return get(relay_path(id, "toggle")); }
+    std::future<Response> on(int id) { return get(relay_path(id, "on")); }
+    std::future<Response> off(int id) { return get(relay_path(id, "off")); }
+    std::future<Response> status(int id) { return get(relay_path(id, "status")); }
+    std::future<Response> pulse(int id, unsigned ms) { return get(pulse_path(id, ms)); }
+    void toggle(int id, Callback cb) { get(relay_path(id, "toggle"), std::move(cb)); }
+    void on(int id, Callback cb) { get(relay_path(id, "on"), std::move(cb)); }
+    void off(int id, Callback cb) { get(relay_path(id, "off"), std::move(cb)); }
+    void status(int id, Callback cb) { get(relay_path(id, "status"), std::move(cb)); }
+    void pulse(int id, unsigned ms, Callback cb) { get(pulse_path(id, ms), std::move(cb)); }
+
+    std::future<Response> all_status() { return get("/relay/all/status"); }
+    std::future<Response> all_on() { return get("/relay/all/on"); }
+    std::future<Response> all_off() { return get("/relay/all/off"); }
+
+    // Sequences
+    std::future<Response> seq_upload(int slot, const std::string &text)
+    {
+        return post("/seq/" + std::to_string(slot), text);
+    }
+    std::future<Response> seq_run(int slot) { return get(seq_path(slot, "run")); }
+    std::future<Response> seq_cancel(int slot) { return get(seq_path(slot, "cancel")); }
+    std::future<Response> seq_status(int slot) { return get(seq_path(slot, "status")); }
+
+    // Thermostat; query is e.g. "sp=27.5&enabled=1"
+    std::future<Response> thermostat_status() { return get("/thermostat/status"); }
+    std::future<Response> thermostat_set(const std::string &query)
+    {
+        return get("/thermostat/set?" + query);
+    }
+
+    // Solar schedule, fleet services and integrations
+    std::future<Response> solar_rules(const std::string &text) { return post("/solar/rules", text); }
+    std::future<Response> solar_status() { return get("/solar/status"); }
+    std::future<Response> failover_status() { return get("/failover/status"); }
+    std::future<Response> gossip_status() { return get("/gossip/status"); }
+    std::future<Response> set_webhooks(const std::string &urls) { return post("/webhooks", urls); }
+    std::future<Response> webhooks_status() { return get("/webhooks/status"); }
+    std::future<Response> set_telemetry(const std::string &url) { return post("/telemetry", url); }
+    std::future<Response> telemetry_status() { return get("/telemetry/status"); }
+
+    const std::string &host() const { return board_->host; }
+
+private:
+    friend class Client;
+    Device(Client *client, std::shared_ptr<detail::Board> board)
+        : client_(client), board_(std::move(board)) {}
+
+    static std::string relay_path(int id, const char *action)
+    {
+        return "/relay/" + std::to_string(id) + "/" + action;
+    }
+    static std::string pulse_path(int id, unsigned ms)
+    {
+        return relay_path(id, "pulse") + "?ms=" + std::to_string(ms);
+    }
+    static std::string seq_path(int slot, const char *action)
+    {
+        return "/seq/" + std::to_string(slot) + "/" + action;
+    }
+
+    Client *client_;
+    std::shared_ptr<detail::Board> board_;
+};
+
+/**
+ * @brief Connection pools and the I/O thread for any number of boards
+ */
+class Client {
+public:
+    explicit Client(Options options = Options()) : options_(options)
+    {
+        if (options_.connections == 0) options_.connections = 1;
+        if (options_.pipeline_depth == 0) options_.pipeline_depth = 1;
+        if (pipe(wake_) != 0) {
+            throw std::runtime_error("relay::Client: pipe failed");
+        }
+        fcntl(wake_[0], F_SETFL, O_NONBLOCK);
+        fcntl(wake_[1], F_SETFL, O_NONBLOCK);
+        io_ = std::thread([this] { run(); });
+    }
+
+    ~Client()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stop_ = true;
+        }
+        wake();
+        io_.join();
+        close(wake_[0]);
+        close(wake_[1]);
+    }
+
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    /**
+     * @brief Get the handle for a board
+     *
+     * @param host IPv4 address or name, optionally with ":port"
+     */
+    Device device(const std::string &host)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = boards_.find(host);
+        if (it != boards_.end()) {
+            return Device(this, it->second);
+        }
+
+        auto board = std::make_shared<detail::Board>();
+        board->host = host;
+        board->conns.resize(options_.connections);
+
+        std::string name = host;
+        uint16_t port = options_.port;
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos) {
+            name = host.substr(0, colon);
+            port = (uint16_t)std::atoi(host.c_str() + colon + 1);
+        }
+        board->addr.sin_family = AF_INET;
+        board->addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, name.c_str(), &board->addr.sin_addr) != 1) {
+            addrinfo hints{}, *res = nullptr;
+            hints.ai_family = AF_INET;
+            if (getaddrinfo(name.c_str(), nullptr, &hints, &res) != 0 || res == nullptr) {
+                throw std::invalid_argument("relay::Client: cannot resolve " + name);
+            }
+            board->addr.sin_addr = ((sockaddr_in *)res->ai_addr)->sin_addr;
+            freeaddrinfo(res);
+        }
+
+        boards_[host] = board;
+        return Device(this, board);
+    }
+
+private:
+    friend class Device;
+
+    void submit(const std::shared_ptr<detail::Board> &board, const char *method,
+                const std::string &path, const std::string &body,
+                detail::RequestPtr req)
+    {
+        req->wire.reserve(64 + path.size() + body.size());
+        req->wire.append(method).append(" ").append(path).append(" HTTP/1.1\r\nHost: ")
+            .append(board->host).append("\r\n");
+        if (!body.empty() || std::strcmp(method, "POST") == 0) {
+            req->wire.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+        }
+        req->wire.append("\r\n").append(body);
+        req->deadline = detail::Clock::now() + std::chrono::milliseconds(options_.timeout_ms);
+
+        bool was_empty;
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            was_empty = board->queue.empty();
+            board->queue.push_back(std::move(req));
+        }
+        // Requests queued behind a pending wake-up ride along in its batch
+        if (was_empty) {
+            wake();
+        }
+    }
+
+    void wake()
+    {
+        char c = 1;
+        (void)!write(wake_[1], &c, 1);
+    }
+
+    void close_conn(detail::Board &board, detail::Conn &conn, const char *error)
+    {
+        if (conn.fd >= 0) {
+            close(conn.fd);
+        }
+
+        // A reused socket the board closed before answering anything:
+        // nothing was processed, so resend once from the front of the queue
+        bool stale = conn.reused && !conn.got_bytes && !conn.connecting;
+        std::deque<detail::RequestPtr> resend;
+        for (auto &req : conn.inflight) {
+            if (stale && !req->resent) {
+                req->resent = true;
+                resend.push_back(std::move(req));
+            } else {
+                detail::fail(req, error);
+            }
+        }
+        if (!resend.empty()) {
+            std::lock_guard<std::mutex> guard(lock_);
+            board.queue.insert(board.queue.begin(),
+                               std::make_move_iterator(resend.begin()),
+                               std::make_move_iterator(resend.end()));
+        }
+
+        conn = detail::Conn();
+    }
+
+    bool open_conn(detail::Board &board, detail::Conn &conn)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return false;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+
+        conn = detail::Conn();
+        conn.fd = fd;
+        if (connect(fd, (const sockaddr *)&board.addr, sizeof(board.addr)) != 0) {
+            if (errno != EINPROGRESS) {
+                close(fd);
+                conn.fd = -1;
+                return false;
+            }
+            conn.connecting = true;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Move queued requests onto sockets with pipeline room
+     */
+    void dispatch(detail::Board &board)
+    {
+        std::deque<detail::RequestPtr> failed;
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            assign_locked(board, failed);
+        }
+        // Completions run without the lock so callbacks may submit again
+        for (auto &req : failed) detail::fail(req, "socket failed");
+    }
+
+    void assign_locked(detail::Board &board, std::deque<detail::RequestPtr> &failed)
+    {
+        while (!board.queue.empty()) {
+            // Least loaded socket; open one rather than deepen a pipeline
+            detail::Conn *best = nullptr;
+            for (auto &conn : board.conns) {
+                if (conn.fd < 0) {
+                    best = &conn;
+                    break;
+                }
+                if (conn.inflight.size() < options_.pipeline_depth &&
+                    (best == nullptr || conn.inflight.size() < best->inflight.size())) {
+                    best = &conn;
+                }
+            }
+            if (best == nullptr) {
+                return;         // Every pipeline is full
+            }
+            if (best->fd < 0) {
+                if (!open_conn(board, *best)) {
+                    failed.swap(board.queue);
+                    return;
+                }
+            } else if (best->inflight.empty()) {
+                best->reused = true;
+                best->got_bytes = false;
+            }
+
+            while (!board.queue.empty() && best->inflight.size() < options_.pipeline_depth) {
+                best->out += board.queue.front()->wire;
+                best->inflight.push_back(std::move(board.queue.front()));
+                board.queue.pop_front();
+            }
+        }
+    }
+
+    void flush(detail::Board &board, detail::Conn &conn)
+    {
+        while (conn.out_off < conn.out.size()) {
+            ssize_t n = send(conn.fd, conn.out.data() + conn.out_off,
+                             conn.out.size() - conn.out_off, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    close_conn(board, conn, "send failed");
+                }
+                return;
+            }
+            conn.out_off += (size_t)n;
+        }
+        conn.out.clear();
+        conn.out_off = 0;
+    }
+
+    void receive(detail::Board &board, detail::Conn &conn)
+    {
+        char buf[4096];
+        bool closed = false;
+        while (true) {
+            ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                closed = true;
+                break;
+            }
+            if (n < 0) {
+                break;
+            }
+            conn.in.append(buf, (size_t)n);
+            conn.got_bytes = true;
+        }
+
+        // Responses that arrived with the board's FIN are still answers;
+        // only the requests left after them fail
+        while (!conn.inflight.empty()) {
+            Response r;
+            bool close_after = false;
+            long used = detail::parse_response(conn.in, r, close_after);
+            if (used == 0) {
+                break;
+            }
+            if (used < 0) {
+                close_conn(board, conn, "malformed response");
+                return;
+            }
+            conn.in.erase(0, (size_t)used);
+            detail::RequestPtr req = std::move(conn.inflight.front());
+            conn.inflight.pop_front();
+            req->complete(std::move(r));
+            if (close_after) {
+                close_conn(board, conn, "connection closed");
+                return;
+            }
+        }
+        if (closed) {
+            close_conn(board, conn, "connection closed");
+        }
+    }
+
+    void expire(detail::Board &board, detail::Clock::time_point now)
+    {
+        for (auto &conn : board.conns) {
+            if (!conn.inflight.empty() && conn.inflight.front()->deadline <= now) {
+                // The pipeline behind a stuck response is lost with it
+                close_conn(board, conn, "timeout");
+            }
+        }
+        std::deque<detail::RequestPtr> expired;
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            while (!board.queue.empty() && board.queue.front()->deadline <= now) {
+                expired.push_back(std::move(board.queue.front()));
+                board.queue.pop_front();
+            }
+        }
+        for (auto &req : expired) detail::fail(req, "timeout");
+    }
+
+    void run()
+    {
+        std::vector<pollfd> fds;
+        std::vector<std::pair<detail::Board *, detail::Conn *>> owners;
+
+        while (true) {
+            std::vector<std::shared_ptr<detail::Board>> boards;
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                if (stop_) break;
+                boards.reserve(boards_.size());
+                for (auto &entry : boards_) boards.push_back(entry.second);
+            }
+
+            auto now = detail::Clock::now();
+            fds.assign(1, pollfd{wake_[0], POLLIN, 0});
+            owners.assign(1, {nullptr, nullptr});
+            for (auto &board : boards) {
+                expire(*board, now);
+                dispatch(*board);
+                for (auto &conn : board->conns) {
+                    if (conn.fd < 0) continue;
+                    if (!conn.connecting && !conn.out.empty()) flush(*board, conn);
+                    if (conn.fd < 0) continue;
+                    short events = POLLIN;
+                    if (conn.connecting || !conn.out.empty()) events |= POLLOUT;
+                    fds.push_back(pollfd{conn.fd, events, 0});
+                    owners.push_back({board.get(), &conn});
+                }
+            }
+
+            if (poll(fds.data(), fds.size(), 50) <= 0) {
+                continue;
+            }
+
+            if (fds[0].revents & POLLIN) {
+                char drain[64];
+                while (read(wake_[0], drain, sizeof(drain)) > 0) {}
+            }
+            for (size_t i = 1; i < fds.size(); i++) {
+                detail::Board &board = *owners[i].first;
+                detail::Conn &conn = *owners[i].second;
+                if (fds[i].revents == 0 || conn.fd != fds[i].fd) continue;
+
+                if (conn.connecting) {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0) {
+                        close_conn(board, conn, "connect failed");
+                        continue;
+                    }
+                    conn.connecting = false;
+                }
+                if (fds[i].revents & POLLOUT) flush(board, conn);
+                if (conn.fd >= 0 && (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    receive(board, conn);
+                }
+            }
+        }
+
+        // Fail whatever is left so no future waits forever
+        std::deque<detail::RequestPtr> left;
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            for (auto &entry : boards_) {
+                for (auto &conn : entry.second->conns) {
+                    if (conn.fd >= 0) close(conn.fd);
+                    for (auto &req : conn.inflight) left.push_back(std::move(req));
+                    conn = detail::Conn();
+                }
+                for (auto &req : entry.second->queue) left.push_back(std::move(req));
+                entry.second->queue.clear();
+            }
+        }
+        for (auto &req : left) detail::fail(req, "client closed");
+    }
+
+    Options options_;
+    std::mutex lock_;
+    std::map<std::string, std::shared_ptr<detail::Board>> boards_;
+    int wake_[2] = {-1, -1};
+    bool stop_ = false;
+    std::thread io_;
+};
+
+inline std::future<Response> Device::get(const std::string &path)
+{
+    auto req = std::make_unique<detail::Request>();
+    std::future<Response> result = req->promise.get_future();
+    client_->submit(board_, "GET", path, std::string(), std::move(req));
+    return result;
+}
+
+inline std::future<Response> Device::post(const std::string &path, const std::string &body)
+{
+    auto req = std::make_unique<detail::Request>();
+    std::future<Response> result = req->promise.get_future();
+    client_->submit(board_, "POST", path, body, std::move(req));
+    return result;
+}
+
+inline void Device::get(const std::string &path, Callback cb)
+{
+    auto req = std::make_unique<detail::Request>();
+    req->callback = std::move(cb);
+    client_->submit(board_, "GET", path, std::string(), std::move(req));
+}
+
+inline void Device::post(const std::string &path, const std::string &body, Callback cb)
+{
+    auto req = std::make_unique<detail::Request>();
+    req->callback = std::move(cb);
+    client_->submit(board_, "POST", path, body, std::move(req));
+}
+
+} // namespace relay
+
+#endif // RELAY_CLIENT_HPP
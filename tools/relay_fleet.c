@@ -0,0 +1,675 @@
+/**
+ * @file relay_fleet.c
+ * @brief Fleet command-line tool: one request to many boards at once
+ *
+ * A single-threaded epoll engine keeps up to -c requests in flight at a
+ * time. Each board gets a per-attempt timeout. Failed attempts are
+ * retried with exponential backoff. A connect failure is always retried,
+ * because the board never saw the request. A failure after the request
+ * was sent is retried only for idempotent commands, not toggle or pulse.
+ * Results are printed as they arrive, followed by a summary.
+ *
+ * Build:
+ *   gcc -O2 -o relay_fleet tools/relay_fleet.c
+ * Usage:
+ *   relay_fleet [options] <command|/path> host[:port] ... [-f hosts.txt]
+ *
+ *   Commands: status, all-on, all-off, failover, gossip, webhooks, telemetry
+ *   Hosts:    192.168.1.100, 192.168.1.100:8080, 192.168.1.100-199
+ *             (range on the last number, e.g. 127.0.0.1:20000-20499)
+ *   Options:
+ *     -f FILE   read hosts from FILE (one per line, # comments)
+ *     -c N      max concurrent requests (default 256)
+ *     -t MS     timeout per attempt (default 2000)
+ *     -r N      retries per board (default 2)
+ *     -X POST   method, with -d TEXT or -d @FILE as the body
+ *     -g KEY    group boards by the value of "KEY" in the JSON response
+ *               (e.g. -g versions with the gossip command as a config check)
+ *     -q        summary only
+ *
+ * Exit status is 0 if every board answered 2xx.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RESP_MAX            16384       // Largest response kept per board
+#define BACKOFF_BASE_MS     100         // First retry delay, doubled per attempt
+#define MAX_EVENTS          256
+#define GROUP_VALUE_MAX     1024        // Longest value compared by -g
+
+/**
+ * @brief Per-board result and retry state
+ */
+typedef struct {
+    char host[80];              // "a.b.c.d:port"
+    struct sockaddr_in addr;
+    int status;                 // HTTP status, 0 on failure
+    const char *error;
+    int attempts;
+    double ms;                  // Latency of the final attempt
+    char *body;
+    int64_t not_before_us;      // Backoff: do not start before this
+} device_t;
+
+typedef enum {
+    CONN_CONNECTING = 0,
+    CONN_SENDING,
+    CONN_RECEIVING
+} conn_stage_t;
+
+/**
+ * @brief One attempt in flight
+ */
+typedef struct {
+    int fd;
+    device_t *dev;
+    conn_stage_t stage;
+    size_t sent;
+    size_t len;
+    int64_t start_us;
+    int64_t deadline_us;
+    char buf[RESP_MAX];
+} conn_t;
+
+static const struct {
+    const char *name;
+    const char *path;
+} s_commands[] = {
+    { "status",    "/relay/all/status" },
+    { "all-on",    "/relay/all/on" },
+    { "all-off",   "/relay/all/off" },
+    { "failover",  "/failover/status" },
+    { "gossip",    "/gossip/status" },
+    { "webhooks",  "/webhooks/status" },
+    { "telemetry", "/telemetry/status" },
+};
+
+static device_t *s_devices = NULL;
+static size_t s_device_count = 0;
+static size_t s_device_cap = 0;
+
+static char *s_request = NULL;          // Rendered once, host header omitted
+static size_t s_request_len = 0;
+static bool s_idempotent = true;
+
+static int s_concurrency = 256;
+static int s_timeout_ms = 2000;
+static int s_retries = 2;
+static bool s_quiet = false;
+
+/*============================================================================
+ * Helpers
+ *============================================================================*/
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int add_device(const char *host, int port)
+{
+    if (s_device_count == s_device_cap) {
+        s_device_cap = s_device_cap ? s_device_cap * 2 : 64;
+        s_devices = realloc(s_devices, s_device_cap * sizeof(device_t));
+    }
+    device_t *dev = &s_devices[s_device_count];
+    memset(dev, 0, sizeof(*dev));
+    snprintf(dev->host, sizeof(dev->host), "%s:%d", host, port);
+    dev->addr.sin_family = AF_INET;
+    dev->addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &dev->addr.sin_addr) != 1) {
+        fprintf(stderr, "relay_fleet: not an IPv4 address: %s\n", host);
+        return -1;
+    }
+    s_device_count++;
+    return 0;
+}
+
+/**
+ * @brief Add "a.b.c.d[:port]" with an optional "-N" range on the last number
+ */
+static int add_host_spec(const char *spec)
+{
+    char buf[96];
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    int last = -1;
+    char *dash = strrchr(buf, '-');
+    if (dash != NULL) {
+        last = atoi(dash + 1);
+        *dash = '\0';
+    }
+
+    // Split off the number the range applies to
+    size_t len = strlen(buf);
+    size_t start = len;
+    while (start > 0 && buf[start - 1] >= '0' && buf[start - 1] <= '9') start--;
+    int first = atoi(buf + start);
+    if (last < 0) last = first;
+    if (start == len || last < first) {
+        fprintf(stderr, "relay_fleet: bad host: %s\n", spec);
+        return -1;
+    }
+
+    char *colon = strchr(buf, ':');
+    bool port_range = colon != NULL && buf + start > colon;
+    for (int n = first; n <= last; n++) {
+        char host[64];
+        int port = 80;
+        if (port_range) {
+            snprintf(host, sizeof(host), "%.*s", (int)(colon - buf), buf);
+            port = n;
+        } else {
+            snprintf(host, sizeof(host), "%.*s%d", (int)start, buf, n);
+            char *p = strchr(host, ':');
+            if (p != NULL) {
+                *p = '\0';
+            }
+            if (colon != NULL) {
+                port = atoi(colon + 1);
+            }
+        }
+        if (add_device(host, port) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int load_host_file(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *p = line + strspn(line, " \t");
+        p[strcspn(p, " \t\r\n#")] = '\0';
+        if (*p != '\0' && add_host_spec(p) != 0) {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static char *read_body(const char *arg)
+{
+    if (arg[0] != '@') {
+        return strdup(arg);
+    }
+    FILE *f = fopen(arg + 1, "rb");
+    if (f == NULL) {
+        perror(arg + 1);
+        exit(2);
+    }
+    char *body = calloc(1, RESP_MAX);
+    size_t n = fread(body, 1, RESP_MAX - 1, f);
+    body[n] = '\0';
+    fclose(f);
+    return body;
+}
+
+/**
+ * @brief Copy the raw JSON value of "key" (object, array, string or scalar)
+ */
+static bool json_value(const char *body, const char *key, char *out, size_t size)
+{
+    char needle[64];
+    snprintf(needle, sizeof(needle), "\"%s\":", key);
+    const char *p = body ? strstr(body, needle) : NULL;
+    if (p == NULL) {
+        return false;
+    }
+    p += strlen(needle);
+
+    const char *end = p;
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        bool in_string = false;
+        for (; *end; end++) {
+            if (*end == '"' && end[-1] != '\\') in_string = !in_string;
+            if (in_string) continue;
+            if (*end == '{' || *end == '[') depth++;
+            if ((*end == '}' || *end == ']') && --depth == 0) { end++; break; }
+        }
+    } else if (*p == '"') {
+        end = strchr(p + 1, '"');
+        end = end ? end + 1 : p + strlen(p);
+    } else {
+        end = p + strcspn(p, ",}]");
+    }
+
+    size_t n = (size_t)(end - p);
+    if (n >= size) n = size - 1;
+    memcpy(out, p, n);
+    out[n] = '\0';
+    return true;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*============================================================================
+ * Engine
+ *============================================================================*/
+
+/**
+ * @brief Join a chunked body in place
+ *
+ * The firmware sends bodies longer than HTTP_RESPONSE_BUFFER_SIZE as
+ * chunks of that size, and keeps the connection open after the last one.
+ *
+ * @param len Set to the decoded length (what has arrived, if incomplete)
+ * @return true once the terminating chunk has arrived
+ */
+static bool dechunk(char *body, size_t avail, size_t *len)
+{
+    const char *p = body;
+    const char *end = body + avail;
+    size_t out = 0;
+
+    for (;;) {
+        const char *eol = strstr(p, "\r\n");
+        if (eol == NULL) break;
+        char *digits_end;
+        size_t size = strtoul(p, &digits_end, 16);
+        if (digits_end == p) break;
+        p = eol + 2;
+        if (size == 0) {
+            *len = out;
+            return true;            // Trailers (none from the firmware) are ignored
+        }
+        size_t take = ((size_t)(end - p) < size) ? (size_t)(end - p) : size;
+        memmove(body + out, p, take);
+        out += take;
+        if (take < size || end - (p + size) < 2) {
+            break;
+        }
+        p += size + 2;
+    }
+    *len = out;
+    return false;
+}
+
+/**
+ * @brief Parse a complete response; returns false while more bytes are needed
+ */
+static bool response_complete(conn_t *c, bool eof)
+{
+    c->buf[c->len] = '\0';
+    char *head_end = strstr(c->buf, "\r\n\r\n");
+    if (head_end == NULL) {
+        return false;
+    }
+    size_t head_len = (size_t)(head_end - c->buf) + 4;
+
+    long content_length = -1;
+    bool chunked = false;
+    for (char *line = strstr(c->buf, "\r\n"); line != NULL && line < head_end;
+         line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0) {
+            content_length = atol(line + 17);
+        } else if (strncasecmp(line + 2, "Transfer-Encoding:", 18) == 0 &&
+                   strstr(line + 2, "chunked") != NULL &&
+                   strstr(line + 2, "chunked") < strstr(line + 2, "\r\n")) {
+            chunked = true;
+        }
+    }
+    if (chunked) {
+        // Decode a copy: more bytes may still arrive after the buffer
+        char *body = strndup(c->buf + head_len, c->len - head_len);
+        size_t body_len;
+        bool done = dechunk(body, c->len - head_len, &body_len);
+        if (!done && !eof) {
+            free(body);
+            return false;
+        }
+        body[body_len] = '\0';
+        c->dev->status = atoi(c->buf + 9);
+        free(c->dev->body);
+        c->dev->body = body;
+        return true;
+    }
+    if (content_length >= 0 && c->len < head_len + (size_t)content_length &&
+        head_len + (size_t)content_length < RESP_MAX) {
+        return false;
+    }
+    if (content_length < 0 && !eof) {
+        return false;
+    }
+
+    c->dev->status = atoi(c->buf + 9);
+    size_t body_len = c->len - head_len;
+    if (content_length >= 0 && (size_t)content_length < body_len) {
+        body_len = (size_t)content_length;
+    }
+    free(c->dev->body);
+    c->dev->body = strndup(c->buf + head_len, body_len);
+    return true;
+}
+
+static void finish(conn_t *c, int epfd, const char *error, size_t *pending, size_t *queue,
+                   size_t *queue_len, int *retries_used)
+{
+    device_t *dev = c->dev;
+    int64_t now = now_us();
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    dev->ms = (now - c->start_us) / 1000.0;
+    dev->error = error;
+
+    // Connect failures never reached the board; others only if idempotent
+    bool retry = error != NULL && dev->attempts <= s_retries &&
+                 (c->stage == CONN_CONNECTING || s_idempotent);
+    if (retry) {
+        int64_t delay_ms = (int64_t)BACKOFF_BASE_MS << (dev->attempts - 1);
+        delay_ms += rand() % (delay_ms / 4 + 1);
+        dev->not_before_us = now + delay_ms * 1000;
+        queue[(*queue_len)++] = (size_t)(dev - s_devices);
+        (*retries_used)++;
+        return;
+    }
+
+    if (error != NULL) {
+        dev->status = 0;
+    }
+    (*pending)--;
+    if (!s_quiet) {
+        if (error != NULL) {
+            printf("%-21s  ---  %7.1f ms  %s\n", dev->host, dev->ms, error);
+        } else {
+            printf("%-21s  %3d  %7.1f ms  %s\n", dev->host, dev->status, dev->ms,
+                   dev->body ? dev->body : "");
+        }
+    }
+}
+
+static bool start(conn_t *c, device_t *dev, int epfd)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    c->fd = fd;
+    c->dev = dev;
+    c->stage = CONN_CONNECTING;
+    c->sent = 0;
+    c->len = 0;
+    c->start_us = now_us();
+    c->deadline_us = c->start_us + (int64_t)s_timeout_ms * 1000;
+    dev->attempts++;
+
+    int ret = connect(fd, (struct sockaddr *)&dev->addr, sizeof(dev->addr));
+    if (ret != 0 && errno != EINPROGRESS) {
+        // Report through the normal path so it is retried
+        c->deadline_us = 0;
+    }
+
+    struct epoll_event ev = { .events = EPOLLOUT | EPOLLIN, .data.ptr = c };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    return true;
+}
+
+/**
+ * @brief Send the rendered request, switching to receive once it is out
+ */
+static const char *on_writable(conn_t *c, int epfd)
+{
+    if (c->stage == CONN_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            return strerror(err);
+        }
+        c->stage = CONN_SENDING;
+    }
+
+    while (c->sent < s_request_len) {
+        ssize_t n = send(c->fd, s_request + c->sent, s_request_len - c->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            return (errno == EAGAIN) ? NULL : strerror(errno);
+        }
+        c->sent += (size_t)n;
+    }
+
+    c->stage = CONN_RECEIVING;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    return NULL;
+}
+
+static void run(void)
+{
+    int epfd = epoll_create1(0);
+    conn_t *conns = calloc((size_t)s_concurrency, sizeof(conn_t));
+    size_t *queue = malloc(s_device_count * sizeof(size_t));
+    size_t queue_len = 0;
+    size_t pending = s_device_count;
+    int active = 0;
+    int retries_used = 0;
+    struct epoll_event events[MAX_EVENTS];
+
+    for (int i = 0; i < s_concurrency; i++) conns[i].fd = -1;
+    for (size_t i = 0; i < s_device_count; i++) queue[queue_len++] = s_device_count - 1 - i;
+
+    int64_t t0 = now_us();
+    while (pending > 0) {
+        int64_t now = now_us();
+
+        // Fill free slots with boards whose backoff has passed
+        int slot = 0;
+        for (size_t q = queue_len; q > 0 && active < s_concurrency; q--) {
+            device_t *dev = &s_devices[queue[q - 1]];
+            if (dev->not_before_us > now) continue;
+            while (conns[slot].fd >= 0) slot++;
+            if (!start(&conns[slot], dev, epfd)) break;
+            active++;
+            queue[q - 1] = queue[--queue_len];
+        }
+
+        int n = epoll_wait(epfd, events, MAX_EVENTS, 10);
+        for (int i = 0; i < n; i++) {
+            conn_t *c = events[i].data.ptr;
+            if (c->fd < 0) continue;
+            const char *error = NULL;
+            bool done = false;
+
+            if (c->stage != CONN_RECEIVING && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                error = on_writable(c, epfd);
+                done = error != NULL;
+            }
+            if (!done && c->stage == CONN_RECEIVING && (events[i].events & (EPOLLIN | EPOLLHUP))) {
+                ssize_t r = recv(c->fd, c->buf + c->len, RESP_MAX - 1 - c->len, 0);
+                if (r > 0) {
+                    c->len += (size_t)r;
+                    done = response_complete(c, c->len == RESP_MAX - 1);
+                } else if (r == 0 || errno != EAGAIN) {
+                    done = true;
+                    if (!response_complete(c, true)) {
+                        error = r == 0 ? "connection closed" : strerror(errno);
+                    }
+                }
+            }
+            if (done) {
+                finish(c, epfd, error, &pending, queue, &queue_len, &retries_used);
+                active--;
+            }
+        }
+
+        // Deadlines; a failed connect() shows up here with deadline 0
+        now = now_us();
+        for (int i = 0; i < s_concurrency; i++) {
+            if (conns[i].fd >= 0 && conns[i].deadline_us <= now) {
+                finish(&conns[i], epfd, conns[i].deadline_us ? "timeout" : "connect failed",
+                       &pending, queue, &queue_len, &retries_used);
+                active--;
+            }
+        }
+    }
+    double wall_ms = (now_us() - t0) / 1000.0;
+
+    // Summary
+    int ok = 0, http_err = 0, failed = 0;
+    double *lat = malloc(s_device_count * sizeof(double));
+    for (size_t i = 0; i < s_device_count; i++) {
+        device_t *dev = &s_devices[i];
+        lat[i] = dev->ms;
+        if (dev->status >= 200 && dev->status < 300) ok++;
+        else if (dev->status > 0) http_err++;
+        else failed++;
+    }
+    qsort(lat, s_device_count, sizeof(double), cmp_double);
+    printf("\n%zu boards in %.0f ms: %d ok, %d HTTP error, %d failed (%d retries)\n",
+           s_device_count, wall_ms, ok, http_err, failed, retries_used);
+    printf("latency ms: p50 %.1f  p95 %.1f  max %.1f\n",
+           lat[s_device_count / 2], lat[s_device_count * 95 / 100], lat[s_device_count - 1]);
+
+    free(lat);
+    free(queue);
+    free(conns);
+    close(epfd);
+}
+
+/**
+ * @brief Print how many boards returned each distinct value of key
+ */
+static void print_groups(const char *key)
+{
+    char (*values)[GROUP_VALUE_MAX] = calloc(s_device_count, sizeof(*values));
+    int *counts = calloc(s_device_count, sizeof(int));
+    size_t groups = 0;
+
+    for (size_t i = 0; i < s_device_count; i++) {
+        char value[GROUP_VALUE_MAX];
+        if (!json_value(s_devices[i].body, key, value, sizeof(value))) {
+            snprintf(value, sizeof(value), "(missing)");
+        }
+        size_t g = 0;
+        while (g < groups && strcmp(values[g], value) != 0) g++;
+        if (g == groups) {
+            strcpy(values[groups++], value);
+        }
+        counts[g]++;
+    }
+
+    printf("\"%s\": %zu distinct value(s)\n", key, groups);
+    for (size_t g = 0; g < groups; g++) {
+        printf("  %5d x %s\n", counts[g], values[g]);
+    }
+    if (groups > 1) {
+        // Name the boards outside the majority
+        size_t major = 0;
+        for (size_t g = 1; g < groups; g++) if (counts[g] > counts[major]) major = g;
+        for (size_t i = 0; i < s_device_count; i++) {
+            char value[GROUP_VALUE_MAX];
+            if (!json_value(s_devices[i].body, key, value, sizeof(value))) {
+                snprintf(value, sizeof(value), "(missing)");
+            }
+            if (strcmp(value, values[major]) != 0) {
+                printf("  differs: %s %s\n", s_devices[i].host, value);
+            }
+        }
+    }
+
+    free(values);
+    free(counts);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: relay_fleet [-f hosts] [-c conc] [-t ms] [-r retries] [-X POST -d body]\n"
+            "                   [-g key] [-q] <command|/path> [host[:port][-N] ...]\n"
+            "commands: status all-on all-off failover gossip webhooks telemetry\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *method = "GET";
+    const char *path = NULL;
+    const char *group = NULL;
+    char *body = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (a[0] == '-' && a[1] != '\0' && a[2] == '\0' && strchr("fctrXdg", a[1])) {
+            if (i + 1 >= argc) usage();
+            const char *v = argv[++i];
+            switch (a[1]) {
+                case 'f': if (load_host_file(v) != 0) return 2; break;
+                case 'c': s_concurrency = atoi(v); break;
+                case 't': s_timeout_ms = atoi(v); break;
+                case 'r': s_retries = atoi(v); break;
+                case 'X': method = v; break;
+                case 'd': body = read_body(v); break;
+                case 'g': group = v; break;
+            }
+        } else if (strcmp(a, "-q") == 0) {
+            s_quiet = true;
+        } else if (path == NULL) {
+            path = a;
+            for (size_t c = 0; c < sizeof(s_commands) / sizeof(s_commands[0]); c++) {
+                if (strcmp(a, s_commands[c].name) == 0) path = s_commands[c].path;
+            }
+            if (path[0] != '/') usage();
+        } else if (add_host_spec(a) != 0) {
+            return 2;
+        }
+    }
+    if (path == NULL || s_device_count == 0 || s_concurrency < 1) {
+        usage();
+    }
+
+    s_idempotent = strcmp(method, "GET") == 0 && strstr(path, "/toggle") == NULL &&
+                   strstr(path, "/pulse") == NULL && strstr(path, "/run") == NULL;
+
+    // The board ignores Host, so one rendering serves every board
+    size_t body_len = body ? strlen(body) : 0;
+    s_request = malloc(256 + strlen(path) + body_len);
+    s_request_len = (size_t)sprintf(s_request,
+                                    "%s %s HTTP/1.1\r\nHost: relay\r\nConnection: close\r\n"
+                                    "Content-Length: %zu\r\n\r\n%s",
+                                    method, path, body_len, body ? body : "");
+
+    srand((unsigned)now_us());
+    run();
+    if (group != NULL) {
+        print_groups(group);
+    }
+
+    for (size_t i = 0; i < s_device_count; i++) {
+        if (s_devices[i].status < 200 || s_devices[i].status >= 300) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+"""
+Measure a hot-standby pair of relay_host instances on one machine.
+
+Starts a primary on 127.0.0.1 and a standby on 127.0.0.2 sharing one
+owner file for the service address, toggles relays on the active node
+every --interval ms and reads both nodes' relay traces. Each scenario
+reports:
+
+  mirror     lag from a relay change on the active node to the same
+             outputs on the standby (p50/p95/max), and how many changes
+             the standby never showed on its own because a later
+             delta or heartbeat carried a newer state (coalesced)
+  takeover   kill -9 (or SIGSTOP) of the active node to "active" on the
+             standby, and to its API being up
+  diverged   whether the new active node's outputs differ from the last
+             outputs of the failed one
+  rejoin     for SIGSTOP: SIGCONT to the stale node's restart, and to its
+             outputs matching the new active node again as standby
+
+Scenarios: kill (kill -9), stop (SIGSTOP, then SIGCONT after the
+takeover), and kill again with --loss percent of the datagrams dropped.
+
+Usage:
+    python3 tools/relay_sim/failover_pair.py --host ./relay_host
+    python3 tools/relay_sim/failover_pair.py --host ./relay_host --loss 20 --seconds 10
+"""
+
+import argparse
+import http.client
+import os
+import signal
+import statistics
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+NODES = (("primary", "127.0.0.1"), ("standby", "127.0.0.2"))
+
+
+def now_us():
+    return time.monotonic_ns() // 1000      # CLOCK_MONOTONIC, as the trace
+
+
+class Node:
+    """One relay_host and its trace lines as (time_us, event, argument)"""
+
+    def __init__(self, host, role, ip, peer, port, owner, loss):
+        self.port = port
+        self.events = []
+        self.lock = threading.Lock()
+        self.proc = subprocess.Popen(
+            [host, "-t", "-p", str(port), "-F", role, "-n", ip, "-P", peer,
+             "-O", owner, "-L", str(loss)],
+            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+        self.reader = threading.Thread(target=self._read, daemon=True)
+        self.reader.start()
+
+    def _read(self):
+        for line in self.proc.stdout:
+            parts = line.split()
+            if len(parts) >= 2:
+                with self.lock:
+                    self.events.append((int(parts[0]), parts[1],
+                                        parts[2] if len(parts) > 2 else ""))
+
+    def find(self, event, after=0, timeout=10.0):
+        """Time of the first event after the given time, or None"""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            with self.lock:
+                for t, e, _ in self.events:
+                    if e == event and t > after:
+                        return t
+            time.sleep(0.005)
+        return None
+
+    def relays(self, after=0):
+        with self.lock:
+            return [(t, int(a, 16)) for t, e, a in self.events if e == "relays" and t > after]
+
+    def outputs_at(self, t):
+        mask = 0
+        for when, m in self.relays():
+            if when > t:
+                break
+            mask = m
+        return mask
+
+    def stop(self):
+        if self.proc.poll() is None:
+            os.kill(self.proc.pid, signal.SIGCONT)
+            self.proc.kill()
+        self.proc.wait()
+
+
+def toggle(node, seconds, interval_ms):
+    """Toggle relays 0..3 in turn on node every interval_ms; returns the count"""
+    conn = http.client.HTTPConnection("127.0.0.1", node.port, timeout=5)
+    count = 0
+    start = time.monotonic()
+    while time.monotonic() - start < seconds:
+        conn.request("GET", "/relay/%d/toggle" % (count % 4))
+        conn.getresponse().read()
+        count += 1
+        next_at = start + count * interval_ms / 1000.0
+        time.sleep(max(0.0, next_at - time.monotonic()))
+    conn.close()
+    return count
+
+
+def mirror_lag(active, standby, since):
+    """
+    Lag of each active change to the standby showing it or a newer state,
+    in ms. A standby change is matched to the latest active change with
+    the same outputs made before it; masks repeat every few toggles, so
+    the earliest match could be one a full cycle old.
+    """
+    lags, coalesced = [], 0
+    ours = active.relays(since)
+    p = 0                           # First active change not yet mirrored
+    for t, mask in standby.relays(since):
+        match = None
+        for j in range(p, len(ours)):
+            if ours[j][0] > t:
+                break
+            if ours[j][1] == mask:
+                match = j
+        if match is None:
+            continue
+        for i in range(p, match + 1):
+            lags.append((t - ours[i][0]) / 1000.0)
+        coalesced += match - p
+        p = match + 1
+    return lags, coalesced
+
+
+def ms(delta_us):
+    return "-" if delta_us is None else "%.0f" % (delta_us / 1000.0)
+
+
+def scenario(host, fault, loss, args, tmp):
+    owner = os.path.join(tmp, "owner-%s-%d" % (fault, loss))
+    a = Node(host, NODES[0][0], NODES[0][1], NODES[1][1], args.port, owner, loss)
+    b = Node(host, NODES[1][0], NODES[1][1], NODES[0][1], args.port + 1, owner, loss)
+    result = {"fault": fault, "loss": loss}
+    try:
+        if a.find("http", timeout=15) is None:
+            sys.exit("primary never became active")
+        time.sleep(1.0)                 # Standby sees a few heartbeats first
+
+        since = now_us()
+        result["changes"] = toggle(a, args.seconds, args.interval)
+        time.sleep(0.5)
+        lags, result["coalesced"] = mirror_lag(a, b, since)
+        result["lags"] = lags
+        result["spurious"] = b.find("active", timeout=0) is not None
+
+        t_fault = now_us()
+        last = a.outputs_at(t_fault)
+        os.kill(a.proc.pid, signal.SIGKILL if fault == "kill" else signal.SIGSTOP)
+        t_active = b.find("active", after=t_fault)
+        t_http = b.find("http", after=t_fault)
+        result["takeover"] = t_active and t_active - t_fault
+        result["api"] = t_http and t_http - t_fault
+        result["diverged"] = t_active is not None and b.outputs_at(t_active) != last
+
+        if fault == "stop" and t_http is not None:
+            toggle(b, 0.3, args.interval)           # Move on without the stale node
+            t_cont = now_us()
+            os.kill(a.proc.pid, signal.SIGCONT)
+            t_boot = a.find("boot", after=t_cont)
+            result["restart"] = t_boot and t_boot - t_cont
+            result["resync"] = None
+            deadline = time.monotonic() + 10
+            while t_boot is not None and time.monotonic() < deadline:
+                want = b.outputs_at(now_us())
+                match = [t for t, m in a.relays(t_boot) if m == want]
+                # Each boot traces from all outputs off
+                if match or (not a.relays(t_boot) and want == 0):
+                    result["resync"] = (match[0] if match else t_boot) - t_cont
+                    break
+                time.sleep(0.05)
+            time.sleep(1.0)
+            result["rejoined_active"] = a.find("active", after=t_cont, timeout=0) is not None
+    finally:
+        a.stop()
+        b.stop()
+    return result
+
+
+def report(results):
+    print("%-6s %5s %8s %8s %8s %8s %10s %10s %8s %9s %9s %9s" %
+          ("fault", "loss%", "changes", "lag p50", "lag p95", "lag max", "coalesced",
+           "takeover", "api", "diverged", "restart", "resync"))
+    for r in results:
+        lags = sorted(r["lags"])
+        p50 = statistics.median(lags) if lags else None
+        p95 = lags[min(len(lags) - 1, int(len(lags) * 0.95))] if lags else None
+        print("%-6s %5d %8d %8s %8s %8s %10d %10s %8s %9s %9s %9s" %
+              (r["fault"], r["loss"], r["changes"],
+               "-" if p50 is None else "%.1f" % p50,
+               "-" if p95 is None else "%.1f" % p95,
+               "-" if not lags else "%.1f" % lags[-1],
+               r["coalesced"], ms(r["takeover"]), ms(r["api"]),
+               "yes" if r["diverged"] else "no",
+               ms(r.get("restart")), ms(r.get("resync"))))
+    print("(lag in ms; takeover, api, restart and resync in ms after the fault or SIGCONT)")
+    for r in results:
+        if r["spurious"]:
+            print("# %s/%d%%: the standby took over before the fault" % (r["fault"], r["loss"]))
+        if r.get("rejoined_active"):
+            print("# %s/%d%%: the stale node came back active" % (r["fault"], r["loss"]))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[0].strip())
+    ap.add_argument("--host", required=True, help="relay_host binary")
+    ap.add_argument("--port", type=int, default=20000, help="HTTP ports PORT and PORT+1")
+    ap.add_argument("--seconds", type=float, default=3.0, help="toggling time per scenario")
+    ap.add_argument("--interval", type=float, default=30.0, help="ms between toggles")
+    ap.add_argument("--loss", type=int, default=20, help="datagram loss for the last scenario")
+    args = ap.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        results = [scenario(args.host, "kill", 0, args, tmp),
+                   scenario(args.host, "stop", 0, args, tmp)]
+        if args.loss > 0:
+            results.append(scenario(args.host, "kill", args.loss, args, tmp))
+    report(results)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Run the fault-injection scenarios through relay_sim and report recovery.
+
+Every scenarios/*.txt file is a relay_sim trace whose "# relay_sim:" line
+holds its options (usually generated traffic). For each injected fault the
+report shows when the firmware noticed it (detect), when the condition
+ended (clear) and when the device was back to normal service (recover),
+all in seconds after the fault; per scenario it counts commands lost,
+commands the handler ran more than once, boots, relay states lost
+across a restart, times the relay outputs disagreed with the relay
+states and /relay/txn batches that applied only in part. Results are
+compared with baseline.json: more lost or repeated commands, more boots,
+lost states, mismatches or partial batches, a fault no longer detected
+or recovered, or a detect/recover time more than --slack seconds later is
+a regression and makes the exit status 1.
+
+Usage:
+    python3 tools/relay_sim/faults.py --sim ./relay_sim
+    python3 tools/relay_sim/faults.py --sim ./relay_sim --update   # Accept results
+    python3 tools/relay_sim/faults.py --sim ./relay_sim wifi_blip.txt
+"""
+
+import argparse
+import json
+import os
+import re
+import shlex
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SCENARIOS = os.path.join(HERE, "scenarios")
+BASELINE = os.path.join(SCENARIOS, "baseline.json")
+
+FAULT = re.compile(r"^# fault \d+ (.+?)\s+at\s+([\d.]+)\s+detect (\S+)\s+clear (\S+)\s+recover (\S+)$")
+CLIENTS = re.compile(r"^# clients: (\d+) failed attempts, (\d+) commands lost, (\d+) run more than once")
+BOOTS = re.compile(r"^# boots: (\d+), relay states lost on (\d+)")
+OUTPUTS = re.compile(r"^# output faults: \d+ writes refused or dropped, outputs off their relay state (\d+) times")
+TXNS = re.compile(r"^# transactions: \d+ committed, \d+ refused, (\d+) applied in part")
+COUNTS = ("lost", "repeated", "boots", "states_lost", "mismatched", "partial")
+
+
+def seconds(text):
+    """'+1.250' -> 1.25, '-' / 'never' -> None"""
+    return float(text) if text.startswith("+") else None
+
+
+def run(sim, path):
+    options = []
+    with open(path) as f:
+        for line in f:
+            if line.startswith("# relay_sim:"):
+                options = shlex.split(line.split(":", 1)[1])
+    proc = subprocess.run([sim, "-q"] + options + [path], capture_output=True, text=True)
+    if proc.returncode not in (0, 1):
+        sys.exit("%s: relay_sim failed\n%s" % (path, proc.stderr))
+
+    result = {"faults": [], "partial": 0}
+    for line in proc.stderr.splitlines():
+        m = FAULT.match(line)
+        if m:
+            result["faults"].append({"fault": "%s @%s" % (m.group(1), m.group(2)),
+                                     "detect": seconds(m.group(3)),
+                                     "clear": seconds(m.group(4)),
+                                     "recover": seconds(m.group(5))})
+        m = CLIENTS.match(line)
+        if m:
+            result["failed_attempts"] = int(m.group(1))
+            result["lost"] = int(m.group(2))
+            result["repeated"] = int(m.group(3))
+        m = BOOTS.match(line)
+        if m:
+            result["boots"] = int(m.group(1))
+            result["states_lost"] = int(m.group(2))
+        m = OUTPUTS.match(line)
+        if m:
+            result["mismatched"] = int(m.group(1))
+        m = TXNS.match(line)
+        if m:
+            result["partial"] = int(m.group(1))
+    if "lost" not in result or "boots" not in result or "mismatched" not in result:
+        sys.exit("%s: no summary from relay_sim\n%s" % (path, proc.stderr))
+    return result
+
+
+def later(new, old, slack):
+    """True if a time got worse: lost (None) or more than slack seconds later"""
+    if old is None:
+        return False
+    return new is None or new > old + slack
+
+
+def compare(name, new, old, slack):
+    problems = []
+    for key in COUNTS:
+        if new[key] > old.get(key, 0):
+            problems.append("%s: %s %d -> %d" % (name, key, old.get(key, 0), new[key]))
+    before = {f["fault"]: f for f in old.get("faults", [])}
+    for f in new["faults"]:
+        b = before.get(f["fault"])
+        if b is None:
+            continue
+        for key in ("detect", "recover"):
+            if later(f[key], b[key], slack):
+                problems.append("%s: %s %s %s -> %s" % (name, f["fault"], key,
+                                                        fmt(b[key]), fmt(f[key])))
+    return problems
+
+
+def fmt(value):
+    return "-" if value is None else "%.3f" % value
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("scenarios", nargs="*", help="scenario files (default: all)")
+    parser.add_argument("--sim", default="./relay_sim", help="relay_sim binary")
+    parser.add_argument("--baseline", default=BASELINE)
+    parser.add_argument("--slack", type=float, default=0.5,
+                        help="seconds a detect/recover time may grow (default 0.5)")
+    parser.add_argument("--update", action="store_true", help="write results as the baseline")
+    args = parser.parse_args()
+
+    files = args.scenarios or sorted(f for f in os.listdir(SCENARIOS) if f.endswith(".txt"))
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    results = {}
+    problems = []
+    print("%-16s %-22s %9s %9s %9s %5s %5s %5s %5s" % ("scenario", "fault", "detect", "clear",
+                                                      "recover", "lost", "twice", "boots",
+                                                      "state"))
+    for name in files:
+        path = name if os.path.exists(name) else os.path.join(SCENARIOS, name)
+        key = os.path.splitext(os.path.basename(path))[0]
+        r = results[key] = run(args.sim, path)
+        counts = "%5d %5d %5d %5d" % (r["lost"], r["repeated"], r["boots"], r["states_lost"])
+        for i, f in enumerate(r["faults"] or [{"fault": "-", "detect": None, "clear": None,
+                                              "recover": None}]):
+            row = "%-16s %-22s %9s %9s %9s %s" % (key if i == 0 else "", f["fault"],
+                                                  fmt(f["detect"]), fmt(f["clear"]),
+                                                  fmt(f["recover"]), counts if i == 0 else "")
+            print(row.rstrip())
+        if key in baseline:
+            problems += compare(key, r, baseline[key], args.slack)
+
+    if args.update:
+        baseline.update(results)
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=1, sort_keys=True)
+            f.write("\n")
+        print("baseline updated: %s" % args.baseline)
+        return
+
+    missing = [k for k in results if k not in baseline]
+    if missing:
+        print("no baseline for: %s" % ", ".join(missing))
+    if problems:
+        print("\n%d regressions:" % len(problems))
+        for p in problems:
+            print("  " + p)
+        sys.exit(1)
+    print("\nno regressions against %s" % os.path.relpath(args.baseline))
+
+
+if __name__ == "__main__":
+    main()
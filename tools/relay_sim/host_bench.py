@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+Run relay_bench and relay_fleet against host builds of the firmware.
+
+Builds relay_host, relay_bench and relay_fleet (unless given), starts one
+relay_host for the client benchmark and --boards more on consecutive ports
+for the fleet sweep, waits for each to report its API up, and runs:
+
+    relay_bench  127.0.0.1:PORT -n N -w 16          (--bench-us service time)
+    relay_fleet  -q -c 1 status 127.0.0.1:P0-P1     (--fleet-us service time)
+    relay_fleet  -q status 127.0.0.1:P0-P1
+
+Their output is printed as is. --rtt adds a round trip on the loopback
+with netem (root, and the sch_netem module); without it loopback has
+almost none, so the gap between the modes is smaller than over WiFi.
+
+Usage:
+    python3 tools/relay_sim/host_bench.py
+    python3 tools/relay_sim/host_bench.py --boards 500 --rtt 4
+    python3 tools/relay_sim/host_bench.py --host ./relay_host --skip-fleet
+"""
+
+import argparse
+import os
+import resource
+import selectors
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.abspath(os.path.join(HERE, "..", ".."))
+
+HOST_SOURCES = [
+    "tools/relay_sim/relay_host.c", "tools/relay_sim/sim_port.c",
+    "tools/relay_sim/sim_httpd.c", "tools/relay_sim/sim_room.c",
+    "tools/relay_sim/host_failover.c", "tools/relay_sim/host_modbus.c",
+    "src/relay_service.c", "src/sequencer.c", "src/wifi_service.c",
+    "src/powerfail.c", "src/block_pool.c", "src/thermostat.c",
+    "src/solar_schedule.c", "src/json_writer.c", "src/http_controller.c",
+]
+
+
+def build(out):
+    """Build the three programs into out/; returns their paths"""
+    host = os.path.join(out, "relay_host")
+    bench = os.path.join(out, "relay_bench")
+    fleet = os.path.join(out, "relay_fleet")
+    steps = [
+        ["gcc", "-O2", "-Itools/relay_sim/port", "-Itools/relay_sim", "-Iinclude",
+         "-o", host] + HOST_SOURCES + ["-lm"],
+        ["g++", "-std=c++17", "-O2", "-pthread", "tools/relay_client/relay_bench.cpp",
+         "-o", bench],
+        ["gcc", "-O2", "-o", fleet, "tools/relay_fleet.c"],
+    ]
+    for cmd in steps:
+        proc = subprocess.run(cmd, cwd=ROOT, capture_output=True, text=True)
+        if proc.returncode != 0:
+            sys.exit("build failed: %s\n%s" % (" ".join(cmd), proc.stderr))
+    return host, bench, fleet
+
+
+def start(host, first_port, count, service_us, timeout=30.0):
+    """Start count instances on first_port.. and wait for each 'http PORT' trace"""
+    procs = []
+    sel = selectors.DefaultSelector()
+    for i in range(count):
+        p = subprocess.Popen([host, "-t", "-p", str(first_port + i), "-d", str(service_us)],
+                             stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+        procs.append(p)
+        sel.register(p.stdout, selectors.EVENT_READ, p)
+    pending = count
+    deadline = time.monotonic() + timeout
+    while pending:
+        left = deadline - time.monotonic()
+        if left <= 0:
+            stop(procs)
+            sys.exit("%d of %d relay_host instances did not come up" % (pending, count))
+        for key, _ in sel.select(left):
+            line = key.fileobj.readline()
+            if not line or line.split()[1:2] == ["http"]:
+                sel.unregister(key.fileobj)
+                if not line:
+                    stop(procs)
+                    sys.exit("relay_host exited during boot")
+                pending -= 1
+    sel.close()
+    # Nothing reads the trace from here on; drop it so the pipes never fill
+    for p in procs:
+        p.stdout.close()
+    return procs
+
+
+def stop(procs):
+    for p in procs:
+        if p.poll() is None:
+            p.kill()
+    for p in procs:
+        p.wait()
+
+
+def netem(delay_ms):
+    """Delay each direction on lo by half the round trip; False if unavailable"""
+    if delay_ms <= 0:
+        return False
+    proc = subprocess.run(["tc", "qdisc", "add", "dev", "lo", "root", "netem", "delay",
+                           "%.3fms" % (delay_ms / 2.0)], capture_output=True, text=True)
+    if proc.returncode != 0:
+        print("# --rtt ignored: %s" % proc.stderr.strip())
+        return False
+    return True
+
+
+def run(cmd):
+    print("$ " + " ".join(os.path.basename(c) if i == 0 else c for i, c in enumerate(cmd)),
+          flush=True)
+    subprocess.run(cmd)
+    print(flush=True)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[0].strip())
+    ap.add_argument("--host", help="relay_host binary (default: build one)")
+    ap.add_argument("--bench", help="relay_bench binary (default: build one)")
+    ap.add_argument("--fleet", help="relay_fleet binary (default: build one)")
+    ap.add_argument("--port", type=int, default=20000, help="first port (default 20000)")
+    ap.add_argument("-n", type=int, default=300, help="relay_bench requests (default 300)")
+    ap.add_argument("--bench-us", type=int, default=1000,
+                    help="service time per request for relay_bench (default 1000)")
+    ap.add_argument("--boards", type=int, default=100, help="fleet size (default 100)")
+    ap.add_argument("--fleet-us", type=int, default=5000,
+                    help="service time per request for the fleet (default 5000)")
+    ap.add_argument("--rtt", type=float, default=0, help="loopback round trip in ms (netem)")
+    ap.add_argument("--skip-bench", action="store_true")
+    ap.add_argument("--skip-fleet", action="store_true")
+    args = ap.parse_args()
+
+    # One socket per board on each side, plus the pipes
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    want = min(hard, max(soft, 4 * args.boards + 64))
+    resource.setrlimit(resource.RLIMIT_NOFILE, (want, hard))
+
+    with tempfile.TemporaryDirectory() as tmp:
+        host, bench, fleet = build(tmp) if not (args.host and args.bench and args.fleet) \
+            else (None, None, None)
+        host, bench, fleet = args.host or host, args.bench or bench, args.fleet or fleet
+        delayed = netem(args.rtt)
+        try:
+            if not args.skip_bench:
+                procs = start(host, args.port, 1, args.bench_us)
+                try:
+                    run([bench, "127.0.0.1:%d" % args.port, "-n", str(args.n), "-w", "16"])
+                finally:
+                    stop(procs)
+            if not args.skip_fleet:
+                first = args.port + 1
+                procs = start(host, first, args.boards, args.fleet_us)
+                hosts = "127.0.0.1:%d-%d" % (first, first + args.boards - 1)
+                try:
+                    run([fleet, "-q", "-c", "1", "status", hosts])
+                    run([fleet, "-q", "status", hosts])
+                finally:
+                    stop(procs)
+        finally:
+            if delayed:
+                subprocess.run(["tc", "qdisc", "del", "dev", "lo", "root"])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,80 @@
+/**
+ * @file host_failover.c
+ * @brief failover.c for a pair of relay_host instances on one machine
+ *
+ * Role and addresses come from the command line instead of config.h, and
+ * each instance binds the heartbeat port on its own loopback address
+ * (127.0.0.1 and 127.0.0.2, say). STATIC_IP, the service address, is a
+ * file naming the node that holds it: claiming the address writes the
+ * node's address there (on the device, wifi_set_ip_address() and lwIP's
+ * gratuitous ARP), and a datagram to STATIC_IP goes to the node the file
+ * names, or is lost while it names none. relay_host -L drops a share of
+ * the outgoing datagrams.
+ */
+
+#include "config.h"
+#include "wifi_service.h"
+#include "lwip/sockets.h"
+#include "relay_host.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @brief Take the service address: name this node in the owner file
+ */
+static esp_err_t host_claim_service(const char *ip)
+{
+    (void)ip;
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.%d", host_failover.owner_file, (int)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        return ESP_FAIL;
+    }
+    fprintf(f, "%s\n", host_failover.node_ip);
+    fclose(f);
+    return rename(tmp, host_failover.owner_file) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static int host_bind(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    struct sockaddr_in own = *(const struct sockaddr_in *)addr;
+    own.sin_addr.s_addr = inet_addr(host_failover.node_ip);
+    return bind(fd, (struct sockaddr *)&own, len);
+}
+
+static ssize_t host_sendto(int fd, const void *buf, size_t len, int flags,
+                           const struct sockaddr *addr, socklen_t alen)
+{
+    struct sockaddr_in to = *(const struct sockaddr_in *)addr;
+    if (host_failover.loss_pct > 0 && rand() % 100 < host_failover.loss_pct) {
+        return (ssize_t)len;
+    }
+    if (to.sin_addr.s_addr == inet_addr(STATIC_IP)) {
+        char owner[32] = "";
+        FILE *f = fopen(host_failover.owner_file, "r");
+        if (f != NULL) {
+            if (fscanf(f, "%31s", owner) != 1) owner[0] = '\0';
+            fclose(f);
+        }
+        if (owner[0] == '\0') {
+            return (ssize_t)len;        // Nobody answers ARP for it yet
+        }
+        to.sin_addr.s_addr = inet_addr(owner);
+    }
+    return sendto(fd, buf, len, flags, (struct sockaddr *)&to, alen);
+}
+
+#undef FAILOVER_ENABLE
+#undef FAILOVER_ROLE
+#undef FAILOVER_NODE_IP
+#undef FAILOVER_PEER_IP
+#define FAILOVER_ENABLE     (host_failover.enabled)
+#define FAILOVER_ROLE       (host_failover.role)
+#define FAILOVER_NODE_IP    (host_failover.node_ip)
+#define FAILOVER_PEER_IP    (host_failover.peer_ip)
+#define wifi_set_ip_address host_claim_service
+#define bind                host_bind
+#define sendto              host_sendto
+
+#include "../../src/failover.c"
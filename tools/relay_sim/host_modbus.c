@@ -0,0 +1,12 @@
+/**
+ * @file host_modbus.c
+ * @brief modbus_server.c listening on relay_host's -m port instead of 502
+ */
+
+#include "config.h"
+#include "relay_host.h"
+
+#undef MODBUS_PORT
+#define MODBUS_PORT         host_modbus_port
+
+#include "../../src/modbus_server.c"
@@ -0,0 +1,15 @@
+/**
+ * @file esp_attr.h
+ * @brief Simulator port: placement attributes
+ *
+ * RTC_NOINIT_ATTR variables share one section, which the simulator keeps
+ * across esp_restart() and clears on a power cut (see sim_port.h).
+ */
+
+#ifndef SIM_ESP_ATTR_H
+#define SIM_ESP_ATTR_H
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR     __attribute__((section("rtc_noinit")))
+
+#endif // SIM_ESP_ATTR_H
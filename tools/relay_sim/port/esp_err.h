@@ -0,0 +1,47 @@
+/**
+ * @file esp_err.h
+ * @brief Simulator port: ESP-IDF error codes used by the firmware
+ */
+
+#ifndef SIM_ESP_ERR_H
+#define SIM_ESP_ERR_H
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                      0
+#define ESP_FAIL                    -1
+#define ESP_ERR_NO_MEM              0x101
+#define ESP_ERR_INVALID_ARG         0x102
+#define ESP_ERR_INVALID_STATE       0x103
+#define ESP_ERR_INVALID_SIZE        0x104
+#define ESP_ERR_NOT_FOUND           0x105
+#define ESP_ERR_NOT_SUPPORTED       0x106
+#define ESP_ERR_TIMEOUT             0x107
+#define ESP_ERR_INVALID_RESPONSE    0x108
+#define ESP_ERR_INVALID_CRC         0x109
+#define ESP_ERR_NOT_ALLOWED         0x10D
+
+#define ESP_ERR_NVS_NOT_FOUND       0x1102
+#define ESP_ERR_NVS_TYPE_MISMATCH   0x1103
+#define ESP_ERR_NVS_READ_ONLY       0x1104
+#define ESP_ERR_NVS_NOT_ENOUGH_SPACE 0x1105
+#define ESP_ERR_NVS_INVALID_HANDLE  0x1107
+#define ESP_ERR_NVS_KEY_TOO_LONG    0x1109
+#define ESP_ERR_NVS_INVALID_LENGTH  0x110c
+#define ESP_ERR_NVS_NO_FREE_PAGES   0x110d
+#define ESP_ERR_NVS_NEW_VERSION_FOUND 0x1110
+
+const char *esp_err_to_name(esp_err_t code);
+void sim_error_check_failed(esp_err_t code, const char *file, int line, const char *expr)
+    __attribute__((noreturn));
+
+#define ESP_ERROR_CHECK(x) do {                                             \
+        esp_err_t err_rc_ = (x);                                            \
+        if (err_rc_ != ESP_OK) {                                            \
+            sim_error_check_failed(err_rc_, __FILE__, __LINE__, #x);        \
+        }                                                                   \
+    } while (0)
+
+#endif // SIM_ESP_ERR_H
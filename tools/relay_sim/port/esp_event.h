@@ -0,0 +1,36 @@
+/**
+ * @file esp_event.h
+ * @brief Simulator port: default event loop
+ *
+ * Handlers run one at a time on a simulated sys_evt task, so a handler
+ * that blocks (wifi_service.c waits before reconnecting) holds back the
+ * events behind it, as on the device.
+ */
+
+#ifndef SIM_ESP_EVENT_H
+#define SIM_ESP_EVENT_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifndef BIT0
+#define BIT0                0x00000001
+#define BIT1                0x00000002
+#endif
+
+typedef const char *esp_event_base_t;
+typedef void *esp_event_handler_instance_t;
+typedef void (*esp_event_handler_t)(void *arg, esp_event_base_t base,
+                                    int32_t id, void *data);
+
+#define ESP_EVENT_ANY_ID    -1
+
+extern esp_event_base_t const WIFI_EVENT;
+extern esp_event_base_t const IP_EVENT;
+
+esp_err_t esp_event_loop_create_default(void);
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id,
+                                              esp_event_handler_t handler, void *arg,
+                                              esp_event_handler_instance_t *instance);
+
+#endif // SIM_ESP_EVENT_H
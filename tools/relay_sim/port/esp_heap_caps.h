@@ -0,0 +1,24 @@
+/**
+ * @file esp_heap_caps.h
+ * @brief Simulator port: a bounded heap with the device's free-space queries
+ *
+ * Allocations come from a fixed SIM_HEAP_SIZE arena (first fit, adjacent
+ * free blocks merged), so free size, low-water mark and largest free block
+ * move as they would on the board, and fragmentation shows up in a soak.
+ */
+
+#ifndef SIM_ESP_HEAP_CAPS_H
+#define SIM_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif // SIM_ESP_HEAP_CAPS_H
@@ -0,0 +1,19 @@
+/**
+ * @file esp_log.h
+ * @brief Simulator port: firmware log lines, stamped with virtual time
+ */
+
+#ifndef SIM_ESP_LOG_H
+#define SIM_ESP_LOG_H
+
+#include <stdio.h>                      // Pulled in by the SDK header too
+
+void sim_log(char level, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, fmt, ...) sim_log('E', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) sim_log('W', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) sim_log('I', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) sim_log('D', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) sim_log('V', tag, fmt, ##__VA_ARGS__)
+
+#endif // SIM_ESP_LOG_H
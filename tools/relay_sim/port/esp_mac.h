@@ -0,0 +1,12 @@
+/**
+ * @file esp_mac.h
+ * @brief Simulator port: MAC address formatting
+ */
+
+#ifndef SIM_ESP_MAC_H
+#define SIM_ESP_MAC_H
+
+#define MACSTR              "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a)          (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+
+#endif // SIM_ESP_MAC_H
@@ -0,0 +1,63 @@
+/**
+ * @file esp_netif.h
+ * @brief Simulator port: station interface and IPv4 addresses
+ */
+
+#ifndef SIM_ESP_NETIF_H
+#define SIM_ESP_NETIF_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef struct esp_netif esp_netif_t;
+
+typedef struct {
+    uint32_t addr;              // Network byte order
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+#define ESP_IPADDR_TYPE_V4  0
+
+typedef struct {
+    struct {
+        union {
+            esp_ip4_addr_t ip4;
+        } u_addr;
+        uint8_t type;
+    } ip;
+} esp_netif_dns_info_t;
+
+typedef enum {
+    ESP_NETIF_DNS_MAIN,
+} esp_netif_dns_type_t;
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+typedef struct {
+    esp_netif_t *esp_netif;
+    esp_netif_ip_info_t ip_info;
+} ip_event_got_ip_t;
+
+#define IPSTR               "%d.%d.%d.%d"
+#define IP2STR(a)           (int)((a)->addr & 0xff), (int)(((a)->addr >> 8) & 0xff), \
+                            (int)(((a)->addr >> 16) & 0xff), (int)(((a)->addr >> 24) & 0xff)
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *netif);
+esp_err_t esp_netif_set_ip_info(esp_netif_t *netif, const esp_netif_ip_info_t *info);
+esp_err_t esp_netif_get_ip_info(esp_netif_t *netif, esp_netif_ip_info_t *info);
+esp_err_t esp_netif_set_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type,
+                                 esp_netif_dns_info_t *dns);
+uint32_t esp_ip4addr_aton(const char *addr);
+
+#endif // SIM_ESP_NETIF_H
@@ -0,0 +1,22 @@
+/**
+ * @file esp_netif_sntp.h
+ * @brief Simulator port: SNTP client
+ *
+ * The host clock is already synchronised, so starting SNTP does nothing
+ * and time() is the host's.
+ */
+
+#ifndef SIM_ESP_NETIF_SNTP_H
+#define SIM_ESP_NETIF_SNTP_H
+
+#include "esp_err.h"
+
+typedef struct {
+    const char *servers[1];
+} esp_sntp_config_t;
+
+#define ESP_NETIF_SNTP_DEFAULT_CONFIG(server)   { .servers = { server } }
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config);
+
+#endif // SIM_ESP_NETIF_SNTP_H
@@ -0,0 +1,13 @@
+/**
+ * @file esp_rom_crc.h
+ * @brief Simulator port: ROM CRC32 (IEEE 802.3, as zlib's crc32())
+ */
+
+#ifndef SIM_ESP_ROM_CRC_H
+#define SIM_ESP_ROM_CRC_H
+
+#include <stdint.h>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif // SIM_ESP_ROM_CRC_H
@@ -0,0 +1,22 @@
+/**
+ * @file esp_system.h
+ * @brief Simulator port: restart and shutdown handlers
+ *
+ * A restart ends the simulated boot; the simulator starts the next one in
+ * a fresh process with the same flash and RTC memory contents (see
+ * sim_port.h). Shutdown handlers run first, as on the device.
+ */
+
+#ifndef SIM_ESP_SYSTEM_H
+#define SIM_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef void (*shutdown_handler_t)(void);
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+void esp_restart(void) __attribute__((noreturn));
+uint32_t esp_get_free_heap_size(void);
+
+#endif // SIM_ESP_SYSTEM_H
@@ -0,0 +1,142 @@
+/**
+ * @file esp_wifi.h
+ * @brief Simulator port: station mode against modelled access points
+ *
+ * Connection attempts, scans and beacon loss complete after fixed delays
+ * (see sim_port.c). The access points of the SSID are switched off and on,
+ * and their signal changed, by fault injection. Power save and TX power
+ * are stored and read back but change no timing.
+ */
+
+#ifndef SIM_ESP_WIFI_H
+#define SIM_ESP_WIFI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef enum {
+    WIFI_EVENT_SCAN_DONE = 1,
+    WIFI_EVENT_STA_START,
+    WIFI_EVENT_STA_STOP,
+    WIFI_EVENT_STA_CONNECTED,
+    WIFI_EVENT_STA_DISCONNECTED,
+    WIFI_EVENT_STA_BSS_RSSI_LOW = 17,
+} wifi_event_t;
+
+typedef enum {
+    WIFI_MODE_NULL,
+    WIFI_MODE_STA,
+} wifi_mode_t;
+
+typedef enum {
+    WIFI_IF_STA,
+} wifi_interface_t;
+
+typedef enum {
+    WIFI_AUTH_OPEN,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+} wifi_auth_mode_t;
+
+typedef enum {
+    WPA3_SAE_PWE_UNSPECIFIED,
+    WPA3_SAE_PWE_HUNT_AND_PECK,
+    WPA3_SAE_PWE_HASH_TO_ELEMENT,
+    WPA3_SAE_PWE_BOTH,
+} wifi_sae_pwe_method_t;
+
+typedef enum {
+    WIFI_FAST_SCAN,             // Join the first AP found
+    WIFI_ALL_CHANNEL_SCAN,
+} wifi_scan_method_t;
+
+typedef enum {
+    WIFI_CONNECT_AP_BY_SIGNAL,
+    WIFI_CONNECT_AP_BY_SECURITY,
+} wifi_sort_method_t;
+
+typedef enum {
+    WIFI_SCAN_TYPE_ACTIVE,
+    WIFI_SCAN_TYPE_PASSIVE,
+} wifi_scan_type_t;
+
+typedef enum {
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+typedef struct {
+    int unused;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT()  { 0 }
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t password[64];
+    wifi_scan_method_t scan_method;
+    bool bssid_set;             // Join only bssid (on channel, if set)
+    uint8_t bssid[6];
+    uint8_t channel;
+    wifi_sort_method_t sort_method;
+    struct {
+        wifi_auth_mode_t authmode;
+    } threshold;
+    uint16_t listen_interval;   // Recorded, not modelled
+    wifi_sae_pwe_method_t sae_pwe_h2e;
+    uint32_t rm_enabled: 1;
+    uint32_t btm_enabled: 1;
+    uint32_t ft_enabled: 1;
+} wifi_sta_config_t;
+
+typedef union {
+    wifi_sta_config_t sta;
+} wifi_config_t;
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;            // Channel
+    int8_t rssi;
+} wifi_ap_record_t;
+
+typedef struct {
+    struct {
+        uint32_t min;
+        uint32_t max;           // ms per channel (0: 120)
+    } active;
+    uint32_t passive;
+} wifi_scan_time_t;
+
+typedef struct {
+    uint8_t *ssid;
+    uint8_t *bssid;
+    uint8_t channel;            // 0: all channels
+    bool show_hidden;
+    wifi_scan_type_t scan_type;
+    wifi_scan_time_t scan_time;
+} wifi_scan_config_t;
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_set_config(wifi_interface_t iface, wifi_config_t *config);
+esp_err_t esp_wifi_get_config(wifi_interface_t iface, wifi_config_t *config);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_stop(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_disconnect(void);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *info);
+esp_err_t esp_wifi_set_rssi_threshold(int32_t rssi);
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *type);
+esp_err_t esp_wifi_set_max_tx_power(int8_t power);
+esp_err_t esp_wifi_get_max_tx_power(int8_t *power);
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block);
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *number);
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *records);
+
+#endif // SIM_ESP_WIFI_H
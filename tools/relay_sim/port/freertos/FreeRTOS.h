@@ -0,0 +1,52 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Simulator port: FreeRTOS types and tick rate
+ *
+ * The tick rate matches CONFIG_FREERTOS_HZ in sdkconfig.esp32dev, so
+ * tick-based timing (debounce, vTaskDelay) rounds as it does on the board.
+ * Tasks are never preempted between blocking calls and interrupts run
+ * inline, so critical sections need no locking.
+ */
+
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define configTICK_RATE_HZ  100
+
+#ifndef BIT0                            // esp_bit_defs.h, via the SDK's port layer
+#define BIT0                0x00000001
+#define BIT1                0x00000002
+#define BIT2                0x00000004
+#define BIT3                0x00000008
+#endif
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS  ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000U))
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portMUX_INITIALIZE(mux)     ((void)(mux))
+#define portENTER_CRITICAL(mux)     ((void)(mux))
+#define portEXIT_CRITICAL(mux)      ((void)(mux))
+#define taskENTER_CRITICAL(mux)     ((void)(mux))
+#define taskEXIT_CRITICAL(mux)      ((void)(mux))
+#define taskENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define taskEXIT_CRITICAL_ISR(mux)  ((void)(mux))
+#define portYIELD_FROM_ISR(woken)   ((void)(woken))
+
+#endif // SIM_FREERTOS_H
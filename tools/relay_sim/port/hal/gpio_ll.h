@@ -0,0 +1,34 @@
+/**
+ * @file gpio_ll.h
+ * @brief Simulator port: GPIO register access of the IRAM profile
+ *
+ * Goes through the simulated driver, so injected GPIO faults and the
+ * output trace see these writes too; the register write itself cannot
+ * fail, so a refused write still reads back wrong.
+ */
+
+#ifndef SIM_GPIO_LL_H
+#define SIM_GPIO_LL_H
+
+#include <stdint.h>
+#include "driver/gpio.h"
+
+typedef struct {
+    int unused;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
+
+static inline void gpio_ll_set_level(gpio_dev_t *hw, uint32_t gpio_num, uint32_t level)
+{
+    (void)hw;
+    (void)gpio_set_level((gpio_num_t)gpio_num, level);
+}
+
+static inline int gpio_ll_get_level(gpio_dev_t *hw, uint32_t gpio_num)
+{
+    (void)hw;
+    return gpio_get_level((gpio_num_t)gpio_num);
+}
+
+#endif // SIM_GPIO_LL_H
@@ -0,0 +1,29 @@
+/**
+ * @file sockets.h
+ * @brief Simulator port: lwIP BSD sockets on the host's
+ *
+ * Everything but select() is the host call. select() blocks only the
+ * calling simulated task (sim_select()); with the clock in realtime mode
+ * a ready socket wakes it, so the servers run unchanged against real
+ * clients. recv(), accept() and send() are the host's blocking calls, so
+ * the firmware must only use them once select() reported the socket
+ * ready, or with MSG_DONTWAIT, as it does.
+ */
+
+#ifndef SIM_LWIP_SOCKETS_H
+#define SIM_LWIP_SOCKETS_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int sim_select(int nfds, fd_set *rd, fd_set *wr, fd_set *ex, struct timeval *timeout);
+
+#define select(nfds, rd, wr, ex, timeout)   sim_select(nfds, rd, wr, ex, timeout)
+
+#endif // SIM_LWIP_SOCKETS_H
@@ -0,0 +1,18 @@
+/**
+ * @file sdkconfig.h
+ * @brief Simulator port: Kconfig options the firmware tests
+ *
+ * The 802.11k/v options are left out, so wifi_service.c roams by scanning
+ * and reassociating; neighbor reports and BSS transition management are
+ * exchanges with the AP that the simulator does not model.
+ *
+ * ESP_TIMER_ISR dispatch is available, so the firmware also builds with
+ * RELAY_IRAM_PROFILE (see sim_set_cache_stall()).
+ */
+
+#ifndef SIM_SDKCONFIG_H
+#define SIM_SDKCONFIG_H
+
+#define CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD   1
+
+#endif // SIM_SDKCONFIG_H
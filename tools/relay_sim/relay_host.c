@@ -0,0 +1,401 @@
+/**
+ * @file relay_host.c
+ * @brief The firmware as a host process serving its API on real sockets
+ *
+ * Boots like app_main() in main.c and runs the real relay_service.c,
+ * sequencer.c, wifi_service.c, powerfail.c, block_pool.c, thermostat.c
+ * (on the simulated room of sim_room.c), solar_schedule.c, json_writer.c,
+ * http_controller.c, modbus_server.c and failover.c on the simulator port
+ * with the clock in realtime mode (sim_set_realtime()). The HTTP server is
+ * the esp_http_server stand-in of sim_httpd.c, so clients and tools in
+ * tools/ can be measured against it. Gossip, webhooks, telemetry, UI
+ * assets and the UART link are left out: their status endpoints report
+ * them idle.
+ *
+ * esp_restart() re-executes the process (same PID, so a test can keep
+ * signalling it) with NVS and RTC memory kept in a memfd.
+ *
+ * Build (from the repository root):
+ *   gcc -O2 -Itools/relay_sim/port -Itools/relay_sim -Iinclude -o relay_host \
+ *       tools/relay_sim/relay_host.c tools/relay_sim/sim_port.c \
+ *       tools/relay_sim/sim_httpd.c tools/relay_sim/sim_room.c \
+ *       tools/relay_sim/host_failover.c tools/relay_sim/host_modbus.c \
+ *       src/relay_service.c src/sequencer.c src/wifi_service.c \
+ *       src/powerfail.c src/block_pool.c src/thermostat.c \
+ *       src/solar_schedule.c src/json_writer.c src/http_controller.c -lm
+ * Usage:
+ *   relay_host [options]
+ *
+ *   Options:
+ *     -p PORT   HTTP port (default 8080)
+ *     -m PORT   also serve Modbus TCP on PORT (default: off)
+ *     -d US     service time per HTTP request ahead of the handler
+ *               (default 0)
+ *     -t        trace on stdout, one line per event, stamped with
+ *               CLOCK_MONOTONIC microseconds so the lines of several
+ *               instances can be merged:
+ *                 T boot N         a boot started
+ *                 T relays MASK    relay outputs changed (hex, bit N relay N)
+ *                 T active         the failover pair made this node active
+ *                 T http PORT      the API is up
+ *     -v        firmware log on stderr (-vv adds debug)
+ *   Failover pair (both instances on one machine):
+ *     -F primary|standby   FAILOVER_ROLE; enables failover
+ *     -n IP     this node's loopback address (FAILOVER_NODE_IP)
+ *     -P IP     the other node's (FAILOVER_PEER_IP)
+ *     -O FILE   service address owner file, shared by the pair
+ *     -L PCT    drop PCT percent of outgoing heartbeats and deltas
+ */
+
+#define _GNU_SOURCE                     // memfd_create()
+#include "sim_port.h"
+#include "relay_host.h"
+#include "config.h"
+#include "relay_service.h"
+#include "sequencer.h"
+#include "wifi_service.h"
+#include "powerfail.h"
+#include "thermostat.h"
+#include "solar_schedule.h"
+#include "modbus_server.h"
+#include "failover.h"
+#include "gossip.h"
+#include "webhook.h"
+#include "telemetry.h"
+#include "ui_assets.h"
+#include "uart_link.h"
+#include "http_controller.h"
+#include "nvs_flash.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ENV_FLASH           "RELAY_HOST_FLASH_FD"   // Kept across esp_restart()
+#define ENV_BOOT            "RELAY_HOST_BOOT"
+
+static const char *TAG = "host";
+
+host_failover_t host_failover = { .node_ip = "127.0.0.1", .peer_ip = "127.0.0.2" };
+uint16_t host_modbus_port = 0;
+
+static struct {
+    uint16_t http_port;
+    int64_t service_us;
+    bool trace;
+    int verbosity;
+} s_opt = { .http_port = 8080 };
+
+static char **s_argv;
+static int s_boot = 1;
+static uint32_t s_outputs = 0;              // Relay outputs as driven
+
+/*============================================================================
+ * Trace
+ *============================================================================*/
+
+static void trace(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void trace(const char *fmt, ...)
+{
+    if (!s_opt.trace) {
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    printf("%lld ", (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    putchar('\n');
+    fflush(stdout);
+}
+
+/*============================================================================
+ * Simulator hooks
+ *============================================================================*/
+
+void sim_on_gpio(int pin, int level)
+{
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        if (relay_get_info(i)->gpio_pin != pin) continue;
+        // Open-drain, active LOW
+        uint32_t outputs = (level == 0) ? (s_outputs | 1UL << i) : (s_outputs & ~(1UL << i));
+        if (outputs != s_outputs) {
+            s_outputs = outputs;
+            trace("relays %lx", (unsigned long)outputs);
+        }
+    }
+}
+
+void sim_on_nvs(const char *ns, const char *key, const void *data, size_t len)
+{
+    (void)ns; (void)key; (void)data; (void)len;
+}
+
+void sim_on_flash(const char *label, size_t offset, size_t len, bool erase)
+{
+    (void)label; (void)offset; (void)len; (void)erase;
+}
+
+void sim_on_step(void)
+{
+}
+
+void sim_on_restart(void)
+{
+    char boot[16];
+    snprintf(boot, sizeof(boot), "%d", s_boot + 1);
+    setenv(ENV_BOOT, boot, 1);
+    fflush(stdout);
+    fflush(stderr);
+    // Sockets close as on a reset (a bound heartbeat port would block the
+    // next boot); only the flash memfd carries over
+    close_range(3, ~0U, CLOSE_RANGE_CLOEXEC);
+    fcntl(atoi(getenv(ENV_FLASH)), F_SETFD, 0);
+    execv("/proc/self/exe", s_argv);
+    perror("execv");
+    _exit(1);
+}
+
+/*============================================================================
+ * Modules left out of the host build
+ *============================================================================*/
+
+esp_err_t gossip_publish(uint8_t obj, const char *text)
+{
+    (void)obj; (void)text;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void gossip_get_stats(gossip_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+esp_err_t webhook_set_targets(const char *text)
+{
+    (void)text;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void webhook_get_status(webhook_status_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+esp_err_t telemetry_set_url(const char *url)
+{
+    (void)url;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void telemetry_get_status(telemetry_status_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+esp_err_t ui_assets_find(const char *name, ui_asset_t *out)
+{
+    (void)name; (void)out;
+    return ESP_ERR_NOT_FOUND;           // The built-in page is served
+}
+
+esp_err_t ui_assets_update_begin(size_t total_len)
+{
+    (void)total_len;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t ui_assets_update_write(const void *data, size_t len)
+{
+    (void)data; (void)len;
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t ui_assets_update_finish(void)
+{
+    return ESP_ERR_INVALID_STATE;
+}
+
+void ui_assets_update_abort(void)
+{
+}
+
+void ui_assets_get_status(ui_assets_status_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+void uart_link_get_stats(uart_link_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+/*============================================================================
+ * Boot
+ *============================================================================*/
+
+/**
+ * @brief app_main() of main.c, minus the modules left out
+ */
+static void main_task(void *arg)
+{
+    (void)arg;
+
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition was truncated, erasing...");
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+
+#if POWERFAIL_ENABLE
+    if (powerfail_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Power-fail flush unavailable");
+    }
+#endif
+    ESP_ERROR_CHECK(relay_service_init());
+    ESP_ERROR_CHECK(sequencer_init());
+
+    if (wifi_service_init() != ESP_OK) {
+        ESP_LOGE(TAG, "WiFi connection failed! Restarting in 5 seconds...");
+        vTaskDelay(pdMS_TO_TICKS(5000));
+        esp_restart();
+    }
+
+    if (host_failover.enabled) {
+        ESP_ERROR_CHECK(failover_init());
+        failover_wait_active();
+        trace("active");
+    }
+
+    ESP_ERROR_CHECK(thermostat_init(sim_room_sensor()));
+    if (solar_schedule_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Solar schedule unavailable");
+    }
+
+    sim_httpd_set_port(s_opt.http_port);
+    sim_httpd_set_service_time(s_opt.service_us);
+    ESP_ERROR_CHECK(http_controller_init());
+    trace("http %u", (unsigned)s_opt.http_port);
+
+    if (host_modbus_port != 0 && modbus_server_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Modbus TCP server unavailable");
+    }
+
+    // The WiFi watchdog of app_main's loop
+    sim_set_background();
+    int wifi_disconnect_seconds = 0;
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(WIFI_CHECK_INTERVAL_MS));
+        if (!wifi_is_connected()) {
+            wifi_disconnect_seconds += WIFI_CHECK_INTERVAL_MS / 1000;
+            if (wifi_disconnect_seconds >= WIFI_RESTART_AFTER_S) {
+                ESP_LOGE(TAG, "WiFi disconnected too long, restarting...");
+                esp_restart();
+            }
+        } else {
+            wifi_disconnect_seconds = 0;
+        }
+    }
+}
+
+/**
+ * @brief Flash and RTC memory in a memfd that esp_restart()'s exec keeps
+ */
+static int attach_flash(void)
+{
+    int fd;
+    const char *env = getenv(ENV_FLASH);
+    if (env != NULL) {
+        fd = atoi(env);
+    } else {
+        fd = memfd_create("relay_host_flash", 0);
+        if (fd < 0 || ftruncate(fd, sim_flash_size()) != 0) {
+            perror("memfd");
+            return -1;
+        }
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d", fd);
+        setenv(ENV_FLASH, buf, 1);
+    }
+    void *mem = mmap(NULL, sim_flash_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    sim_flash_attach(mem);
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: relay_host [-p PORT] [-m PORT] [-d US] [-t] [-v]\n"
+            "                  [-F primary|standby -n IP -P IP -O FILE [-L PCT]]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    s_argv = argv;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (a[0] != '-' || a[1] == '\0') usage();
+        if (strchr("pmdFnPOL", a[1]) != NULL && (a[2] != '\0' || i + 1 >= argc)) usage();
+
+        switch (a[1]) {
+        case 'p': s_opt.http_port = (uint16_t)atoi(argv[++i]); break;
+        case 'm': host_modbus_port = (uint16_t)atoi(argv[++i]); break;
+        case 'd': s_opt.service_us = strtoll(argv[++i], NULL, 0); break;
+        case 't': s_opt.trace = true; break;
+        case 'v': s_opt.verbosity = (int)strlen(a) - 1; break;
+        case 'F':
+            host_failover.enabled = true;
+            if (strcmp(argv[++i], "primary") == 0) {
+                host_failover.role = FAILOVER_ROLE_PRIMARY;
+            } else if (strcmp(argv[i], "standby") == 0) {
+                host_failover.role = FAILOVER_ROLE_STANDBY;
+            } else {
+                usage();
+            }
+            break;
+        case 'n': host_failover.node_ip = argv[++i]; break;
+        case 'P': host_failover.peer_ip = argv[++i]; break;
+        case 'O': host_failover.owner_file = argv[++i]; break;
+        case 'L': host_failover.loss_pct = atoi(argv[++i]); break;
+        default: usage();
+        }
+    }
+    if (host_failover.enabled && host_failover.owner_file == NULL) {
+        usage();
+    }
+
+    const char *boot = getenv(ENV_BOOT);
+    s_boot = boot ? atoi(boot) : 1;
+    if (attach_flash() != 0) {
+        return 1;
+    }
+    srand((unsigned)getpid() ^ (unsigned)s_boot);
+
+    sim_set_verbosity(s_opt.verbosity);
+    sim_init(0);
+    sim_set_realtime(true);
+    trace("boot %d", s_boot);
+
+    sim_task_create("main", SIM_PRIO_MAIN, main_task, NULL);
+    sim_run(SIM_NEVER);
+    return 0;
+}
@@ -0,0 +1,25 @@
+/**
+ * @file relay_host.h
+ * @brief Settings relay_host.c hands to the firmware modules it rebuilds
+ *        with host values (host_failover.c, host_modbus.c)
+ */
+
+#ifndef RELAY_HOST_H
+#define RELAY_HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    bool enabled;               // FAILOVER_ENABLE
+    int role;                   // FAILOVER_ROLE
+    const char *node_ip;        // FAILOVER_NODE_IP, a loopback address
+    const char *peer_ip;        // FAILOVER_PEER_IP
+    const char *owner_file;     // Names the node holding STATIC_IP
+    int loss_pct;               // Outgoing datagrams dropped
+} host_failover_t;
+
+extern host_failover_t host_failover;
+extern uint16_t host_modbus_port;       // MODBUS_PORT
+
+#endif // RELAY_HOST_H
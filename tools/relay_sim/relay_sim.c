@@ -0,0 +1,1747 @@
+/**
+ * @file relay_sim.c
+ * @brief Deterministic trace replay against the firmware on a virtual clock
+ *
+ * Runs the real relay_service.c, sequencer.c, wifi_service.c, powerfail.c
+ * and block_pool.c on the host (see port/ and sim_port.c), replays a command trace and prints the
+ * GPIO edge timeline, the relay state history and NVS writes. Idle time is
+ * skipped, so a day of traffic replays in well under a second, and the
+ * same trace always gives the same timeline. Build the simulator against
+ * two firmware trees and diff their timelines (or compare the hash in the
+ * summary) to see what a change does to timing.
+ *
+ * Traces can also inject faults (access point loss, NVS write failures, a
+ * full NVS partition, relay outputs that refuse or drop writes, socket
+ * resets, lost responses, slow clients, power cycles). Each command comes from a client that retries a failed request
+ * CLIENT_RETRIES times, CLIENT_RETRY_US apart, so the summary can count
+ * commands lost and commands executed twice, and reports for every fault
+ * when the firmware noticed it and when the device recovered.
+ * esp_restart() (the main loop's WiFi watchdog, a failed ESP_ERROR_CHECK)
+ * boots again BOOT_US later in a fresh process with the same flash and
+ * RTC memory. A power cycle first pulls the power-fail input LOW and keeps
+ * the rail up for POWERFAIL_HOLDUP_US, then boots with RTC memory lost.
+ *
+ * Each command's client opens its own connection, which stays open until
+ * SESSION_IDLE_US after its last response or until the server purges it as
+ * least recently used. The session context comes from a block pool as in
+ * http_controller.c (or, with -H, from the heap), and every request and
+ * response holds a heap buffer while in flight, as lwIP's pbufs do. The
+ * summary reports the largest free heap block across the run, so a long
+ * soak shows whether connection churn fragments the heap.
+ *
+ * Build (from the repository root; output read-back on, so the "output
+ * stuck" fault is noticed):
+ *   gcc -O2 -DRELAY_VERIFY_OUTPUTS=1 -Itools/relay_sim/port -Iinclude -o relay_sim \
+ *       tools/relay_sim/relay_sim.c tools/relay_sim/sim_port.c \
+ *       src/relay_service.c src/sequencer.c src/wifi_service.c \
+ *       src/powerfail.c src/block_pool.c -lm
+ * Usage:
+ *   relay_sim [options] trace.txt       (- for stdin)
+ *   relay_sim [options] -g SECONDS [faults.txt]
+ *
+ *   Options:
+ *     -o FILE   write the timeline to FILE (default stdout)
+ *     -q        no timeline, summary only
+ *     -e SEC    stop at this virtual time (default: when idle, at most
+ *               one hour after the last command)
+ *     -b MASK   relay states saved in NVS before boot (hex)
+ *     -g SEC    generate SEC seconds of random commands (merged with the
+ *               trace file, if one is given)
+ *     -r N      commands per minute for -g (default 2)
+ *     -s SEED   random seed for -g (default 1)
+ *     -p        print the trace (parsed or generated) and exit
+ *     -H        heap-allocate session contexts instead of pooling them
+ *     -c US     flash cache off for US after each NVS write that changes
+ *               flash (default 0: not modelled); tasks wait it out, ISR
+ *               timers do not (build with -DRELAY_IRAM_PROFILE=1 to move
+ *               pulse ends there)
+ *     -v        firmware log on stderr (-vv adds debug)
+ *
+ * Trace lines, in time order:
+ *   TIME [GET|POST] PATH [BODY]
+ *     TIME is seconds since boot, or +SECONDS after the previous line.
+ *     PATH is an API path, e.g. /relay/1/toggle, /relay/2/pulse?ms=300,
+ *     /relay/all/off, /seq/0/run; POST /seq/N takes the sequence as BODY.
+ *     /relay/txn?on=HEX&off=HEX (simulator only) stages the relays of both
+ *     masks with relay_txn_stage() and applies them with relay_txn_commit().
+ *   TIME fault FAULT
+ *     wifi down | wifi up    access point off / back on
+ *     wifi ap N DBM|off      access point N (0 or 1) heard at DBM, or off;
+ *                            AP 0 starts at -55 dBm, AP 1 off
+ *     nvs fail N             the next N NVS writes fail
+ *     nvs full               every NVS write fails until the partition is
+ *                            erased (the boot code does that)
+ *     output fail N          the next N relay output writes return an error
+ *     output stuck N         the next N relay output writes are ignored
+ *                            (only a read-back notices)
+ *     sock reset N           the next N requests are reset before the
+ *                            handler runs
+ *     sock drop N            the next N responses are lost after the
+ *                            handler ran (the client retries)
+ *     slow MS [N]            the next N requests trickle in over MS
+ *     reboot                 power cycle (power-fail warning first)
+ *   I (12345) HTTP: GET /relay/1/toggle
+ *     A serial monitor line; the device's HTTP log replays as recorded.
+ *   Blank lines and lines starting with # are ignored, as are other log
+ *   lines. Paths the simulator does not model are reported as "skip".
+ *
+ * Timeline lines ("SECONDS KIND ..."):
+ *   gpio PIN LEVEL NAME     output edge
+ *   relay ID on|off WATTS   state change (from the change journal)
+ *   cmd N METHOD PATH       command N starts (late if queued)
+ *   done N STATUS [STATE]   command N returns, with its HTTP status
+ *   fail N REASON           an attempt failed (unreachable, reset,
+ *                           timeout, dropped, restart); the client retries
+ *   giveup N REASON         the client stopped retrying
+ *   nvs NS/KEY BYTES        flash write (value unchanged: no write)
+ *   flash LABEL write|erase OFFSET BYTES
+ *                           partition program / erase (power-fail records)
+ *   wifi up|down            the firmware's view of the link
+ *   fault FAULT             fault injected
+ *   boot N / restart        boot starts / esp_restart()
+ *   restore MASK, was MASK  the boot did not bring back the relays that
+ *                           were on at the restart (hex masks)
+ *   partial N MASK          transaction command N left the relays at MASK
+ *                           (hex), neither all of it applied nor none
+ */
+
+#define _GNU_SOURCE
+#include "sim_port.h"
+#include "config.h"
+#include "relay_service.h"
+#include "sequencer.h"
+#include "wifi_service.h"
+#include "powerfail.h"
+#include "block_pool.h"
+#include "driver/gpio.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DRAIN_US            (3600LL * 1000000)  // Default run-on after the last command
+#define MAX_LINE            1024
+#define MAX_RETRY_QUEUE     256
+#define SIM_PRIO_FAULTS     24                  // Faults apply before anything else at their time
+
+#define BOOT_US             400000              // ROM, bootloader and app image load
+#define CLIENT_RETRIES      3                   // Further attempts after a failure
+#define CLIENT_RETRY_US     5000000             // Client timeout, then the next attempt
+
+#define SESSION_IDLE_US     5000000             // Client closes a connection idle this long
+#define REQUEST_HEADERS     160                 // Request line and headers beyond the path
+#define RESPONSE_BYTES      320                 // Status line, headers and JSON body
+
+static const char *TAG = LOG_TAG_MAIN;
+
+typedef struct {
+    int64_t t_us;
+    int line;
+    bool post;
+    char *path;
+    char *body;
+} trace_cmd_t;
+
+typedef enum {
+    FAULT_WIFI_DOWN,
+    FAULT_WIFI_UP,
+    FAULT_WIFI_AP,
+    FAULT_NVS_FAIL,
+    FAULT_NVS_FULL,
+    FAULT_OUTPUT_FAIL,
+    FAULT_OUTPUT_STUCK,
+    FAULT_SOCK_RESET,
+    FAULT_SOCK_DROP,
+    FAULT_SLOW,
+    FAULT_REBOOT,
+} fault_kind_t;
+
+typedef struct {
+    int64_t t_us;
+    fault_kind_t kind;
+    int count;
+    int ms;
+    int ap;
+    int dbm;                    // "wifi ap" signal (0: off)
+    char text[32];              // As written in the trace
+} fault_t;
+
+typedef struct {
+    const char *out_path;
+    bool quiet;
+    int64_t end_us;
+    int boot_mask;              // -1: empty NVS
+    double gen_seconds;
+    double gen_rate;
+    uint64_t seed;
+    bool print_trace;
+    bool heap_sessions;
+    int64_t cache_stall_us;
+    int verbosity;
+} options_t;
+
+/**
+ * @brief Session context, as http_controller.c attaches to each connection
+ */
+typedef struct {
+    int64_t opened_us;
+    uint32_t requests;
+} session_t;
+
+/**
+ * @brief An open client connection on the server
+ */
+typedef struct {
+    session_t *ctx;             // NULL when the slot is free
+    int64_t last_us;
+} conn_t;
+
+/**
+ * @brief Client side of one command
+ */
+typedef struct {
+    int64_t next_us;            // Next attempt
+    uint8_t tries;
+    uint8_t runs;               // Times the handler ran
+    bool finished;              // Answered, or the client gave up
+} cmd_state_t;
+
+typedef struct {
+    int64_t detect_us;          // Firmware noticed (-1: not yet / cannot)
+    int64_t clear_us;           // Fault condition ended
+    int64_t recover_us;         // Device back to normal service
+    uint32_t wifi_seen;         // Firmware scans, roams and disconnects when injected
+    uint32_t output_seen;       // Output errors the firmware had counted when injected
+} fault_state_t;
+
+/**
+ * @brief Everything that outlives one boot (shared with each boot's process)
+ */
+typedef struct {
+    int64_t boot_us;
+    int64_t now_us;
+    uint32_t boots;
+    bool restarting;
+    int restart_mask;           // Relays on when the last boot ended (-1: unknown)
+    uint32_t state_lost;        // Boots that did not restore those relays
+    uint32_t output_mismatches; // Times the outputs stopped matching the relay states
+    uint32_t txn_commits;       // /relay/txn commands that ran
+    uint32_t txn_refused;       // ... and returned an error
+    uint32_t txn_partial;       // ... and left only part of the batch applied
+
+    // Injected state
+    bool ap_down;
+    int sock_reset_left;
+    int sock_drop_left;
+    int slow_left;
+    int slow_ms;
+
+    // Replay progress
+    size_t next_cmd;
+    size_t next_fault;
+    size_t retry[MAX_RETRY_QUEUE];
+    size_t retry_count;
+    int64_t last_ok_us;
+
+    // Replay results
+    size_t answered;
+    size_t skipped;
+    size_t failed;
+    size_t attempts_failed;
+    size_t late;
+    int64_t late_total_us;
+    int64_t late_max_us;
+    uint32_t switches[RELAY_COUNT];
+    int64_t on_since[RELAY_COUNT];
+    int64_t on_total[RELAY_COUNT];
+    char names[RELAY_COUNT][32];
+    uint64_t hash;
+    sim_stats_t stats;
+    relay_output_stats_t outputs;   // The firmware's counters, summed over boots
+
+    // Connections and heap
+    size_t sessions;
+    size_t sessions_purged;
+    size_t sessions_refused;
+    uint32_t heap_largest_start;    // When the first server came up (0: not yet)
+    uint32_t heap_largest_min;
+    uint32_t heap_largest_end;
+    uint32_t heap_free_min;
+} run_t;
+
+static options_t s_opt = { .end_us = -1, .boot_mask = -1, .gen_rate = 2, .seed = 1 };
+
+static trace_cmd_t *s_trace = NULL;
+static size_t s_trace_len = 0;
+static size_t s_trace_cap = 0;
+static fault_t *s_faults = NULL;
+static size_t s_fault_len = 0;
+static size_t s_fault_cap = 0;
+static size_t s_ignored_lines = 0;
+
+static FILE *s_out = NULL;
+static run_t *s_run = NULL;
+static cmd_state_t *s_cmd = NULL;
+static fault_state_t *s_fault_state = NULL;
+
+// This boot only
+static bool s_started = false;
+static bool s_relays_up = false;
+static bool s_server_up = false;
+static int64_t s_server_up_us = SIM_NEVER;
+static bool s_link_seen = false;
+static uint64_t s_nvs_failed_seen = 0;
+static bool s_outputs_mismatched = false;
+static long s_inflight = -1;
+static uint32_t s_journal_cursor = 0;
+static uint32_t s_load_w = 0;
+static block_pool_t s_session_pool;
+static conn_t s_conns[HTTP_MAX_CONNECTIONS];
+static void *s_tx_buf = NULL;               // Last response, until it is acknowledged
+
+static void fail_attempt(size_t idx, int64_t t_us, const char *reason);
+static void conn_expire(int64_t now);
+
+/*============================================================================
+ * Timeline output
+ *============================================================================*/
+
+static void emit_at(int64_t t_us, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void emit_at(int64_t t_us, const char *fmt, ...)
+{
+    char line[MAX_LINE + 64];
+    int n = snprintf(line, sizeof(line), "%lld.%06lld ",
+                     (long long)(t_us / 1000000), (long long)(t_us % 1000000));
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line + n, sizeof(line) - n, fmt, args);
+    va_end(args);
+
+    for (const char *p = line; *p; p++) {
+        s_run->hash = (s_run->hash ^ (uint8_t)*p) * 1099511628211ULL;
+    }
+    s_run->hash = (s_run->hash ^ '\n') * 1099511628211ULL;
+
+    if (!s_opt.quiet) {
+        fputs(line, s_out);
+        fputc('\n', s_out);
+    }
+}
+
+static const char *pin_name(int pin)
+{
+    if (pin == LED_BUILTIN_GPIO) {
+        return "LED";
+    }
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        const relay_info_t *info = relay_get_info(i);
+        if (info != NULL && info->gpio_pin == pin) {
+            return info->name;
+        }
+    }
+    return "-";
+}
+
+void sim_on_gpio(int pin, int level)
+{
+    emit_at(sim_now(), "gpio %d %d %s", pin, level, pin_name(pin));
+}
+
+void sim_on_nvs(const char *ns, const char *key, const void *data, size_t len)
+{
+    (void)data;
+    if (s_started) {
+        emit_at(sim_now(), "nvs %s/%s %u", ns, key, (unsigned)len);
+    }
+}
+
+void sim_on_flash(const char *label, size_t offset, size_t len, bool erase)
+{
+    emit_at(sim_now(), "flash %s %s 0x%04x %u", label, erase ? "erase" : "write",
+            (unsigned)offset, (unsigned)len);
+}
+
+static void relay_off_since(int id, int64_t t_us)
+{
+    if (s_run->on_since[id] >= 0) {
+        s_run->on_total[id] += t_us - s_run->on_since[id];
+        s_run->on_since[id] = -1;
+    }
+}
+
+/**
+ * @brief Scans, roams and disconnects so far: the firmware reacting to the radio
+ */
+static uint32_t wifi_activity(void)
+{
+    wifi_roam_status_t st;
+    wifi_get_roam_status(&st);
+    return st.scans + st.roams + st.disconnects;
+}
+
+/**
+ * @brief True if the station is on an AP it has no reason to leave: above
+ *        the roaming threshold, or within the hysteresis of the best AP
+ */
+static bool wifi_well_placed(void)
+{
+    int ap = sim_wifi_current_ap();
+    int best = -128;
+
+    if (ap < 0 || !sim_wifi_link_up()) {
+        return false;
+    }
+    for (int i = 0; i < SIM_WIFI_APS; i++) {
+        int rssi = sim_wifi_ap_rssi(i);
+        if (rssi != 0 && rssi > best) {
+            best = rssi;
+        }
+    }
+    int rssi = sim_wifi_ap_rssi(ap);
+    return rssi >= WIFI_ROAM_RSSI_LOW || rssi > best - WIFI_ROAM_HYSTERESIS_DB;
+}
+
+static uint32_t output_errors(void)
+{
+    relay_output_stats_t os;
+    relay_get_output_stats(&os);
+    return os.write_errors + os.verify_errors;
+}
+
+/**
+ * @brief Mask of relays whose output level disagrees with their state
+ */
+static uint32_t output_mismatch(void)
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        // Open-drain, active LOW
+        int want = (relay_get_state(i) == RELAY_ON) ? 0 : 1;
+        if (gpio_get_level(relay_get_info(i)->gpio_pin) != want) mask |= 1UL << i;
+    }
+    return mask;
+}
+
+static uint64_t relay_pins(void)
+{
+    uint64_t pins = 0;
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        pins |= 1ULL << relay_get_info(i)->gpio_pin;
+    }
+    return pins;
+}
+
+/**
+ * @brief Advance the detect / clear / recover times of the injected faults
+ */
+static void track_faults(void)
+{
+    int64_t now = sim_now();
+    const sim_stats_t *st = sim_get_stats();
+    bool nvs_failed = st->nvs_failed > s_nvs_failed_seen;
+    bool reachable = s_server_up && sim_wifi_link_up();
+    s_nvs_failed_seen = st->nvs_failed;
+
+    for (size_t i = 0; i < s_run->next_fault; i++) {
+        const fault_t *f = &s_faults[i];
+        fault_state_t *fs = &s_fault_state[i];
+        if (fs->recover_us >= 0) {
+            continue;
+        }
+
+        switch (f->kind) {
+        case FAULT_WIFI_DOWN:
+            if (fs->detect_us < 0 && !wifi_is_connected()) fs->detect_us = now;
+            if (fs->clear_us >= 0 && reachable) fs->recover_us = now;
+            break;
+        case FAULT_WIFI_AP:
+            if (fs->detect_us < 0 && wifi_activity() != fs->wifi_seen) fs->detect_us = now;
+            if (s_server_up && wifi_well_placed()) fs->recover_us = now;
+            break;
+        case FAULT_REBOOT:
+            if (reachable) fs->recover_us = now;
+            break;
+        case FAULT_NVS_FAIL:
+        case FAULT_NVS_FULL:
+            if (fs->detect_us < 0 && nvs_failed) fs->detect_us = now;
+            if (fs->clear_us < 0 && !sim_nvs_faulty()) fs->clear_us = now;
+            if (fs->clear_us >= 0 && sim_nvs_stale() == 0) fs->recover_us = now;
+            break;
+        case FAULT_OUTPUT_FAIL:
+        case FAULT_OUTPUT_STUCK:
+            if (!s_relays_up) break;
+            if (fs->detect_us < 0 && output_errors() > fs->output_seen) fs->detect_us = now;
+            if (fs->clear_us < 0 && !sim_gpio_faulty()) fs->clear_us = now;
+            if (fs->clear_us >= 0 && output_mismatch() == 0) fs->recover_us = now;
+            break;
+        case FAULT_SOCK_RESET:
+        case FAULT_SOCK_DROP:
+        case FAULT_SLOW: {
+            int left = (f->kind == FAULT_SOCK_RESET) ? s_run->sock_reset_left :
+                       (f->kind == FAULT_SOCK_DROP) ? s_run->sock_drop_left : s_run->slow_left;
+            if (fs->clear_us < 0 && left == 0) fs->clear_us = now;
+            if (fs->clear_us >= 0 && s_run->last_ok_us >= fs->clear_us) {
+                fs->recover_us = s_run->last_ok_us;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+void sim_on_step(void)
+{
+    relay_event_t events[16];
+    uint32_t lost = 0;
+    size_t n;
+
+    // Drained after every task switch, so the journal never wraps
+    while ((n = relay_read_events(&s_journal_cursor, events, 16, &lost)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            const relay_event_t *e = &events[i];
+            uint16_t weight = relay_get_info(e->relay_id)->power_w;
+            s_load_w = (e->state == RELAY_ON) ? s_load_w + weight : s_load_w - weight;
+            emit_at(e->time_us, "relay %u %s %luW", e->relay_id, e->state ? "on" : "off",
+                    (unsigned long)s_load_w);
+
+            s_run->switches[e->relay_id]++;
+            if (e->state == RELAY_ON) {
+                s_run->on_since[e->relay_id] = e->time_us;
+            } else {
+                relay_off_since(e->relay_id, e->time_us);
+            }
+        }
+    }
+
+    bool link = wifi_is_connected();
+    if (link != s_link_seen) {
+        s_link_seen = link;
+        emit_at(sim_now(), "wifi %s", link ? "up" : "down");
+    }
+
+    // The outputs must follow the journal: a failed frame is rolled back
+    uint32_t mismatch = s_relays_up ? output_mismatch() : 0;
+    if ((mismatch != 0) != s_outputs_mismatched) {
+        s_outputs_mismatched = (mismatch != 0);
+        if (mismatch != 0) {
+            s_run->output_mismatches++;
+            emit_at(sim_now(), "mismatch %lx", (unsigned long)mismatch);
+        }
+    }
+    track_faults();
+}
+
+static int relay_mask(void)
+{
+    int mask = 0;
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        if (relay_get_state(i) == RELAY_ON) mask |= 1 << i;
+    }
+    return mask;
+}
+
+/**
+ * @brief Close this boot's process and hand over to the next boot
+ */
+static void __attribute__((noreturn)) end_boot(void)
+{
+    const sim_stats_t *st = sim_get_stats();
+    sim_stats_t *total = &s_run->stats;
+
+    total->switches += st->switches;
+    total->timer_callbacks += st->timer_callbacks;
+    if (st->timer_late_max_us > total->timer_late_max_us) {
+        total->timer_late_max_us = st->timer_late_max_us;
+    }
+    total->gpio_edges += st->gpio_edges;
+    total->nvs_writes += st->nvs_writes;
+    total->nvs_unchanged += st->nvs_unchanged;
+    total->nvs_failed += st->nvs_failed;
+    total->gpio_failed += st->gpio_failed;
+    total->wifi_events += st->wifi_events;
+    total->flash_writes += st->flash_writes;
+    total->flash_erases += st->flash_erases;
+    total->cache_stalls += st->cache_stalls;
+    s_run->now_us = sim_now();
+
+    relay_output_stats_t out;
+    relay_get_output_stats(&out);
+    s_run->outputs.pulse_ends += out.pulse_ends;
+    if (out.pulse_late_max_us > s_run->outputs.pulse_late_max_us) {
+        s_run->outputs.pulse_late_max_us = out.pulse_late_max_us;
+    }
+    for (int b = 0; b < RELAY_LATE_HIST_BUCKETS; b++) {
+        s_run->outputs.pulse_late_hist[b] += out.pulse_late_hist[b];
+    }
+
+    // Heap once the clients have gone quiet (connections do not outlive the boot)
+    heap_caps_free(s_tx_buf);
+    s_tx_buf = NULL;
+    conn_expire(SIM_NEVER);
+    if (s_server_up_us != SIM_NEVER) {
+        s_run->heap_largest_end = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    }
+    uint32_t free_min = (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    if (free_min < s_run->heap_free_min) {
+        s_run->heap_free_min = free_min;
+    }
+
+    fflush(s_out);
+    fflush(stderr);
+    _exit(0);
+}
+
+void sim_on_restart(void)
+{
+    int64_t now = sim_now();
+    s_server_up = false;
+    sim_on_step();
+    emit_at(now, "restart");
+
+    // The request being handled never gets its response
+    if (s_inflight >= 0) {
+        fail_attempt((size_t)s_inflight, now, "restart");
+    }
+    // Outputs drop with the reset
+    s_run->restart_mask = s_relays_up ? relay_mask() : -1;
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        relay_off_since(i, now);
+    }
+
+    s_run->restarting = true;
+    s_run->boot_us = now + BOOT_US;
+    end_boot();
+}
+
+/*============================================================================
+ * Trace input
+ *============================================================================*/
+
+static void *grow(void *array, size_t *cap, size_t len, size_t size)
+{
+    if (len < *cap) {
+        return array;
+    }
+    *cap = *cap ? *cap * 2 : 256;
+    array = realloc(array, *cap * size);
+    if (array == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return array;
+}
+
+static void add_command(int64_t t_us, int line, bool post, const char *path, const char *body)
+{
+    s_trace = grow(s_trace, &s_trace_cap, s_trace_len, sizeof(*s_trace));
+    trace_cmd_t *c = &s_trace[s_trace_len++];
+    c->t_us = t_us;
+    c->line = line;
+    c->post = post;
+    c->path = strdup(path);
+    c->body = body ? strdup(body) : NULL;
+}
+
+/**
+ * @brief Parse the FAULT part of a "TIME fault FAULT" line
+ */
+static int add_fault(int64_t t_us, const char *text)
+{
+    fault_t f = { .t_us = t_us, .count = 1 };
+    char word[16] = "";
+    char arg[16] = "";
+    int n = 0;
+    int fields = sscanf(text, "%15s %15s %d %n", word, arg, &f.count, &n);
+
+    if (strcmp(word, "wifi") == 0 && fields == 2 && strcmp(arg, "down") == 0) {
+        f.kind = FAULT_WIFI_DOWN;
+    } else if (strcmp(word, "wifi") == 0 && fields == 2 && strcmp(arg, "up") == 0) {
+        f.kind = FAULT_WIFI_UP;
+    } else if (strcmp(word, "wifi") == 0 && fields == 3 && strcmp(arg, "ap") == 0) {
+        char *end;
+        f.kind = FAULT_WIFI_AP;
+        f.ap = f.count;
+        f.count = 1;
+        f.dbm = (strcmp(text + n, "off") == 0) ? 0 : (int)strtol(text + n, &end, 10);
+        if (f.ap < 0 || f.ap >= SIM_WIFI_APS ||
+            (f.dbm == 0 && strcmp(text + n, "off") != 0) ||
+            (f.dbm != 0 && (*end != '\0' || f.dbm < -100 || f.dbm > -20))) {
+            return -1;
+        }
+    } else if (strcmp(word, "nvs") == 0 && fields == 3 && strcmp(arg, "fail") == 0) {
+        f.kind = FAULT_NVS_FAIL;
+    } else if (strcmp(word, "nvs") == 0 && fields == 2 && strcmp(arg, "full") == 0) {
+        f.kind = FAULT_NVS_FULL;
+    } else if (strcmp(word, "output") == 0 && fields == 3 && strcmp(arg, "fail") == 0) {
+        f.kind = FAULT_OUTPUT_FAIL;
+    } else if (strcmp(word, "output") == 0 && fields == 3 && strcmp(arg, "stuck") == 0) {
+        f.kind = FAULT_OUTPUT_STUCK;
+    } else if (strcmp(word, "sock") == 0 && fields == 3 && strcmp(arg, "reset") == 0) {
+        f.kind = FAULT_SOCK_RESET;
+    } else if (strcmp(word, "sock") == 0 && fields == 3 && strcmp(arg, "drop") == 0) {
+        f.kind = FAULT_SOCK_DROP;
+    } else if (strcmp(word, "slow") == 0 && fields >= 2) {
+        f.kind = FAULT_SLOW;
+        f.ms = atoi(arg);
+    } else if (strcmp(word, "reboot") == 0 && fields == 1) {
+        f.kind = FAULT_REBOOT;
+    } else {
+        return -1;
+    }
+    if (f.count < 1 || (f.kind == FAULT_SLOW && f.ms < 1)) {
+        return -1;
+    }
+    snprintf(f.text, sizeof(f.text), "%s", text);
+
+    s_faults = grow(s_faults, &s_fault_cap, s_fault_len, sizeof(*s_faults));
+    s_faults[s_fault_len++] = f;
+    return 0;
+}
+
+/**
+ * @brief Parse a serial monitor line ("I (12345) HTTP: GET /path")
+ *
+ * @return 1 if it is a replayable HTTP line, 0 if it is any other log line,
+ *         -1 if it is not a log line
+ */
+static int parse_log_line(const char *p, int64_t *t_us, const char **path, bool *post)
+{
+    if (strchr("EWIDV", p[0]) == NULL || p[1] != ' ' || p[2] != '(') {
+        return -1;
+    }
+
+    char *end;
+    long long ms = strtoll(p + 3, &end, 10);
+    if (end == p + 3 || strncmp(end, ") ", 2) != 0) {
+        return -1;
+    }
+    p = end + 2;
+
+    size_t tag_len = strlen(LOG_TAG_HTTP);
+    if (strncmp(p, LOG_TAG_HTTP, tag_len) != 0 || strncmp(p + tag_len, ": ", 2) != 0) {
+        return 0;
+    }
+    p += tag_len + 2;
+
+    // POST bodies are not logged, so only GET lines can be replayed
+    if (strncmp(p, "GET /", 5) != 0) {
+        return 0;
+    }
+    *t_us = ms * 1000;
+    *path = p + 4;
+    *post = false;
+    return 1;
+}
+
+static int load_trace(const char *file)
+{
+    FILE *f = strcmp(file, "-") == 0 ? stdin : fopen(file, "r");
+    if (f == NULL) {
+        fprintf(stderr, "%s: %s\n", file, strerror(errno));
+        return -1;
+    }
+
+    char buf[MAX_LINE];
+    int line = 0;
+    int64_t prev_us = 0;
+
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        line++;
+        buf[strcspn(buf, "\r\n")] = '\0';
+
+        // Serial monitors may keep the ESP-IDF colour codes
+        char *p = buf;
+        while (*p == '\033') {
+            char *m = strchr(p, 'm');
+            if (m == NULL) break;
+            p = m + 1;
+        }
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+
+        int64_t t_us;
+        const char *path;
+        bool post = false;
+        int log = parse_log_line(p, &t_us, &path, &post);
+        if (log == 0) {
+            s_ignored_lines++;
+            continue;
+        }
+
+        char *body = NULL;
+        char *path_buf = NULL;
+        if (log < 0) {
+            char *end;
+            bool relative = (*p == '+');
+            double sec = strtod(relative ? p + 1 : p, &end);
+            if (end == p || sec < 0 || (*end != ' ' && *end != '\t')) {
+                fprintf(stderr, "%s:%d: expected TIME [GET|POST] PATH\n", file, line);
+                goto fail;
+            }
+            t_us = (relative ? prev_us : 0) + llround(sec * 1e6);
+            if (t_us < prev_us) {
+                fprintf(stderr, "%s:%d: time goes backwards\n", file, line);
+                goto fail;
+            }
+
+            p = end + strspn(end, " \t");
+            if (strncmp(p, "fault ", 6) == 0) {
+                if (add_fault(t_us, p + 6 + strspn(p + 6, " \t")) != 0) {
+                    fprintf(stderr, "%s:%d: unknown fault '%s'\n", file, line, p + 6);
+                    goto fail;
+                }
+                prev_us = t_us;
+                continue;
+            }
+            if (strncmp(p, "GET ", 4) == 0) {
+                p += 4;
+            } else if (strncmp(p, "POST ", 5) == 0) {
+                p += 5;
+                post = true;
+            }
+            p += strspn(p, " \t");
+            path_buf = p;
+            p += strcspn(p, " \t");
+            if (*p != '\0') {
+                *p++ = '\0';
+                body = p + strspn(p, " \t");
+            }
+            path = path_buf;
+        }
+
+        if (path[0] != '/') {
+            fprintf(stderr, "%s:%d: expected a path starting with /\n", file, line);
+            goto fail;
+        }
+        if (t_us < prev_us) {
+            fprintf(stderr, "%s:%d: time goes backwards\n", file, line);
+            goto fail;
+        }
+        prev_us = t_us;
+        add_command(t_us, line, post, path, (body && *body) ? body : NULL);
+    }
+
+    if (f != stdin) fclose(f);
+    return 0;
+
+fail:
+    if (f != stdin) fclose(f);
+    return -1;
+}
+
+/**
+ * @brief xorshift64*: the same seed gives the same trace on every host
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static double uniform(uint64_t *state)
+{
+    return ((next_random(state) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/**
+ * @brief Random traffic: Poisson arrivals, a mix of the common commands
+ */
+static void generate_trace(double seconds, double per_minute, uint64_t seed)
+{
+    uint64_t rng = seed ? seed : 1;
+    double mean_s = 60.0 / per_minute;
+    int64_t t_us = 0;
+    char path[64];
+
+    for (;;) {
+        t_us += llround(-log(uniform(&rng)) * mean_s * 1000.0) * 1000;    // Whole milliseconds
+        if (t_us > (int64_t)(seconds * 1e6)) {
+            break;
+        }
+
+        int relay = (int)(next_random(&rng) % RELAY_COUNT);
+        int pick = (int)(next_random(&rng) % 100);
+        if (pick < 40) {
+            snprintf(path, sizeof(path), "/relay/%d/toggle", relay);
+        } else if (pick < 60) {
+            snprintf(path, sizeof(path), "/relay/%d/on", relay);
+        } else if (pick < 80) {
+            snprintf(path, sizeof(path), "/relay/%d/off", relay);
+        } else if (pick < 88) {
+            int ms = RELAY_PULSE_MIN_MS + (int)(next_random(&rng) % 2000);
+            snprintf(path, sizeof(path), "/relay/%d/pulse?ms=%d", relay, ms);
+        } else if (pick < 92) {
+            snprintf(path, sizeof(path), "/relay/all/on");
+        } else if (pick < 96) {
+            snprintf(path, sizeof(path), "/relay/all/off");
+        } else {
+            snprintf(path, sizeof(path), "/relay/%d/status", relay);
+        }
+        add_command(t_us, 0, false, path, NULL);
+    }
+}
+
+/**
+ * @brief Interleave generated commands (from split on) with the trace's
+ */
+static void merge_commands(size_t split)
+{
+    trace_cmd_t *merged = malloc(s_trace_len * sizeof(*merged));
+    if (merged == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    size_t a = 0, b = split, n = 0;
+    while (a < split || b < s_trace_len) {
+        bool take_a = b == s_trace_len || (a < split && s_trace[a].t_us <= s_trace[b].t_us);
+        merged[n++] = take_a ? s_trace[a++] : s_trace[b++];
+    }
+    free(s_trace);
+    s_trace = merged;
+    s_trace_cap = s_trace_len;
+}
+
+/*============================================================================
+ * Command execution (mirrors the HTTP handlers' calls and status codes)
+ *============================================================================*/
+
+static int status_of(esp_err_t ret)
+{
+    switch (ret) {
+    case ESP_OK:                return 200;
+    case ESP_ERR_NOT_FOUND:     return 404;
+    case ESP_ERR_NOT_ALLOWED:
+    case ESP_ERR_INVALID_STATE: return 409;
+    case ESP_FAIL:
+    case ESP_ERR_INVALID_RESPONSE: return 500;     // Output fault, rolled back
+    default:                    return 400;
+    }
+}
+
+/**
+ * @brief Run a /relay/txn command through the transaction API
+ *
+ * Checks the outcome is all or nothing: on success every staged relay is
+ * in its staged state, on failure no relay changed.
+ */
+static int execute_txn(size_t idx, const char *query)
+{
+    const char *q_on = strstr(query, "on=");
+    const char *q_off = strstr(query, "off=");
+    uint32_t on = q_on ? (uint32_t)strtoul(q_on + 3, NULL, 16) : 0;
+    uint32_t off = q_off ? (uint32_t)strtoul(q_off + 4, NULL, 16) : 0;
+    if ((on | off) == 0 || (on & off) != 0 || (on | off) >> RELAY_COUNT) return 400;
+
+    relay_txn_t txn;
+    relay_txn_begin(&txn);
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        if (on & (1UL << i)) relay_txn_stage(&txn, (uint8_t)i, RELAY_ON);
+        if (off & (1UL << i)) relay_txn_stage(&txn, (uint8_t)i, RELAY_OFF);
+    }
+
+    int before = relay_mask();
+    esp_err_t ret = relay_txn_commit(&txn, true);
+    int after = relay_mask();
+
+    s_run->txn_commits++;
+    bool whole = (ret == ESP_OK) ? (((uint32_t)after & (on | off)) == on) : (after == before);
+    if (ret != ESP_OK) s_run->txn_refused++;
+    if (!whole) {
+        s_run->txn_partial++;
+        emit_at(sim_now(), "partial %zu %x", idx + 1, after);
+    }
+    return status_of(ret);
+}
+
+/**
+ * @brief Run one command
+ *
+ * @param state Set to the relay state the response reports (-1 if none)
+ * @return HTTP status, or 0 if the path is not modelled
+ */
+static int execute(size_t idx, const trace_cmd_t *c, int *state)
+{
+    const char *p = c->path;
+    char *end;
+    *state = -1;
+
+    if (strncmp(p, "/relay/", 7) == 0) {
+        p += 7;
+        if (strncmp(p, "all/", 4) == 0) {
+            p += 4;
+            if (strcmp(p, "on") == 0) return status_of(relay_all_on());
+            if (strcmp(p, "off") == 0) return status_of(relay_all_off());
+            if (strcmp(p, "status") == 0) return 200;
+            return 0;
+        }
+
+        if (strncmp(p, "txn?", 4) == 0) return execute_txn(idx, p + 4);
+
+        long id = strtol(p, &end, 10);
+        if (end == p || *end != '/') return 0;
+        if (id < 0 || id >= RELAY_COUNT) return 400;
+        p = end + 1;
+
+        if (strcmp(p, "toggle") == 0) {
+            *state = relay_toggle((uint8_t)id);
+            return (*state == -2) ? 500 : (*state < 0) ? 409 : 200;
+        }
+        if (strcmp(p, "on") == 0 || strcmp(p, "off") == 0) {
+            relay_state_t target = (p[1] == 'n') ? RELAY_ON : RELAY_OFF;
+            esp_err_t ret = relay_set_state((uint8_t)id, target);
+            if (ret != ESP_OK) return status_of(ret);
+            *state = target;
+            return 200;
+        }
+        if (strcmp(p, "status") == 0) {
+            *state = relay_get_state((uint8_t)id);
+            return 200;
+        }
+        if (strncmp(p, "pulse", 5) == 0) {
+            unsigned long ms = RELAY_PULSE_DEFAULT_MS;
+            const char *q = strstr(p, "ms=");
+            if (q != NULL) {
+                ms = strtoul(q + 3, &end, 10);
+                if (end == q + 3) return 400;
+                if (ms < RELAY_PULSE_MIN_MS || ms > RELAY_PULSE_MAX_MS) return 400;
+            }
+            esp_err_t ret = relay_pulse((uint8_t)id, (uint32_t)ms);
+            return (ret == ESP_ERR_INVALID_STATE || ret == ESP_ERR_NOT_ALLOWED) ? 409 :
+                   (ret != ESP_OK) ? 500 : 200;
+        }
+        return 0;
+    }
+
+    if (strncmp(p, "/seq/", 5) == 0) {
+        long slot = strtol(p + 5, &end, 10);
+        if (end == p + 5 || slot < 0 || slot >= SEQ_MAX_SLOTS) return 400;
+
+        if (c->post) {
+            esp_err_t ret = sequencer_store((uint8_t)slot, c->body ? c->body : "");
+            return (ret == ESP_ERR_INVALID_STATE) ? 409 : (ret != ESP_OK) ? 400 : 200;
+        }
+        if (strcmp(end, "/run") == 0) return status_of(sequencer_start((uint8_t)slot));
+        if (strcmp(end, "/cancel") == 0) return status_of(sequencer_cancel((uint8_t)slot));
+        if (strcmp(end, "/status") == 0) return 200;
+        return 404;
+    }
+
+    return 0;
+}
+
+/*============================================================================
+ * Simulated tasks
+ *============================================================================*/
+
+static void note_detect(fault_kind_t kind)
+{
+    for (size_t i = 0; i < s_run->next_fault; i++) {
+        if (s_faults[i].kind == kind && s_fault_state[i].detect_us < 0) {
+            s_fault_state[i].detect_us = sim_now();
+        }
+    }
+}
+
+/**
+ * @brief The client's view of a failed attempt: retry later or give up
+ *
+ * @param t_us When the failed attempt was made
+ */
+static void fail_attempt(size_t idx, int64_t t_us, const char *reason)
+{
+    cmd_state_t *st = &s_cmd[idx];
+    s_run->attempts_failed++;
+
+    if (st->tries > CLIENT_RETRIES || s_run->retry_count == MAX_RETRY_QUEUE) {
+        st->finished = true;
+        emit_at(sim_now(), "giveup %zu %s", idx + 1, reason);
+        return;
+    }
+    emit_at(sim_now(), "fail %zu %s", idx + 1, reason);
+    st->next_us = t_us + CLIENT_RETRY_US;
+    s_run->retry[s_run->retry_count++] = idx;
+}
+
+/**
+ * @brief Earliest pending attempt: a new command or a client retry
+ *
+ * Only looks, so a restart while the HTTP task sleeps towards the attempt
+ * loses nothing.
+ *
+ * @param queued Set to the retry queue slot, or -1 for the next new command
+ */
+static bool peek_attempt(size_t *idx, int64_t *t_us, long *queued)
+{
+    bool found = false;
+    for (size_t q = 0; q < s_run->retry_count; q++) {
+        size_t k = s_run->retry[q];
+        if (!found || s_cmd[k].next_us < *t_us || (s_cmd[k].next_us == *t_us && k < *idx)) {
+            found = true;
+            *idx = k;
+            *t_us = s_cmd[k].next_us;
+            *queued = (long)q;
+        }
+    }
+    if (s_run->next_cmd < s_trace_len) {
+        size_t k = s_run->next_cmd;
+        if (!found || s_trace[k].t_us < *t_us || (s_trace[k].t_us == *t_us && k < *idx)) {
+            found = true;
+            *idx = k;
+            *t_us = s_trace[k].t_us;
+            *queued = -1;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Close a connection and release its session context
+ */
+static void conn_close(conn_t *c)
+{
+    if (s_opt.heap_sessions) {
+        heap_caps_free(c->ctx);
+    } else {
+        block_pool_free(&s_session_pool, c->ctx);
+    }
+    c->ctx = NULL;
+}
+
+/**
+ * @brief Close the connections whose clients went idle
+ */
+static void conn_expire(int64_t now)
+{
+    for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+        if (s_conns[i].ctx != NULL && now - s_conns[i].last_us >= SESSION_IDLE_US) {
+            conn_close(&s_conns[i]);
+        }
+    }
+}
+
+/**
+ * @brief Accept a client's connection as the HTTP server does
+ *
+ * With every slot taken, the least recently used connection is purged.
+ *
+ * @return The connection, or NULL if no session context could be had
+ */
+static conn_t *conn_open(int64_t now)
+{
+    conn_t *slot = NULL;
+    conn_expire(now);
+    for (int i = 0; i < HTTP_MAX_CONNECTIONS && slot == NULL; i++) {
+        if (s_conns[i].ctx == NULL) slot = &s_conns[i];
+    }
+    if (slot == NULL) {
+        slot = &s_conns[0];
+        for (int i = 1; i < HTTP_MAX_CONNECTIONS; i++) {
+            if (s_conns[i].last_us < slot->last_us) slot = &s_conns[i];
+        }
+        conn_close(slot);
+        s_run->sessions_purged++;
+    }
+
+    session_t *ctx = s_opt.heap_sessions ? heap_caps_malloc(sizeof(*ctx), MALLOC_CAP_8BIT)
+                                         : block_pool_alloc(&s_session_pool);
+    if (ctx == NULL) {
+        s_run->sessions_refused++;
+        return NULL;
+    }
+    ctx->opened_us = now;
+    ctx->requests = 0;
+    slot->ctx = ctx;
+    slot->last_us = now;
+    s_run->sessions++;
+    return slot;
+}
+
+static void note_heap(void)
+{
+    uint32_t largest = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    if (largest < s_run->heap_largest_min) {
+        s_run->heap_largest_min = largest;
+    }
+}
+
+/**
+ * @brief One request from the client, through the faults in its way
+ */
+static void attempt(size_t idx, int64_t t_us)
+{
+    cmd_state_t *st = &s_cmd[idx];
+    const trace_cmd_t *c = &s_trace[idx];
+    int64_t now = sim_now();
+    st->tries++;
+
+    // Attempts made before this boot's server came up failed back then
+    if (t_us < s_server_up_us || !sim_wifi_link_up()) {
+        fail_attempt(idx, t_us, "unreachable");
+        return;
+    }
+    if (s_run->sock_reset_left > 0) {
+        s_run->sock_reset_left--;
+        fail_attempt(idx, t_us, "reset");
+        return;
+    }
+
+    // The previous response has long been acknowledged
+    heap_caps_free(s_tx_buf);
+    s_tx_buf = NULL;
+    conn_t *conn = conn_open(now);
+    if (conn == NULL) {
+        fail_attempt(idx, t_us, "refused");
+        return;
+    }
+    void *rx_buf = heap_caps_malloc(REQUEST_HEADERS + strlen(c->path) +
+                                    (c->body ? strlen(c->body) : 0), MALLOC_CAP_8BIT);
+
+    // A request arriving while the previous one blocks waits its turn
+    int64_t late = now - t_us;
+    if (late > 0) {
+        s_run->late++;
+        s_run->late_total_us += late;
+        if (late > s_run->late_max_us) s_run->late_max_us = late;
+    }
+
+    emit_at(now, "cmd %zu %s %s", idx + 1, c->post ? "POST" : "GET", c->path);
+    s_inflight = (long)idx;
+
+    // The server task reads the whole request before the handler runs
+    if (s_run->slow_left > 0) {
+        int64_t trickle_us = (int64_t)s_run->slow_ms * 1000;
+        int64_t timeout_us = (int64_t)HTTP_SOCKET_TIMEOUT_S * 1000000;
+        if (trickle_us > timeout_us) {
+            sim_sleep_until(now + timeout_us);
+            s_run->slow_left--;
+            s_inflight = -1;
+            heap_caps_free(rx_buf);
+            conn_close(conn);
+            note_detect(FAULT_SLOW);
+            emit_at(sim_now(), "done %zu 408", idx + 1);
+            fail_attempt(idx, t_us, "timeout");
+            return;
+        }
+        sim_sleep_until(now + trickle_us);
+        s_run->slow_left--;
+    }
+
+    int state;
+    int status = execute(idx, c, &state);
+    sim_on_step();
+    s_inflight = -1;
+    st->runs++;
+
+    heap_caps_free(rx_buf);
+    s_tx_buf = heap_caps_malloc(RESPONSE_BYTES, MALLOC_CAP_8BIT);
+    note_heap();
+    conn->ctx->requests++;
+    conn->last_us = sim_now();
+
+    char result[32];
+    if (status == 0) {
+        snprintf(result, sizeof(result), "skip");
+    } else if (state >= 0) {
+        snprintf(result, sizeof(result), "%d %s", status, state ? "on" : "off");
+    } else {
+        snprintf(result, sizeof(result), "%d", status);
+    }
+
+    if (s_run->sock_drop_left > 0) {
+        s_run->sock_drop_left--;
+        emit_at(sim_now(), "done %zu %s dropped", idx + 1, result);
+        fail_attempt(idx, t_us, "dropped");
+        return;
+    }
+
+    emit_at(sim_now(), "done %zu %s", idx + 1, result);
+    st->finished = true;
+    s_run->answered++;
+    if (status == 0) {
+        s_run->skipped++;
+    } else if (status != 200) {
+        s_run->failed++;
+    } else {
+        s_run->last_ok_us = sim_now();
+    }
+}
+
+/**
+ * @brief HTTP server task: one request at a time, in arrival order
+ */
+static void httpd_task(void *arg)
+{
+    (void)arg;
+    size_t idx = 0;
+    int64_t t_us = 0;
+    long queued;
+
+    while (peek_attempt(&idx, &t_us, &queued)) {
+        sim_sleep_until(t_us);
+        if (queued < 0) {
+            s_run->next_cmd++;
+        } else {
+            s_run->retry[queued] = s_run->retry[--s_run->retry_count];
+        }
+        attempt(idx, t_us);
+    }
+}
+
+static void apply_fault(size_t i)
+{
+    const fault_t *f = &s_faults[i];
+    emit_at(sim_now(), "fault %s", f->text);
+
+    switch (f->kind) {
+    case FAULT_WIFI_DOWN:
+        s_run->ap_down = true;
+        sim_wifi_set_ap(false);
+        break;
+    case FAULT_WIFI_UP:
+        s_run->ap_down = false;
+        sim_wifi_set_ap(true);
+        for (size_t k = 0; k < i; k++) {
+            if (s_faults[k].kind == FAULT_WIFI_DOWN && s_fault_state[k].clear_us < 0) {
+                s_fault_state[k].clear_us = sim_now();
+            }
+        }
+        break;
+    case FAULT_WIFI_AP:
+        s_fault_state[i].clear_us = sim_now();
+        s_fault_state[i].wifi_seen = wifi_activity();
+        sim_wifi_set_ap_signal(f->ap, f->dbm != 0, f->dbm);
+        break;
+    case FAULT_NVS_FAIL:
+        sim_fault_nvs_fail(f->count, ESP_FAIL);
+        break;
+    case FAULT_NVS_FULL:
+        sim_fault_nvs_full();
+        break;
+    case FAULT_OUTPUT_FAIL:
+    case FAULT_OUTPUT_STUCK:
+        if (s_relays_up) s_fault_state[i].output_seen = output_errors();
+        sim_fault_gpio(relay_pins(), f->count, f->kind == FAULT_OUTPUT_STUCK);
+        break;
+    case FAULT_SOCK_RESET:
+        s_run->sock_reset_left += f->count;
+        break;
+    case FAULT_SOCK_DROP:
+        s_run->sock_drop_left += f->count;
+        break;
+    case FAULT_SLOW:
+        s_run->slow_left = f->count;
+        s_run->slow_ms = f->ms;
+        break;
+    case FAULT_REBOOT:
+        s_fault_state[i].clear_us = sim_now();
+        s_server_up = false;
+#if POWERFAIL_ENABLE
+        // The supervisor warns while the rail still holds up
+        sim_gpio_input(POWERFAIL_GPIO, 0);
+        sim_sleep_until(sim_now() + POWERFAIL_HOLDUP_US);
+#endif
+        sim_power_off();
+    }
+}
+
+static bool faults_open(void)
+{
+    for (size_t i = 0; i < s_fault_len; i++) {
+        if (s_faults[i].kind != FAULT_WIFI_UP && s_fault_state[i].recover_us < 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Inject the trace's faults, then keep the run going until the
+ *        device has recovered from all of them
+ */
+static void fault_task(void *arg)
+{
+    (void)arg;
+    while (s_run->next_fault < s_fault_len) {
+        size_t i = s_run->next_fault;
+        sim_sleep_until(s_faults[i].t_us);
+        s_run->next_fault++;
+        apply_fault(i);
+        sim_on_step();
+    }
+    while (faults_open()) {
+        sim_sleep_until(sim_now() + 1000000);
+    }
+}
+
+/**
+ * @brief Boot as app_main does for these modules, then watch the link
+ */
+static void main_task(void *arg)
+{
+    (void)arg;
+    if (s_run->boots == 1 && s_opt.boot_mask >= 0) {
+        nvs_handle_t nvs;
+        nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+        nvs_set_u8(nvs, NVS_KEY_RELAY_STATE, (uint8_t)s_opt.boot_mask);
+        nvs_close(nvs);
+    }
+    s_started = true;
+
+    // init_nvs()
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition was truncated, erasing...");
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+
+#if POWERFAIL_ENABLE
+    if (powerfail_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Power-fail flush unavailable");
+    }
+#endif
+    ESP_ERROR_CHECK(relay_service_init());
+    ESP_ERROR_CHECK(sequencer_init());
+    sim_on_step();
+    s_relays_up = true;
+    if (s_run->restart_mask >= 0 && relay_mask() != s_run->restart_mask) {
+        s_run->state_lost++;
+        emit_at(sim_now(), "restore %x, was %x", (unsigned)relay_mask(), (unsigned)s_run->restart_mask);
+    }
+    s_run->restart_mask = -1;
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        snprintf(s_run->names[i], sizeof(s_run->names[i]), "%s", relay_get_info(i)->name);
+    }
+
+    if (wifi_service_init() != ESP_OK) {
+        ESP_LOGE(TAG, "WiFi connection failed! Restarting in 5 seconds...");
+        vTaskDelay(pdMS_TO_TICKS(5000));
+        esp_restart();
+    }
+    // http_controller_init()
+    if (!s_opt.heap_sessions) {
+        ESP_ERROR_CHECK(block_pool_init(&s_session_pool, "http_session", sizeof(session_t),
+                                        HTTP_MAX_CONNECTIONS));
+    }
+    if (s_run->heap_largest_start == 0) {
+        s_run->heap_largest_start = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    }
+    s_server_up = true;
+    s_server_up_us = sim_now();
+    sim_task_create("httpd", SIM_PRIO_HTTPD, httpd_task, NULL);
+
+    // The WiFi watchdog of app_main's loop
+    sim_set_background();
+    int wifi_disconnect_seconds = 0;
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(WIFI_CHECK_INTERVAL_MS));
+        if (!wifi_is_connected()) {
+            wifi_disconnect_seconds += WIFI_CHECK_INTERVAL_MS / 1000;
+            ESP_LOGW(TAG, "WiFi disconnected for %d seconds", wifi_disconnect_seconds);
+            if (wifi_disconnect_seconds >= WIFI_RESTART_AFTER_S) {
+                ESP_LOGE(TAG, "WiFi disconnected too long, restarting...");
+                esp_restart();
+            }
+        } else {
+            wifi_disconnect_seconds = 0;
+        }
+    }
+}
+
+/**
+ * @brief One boot, run in its own process
+ */
+static void run_boot(int64_t end_us)
+{
+    s_run->boots++;
+    sim_set_verbosity(s_opt.verbosity);
+    sim_set_cache_stall(s_opt.cache_stall_us);
+    sim_init(s_run->boot_us);
+    sim_wifi_set_ap(!s_run->ap_down);
+    emit_at(s_run->boot_us, "boot %u", (unsigned)s_run->boots);
+
+    if (s_fault_len > 0) {
+        sim_task_create("faults", SIM_PRIO_FAULTS, fault_task, NULL);
+    }
+    sim_task_create("main", SIM_PRIO_MAIN, main_task, NULL);
+    sim_run(end_us);
+    sim_on_step();
+    end_boot();
+}
+
+/*============================================================================
+ * Main
+ *============================================================================*/
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: relay_sim [-o FILE] [-q] [-e SEC] [-b MASK] [-c US] [-p] [-H] [-v] trace.txt|-\n"
+            "       relay_sim [options] -g SECONDS [-r PER_MIN] [-s SEED] [trace.txt]\n");
+    exit(2);
+}
+
+static double elapsed_s(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static const char *since(char *buf, size_t size, int64_t t_us, int64_t from_us, const char *none)
+{
+    if (t_us < 0) {
+        return none;
+    }
+    snprintf(buf, size, "+%.3f", (t_us - from_us) / 1e6);
+    return buf;
+}
+
+static void print_summary(double wall_s)
+{
+    const sim_stats_t *st = &s_run->stats;
+    int64_t span_us = s_run->now_us;
+    size_t lost = 0, repeated = 0, unfinished = 0;
+
+    for (size_t k = 0; k < s_trace_len; k++) {
+        if (s_cmd[k].runs == 0) lost++;
+        if (s_cmd[k].runs > 1) repeated++;
+        if (!s_cmd[k].finished) unfinished++;
+    }
+
+    fprintf(stderr, "# %zu commands answered (%zu skipped, %zu not 200, %zu log lines ignored)\n",
+            s_run->answered, s_run->skipped, s_run->failed, s_ignored_lines);
+    fprintf(stderr, "# %.3f s simulated in %.3f s (%.0fx real time)\n",
+            span_us / 1e6, wall_s, wall_s > 0 ? span_us / 1e6 / wall_s : 0.0);
+    fprintf(stderr, "# boots: %u, relay states lost on %u\n",
+            (unsigned)s_run->boots, (unsigned)s_run->state_lost);
+    fprintf(stderr, "# queued behind a busy handler: %zu commands, max %.1f ms, mean %.1f ms\n",
+            s_run->late, s_run->late_max_us / 1e3,
+            s_run->late ? s_run->late_total_us / 1e3 / s_run->late : 0.0);
+    fprintf(stderr, "# clients: %zu failed attempts, %zu commands lost, %zu run more than once",
+            s_run->attempts_failed, lost, repeated);
+    if (unfinished > 0) {
+        fprintf(stderr, ", %zu unfinished", unfinished);
+    }
+    fputc('\n', stderr);
+    fprintf(stderr, "# timer callbacks: %llu, max %.1f ms late\n",
+            (unsigned long long)st->timer_callbacks, st->timer_late_max_us / 1e3);
+    const relay_output_stats_t *out = &s_run->outputs;
+    fprintf(stderr, "# pulse ends: %u (%s), max %u us late, by lateness:",
+            (unsigned)out->pulse_ends, RELAY_IRAM_PROFILE ? "isr" : "task",
+            (unsigned)out->pulse_late_max_us);
+    for (int b = 0; b < RELAY_LATE_HIST_BUCKETS; b++) {
+        if (b < RELAY_LATE_HIST_BUCKETS - 1) {
+            fprintf(stderr, " <%u:%u", 32u << b, (unsigned)out->pulse_late_hist[b]);
+        } else {
+            fprintf(stderr, " more:%u", (unsigned)out->pulse_late_hist[b]);
+        }
+    }
+    fputc('\n', stderr);
+    if (s_opt.cache_stall_us > 0) {
+        fprintf(stderr, "# cache stalls: %llu of %lld us\n",
+                (unsigned long long)st->cache_stalls, (long long)s_opt.cache_stall_us);
+    }
+    for (int i = 0; i < RELAY_COUNT; i++) {
+        int64_t on = s_run->on_total[i] + (s_run->on_since[i] >= 0 ? span_us - s_run->on_since[i] : 0);
+        fprintf(stderr, "# relay %d %-10s %6u switches, on %5.1f%% of the time\n",
+                i, s_run->names[i], s_run->switches[i], span_us ? 100.0 * on / span_us : 0.0);
+    }
+    fprintf(stderr, "# gpio edges: %llu, nvs writes: %llu (%llu unchanged values skipped, %llu failed)\n",
+            (unsigned long long)st->gpio_edges, (unsigned long long)st->nvs_writes,
+            (unsigned long long)st->nvs_unchanged, (unsigned long long)st->nvs_failed);
+    fprintf(stderr, "# output faults: %llu writes refused or dropped, outputs off their relay state %u times\n",
+            (unsigned long long)st->gpio_failed, (unsigned)s_run->output_mismatches);
+    if (s_run->txn_commits > 0) {
+        fprintf(stderr, "# transactions: %u committed, %u refused, %u applied in part\n",
+                (unsigned)s_run->txn_commits, (unsigned)s_run->txn_refused,
+                (unsigned)s_run->txn_partial);
+    }
+    fprintf(stderr, "# power-fail records: %llu written, %llu erases\n",
+            (unsigned long long)st->flash_writes, (unsigned long long)st->flash_erases);
+    fprintf(stderr, "# sessions: %zu opened (%s), %zu purged, %zu refused\n",
+            s_run->sessions, s_opt.heap_sessions ? "heap" : "pool",
+            s_run->sessions_purged, s_run->sessions_refused);
+    if (s_run->heap_largest_start > 0) {
+        fprintf(stderr, "# heap: largest free block %lu at start, %lu at end, %lu lowest;"
+                " free low-water %lu\n",
+                (unsigned long)s_run->heap_largest_start, (unsigned long)s_run->heap_largest_end,
+                (unsigned long)s_run->heap_largest_min, (unsigned long)s_run->heap_free_min);
+    }
+
+    for (size_t i = 0, n = 0; i < s_fault_len; i++) {
+        const fault_t *f = &s_faults[i];
+        const fault_state_t *fs = &s_fault_state[i];
+        char detect[24], clear[24], recover[24];
+        if (f->kind == FAULT_WIFI_UP) {
+            continue;
+        }
+        fprintf(stderr, "# fault %zu %-16s at %10.3f  detect %-9s clear %-9s recover %s\n",
+                ++n, f->text, f->t_us / 1e6,
+                since(detect, sizeof(detect), fs->detect_us, f->t_us, "-"),
+                since(clear, sizeof(clear), fs->clear_us, f->t_us, "never"),
+                since(recover, sizeof(recover), fs->recover_us, f->t_us, "never"));
+    }
+    fprintf(stderr, "# timeline fnv1a64 %016llx\n", (unsigned long long)s_run->hash);
+}
+
+static void *shared_alloc(size_t size)
+{
+    void *mem = mmap(NULL, size ? size : 1, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    return mem;
+}
+
+int main(int argc, char **argv)
+{
+    int i = 1;
+    const char *trace_file = NULL;
+
+    for (; i < argc; i++) {
+        const char *a = argv[i];
+        if (a[0] != '-' || strcmp(a, "-") == 0) {
+            trace_file = a;
+            continue;
+        }
+        if (strchr("oebcgrs", a[1]) != NULL && (a[2] != '\0' || i + 1 >= argc)) usage();
+
+        switch (a[1]) {
+        case 'o': s_opt.out_path = argv[++i]; break;
+        case 'q': s_opt.quiet = true; break;
+        case 'e': s_opt.end_us = llround(atof(argv[++i]) * 1e6); break;
+        case 'b': s_opt.boot_mask = (int)strtol(argv[++i], NULL, 16); break;
+        case 'c': s_opt.cache_stall_us = strtoll(argv[++i], NULL, 0); break;
+        case 'g': s_opt.gen_seconds = atof(argv[++i]); break;
+        case 'r': s_opt.gen_rate = atof(argv[++i]); break;
+        case 's': s_opt.seed = strtoull(argv[++i], NULL, 0); break;
+        case 'p': s_opt.print_trace = true; break;
+        case 'H': s_opt.heap_sessions = true; break;
+        case 'v': s_opt.verbosity = (int)strlen(a) - 1; break;
+        default: usage();
+        }
+    }
+
+    if (trace_file == NULL && s_opt.gen_seconds <= 0) {
+        usage();
+    }
+    if (trace_file != NULL && load_trace(trace_file) != 0) {
+        return 1;
+    }
+    if (s_opt.gen_seconds > 0) {
+        size_t split = s_trace_len;
+        if (s_opt.gen_rate <= 0) usage();
+        generate_trace(s_opt.gen_seconds, s_opt.gen_rate, s_opt.seed);
+        if (split > 0) {
+            merge_commands(split);
+        }
+    }
+
+    if (s_opt.print_trace) {
+        size_t f = 0;
+        for (size_t k = 0; k <= s_trace_len; k++) {
+            for (; f < s_fault_len && (k == s_trace_len || s_faults[f].t_us <= s_trace[k].t_us); f++) {
+                printf("%lld.%03lld fault %s\n", (long long)(s_faults[f].t_us / 1000000),
+                       (long long)(s_faults[f].t_us % 1000000 / 1000), s_faults[f].text);
+            }
+            if (k == s_trace_len) {
+                break;
+            }
+            const trace_cmd_t *c = &s_trace[k];
+            printf("%lld.%03lld %s%s%s%s\n", (long long)(c->t_us / 1000000),
+                   (long long)(c->t_us % 1000000 / 1000), c->post ? "POST " : "", c->path,
+                   c->body ? " " : "", c->body ? c->body : "");
+        }
+        return 0;
+    }
+
+    s_out = stdout;
+    if (s_opt.out_path != NULL && (s_out = fopen(s_opt.out_path, "w")) == NULL) {
+        fprintf(stderr, "%s: %s\n", s_opt.out_path, strerror(errno));
+        return 1;
+    }
+
+    s_run = shared_alloc(sizeof(*s_run));
+    s_cmd = shared_alloc(s_trace_len * sizeof(*s_cmd));
+    s_fault_state = shared_alloc(s_fault_len * sizeof(*s_fault_state));
+    sim_flash_attach(shared_alloc(sim_flash_size()));
+
+    s_run->hash = 1469598103934665603ULL;       // FNV-1a 64 offset basis
+    s_run->last_ok_us = -1;
+    s_run->restart_mask = -1;
+    s_run->heap_largest_min = UINT32_MAX;
+    s_run->heap_free_min = UINT32_MAX;
+    for (int r = 0; r < RELAY_COUNT; r++) {
+        s_run->on_since[r] = -1;
+    }
+    for (size_t k = 0; k < s_fault_len; k++) {
+        s_fault_state[k] = (fault_state_t){ -1, -1, -1, 0, 0 };
+    }
+
+    int64_t end_us = s_opt.end_us;
+    if (end_us < 0) {
+        int64_t last_us = s_trace_len ? s_trace[s_trace_len - 1].t_us : 0;
+        if (s_fault_len > 0 && s_faults[s_fault_len - 1].t_us > last_us) {
+            last_us = s_faults[s_fault_len - 1].t_us;
+        }
+        end_us = last_us + DRAIN_US;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Each boot runs in a child process: a restart starts from clean
+    // firmware statics while flash and the results carry over
+    do {
+        s_run->restarting = false;
+        fflush(s_out);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            run_boot(end_us);
+        }
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "boot %u did not finish\n", (unsigned)s_run->boots);
+            return 1;
+        }
+    } while (s_run->restarting && s_run->boot_us < end_us);
+
+    if (s_out != stdout) fclose(s_out);
+    print_summary(elapsed_s(&start));
+
+    for (size_t k = 0; k < s_trace_len; k++) {
+        if (!s_cmd[k].finished) return 1;
+    }
+    return 0;
+}
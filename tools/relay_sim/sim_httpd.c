@@ -0,0 +1,704 @@
+/**
+ * @file sim_httpd.c
+ * @brief esp_http_server stand-in for host builds, on host sockets
+ *
+ * One simulated task accepts connections and serves them, the way the
+ * real server's single httpd task does:
+ *   - At most max_open_sockets connections. With lru_purge_enable a new
+ *     one closes the least recently used; without it the new one is
+ *     closed. open_fn runs on accept and can refuse the connection.
+ *   - Requests on a connection are handled in order, one at a time, so
+ *     pipelined requests wait for the ones before them. A handler that
+ *     blocks (a mutex, a delay) blocks the whole server, as on the device.
+ *   - Connections stay open until the client closes them, a handler
+ *     returns an error or the LRU purge picks them, whatever the request's
+ *     Connection header says; the firmware answers keep-alive.
+ *   - httpd_resp_send() sends Content-Length, httpd_resp_send_chunk()
+ *     Transfer-Encoding: chunked.
+ * sim_httpd_set_service_time() adds a fixed time per request ahead of the
+ * handler, standing in for the device's parsing and lwIP cost.
+ */
+
+#define _GNU_SOURCE                     // memmem()
+#include "sim_port.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define HTTPD_RECV_BUF      (HTTPD_MAX_REQ_HDR_LEN + 2048)  // Headers plus pipelined requests
+#define HTTPD_MAX_HEADERS   8                               // Response headers
+#define HTTPD_MAX_SOCKETS   16
+
+static const char *TAG = "httpd";
+
+typedef struct {
+    int fd;                     // -1: free
+    uint64_t last_used;         // LRU order
+    void *ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    size_t in_len;              // Bytes buffered, not yet consumed
+    char in[HTTPD_RECV_BUF];
+} session_t;
+
+typedef struct {
+    session_t *sess;
+    char *headers;              // Request header lines, NUL-terminated
+    size_t body_left;           // Body bytes not yet read by the handler
+    const char *status;
+    const char *type;
+    const char *hdr_field[HTTPD_MAX_HEADERS];
+    const char *hdr_value[HTTPD_MAX_HEADERS];
+    int hdr_count;
+    bool head_sent;             // Status line and headers are out
+} request_aux_t;
+
+typedef struct {
+    httpd_config_t config;
+    httpd_uri_t *handlers;
+    int handler_count;
+    int listen_fd;
+    session_t sessions[HTTPD_MAX_SOCKETS];
+    uint64_t use_seq;
+    bool stop;
+} server_t;
+
+static uint16_t s_port = 0;             // Overrides config.server_port
+static int64_t s_service_us = 0;
+
+void sim_httpd_set_port(uint16_t port)
+{
+    s_port = port;
+}
+
+void sim_httpd_set_service_time(int64_t us)
+{
+    s_service_us = us;
+}
+
+/*============================================================================
+ * Sockets
+ *============================================================================*/
+
+/**
+ * @brief Send all of buf, waiting for the socket to drain up to timeout
+ */
+static int send_all(int fd, const char *buf, size_t len, int timeout_s)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            buf += n;
+            len -= n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return HTTPD_SOCK_ERR_FAIL;
+        }
+        fd_set wfds;
+        FD_ZERO(&wfds);
+        FD_SET(fd, &wfds);
+        struct timeval tv = { .tv_sec = timeout_s, .tv_usec = 0 };
+        if (select(fd + 1, NULL, &wfds, NULL, &tv) <= 0) {
+            return HTTPD_SOCK_ERR_TIMEOUT;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Read what the socket has into the session buffer
+ *
+ * @return Bytes read, 0 on EOF, -1 on error or a full buffer
+ */
+static int fill(session_t *sess)
+{
+    if (sess->in_len == sizeof(sess->in)) {
+        return -1;
+    }
+    ssize_t n = recv(sess->fd, sess->in + sess->in_len, sizeof(sess->in) - sess->in_len,
+                     MSG_DONTWAIT);
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : -1;
+    }
+    sess->in_len += n;
+    return (int)n;
+}
+
+static void consume(session_t *sess, size_t len)
+{
+    memmove(sess->in, sess->in + len, sess->in_len - len);
+    sess->in_len -= len;
+}
+
+static void session_close(server_t *server, session_t *sess)
+{
+    if (server->config.close_fn != NULL) {
+        server->config.close_fn(server, sess->fd);
+    }
+    close(sess->fd);
+    if (sess->ctx != NULL) {
+        if (sess->free_ctx != NULL) {
+            sess->free_ctx(sess->ctx);
+        } else {
+            free(sess->ctx);
+        }
+    }
+    sess->fd = -1;
+    sess->ctx = NULL;
+    sess->free_ctx = NULL;
+    sess->in_len = 0;
+}
+
+static session_t *session_of(server_t *server, int fd)
+{
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd == fd) {
+            return &server->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static void accept_one(server_t *server)
+{
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    session_t *slot = session_of(server, -1);
+    if (slot == NULL && server->config.lru_purge_enable) {
+        slot = &server->sessions[0];
+        for (int i = 1; i < server->config.max_open_sockets; i++) {
+            if (server->sessions[i].last_used < slot->last_used) {
+                slot = &server->sessions[i];
+            }
+        }
+        ESP_LOGD(TAG, "LRU purge of socket %d", slot->fd);
+        session_close(server, slot);
+    }
+    if (slot == NULL) {
+        ESP_LOGW(TAG, "No free session, closing socket %d", fd);
+        close(fd);
+        return;
+    }
+
+    slot->fd = fd;
+    slot->last_used = ++server->use_seq;
+    if (server->config.open_fn != NULL && server->config.open_fn(server, fd) != ESP_OK) {
+        session_close(server, slot);
+    }
+}
+
+/*============================================================================
+ * Requests
+ *============================================================================*/
+
+static const httpd_uri_t *find_handler(server_t *server, const char *uri, size_t len,
+                                       int method, bool *uri_known)
+{
+    *uri_known = false;
+    for (int i = 0; i < server->handler_count; i++) {
+        const httpd_uri_t *h = &server->handlers[i];
+        bool match = server->config.uri_match_fn ?
+                     server->config.uri_match_fn(h->uri, uri, len) :
+                     (strlen(h->uri) == len && strncmp(h->uri, uri, len) == 0);
+        if (!match) continue;
+        *uri_known = true;
+        if ((int)h->method == method) {
+            return h;
+        }
+    }
+    return NULL;
+}
+
+static int parse_method(const char *s, size_t len)
+{
+    static const struct { const char *name; int method; } methods[] = {
+        { "GET", HTTP_GET }, { "POST", HTTP_POST }, { "PUT", HTTP_PUT },
+        { "DELETE", HTTP_DELETE }, { "HEAD", HTTP_HEAD },
+    };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (strlen(methods[i].name) == len && strncmp(methods[i].name, s, len) == 0) {
+            return methods[i].method;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Value of a request header line, NULL if absent
+ */
+static const char *find_header(const char *headers, const char *field, size_t *len)
+{
+    size_t flen = strlen(field);
+    for (const char *line = headers; *line != '\0'; ) {
+        const char *end = strstr(line, "\r\n");
+        if (end == NULL) end = line + strlen(line);
+        if ((size_t)(end - line) > flen && line[flen] == ':' &&
+            strncasecmp(line, field, flen) == 0) {
+            const char *v = line + flen + 1;
+            while (v < end && (*v == ' ' || *v == '\t')) v++;
+            *len = end - v;
+            return v;
+        }
+        line = (*end != '\0') ? end + 2 : end;
+    }
+    return NULL;
+}
+
+static esp_err_t send_error(httpd_req_t *req, const char *status, const char *msg)
+{
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "text/html");
+    return httpd_resp_sendstr(req, msg);
+}
+
+/**
+ * @brief Serve the request at the head of the session buffer
+ *
+ * @return 1 served, 0 incomplete (wait for more), -1 close the connection
+ */
+static int serve_one(server_t *server, session_t *sess)
+{
+    char *head_end = memmem(sess->in, sess->in_len, "\r\n\r\n", 4);
+    if (head_end == NULL) {
+        return (sess->in_len >= HTTPD_MAX_REQ_HDR_LEN) ? -1 : 0;
+    }
+    *head_end = '\0';
+    size_t head_len = head_end + 4 - sess->in;
+
+    // Request line: METHOD SP URI SP VERSION
+    char *line_end = strstr(sess->in, "\r\n");
+    char *headers = line_end ? line_end + 2 : head_end;
+    if (line_end) *line_end = '\0';
+    char *sp1 = strchr(sess->in, ' ');
+    char *sp2 = sp1 ? strchr(sp1 + 1, ' ') : NULL;
+    if (sp1 == NULL || sp2 == NULL || (size_t)(sp2 - sp1 - 1) > HTTPD_MAX_URI_LEN) {
+        return -1;
+    }
+
+    httpd_req_t req = { .handle = server, .method = parse_method(sess->in, sp1 - sess->in) };
+    memcpy((char *)req.uri, sp1 + 1, sp2 - sp1 - 1);
+    request_aux_t aux = { .sess = sess, .headers = headers, .status = "200 OK",
+                          .type = "text/html" };
+    req.aux = &aux;
+    req.sess_ctx = sess->ctx;
+
+    size_t vlen;
+    const char *v = find_header(headers, "Content-Length", &vlen);
+    req.content_len = v ? strtoul(v, NULL, 10) : 0;
+    aux.body_left = req.content_len;
+
+    // Headers are parsed; the body (if any) follows in the buffer
+    char head_copy[HTTPD_MAX_REQ_HDR_LEN];
+    size_t hlen = strlen(headers);
+    if (hlen >= sizeof(head_copy)) hlen = sizeof(head_copy) - 1;
+    memcpy(head_copy, headers, hlen);
+    head_copy[hlen] = '\0';
+    aux.headers = head_copy;
+    consume(sess, head_len);
+    sess->last_used = ++server->use_seq;
+
+    if (s_service_us > 0) {
+        sim_sleep_until(sim_now() + s_service_us);
+    }
+
+    const char *q = strchr(req.uri, '?');
+    size_t path_len = q ? (size_t)(q - req.uri) : strlen(req.uri);
+    bool uri_known;
+    const httpd_uri_t *h = find_handler(server, req.uri, path_len, req.method, &uri_known);
+    esp_err_t ret;
+    if (h != NULL) {
+        req.user_ctx = h->user_ctx;
+        ret = h->handler(&req);
+    } else if (uri_known) {
+        ret = send_error(&req, "405 Method Not Allowed", "Request method for this URI is not handled by server");
+    } else {
+        ret = httpd_resp_send_404(&req);
+    }
+
+    // Drop what the handler left of the body
+    while (aux.body_left > 0 && sess->fd >= 0) {
+        char skip[256];
+        int n = httpd_req_recv(&req, skip, aux.body_left < sizeof(skip) ? aux.body_left : sizeof(skip));
+        if (n <= 0) return -1;
+    }
+    return (ret == ESP_OK) ? 1 : -1;
+}
+
+static void serve_session(server_t *server, session_t *sess)
+{
+    int n = fill(sess);
+    if (n <= 0) {
+        session_close(server, sess);
+        return;
+    }
+    for (;;) {
+        int r = serve_one(server, sess);
+        if (r < 0) {
+            session_close(server, sess);
+            return;
+        }
+        if (r == 0) {
+            return;
+        }
+    }
+}
+
+static void server_task(void *arg)
+{
+    server_t *server = arg;
+
+    while (!server->stop) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(server->listen_fd, &rfds);
+        int max_fd = server->listen_fd;
+        for (int i = 0; i < server->config.max_open_sockets; i++) {
+            int fd = server->sessions[i].fd;
+            if (fd >= 0) {
+                FD_SET(fd, &rfds);
+                if (fd > max_fd) max_fd = fd;
+            }
+        }
+
+        if (select(max_fd + 1, &rfds, NULL, NULL, NULL) <= 0) {
+            continue;
+        }
+        for (int i = 0; i < server->config.max_open_sockets && !server->stop; i++) {
+            session_t *sess = &server->sessions[i];
+            if (sess->fd >= 0 && FD_ISSET(sess->fd, &rfds)) {
+                serve_session(server, sess);
+            }
+        }
+        if (!server->stop && FD_ISSET(server->listen_fd, &rfds)) {
+            accept_one(server);
+        }
+    }
+
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd >= 0) {
+            session_close(server, &server->sessions[i]);
+        }
+    }
+    close(server->listen_fd);
+    free(server->handlers);
+    free(server);
+    vTaskDelete(NULL);
+}
+
+/*============================================================================
+ * Server
+ *============================================================================*/
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    if (config->max_open_sockets > HTTPD_MAX_SOCKETS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    server_t *server = calloc(1, sizeof(server_t));
+    if (server == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    server->config = *config;
+    if (s_port != 0) {
+        server->config.server_port = s_port;
+    }
+    server->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    for (int i = 0; i < HTTPD_MAX_SOCKETS; i++) {
+        server->sessions[i].fd = -1;
+    }
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(server->config.server_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (server->handlers == NULL || server->listen_fd < 0 ||
+        bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server->listen_fd, 128) != 0) {
+        ESP_LOGE(TAG, "Cannot listen on port %u: errno %d", server->config.server_port, errno);
+        if (server->listen_fd >= 0) close(server->listen_fd);
+        free(server->handlers);
+        free(server);
+        return ESP_FAIL;
+    }
+
+    if (xTaskCreate(server_task, "httpd", config->stack_size, server,
+                    config->task_priority, NULL) != pdPASS) {
+        close(server->listen_fd);
+        free(server->handlers);
+        free(server);
+        return ESP_ERR_NO_MEM;
+    }
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    server_t *server = handle;
+    server->stop = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    server_t *server = handle;
+    if (server->handler_count == server->config.max_uri_handlers) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    server->handlers[server->handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char *reference_uri, const char *uri_to_match,
+                              size_t match_upto)
+{
+    size_t len = strlen(reference_uri);
+    if (len > 0 && reference_uri[len - 1] == '*') {
+        return match_upto >= len - 1 && strncmp(reference_uri, uri_to_match, len - 1) == 0;
+    }
+    return len == match_upto && strncmp(reference_uri, uri_to_match, len) == 0;
+}
+
+void httpd_sess_set_ctx(httpd_handle_t handle, int sockfd, void *ctx, httpd_free_ctx_fn_t free_fn)
+{
+    session_t *sess = session_of(handle, sockfd);
+    if (sess != NULL) {
+        sess->ctx = ctx;
+        sess->free_ctx = free_fn;
+    }
+}
+
+void *httpd_sess_get_ctx(httpd_handle_t handle, int sockfd)
+{
+    session_t *sess = session_of(handle, sockfd);
+    return sess ? sess->ctx : NULL;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    return ((request_aux_t *)r->aux)->sess->fd;
+}
+
+/*============================================================================
+ * Request data
+ *============================================================================*/
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    request_aux_t *aux = r->aux;
+    session_t *sess = aux->sess;
+    server_t *server = r->handle;
+
+    if (buf_len > aux->body_left) {
+        buf_len = aux->body_left;
+    }
+    if (buf_len == 0) {
+        return 0;
+    }
+    if (sess->in_len == 0) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(sess->fd, &rfds);
+        struct timeval tv = { .tv_sec = server->config.recv_wait_timeout, .tv_usec = 0 };
+        if (select(sess->fd + 1, &rfds, NULL, NULL, &tv) <= 0) {
+            return HTTPD_SOCK_ERR_TIMEOUT;
+        }
+        if (fill(sess) <= 0) {
+            return HTTPD_SOCK_ERR_FAIL;
+        }
+    }
+    size_t n = (sess->in_len < buf_len) ? sess->in_len : buf_len;
+    memcpy(buf, sess->in, n);
+    consume(sess, n);
+    aux->body_left -= n;
+    return (int)n;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    size_t len;
+    return find_header(((request_aux_t *)r->aux)->headers, field, &len) ? len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val,
+                                      size_t val_size)
+{
+    size_t len;
+    const char *v = find_header(((request_aux_t *)r->aux)->headers, field, &len);
+    if (v == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (val_size == 0) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    size_t n = (len < val_size - 1) ? len : val_size - 1;
+    memcpy(val, v, n);
+    val[n] = '\0';
+    return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    const char *q = strchr(r->uri, '?');
+    if (q == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    q++;
+    size_t len = strlen(q);
+    if (buf_len == 0) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    size_t n = (len < buf_len - 1) ? len : buf_len - 1;
+    memcpy(buf, q, n);
+    buf[n] = '\0';
+    return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    size_t klen = strlen(key);
+    for (const char *p = qry; p != NULL && *p != '\0'; ) {
+        const char *end = strchr(p, '&');
+        size_t plen = end ? (size_t)(end - p) : strlen(p);
+        if (plen > klen && p[klen] == '=' && strncmp(p, key, klen) == 0) {
+            size_t len = plen - klen - 1;
+            if (val_size == 0) {
+                return ESP_ERR_HTTPD_RESULT_TRUNC;
+            }
+            size_t n = (len < val_size - 1) ? len : val_size - 1;
+            memcpy(val, p + klen + 1, n);
+            val[n] = '\0';
+            return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        p = end ? end + 1 : NULL;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/*============================================================================
+ * Responses
+ *============================================================================*/
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    ((request_aux_t *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    ((request_aux_t *)r->aux)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    request_aux_t *aux = r->aux;
+    if (aux->hdr_count == HTTPD_MAX_HEADERS) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    aux->hdr_field[aux->hdr_count] = field;
+    aux->hdr_value[aux->hdr_count] = value;
+    aux->hdr_count++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Send the status line and headers, with a length or chunked
+ */
+static esp_err_t send_head(httpd_req_t *r, ssize_t content_len)
+{
+    request_aux_t *aux = r->aux;
+    server_t *server = r->handle;
+    char head[HTTPD_MAX_REQ_HDR_LEN];
+    int len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\n",
+                       aux->status, aux->type);
+    if (content_len >= 0) {
+        len += snprintf(head + len, sizeof(head) - len, "Content-Length: %zd\r\n", content_len);
+    } else {
+        len += snprintf(head + len, sizeof(head) - len, "Transfer-Encoding: chunked\r\n");
+    }
+    for (int i = 0; i < aux->hdr_count && len < (int)sizeof(head); i++) {
+        len += snprintf(head + len, sizeof(head) - len, "%s: %s\r\n",
+                        aux->hdr_field[i], aux->hdr_value[i]);
+    }
+    if (len + 2 >= (int)sizeof(head)) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    len += snprintf(head + len, sizeof(head) - len, "\r\n");
+    aux->head_sent = true;
+    return send_all(aux->sess->fd, head, len, server->config.send_wait_timeout) == 0 ?
+           ESP_OK : ESP_ERR_HTTPD_RESP_SEND;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    request_aux_t *aux = r->aux;
+    server_t *server = r->handle;
+    if (buf == NULL) {
+        buf_len = 0;
+    } else if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = strlen(buf);
+    }
+    esp_err_t ret = send_head(r, buf_len);
+    if (ret == ESP_OK && buf_len > 0 &&
+        send_all(aux->sess->fd, buf, buf_len, server->config.send_wait_timeout) != 0) {
+        ret = ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ret;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    request_aux_t *aux = r->aux;
+    server_t *server = r->handle;
+    if (buf == NULL) {
+        buf_len = 0;
+    } else if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = strlen(buf);
+    }
+    if (!aux->head_sent) {
+        esp_err_t ret = send_head(r, -1);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    char size[16];
+    int len = snprintf(size, sizeof(size), "%zx\r\n", buf_len);
+    int timeout = server->config.send_wait_timeout;
+    if (send_all(aux->sess->fd, size, len, timeout) != 0 ||
+        (buf_len > 0 && send_all(aux->sess->fd, buf, buf_len, timeout) != 0) ||
+        send_all(aux->sess->fd, "\r\n", 2, timeout) != 0) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str)
+{
+    return httpd_resp_send(r, str, str ? (ssize_t)strlen(str) : 0);
+}
+
+esp_err_t httpd_resp_send_404(httpd_req_t *r)
+{
+    httpd_resp_set_status(r, "404 Not Found");
+    httpd_resp_set_type(r, "text/html");
+    return httpd_resp_sendstr(r, "Nothing matches the given URI");
+}
@@ -0,0 +1,1988 @@
+/**
+ * @file sim_port.c
+ * @brief Virtual-clock implementation of the FreeRTOS and ESP-IDF calls
+ *        used by relay_service.c, sequencer.c, wifi_service.c,
+ *        powerfail.c and block_pool.c
+ *
+ * Timing follows the device where the firmware can observe it:
+ *   - vTaskDelay() wakes on a tick boundary, xTaskGetTickCount() counts
+ *     configTICK_RATE_HZ ticks, so debounce rounding matches the board.
+ *   - esp_timer callbacks run one at a time on a priority-22 task; a
+ *     callback that blocks (e.g. an LED blink) delays the next one.
+ *     ESP_TIMER_ISR callbacks run from the scheduler at their deadline,
+ *     ahead of any task; logging, blocking or NVS there aborts the run.
+ *   - Mutexes block the taking task until the owner gives them back.
+ *   - NVS skips writes of an unchanged value and enforces 15-character
+ *     keys, so flash write counts are comparable with the device.
+ *   - Event handlers run one at a time on a sys_evt task. The station
+ *     joins SIM_WIFI_JOIN_US after esp_wifi_connect() if an access point
+ *     is up (the strongest, with an all-channel scan sorted by signal),
+ *     reports "no AP" after SIM_WIFI_NO_AP_US if not, and notices a
+ *     vanished access point after SIM_WIFI_BEACON_TIMEOUT_US. With a
+ *     BSSID and channel set it reassociates in SIM_WIFI_REASSOC_US, also
+ *     from a live link (a roam). A scan takes its dwell time per channel,
+ *     plus SIM_WIFI_HOME_US on the home channel between channels while
+ *     linked, and the RSSI threshold event fires when the joined AP's
+ *     signal is set below it. Power save and the listen interval add no
+ *     latency.
+ *   - With sim_set_cache_stall(), every NVS write that changes flash
+ *     turns the flash cache off for that long: no task runs, on either
+ *     core, until it is back, but ISR timers still fire.
+ *   - A partition write blocks the writing task for SIM_FLASH_PROGRAM_US
+ *     and lands only when that time is up, so a power cut during the
+ *     program loses it; an erase takes SIM_FLASH_ERASE_US per sector.
+ *   - GPIO interrupt handlers run inline in the task that drives the input.
+ *   - select() from lwip/sockets.h blocks the calling task until a
+ *     descriptor is ready or its timeout passes. In realtime mode
+ *     (sim_set_realtime()) the clock follows the wall clock and the
+ *     scheduler sleeps in select() on all waited-for descriptors, so a
+ *     host build serves real sockets; otherwise only the timeout passes.
+ *   - heap_caps_malloc() takes first fit from a SIM_HEAP_SIZE arena with
+ *     SIM_HEAP_HEADER bytes of overhead per block and merges neighbours on
+ *     free. The device's TLSF allocator picks blocks differently, so the
+ *     numbers are indicative, but a placement that fragments one heap
+ *     fragments the other too.
+ */
+
+#include "sim_port.h"
+#include "config.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_netif_sntp.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "driver/gpio.h"
+#include "hal/gpio_ll.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+
+#define SIM_MAX_TASKS       16
+#define SIM_MAX_EVENTS      32
+#define SIM_MAX_HANDLERS    4
+#define SIM_MAX_TIMERS      32
+#define SIM_STACK_SIZE      (256 * 1024)
+#define SIM_TICK_US         ((int64_t)portTICK_PERIOD_MS * 1000)
+
+#define NVS_MAX_NAMESPACES  8
+#define NVS_MAX_ENTRIES     64
+#define NVS_MAX_VALUE       512
+#define NVS_KEY_MAX         15
+#define NVS_HANDLE_RO       0x100
+#define NVS_MAX_STALE       16
+
+// Station timing (ESP-IDF defaults)
+#define SIM_WIFI_JOIN_US            2000000     // Scan, auth, association, 4-way handshake
+#define SIM_WIFI_REASSOC_US         150000      // Known BSSID and channel: no scan
+#define SIM_WIFI_NO_AP_US           1600000     // Full scan without a match
+#define SIM_WIFI_BEACON_TIMEOUT_US  6000000     // Inactive time before a disconnect
+#define SIM_WIFI_SCAN_DWELL_US      120000      // Active scan time per channel by default
+#define SIM_WIFI_HOME_US            30000       // Home channel time between scanned channels
+#define SIM_WIFI_CHANNELS           13
+
+// SPI flash timing (typical for the 4 MB parts on DevKit modules)
+#define SIM_FLASH_PROGRAM_US        600         // Page program plus driver overhead
+#define SIM_FLASH_ERASE_US          45000       // 4 KB sector erase
+#define SIM_SECTOR_SIZE             0x1000
+#define SIM_PART_SIZE               0x1000      // partitions.csv "pfail"
+
+#define SIM_RTC_SIZE                8192        // RTC slow memory
+
+#define SIM_HEAP_SIZE               (300 * 1024) // Free DRAM once WiFi and lwIP are up
+#define SIM_HEAP_HEADER             8           // Per-block overhead, as multi_heap
+#define SIM_HEAP_ALIGN              8
+#define SIM_MAX_SHUTDOWN_HANDLERS   4
+
+typedef enum {
+    TASK_READY,
+    TASK_SLEEPING,
+    TASK_WAIT_TIMERS,           // esp_timer task with nothing due
+    TASK_WAIT_EVENTS,           // sys_evt task with nothing due
+    TASK_WAIT_MUTEX,
+    TASK_WAIT_BITS,
+    TASK_WAIT_NOTIFY,
+    TASK_WAIT_IO,               // select() on sockets
+    TASK_DONE
+} task_state_t;
+
+struct sim_task {
+    const char *name;
+    int priority;
+    task_state_t state;
+    bool background;            // Does not keep the run going on its own
+    int64_t wake_us;
+    const void *wait_on;
+    uint32_t notify_value;
+    bool notified;              // Notification pending
+    int io_nfds;                // TASK_WAIT_IO: descriptors waited for
+    fd_set io_read;
+    fd_set io_write;
+    void (*fn)(void *);
+    void *arg;
+    ucontext_t ctx;
+    void *stack;
+};
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    bool armed;
+    int64_t deadline_us;
+    uint64_t arm_seq;           // Equal deadlines fire in arming order
+    bool isr;                   // ESP_TIMER_ISR dispatch
+};
+
+struct sim_mutex {
+    const void *owner;
+};
+
+struct sim_event_group {
+    EventBits_t bits;
+};
+
+typedef enum {
+    EV_POST,                    // Deliver to the registered handlers
+    EV_JOIN_DONE,               // Outcome of esp_wifi_connect()
+    EV_BEACON_LOST,             // Access point silent for the beacon timeout
+    EV_SCAN_DONE,               // Outcome of esp_wifi_scan_start()
+} event_kind_t;
+
+typedef struct {
+    int64_t deliver_us;
+    uint64_t seq;
+    event_kind_t kind;
+    esp_event_base_t base;
+    int32_t id;
+} sim_event_t;
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;                // As heard by the station
+    bool on;
+} sim_ap_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_t;
+
+typedef struct {
+    bool used;
+    int ns;
+    char key[NVS_KEY_MAX + 1];
+    uint8_t type;               // 1 u8, 2 blob
+    size_t len;
+    uint8_t data[NVS_MAX_VALUE];
+} nvs_entry_t;
+
+typedef struct {
+    int ns;
+    char key[NVS_KEY_MAX + 1];
+} nvs_key_t;
+
+// Everything that survives a restart (NVS first: nvs_flash_erase() clears it)
+typedef struct {
+    char ns[NVS_MAX_NAMESPACES][16];
+    int ns_count;
+    nvs_entry_t entries[NVS_MAX_ENTRIES];
+    nvs_key_t stale[NVS_MAX_STALE];         // Last write failed
+    int stale_count;
+    bool full;
+    int fail_left;
+    esp_err_t fail_err;
+    
+    // Power-fail partition, stored inverted so zeroed memory reads erased
+    uint8_t part[SIM_PART_SIZE];
+    
+    // RTC slow memory, kept by a restart and lost on a power cut
+    uint8_t rtc[SIM_RTC_SIZE];
+} sim_flash_t;
+
+// Heap block header; size includes the header, the low bit marks it used
+typedef struct {
+    uint32_t size;
+    uint32_t prev_size;         // Size of the block before (0 for the first)
+} heap_block_t;
+
+_Static_assert(sizeof(heap_block_t) == SIM_HEAP_HEADER, "header size");
+
+// The firmware's RTC_NOINIT_ATTR variables (see port/esp_attr.h)
+extern char __start_rtc_noinit[] __attribute__((weak));
+extern char __stop_rtc_noinit[] __attribute__((weak));
+
+static sim_task_t s_tasks[SIM_MAX_TASKS];
+static int s_task_count = 0;
+static sim_task_t *s_current = NULL;        // NULL while the scheduler runs
+static const char s_scheduler_handle = 0;   // Never NULL, like a real task handle
+static ucontext_t s_scheduler_ctx;
+static int64_t s_now_us = 0;
+static bool s_realtime = false;
+static int64_t s_wall_base_us = 0;          // Monotonic clock at virtual time 0
+
+static struct esp_timer s_timers[SIM_MAX_TIMERS];
+static int s_timer_count = 0;
+static uint64_t s_arm_seq = 0;
+static bool s_in_isr = false;               // An ISR timer callback is running
+
+static int64_t s_cache_stall_us = 0;        // Per changed NVS write (0: not modelled)
+static int64_t s_cache_off_until = 0;
+
+static sim_task_t *s_event_task = NULL;
+static sim_event_t s_events[SIM_MAX_EVENTS];
+static int s_event_count = 0;
+static uint64_t s_event_seq = 0;
+static event_handler_t s_handlers[SIM_MAX_HANDLERS];
+static int s_handler_count = 0;
+
+// Access points of the SSID; the second one is off until a fault adds it
+static sim_ap_t s_aps[SIM_WIFI_APS] = {
+    { { 0x24, 0x0a, 0xc4, 0x10, 0x00, 0x01 }, 1, -55, true },
+    { { 0x24, 0x0a, 0xc4, 0x10, 0x00, 0x02 }, 6, -60, false },
+};
+static bool s_ap_up = true;                 // Power to all of them ("wifi down")
+static bool s_wifi_started = false;
+static bool s_joining = false;
+static bool s_link_up = false;
+static int s_ap = -1;                       // AP joined last
+static wifi_config_t s_sta_config;
+static bool s_scanning = false;
+static wifi_ap_record_t s_scan_result[SIM_WIFI_APS];
+static uint16_t s_scan_count = 0;
+static bool s_rssi_armed = false;
+static int32_t s_rssi_threshold = 0;
+static wifi_ps_type_t s_ps = WIFI_PS_MIN_MODEM;     // The driver's default
+static int8_t s_tx_power = 80;                      // 0.25 dBm
+static esp_netif_ip_info_t s_ip_info;
+
+gpio_dev_t GPIO;                            // Register block of hal/gpio_ll.h
+static int s_gpio_level[GPIO_NUM_MAX];
+static gpio_int_type_t s_gpio_intr[GPIO_NUM_MAX];
+static gpio_isr_t s_gpio_isr[GPIO_NUM_MAX];
+static void *s_gpio_isr_arg[GPIO_NUM_MAX];
+static bool s_isr_service = false;
+static uint64_t s_gpio_fault_pins = 0;
+static int s_gpio_fault_left = 0;
+static bool s_gpio_fault_stuck = false;
+
+static shutdown_handler_t s_shutdown_handlers[SIM_MAX_SHUTDOWN_HANDLERS];
+static int s_shutdown_count = 0;
+
+static const esp_partition_t s_pfail_part = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = POWERFAIL_PARTITION_SUBTYPE,
+    .address = 0x1ff000,
+    .size = SIM_PART_SIZE,
+    .erase_size = SIM_SECTOR_SIZE,
+    .label = POWERFAIL_PARTITION_LABEL,
+};
+static sim_flash_t s_own_flash;
+static sim_flash_t *s_flash = &s_own_flash;
+
+static uint8_t s_heap[SIM_HEAP_SIZE] __attribute__((aligned(SIM_HEAP_ALIGN)));
+static size_t s_heap_free = 0;
+static size_t s_heap_min_free = 0;
+
+static int s_verbosity = 0;
+static sim_stats_t s_stats;
+
+/*============================================================================
+ * Scheduler
+ *============================================================================*/
+
+static void yield(void)
+{
+    swapcontext(&s_current->ctx, &s_scheduler_ctx);
+}
+
+static void task_entry(int index)
+{
+    sim_task_t *t = &s_tasks[index];
+    t->fn(t->arg);
+    t->state = TASK_DONE;
+}
+
+static struct esp_timer *earliest_timer(bool isr)
+{
+    struct esp_timer *best = NULL;
+    for (int i = 0; i < s_timer_count; i++) {
+        struct esp_timer *t = &s_timers[i];
+        if (!t->armed || t->isr != isr) continue;
+        if (best == NULL || t->deadline_us < best->deadline_us ||
+            (t->deadline_us == best->deadline_us && t->arm_seq < best->arm_seq)) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static sim_event_t *earliest_event(void)
+{
+    sim_event_t *best = NULL;
+    for (int i = 0; i < s_event_count; i++) {
+        sim_event_t *e = &s_events[i];
+        if (best == NULL || e->deliver_us < best->deliver_us ||
+            (e->deliver_us == best->deliver_us && e->seq < best->seq)) {
+            best = e;
+        }
+    }
+    return best;
+}
+
+static int64_t task_wake(const sim_task_t *t)
+{
+    switch (t->state) {
+    case TASK_READY:
+    case TASK_SLEEPING:
+    case TASK_WAIT_MUTEX:
+    case TASK_WAIT_BITS:
+    case TASK_WAIT_NOTIFY:
+    case TASK_WAIT_IO:
+        return t->wake_us;
+    case TASK_WAIT_TIMERS: {
+        const struct esp_timer *timer = earliest_timer(false);
+        return timer ? timer->deadline_us : SIM_NEVER;
+    }
+    case TASK_WAIT_EVENTS: {
+        const sim_event_t *e = earliest_event();
+        return e ? e->deliver_us : SIM_NEVER;
+    }
+    default:
+        return SIM_NEVER;
+    }
+}
+
+static void fire_timer(struct esp_timer *timer)
+{
+    timer->armed = false;
+    int64_t late = s_now_us - timer->deadline_us;
+    if (late > s_stats.timer_late_max_us) {
+        s_stats.timer_late_max_us = late;
+    }
+    s_stats.timer_callbacks++;
+    s_in_isr = timer->isr;
+    timer->callback(timer->arg);
+    s_in_isr = false;
+}
+
+/**
+ * @brief Stop the run if an ISR timer callback calls something that may
+ *        not run in an interrupt (on the device: a crash or a deadlock)
+ */
+static void isr_check(const char *what)
+{
+    if (s_in_isr) {
+        fprintf(stderr, "sim: %s called from an ESP_TIMER_ISR callback\n", what);
+        abort();
+    }
+}
+
+/**
+ * @brief Turn the flash cache off for the modelled write time
+ *
+ * The writer sleeps through it and every other task is held until it ends.
+ */
+static void cache_stall(void)
+{
+    if (s_cache_stall_us == 0 || s_current == NULL) {
+        return;
+    }
+    s_cache_off_until = s_now_us + s_cache_stall_us;
+    s_stats.cache_stalls++;
+    sim_sleep_until(s_cache_off_until);
+}
+
+static int64_t wall_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - s_wall_base_us;
+}
+
+/**
+ * @brief Realtime mode: let the wall clock reach until_us, or less if a
+ *        socket that a task waits on becomes ready first
+ *
+ * @return true if a socket made its task ready
+ */
+static bool io_wait(int64_t until_us)
+{
+    fd_set rd, wr;
+    int nfds = 0;
+    FD_ZERO(&rd);
+    FD_ZERO(&wr);
+    for (int i = 0; i < s_task_count; i++) {
+        sim_task_t *t = &s_tasks[i];
+        if (t->state != TASK_WAIT_IO) continue;
+        for (int fd = 0; fd < t->io_nfds; fd++) {
+            if (FD_ISSET(fd, &t->io_read)) FD_SET(fd, &rd);
+            if (FD_ISSET(fd, &t->io_write)) FD_SET(fd, &wr);
+        }
+        if (t->io_nfds > nfds) nfds = t->io_nfds;
+    }
+
+    struct timeval tv, *timeout = NULL;
+    if (until_us != SIM_NEVER) {
+        int64_t wait = until_us - wall_now();
+        if (wait <= 0 && nfds == 0) {
+            return false;
+        }
+        if (wait < 0) wait = 0;
+        tv.tv_sec = wait / 1000000;
+        tv.tv_usec = wait % 1000000;
+        timeout = &tv;
+    }
+    int ready = select(nfds, &rd, &wr, NULL, timeout);
+
+    int64_t now = wall_now();
+    if (now > s_now_us) {
+        s_now_us = now;
+    }
+    if (ready <= 0) {
+        return false;
+    }
+    for (int i = 0; i < s_task_count; i++) {
+        if (s_tasks[i].state == TASK_WAIT_IO) {
+            s_tasks[i].state = TASK_READY;     // Its select() checks which
+            s_tasks[i].wake_us = s_now_us;
+        }
+    }
+    return true;
+}
+
+static void timer_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        struct esp_timer *timer = earliest_timer(false);
+        if (timer == NULL || timer->deadline_us > s_now_us) {
+            s_current->state = TASK_WAIT_TIMERS;
+            yield();
+            continue;
+        }
+        fire_timer(timer);
+    }
+}
+
+static void init_context(int index)
+{
+    sim_task_t *t = &s_tasks[index];
+    getcontext(&t->ctx);
+    t->ctx.uc_stack.ss_sp = t->stack;
+    t->ctx.uc_stack.ss_size = SIM_STACK_SIZE;
+    t->ctx.uc_link = &s_scheduler_ctx;
+    makecontext(&t->ctx, (void (*)(void))task_entry, 1, index);
+}
+
+void sim_init(int64_t boot_us)
+{
+    s_now_us = boot_us;
+    s_current = NULL;
+    memset(&s_stats, 0, sizeof(s_stats));
+    for (int i = 0; i < GPIO_NUM_MAX; i++) {
+        s_gpio_level[i] = -1;
+    }
+    size_t rtc_len = (size_t)(__stop_rtc_noinit - __start_rtc_noinit);
+    if (rtc_len > 0 && rtc_len <= SIM_RTC_SIZE) {
+        memcpy(__start_rtc_noinit, s_flash->rtc, rtc_len);
+    }
+    *(heap_block_t *)s_heap = (heap_block_t){ .size = SIM_HEAP_SIZE, .prev_size = 0 };
+    s_heap_free = s_heap_min_free = SIM_HEAP_SIZE - SIM_HEAP_HEADER;
+    sim_task_create("esp_timer", SIM_PRIO_TIMER, timer_task, NULL);
+}
+
+sim_task_t *sim_task_create(const char *name, int priority, void (*fn)(void *), void *arg)
+{
+    if (s_task_count == SIM_MAX_TASKS) {
+        return NULL;
+    }
+
+    sim_task_t *t = &s_tasks[s_task_count];
+    t->name = name;
+    t->priority = priority;
+    t->state = TASK_READY;
+    t->background = false;
+    t->wake_us = s_now_us;
+    t->notify_value = 0;
+    t->notified = false;
+    t->fn = fn;
+    t->arg = arg;
+    t->stack = malloc(SIM_STACK_SIZE);
+    if (t->stack == NULL) {
+        return NULL;
+    }
+
+    init_context(s_task_count);
+    s_task_count++;
+    return t;
+}
+
+void sim_run(int64_t end_us)
+{
+    for (;;) {
+        sim_task_t *next = NULL;
+        int64_t best = SIM_NEVER;
+        bool busy = false;
+        bool io = false;            // Realtime: a task waits for a socket
+
+        for (int i = 0; i < s_task_count; i++) {
+            int64_t wake = task_wake(&s_tasks[i]);
+            if (wake < s_cache_off_until) {
+                wake = s_cache_off_until;
+            }
+            if (wake < best || (wake == best && next != NULL && s_tasks[i].priority > next->priority)) {
+                best = wake;
+                next = &s_tasks[i];
+            }
+            bool waits_io = s_realtime && s_tasks[i].state == TASK_WAIT_IO;
+            if (!s_tasks[i].background && (wake != SIM_NEVER || waits_io)) {
+                busy = true;
+            }
+            io = io || waits_io;
+        }
+
+        // Interrupts preempt every task and run with the cache off too
+        struct esp_timer *isr = earliest_timer(true);
+        if (isr != NULL && isr->deadline_us <= best && isr->deadline_us <= end_us) {
+            if (isr->deadline_us > s_now_us) {
+                s_now_us = isr->deadline_us;
+            }
+            fire_timer(isr);
+            sim_on_step();
+            continue;
+        }
+
+        if (!busy || (best == SIM_NEVER && !io)) {
+            break;
+        }
+        if (s_realtime && io_wait(best < end_us ? best : end_us)) {
+            continue;
+        }
+        if (best > end_us) {
+            s_now_us = end_us;
+            break;
+        }
+        if (best == SIM_NEVER) {
+            continue;               // Interrupted wait for a socket
+        }
+        if (best > s_now_us) {
+            s_now_us = best;
+        }
+
+        s_current = next;
+        swapcontext(&s_scheduler_ctx, &next->ctx);
+        s_current = NULL;
+        s_stats.switches++;
+        sim_on_step();
+    }
+}
+
+int64_t sim_now(void)
+{
+    return s_now_us;
+}
+
+void sim_sleep_until(int64_t t_us)
+{
+    isr_check("sim_sleep_until");
+    if (t_us <= s_now_us) {
+        return;
+    }
+    s_current->state = TASK_SLEEPING;
+    s_current->wake_us = t_us;
+    yield();
+}
+
+void sim_set_background(void)
+{
+    s_current->background = true;
+}
+
+void sim_set_verbosity(int level)
+{
+    s_verbosity = level;
+}
+
+void sim_set_cache_stall(int64_t us)
+{
+    s_cache_stall_us = us;
+}
+
+void sim_set_realtime(bool on)
+{
+    s_realtime = on;
+    if (on) {
+        s_wall_base_us = 0;
+        s_wall_base_us = wall_now() - s_now_us;
+    }
+}
+
+int sim_select(int nfds, fd_set *rd, fd_set *wr, fd_set *ex, struct timeval *timeout)
+{
+    isr_check("select");
+    int64_t until = (timeout == NULL) ? SIM_NEVER :
+                    s_now_us + (int64_t)timeout->tv_sec * 1000000 + timeout->tv_usec;
+    fd_set want_rd, want_wr, want_ex;
+    FD_ZERO(&want_rd);
+    FD_ZERO(&want_wr);
+    FD_ZERO(&want_ex);
+    if (rd != NULL) want_rd = *rd;
+    if (wr != NULL) want_wr = *wr;
+    if (ex != NULL) want_ex = *ex;
+
+    for (;;) {
+        struct timeval poll = { 0, 0 };
+        int ready = select(nfds, rd, wr, ex, &poll);
+        if (ready != 0 || s_current == NULL || s_now_us >= until) {
+            return ready;
+        }
+        if (rd != NULL) *rd = want_rd;
+        if (wr != NULL) *wr = want_wr;
+        if (ex != NULL) *ex = want_ex;
+        s_current->state = TASK_WAIT_IO;
+        s_current->wake_us = until;
+        s_current->io_nfds = nfds;
+        s_current->io_read = want_rd;
+        s_current->io_write = want_wr;
+        yield();
+    }
+}
+
+const sim_stats_t *sim_get_stats(void)
+{
+    return &s_stats;
+}
+
+/*============================================================================
+ * FreeRTOS
+ *============================================================================*/
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(s_now_us / SIM_TICK_US);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    isr_check("vTaskDelay");
+    if (s_current == NULL) {
+        return;
+    }
+    // Blocked until the tick interrupt that reaches the target count
+    s_current->wake_us = (s_now_us / SIM_TICK_US + ticks) * SIM_TICK_US;
+    if (s_current->wake_us < s_now_us) {
+        s_current->wake_us = s_now_us;
+    }
+    s_current->state = TASK_SLEEPING;
+    yield();
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment)
+{
+    isr_check("vTaskDelayUntil");
+    *previous_wake += increment;
+    if (s_current == NULL) {
+        return;
+    }
+    int64_t wake = (int64_t)*previous_wake * SIM_TICK_US;
+    if (wake > s_now_us) {
+        s_current->wake_us = wake;
+        s_current->state = TASK_SLEEPING;
+        yield();
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current ? (TaskHandle_t)s_current : (TaskHandle_t)&s_scheduler_handle;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *out)
+{
+    (void)stack_depth;
+    sim_task_t *t = sim_task_create(name, (int)priority, fn, arg);
+    if (t == NULL) {
+        return pdFALSE;
+    }
+    if (out != NULL) {
+        *out = t;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    sim_task_t *t = (task != NULL) ? task : s_current;
+    t->state = TASK_DONE;
+    if (t == s_current) {
+        yield();                    // Never resumed
+    }
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    sim_task_t *t = task;
+    switch (action) {
+    case eSetBits:                  t->notify_value |= value; break;
+    case eIncrement:                t->notify_value++; break;
+    case eSetValueWithOverwrite:    t->notify_value = value; break;
+    case eSetValueWithoutOverwrite:
+        if (t->notified) return pdFALSE;
+        t->notify_value = value;
+        break;
+    default:                        break;
+    }
+    t->notified = true;
+    if (t->state == TASK_WAIT_NOTIFY) {
+        t->state = TASK_READY;
+        t->wake_us = s_now_us;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action,
+                              BaseType_t *higher_priority_woken)
+{
+    sim_task_t *t = task;
+    bool waiting = (t->state == TASK_WAIT_NOTIFY);
+    BaseType_t ret = xTaskNotify(task, value, action);
+    if (higher_priority_woken != NULL && waiting && s_current != NULL &&
+        t->priority > s_current->priority) {
+        *higher_priority_woken = pdTRUE;
+    }
+    return ret;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+                           uint32_t *value, TickType_t ticks)
+{
+    isr_check("xTaskNotifyWait");
+    int64_t deadline = (ticks == portMAX_DELAY) ? SIM_NEVER : s_now_us + (int64_t)ticks * SIM_TICK_US;
+
+    if (!s_current->notified) {
+        s_current->notify_value &= ~clear_on_entry;
+    }
+    while (!s_current->notified) {
+        if (s_now_us >= deadline) {
+            if (value != NULL) *value = s_current->notify_value;
+            return pdFALSE;
+        }
+        s_current->state = TASK_WAIT_NOTIFY;
+        s_current->wake_us = deadline;
+        yield();
+    }
+    if (value != NULL) {
+        *value = s_current->notify_value;
+    }
+    s_current->notify_value &= ~clear_on_exit;
+    s_current->notified = false;
+    return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return calloc(1, sizeof(struct sim_mutex));
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks)
+{
+    isr_check("xSemaphoreTake");
+    const void *self = xTaskGetCurrentTaskHandle();
+    int64_t deadline = (ticks == portMAX_DELAY) ? SIM_NEVER : s_now_us + (int64_t)ticks * SIM_TICK_US;
+
+    while (mutex->owner != NULL) {
+        if (s_current == NULL || s_now_us >= deadline) {
+            return pdFALSE;
+        }
+        s_current->state = TASK_WAIT_MUTEX;
+        s_current->wait_on = mutex;
+        s_current->wake_us = deadline;
+        yield();
+    }
+    mutex->owner = self;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    if (mutex->owner != xTaskGetCurrentTaskHandle()) {
+        return pdFALSE;
+    }
+    mutex->owner = NULL;
+    for (int i = 0; i < s_task_count; i++) {
+        if (s_tasks[i].state == TASK_WAIT_MUTEX && s_tasks[i].wait_on == mutex) {
+            s_tasks[i].state = TASK_READY;
+            s_tasks[i].wake_us = s_now_us;
+        }
+    }
+    return pdTRUE;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct sim_event_group));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    group->bits |= bits;
+    for (int i = 0; i < s_task_count; i++) {
+        if (s_tasks[i].state == TASK_WAIT_BITS && s_tasks[i].wait_on == group) {
+            s_tasks[i].state = TASK_READY;
+            s_tasks[i].wake_us = s_now_us;
+        }
+    }
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+                                BaseType_t clear_on_exit, BaseType_t wait_for_all,
+                                TickType_t ticks)
+{
+    int64_t deadline = (ticks == portMAX_DELAY) ? SIM_NEVER : s_now_us + (int64_t)ticks * SIM_TICK_US;
+
+    for (;;) {
+        EventBits_t set = group->bits & bits;
+        if (wait_for_all ? set == bits : set != 0) {
+            EventBits_t value = group->bits;
+            if (clear_on_exit) {
+                group->bits &= ~bits;
+            }
+            return value;
+        }
+        if (s_current == NULL || s_now_us >= deadline) {
+            return group->bits;
+        }
+        s_current->state = TASK_WAIT_BITS;
+        s_current->wait_on = group;
+        s_current->wake_us = deadline;
+        yield();
+    }
+}
+
+/*============================================================================
+ * esp_timer
+ *============================================================================*/
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    if (args == NULL || args->callback == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_timer_count == SIM_MAX_TIMERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    struct esp_timer *t = &s_timers[s_timer_count++];
+    t->callback = args->callback;
+    t->arg = args->arg;
+    t->armed = false;
+    t->isr = (args->dispatch_method == ESP_TIMER_ISR);
+    *out = t;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = true;
+    timer->deadline_us = s_now_us + (int64_t)timeout_us;
+    timer->arm_seq = ++s_arm_seq;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->armed;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return s_now_us;
+}
+
+/*============================================================================
+ * GPIO
+ *============================================================================*/
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    if (config->pin_bit_mask == 0 || (config->pin_bit_mask >> GPIO_NUM_MAX) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (config->mode == GPIO_MODE_INPUT) {
+        for (int pin = 0; pin < GPIO_NUM_MAX; pin++) {
+            if (!(config->pin_bit_mask & (1ULL << pin))) continue;
+            s_gpio_level[pin] = (config->pull_up_en == GPIO_PULLUP_ENABLE) ? 1 : 0;
+            s_gpio_intr[pin] = config->intr_type;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    if (pin < 0 || pin >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int value = level ? 1 : 0;
+    if (s_gpio_fault_left > 0 && (s_gpio_fault_pins & (1ULL << pin))) {
+        s_gpio_fault_left--;
+        s_stats.gpio_failed++;
+        return s_gpio_fault_stuck ? ESP_OK : ESP_FAIL;
+    }
+    if (s_gpio_level[pin] != value) {
+        s_gpio_level[pin] = value;
+        s_stats.gpio_edges++;
+        sim_on_gpio(pin, value);
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin)
+{
+    return (pin >= 0 && pin < GPIO_NUM_MAX && s_gpio_level[pin] > 0) ? 1 : 0;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    (void)intr_alloc_flags;
+    if (s_isr_service) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_isr_service = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void *arg)
+{
+    if (!s_isr_service) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (pin < 0 || pin >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio_isr[pin] = handler;
+    s_gpio_isr_arg[pin] = arg;
+    return ESP_OK;
+}
+
+void sim_gpio_input(int pin, int level)
+{
+    int before = s_gpio_level[pin] > 0;
+    s_gpio_level[pin] = level ? 1 : 0;
+    if (before == s_gpio_level[pin] || s_gpio_isr[pin] == NULL) {
+        return;
+    }
+    gpio_int_type_t type = s_gpio_intr[pin];
+    if (type == GPIO_INTR_ANYEDGE || (type == GPIO_INTR_NEGEDGE && !level) ||
+        (type == GPIO_INTR_POSEDGE && level)) {
+        s_gpio_isr[pin](s_gpio_isr_arg[pin]);
+    }
+}
+
+/*============================================================================
+ * Heap
+ *============================================================================*/
+
+#define BLOCK_SIZE(b)       ((b)->size & ~1u)
+#define BLOCK_USED(b)       (((b)->size & 1u) != 0)
+
+static heap_block_t *block_at(size_t off)
+{
+    return (off < SIM_HEAP_SIZE) ? (heap_block_t *)(s_heap + off) : NULL;
+}
+
+static size_t block_off(const heap_block_t *b)
+{
+    return (size_t)((const uint8_t *)b - s_heap);
+}
+
+/**
+ * @brief Tell the block after b its new neighbour size
+ */
+static void link_next(heap_block_t *b)
+{
+    heap_block_t *next = block_at(block_off(b) + BLOCK_SIZE(b));
+    if (next != NULL) {
+        next->prev_size = BLOCK_SIZE(b);
+    }
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    size_t need = SIM_HEAP_HEADER + ((size + SIM_HEAP_ALIGN - 1) & ~(size_t)(SIM_HEAP_ALIGN - 1));
+    if (size == 0 || need > SIM_HEAP_SIZE) {
+        return NULL;
+    }
+
+    for (heap_block_t *b = block_at(0); b != NULL; b = block_at(block_off(b) + BLOCK_SIZE(b))) {
+        if (BLOCK_USED(b) || BLOCK_SIZE(b) < need) {
+            continue;
+        }
+        // Split unless the rest could not hold a header and one aligned unit
+        if (BLOCK_SIZE(b) - need >= SIM_HEAP_HEADER + SIM_HEAP_ALIGN) {
+            heap_block_t *rest = (heap_block_t *)((uint8_t *)b + need);
+            rest->size = (uint32_t)(BLOCK_SIZE(b) - need);
+            rest->prev_size = (uint32_t)need;
+            link_next(rest);
+            b->size = (uint32_t)need;
+            s_heap_free -= SIM_HEAP_HEADER;
+        }
+        s_heap_free -= BLOCK_SIZE(b) - SIM_HEAP_HEADER;
+        if (s_heap_free < s_heap_min_free) {
+            s_heap_min_free = s_heap_free;
+        }
+        b->size |= 1u;
+        return b + 1;
+    }
+    return NULL;
+}
+
+void heap_caps_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    heap_block_t *b = (heap_block_t *)ptr - 1;
+    b->size &= ~1u;
+    s_heap_free += BLOCK_SIZE(b) - SIM_HEAP_HEADER;
+
+    heap_block_t *next = block_at(block_off(b) + BLOCK_SIZE(b));
+    if (next != NULL && !BLOCK_USED(next)) {
+        b->size += BLOCK_SIZE(next);
+        s_heap_free += SIM_HEAP_HEADER;
+    }
+    if (b->prev_size != 0) {
+        heap_block_t *prev = block_at(block_off(b) - b->prev_size);
+        if (!BLOCK_USED(prev)) {
+            prev->size += BLOCK_SIZE(b);
+            s_heap_free += SIM_HEAP_HEADER;
+            b = prev;
+        }
+    }
+    link_next(b);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void)caps;
+    return s_heap_free;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return (uint32_t)s_heap_free;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    (void)caps;
+    return s_heap_min_free;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    (void)caps;
+    size_t largest = 0;
+    for (heap_block_t *b = block_at(0); b != NULL; b = block_at(block_off(b) + BLOCK_SIZE(b))) {
+        if (!BLOCK_USED(b) && BLOCK_SIZE(b) - SIM_HEAP_HEADER > largest) {
+            largest = BLOCK_SIZE(b) - SIM_HEAP_HEADER;
+        }
+    }
+    return largest;
+}
+
+/*============================================================================
+ * Partition and ROM CRC
+ *============================================================================*/
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    if (type != s_pfail_part.type || subtype != s_pfail_part.subtype ||
+        (label != NULL && strcmp(label, s_pfail_part.label) != 0)) {
+        return NULL;
+    }
+    return &s_pfail_part;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    if (part != &s_pfail_part || offset + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t *out = dst;
+    for (size_t i = 0; i < size; i++) {
+        out[i] = (uint8_t)~s_flash->part[offset + i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    if (part != &s_pfail_part || offset + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Lands when the program completes; a power cut before that loses it
+    if (s_current != NULL) {
+        sim_sleep_until(s_now_us + SIM_FLASH_PROGRAM_US);
+    }
+    const uint8_t *in = src;
+    for (size_t i = 0; i < size; i++) {
+        s_flash->part[offset + i] |= (uint8_t)~in[i];       // Programming only clears bits
+    }
+    s_stats.flash_writes++;
+    sim_on_flash(part->label, offset, size, false);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if (part != &s_pfail_part || offset + size > part->size ||
+        offset % part->erase_size != 0 || size % part->erase_size != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_current != NULL) {
+        sim_sleep_until(s_now_us + SIM_FLASH_ERASE_US * (int64_t)(size / part->erase_size));
+    }
+    memset(s_flash->part + offset, 0, size);
+    s_stats.flash_erases++;
+    sim_on_flash(part->label, offset, size, true);
+    return ESP_OK;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+/*============================================================================
+ * NVS
+ *============================================================================*/
+
+static nvs_entry_t *nvs_find(int ns, const char *key)
+{
+    for (int i = 0; i < NVS_MAX_ENTRIES; i++) {
+        nvs_entry_t *e = &s_flash->entries[i];
+        if (e->used && e->ns == ns && strcmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Track keys whose flash value is not what the firmware last wrote
+ */
+static void nvs_mark(int ns, const char *key, bool stale)
+{
+    for (int i = 0; i < s_flash->stale_count; i++) {
+        nvs_key_t *k = &s_flash->stale[i];
+        if (k->ns == ns && strcmp(k->key, key) == 0) {
+            if (!stale) {
+                *k = s_flash->stale[--s_flash->stale_count];
+            }
+            return;
+        }
+    }
+    if (stale && s_flash->stale_count < NVS_MAX_STALE) {
+        nvs_key_t *k = &s_flash->stale[s_flash->stale_count++];
+        k->ns = ns;
+        strcpy(k->key, key);
+    }
+}
+
+/**
+ * @brief Injected write failure, if one is due
+ */
+static esp_err_t nvs_fault(void)
+{
+    if (s_flash->full) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    if (s_flash->fail_left > 0) {
+        s_flash->fail_left--;
+        return s_flash->fail_err;
+    }
+    return ESP_OK;
+}
+
+static int nvs_writable(nvs_handle_t handle, const char *key, esp_err_t *ret)
+{
+    int ns = (int)(handle & 0xff) - 1;
+    if (ns < 0 || ns >= s_flash->ns_count) {
+        *ret = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (handle & NVS_HANDLE_RO) {
+        *ret = ESP_ERR_NVS_READ_ONLY;
+    } else if (strlen(key) > NVS_KEY_MAX) {
+        *ret = ESP_ERR_NVS_KEY_TOO_LONG;
+    } else if ((*ret = nvs_fault()) != ESP_OK) {
+        s_stats.nvs_failed++;
+        nvs_mark(ns, key, true);
+    }
+    return ns;
+}
+
+static esp_err_t nvs_write(nvs_handle_t handle, const char *key, uint8_t type,
+                           const void *data, size_t len)
+{
+    isr_check("nvs_set");
+    esp_err_t ret;
+    int ns = nvs_writable(handle, key, &ret);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (len > NVS_MAX_VALUE) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    nvs_entry_t *e = nvs_find(ns, key);
+    nvs_mark(ns, key, false);
+    if (e != NULL && e->type == type && e->len == len && memcmp(e->data, data, len) == 0) {
+        s_stats.nvs_unchanged++;
+        return ESP_OK;
+    }
+    if (e == NULL) {
+        for (int i = 0; i < NVS_MAX_ENTRIES && e == NULL; i++) {
+            if (!s_flash->entries[i].used) e = &s_flash->entries[i];
+        }
+        if (e == NULL) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        e->used = true;
+        e->ns = ns;
+        strcpy(e->key, key);
+    }
+    e->type = type;
+    e->len = len;
+    memcpy(e->data, data, len);
+    s_stats.nvs_writes++;
+    sim_on_nvs(s_flash->ns[ns], key, data, len);
+    cache_stall();
+    return ESP_OK;
+}
+
+static esp_err_t nvs_read(nvs_handle_t handle, const char *key, uint8_t type, nvs_entry_t **out)
+{
+    int ns = (int)(handle & 0xff) - 1;
+    if (ns < 0 || ns >= s_flash->ns_count) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    nvs_entry_t *e = nvs_find(ns, key);
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (e->type != type) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    *out = e;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    // A partition without a free page cannot take the next write
+    return s_flash->full ? ESP_ERR_NVS_NO_FREE_PAGES : ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(s_flash, 0, offsetof(sim_flash_t, part));
+    s_stats.nvs_writes++;
+    sim_on_nvs("*", "*", NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out)
+{
+    int ns = 0;
+    while (ns < s_flash->ns_count && strcmp(s_flash->ns[ns], name) != 0) ns++;
+
+    if (ns == s_flash->ns_count) {
+        // A namespace exists once something opened it for writing
+        if (mode == NVS_READONLY) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        if (ns == NVS_MAX_NAMESPACES || strlen(name) > NVS_KEY_MAX || s_flash->full) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        strcpy(s_flash->ns[s_flash->ns_count++], name);
+    }
+    *out = (nvs_handle_t)(ns + 1) | (mode == NVS_READONLY ? NVS_HANDLE_RO : 0);
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return nvs_write(handle, key, 1, &value, 1);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out)
+{
+    nvs_entry_t *e;
+    esp_err_t ret = nvs_read(handle, key, 1, &e);
+    if (ret == ESP_OK) {
+        *out = e->data[0];
+    }
+    return ret;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len)
+{
+    return nvs_write(handle, key, 2, value, len);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *len)
+{
+    nvs_entry_t *e;
+    esp_err_t ret = nvs_read(handle, key, 2, &e);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (out == NULL) {
+        *len = e->len;
+        return ESP_OK;
+    }
+    if (*len < e->len) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, e->data, e->len);
+    *len = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    isr_check("nvs_erase_key");
+    esp_err_t ret;
+    int ns = nvs_writable(handle, key, &ret);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    nvs_mark(ns, key, false);
+    nvs_entry_t *e = nvs_find(ns, key);
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    e->used = false;
+    s_stats.nvs_writes++;
+    sim_on_nvs(s_flash->ns[ns], key, NULL, 0);
+    cache_stall();
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+size_t sim_flash_size(void)
+{
+    return sizeof(sim_flash_t);
+}
+
+void sim_flash_attach(void *mem)
+{
+    s_flash = mem;
+}
+
+/*============================================================================
+ * Event loop and WiFi station
+ *============================================================================*/
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+static void post_event(event_kind_t kind, esp_event_base_t base, int32_t id, int64_t delay_us)
+{
+    if (s_event_count == SIM_MAX_EVENTS) {
+        sim_log('E', "event", "Event queue full, dropping %s %ld", base ? base : "-", (long)id);
+        return;
+    }
+    sim_event_t *e = &s_events[s_event_count++];
+    memset(e, 0, sizeof(*e));
+    e->deliver_us = s_now_us + delay_us;
+    e->seq = ++s_event_seq;
+    e->kind = kind;
+    e->base = base;
+    e->id = id;
+}
+
+static void dispatch(esp_event_base_t base, int32_t id, void *data)
+{
+    s_stats.wifi_events++;
+    for (int i = 0; i < s_handler_count; i++) {
+        const event_handler_t *h = &s_handlers[i];
+        if (h->base == base && (h->id == ESP_EVENT_ANY_ID || h->id == id)) {
+            h->handler(h->arg, base, id, data);
+        }
+    }
+}
+
+static bool ap_reachable(int ap)
+{
+    return ap >= 0 && s_ap_up && s_aps[ap].on;
+}
+
+/**
+ * @brief AP esp_wifi_connect() would join, -1 if none is up
+ */
+static int pick_ap(void)
+{
+    const wifi_sta_config_t *sta = &s_sta_config.sta;
+    bool by_signal = sta->scan_method == WIFI_ALL_CHANNEL_SCAN &&
+                     sta->sort_method == WIFI_CONNECT_AP_BY_SIGNAL;
+    int best = -1;
+
+    for (int i = 0; i < SIM_WIFI_APS; i++) {
+        if (!ap_reachable(i) || (sta->bssid_set && memcmp(sta->bssid, s_aps[i].bssid, 6) != 0)) {
+            continue;
+        }
+        // A fast scan stops at the first AP it finds, going up the channels
+        if (best < 0 || (by_signal ? s_aps[i].rssi > s_aps[best].rssi
+                                   : s_aps[i].channel < s_aps[best].channel)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Fire the armed RSSI threshold event if the joined AP is below it
+ */
+static void rssi_check(void)
+{
+    if (s_rssi_armed && s_link_up && s_aps[s_ap].rssi < s_rssi_threshold) {
+        s_rssi_armed = false;
+        post_event(EV_POST, WIFI_EVENT, WIFI_EVENT_STA_BSS_RSSI_LOW, 0);
+    }
+}
+
+static void beacon_check(void)
+{
+    if (s_link_up && !ap_reachable(s_ap)) {
+        post_event(EV_BEACON_LOST, NULL, 0, SIM_WIFI_BEACON_TIMEOUT_US);
+    }
+}
+
+static void scan_done(uint8_t channel)
+{
+    s_scanning = false;
+    s_scan_count = 0;
+    for (int i = 0; i < SIM_WIFI_APS; i++) {
+        if (ap_reachable(i) && (channel == 0 || s_aps[i].channel == channel)) {
+            wifi_ap_record_t *r = &s_scan_result[s_scan_count++];
+            memset(r, 0, sizeof(*r));
+            memcpy(r->bssid, s_aps[i].bssid, 6);
+            memcpy(r->ssid, s_sta_config.sta.ssid, sizeof(s_sta_config.sta.ssid));
+            r->primary = s_aps[i].channel;
+            r->rssi = s_aps[i].rssi;
+        }
+    }
+    dispatch(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, NULL);
+}
+
+static void event_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        sim_event_t *next = earliest_event();
+        if (next == NULL || next->deliver_us > s_now_us) {
+            s_current->state = TASK_WAIT_EVENTS;
+            yield();
+            continue;
+        }
+        sim_event_t e = *next;
+        *next = s_events[--s_event_count];
+
+        switch (e.kind) {
+        case EV_POST:
+            dispatch(e.base, e.id, NULL);
+            break;
+        case EV_JOIN_DONE:
+            s_joining = false;
+            if (!s_wifi_started) {
+                break;
+            }
+            // Joins only if the access point was there for the whole attempt
+            if (ap_reachable(e.id - 1)) {
+                ip_event_got_ip_t got = { .ip_info = s_ip_info };
+                s_ap = e.id - 1;
+                s_link_up = true;
+                dispatch(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, NULL);
+                dispatch(IP_EVENT, IP_EVENT_STA_GOT_IP, &got);
+            } else {
+                dispatch(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, NULL);
+            }
+            break;
+        case EV_BEACON_LOST:
+            if (s_link_up && !ap_reachable(s_ap)) {
+                s_link_up = false;
+                dispatch(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, NULL);
+            }
+            break;
+        case EV_SCAN_DONE:
+            scan_done((uint8_t)e.id);
+            break;
+        }
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (s_event_task != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_event_task = sim_task_create("sys_evt", SIM_PRIO_EVENT, event_task, NULL);
+    return s_event_task ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id,
+                                              esp_event_handler_t handler, void *arg,
+                                              esp_event_handler_instance_t *instance)
+{
+    if (s_handler_count == SIM_MAX_HANDLERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_handlers[s_handler_count++] = (event_handler_t){ base, id, handler, arg };
+    if (instance != NULL) {
+        *instance = &s_handlers[s_handler_count - 1];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    return (esp_netif_t *)&s_ip_info;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *netif)
+{
+    (void)netif;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *netif, const esp_netif_ip_info_t *info)
+{
+    (void)netif;
+    s_ip_info = *info;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *netif, esp_netif_ip_info_t *info)
+{
+    (void)netif;
+    *info = s_ip_info;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type,
+                                 esp_netif_dns_info_t *dns)
+{
+    (void)netif;
+    (void)type;
+    (void)dns;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+uint32_t esp_ip4addr_aton(const char *addr)
+{
+    unsigned a = 0, b = 0, c = 0, d = 0;
+    if (sscanf(addr, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) {
+        return 0;
+    }
+    return (a & 0xff) | (b & 0xff) << 8 | (c & 0xff) << 16 | (uint32_t)(d & 0xff) << 24;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t iface, wifi_config_t *config)
+{
+    (void)iface;
+    s_sta_config = *config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t iface, wifi_config_t *config)
+{
+    (void)iface;
+    *config = s_sta_config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    if (!s_wifi_started) {
+        s_wifi_started = true;
+        post_event(EV_POST, WIFI_EVENT, WIFI_EVENT_STA_START, 0);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    s_wifi_started = false;
+    s_link_up = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    if (!s_wifi_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_joining) {
+        return ESP_OK;
+    }
+    const wifi_sta_config_t *sta = &s_sta_config.sta;
+    if (s_link_up) {
+        // A new BSSID while linked: leave the AP and join that one (a roam)
+        if (!sta->bssid_set || memcmp(sta->bssid, s_aps[s_ap].bssid, 6) == 0) {
+            return ESP_OK;
+        }
+        s_link_up = false;
+        post_event(EV_POST, WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, 0);
+    }
+
+    int ap = pick_ap();
+    int64_t t_us = (ap < 0) ? SIM_WIFI_NO_AP_US :
+                   (sta->bssid_set && sta->channel != 0) ? SIM_WIFI_REASSOC_US : SIM_WIFI_JOIN_US;
+    s_joining = true;
+    post_event(EV_JOIN_DONE, NULL, ap + 1, t_us);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    if (s_link_up) {
+        s_link_up = false;
+        post_event(EV_POST, WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, 0);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *info)
+{
+    if (!s_link_up) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memset(info, 0, sizeof(*info));
+    memcpy(info->bssid, s_aps[s_ap].bssid, 6);
+    memcpy(info->ssid, s_sta_config.sta.ssid, sizeof(s_sta_config.sta.ssid));
+    info->primary = s_aps[s_ap].channel;
+    info->rssi = s_aps[s_ap].rssi;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_rssi_threshold(int32_t rssi)
+{
+    s_rssi_threshold = rssi;
+    s_rssi_armed = true;
+    rssi_check();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    s_ps = type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *type)
+{
+    *type = s_ps;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_max_tx_power(int8_t power)
+{
+    if (!s_wifi_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // The ESP32 range, 2 to 20 dBm
+    s_tx_power = power < 8 ? 8 : power > 80 ? 80 : power;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_max_tx_power(int8_t *power)
+{
+    *power = s_tx_power;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block)
+{
+    (void)block;
+    if (!s_wifi_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_scanning || s_joining) {
+        return ESP_FAIL;
+    }
+    uint8_t channel = config ? config->channel : 0;
+    int64_t dwell = (config && config->scan_time.active.max) ?
+                    (int64_t)config->scan_time.active.max * 1000 : SIM_WIFI_SCAN_DWELL_US;
+    int64_t per_channel = dwell + (s_link_up ? SIM_WIFI_HOME_US : 0);
+    s_scanning = true;
+    post_event(EV_SCAN_DONE, NULL, channel, (channel ? 1 : SIM_WIFI_CHANNELS) * per_channel);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *number)
+{
+    *number = s_scan_count;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *records)
+{
+    if (*number > s_scan_count) {
+        *number = s_scan_count;
+    }
+    memcpy(records, s_scan_result, *number * sizeof(*records));
+    s_scan_count = 0;
+    return ESP_OK;
+}
+
+/*============================================================================
+ * Fault injection
+ *============================================================================*/
+
+void sim_fault_nvs_fail(int count, esp_err_t err)
+{
+    s_flash->fail_left = count;
+    s_flash->fail_err = err;
+}
+
+void sim_fault_nvs_full(void)
+{
+    s_flash->full = true;
+}
+
+bool sim_nvs_faulty(void)
+{
+    return s_flash->full || s_flash->fail_left > 0;
+}
+
+int sim_nvs_stale(void)
+{
+    return s_flash->stale_count;
+}
+
+void sim_fault_gpio(uint64_t pins, int count, bool stuck)
+{
+    s_gpio_fault_pins = pins;
+    s_gpio_fault_left = count;
+    s_gpio_fault_stuck = stuck;
+}
+
+bool sim_gpio_faulty(void)
+{
+    return s_gpio_fault_left > 0;
+}
+
+void sim_wifi_set_ap(bool up)
+{
+    if (s_ap_up == up) {
+        return;
+    }
+    s_ap_up = up;
+    if (!up) {
+        beacon_check();
+    }
+}
+
+void sim_wifi_set_ap_signal(int ap, bool on, int rssi)
+{
+    bool was_on = s_aps[ap].on;
+    s_aps[ap].on = on;
+    if (on) {
+        s_aps[ap].rssi = (int8_t)rssi;
+    }
+    if (was_on && !on && ap == s_ap) {
+        beacon_check();
+    }
+    rssi_check();
+}
+
+int sim_wifi_ap_rssi(int ap)
+{
+    return ap_reachable(ap) ? s_aps[ap].rssi : 0;
+}
+
+int sim_wifi_current_ap(void)
+{
+    return s_link_up ? s_ap : -1;
+}
+
+bool sim_wifi_ap_up(void)
+{
+    return s_ap_up;
+}
+
+bool sim_wifi_link_up(void)
+{
+    return s_link_up && ap_reachable(s_ap);
+}
+
+/*============================================================================
+ * Logging and errors
+ *============================================================================*/
+
+void sim_log(char level, const char *tag, const char *fmt, ...)
+{
+    isr_check("ESP_LOG");
+    int rank = (level == 'E' || level == 'W' || level == 'I') ? 1 : 2;
+    if (rank > s_verbosity) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%c (%lld) %s: ", level, (long long)(s_now_us / 1000), tag);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:                        return "ESP_OK";
+    case ESP_FAIL:                      return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:                return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:           return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:         return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:          return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:             return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:         return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:               return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:      return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:           return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_NOT_ALLOWED:           return "ESP_ERR_NOT_ALLOWED";
+    case ESP_ERR_NVS_NOT_FOUND:         return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_TYPE_MISMATCH:     return "ESP_ERR_NVS_TYPE_MISMATCH";
+    case ESP_ERR_NVS_READ_ONLY:         return "ESP_ERR_NVS_READ_ONLY";
+    case ESP_ERR_NVS_NOT_ENOUGH_SPACE:  return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+    case ESP_ERR_NVS_INVALID_HANDLE:    return "ESP_ERR_NVS_INVALID_HANDLE";
+    case ESP_ERR_NVS_KEY_TOO_LONG:      return "ESP_ERR_NVS_KEY_TOO_LONG";
+    case ESP_ERR_NVS_INVALID_LENGTH:    return "ESP_ERR_NVS_INVALID_LENGTH";
+    case ESP_ERR_NVS_NO_FREE_PAGES:     return "ESP_ERR_NVS_NO_FREE_PAGES";
+    case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+    default:                            return "UNKNOWN ERROR";
+    }
+}
+
+/**
+ * @brief End the boot; RTC memory survives unless the power went
+ */
+static void __attribute__((noreturn)) reset(bool keep_rtc)
+{
+    size_t rtc_len = (size_t)(__stop_rtc_noinit - __start_rtc_noinit);
+    if (keep_rtc && rtc_len > 0 && rtc_len <= SIM_RTC_SIZE) {
+        memcpy(s_flash->rtc, __start_rtc_noinit, rtc_len);
+    } else {
+        memset(s_flash->rtc, 0, sizeof(s_flash->rtc));
+    }
+    sim_on_restart();
+}
+
+void sim_error_check_failed(esp_err_t code, const char *file, int line, const char *expr)
+{
+    // The device panics and reboots (no shutdown handlers); so does the simulation
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d: %s\n",
+            code, esp_err_to_name(code), file, line, expr);
+    reset(true);
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler)
+{
+    for (int i = 0; i < s_shutdown_count; i++) {
+        if (s_shutdown_handlers[i] == handler) return ESP_ERR_INVALID_STATE;
+    }
+    if (s_shutdown_count == SIM_MAX_SHUTDOWN_HANDLERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_shutdown_handlers[s_shutdown_count++] = handler;
+    return ESP_OK;
+}
+
+void esp_restart(void)
+{
+    for (int i = s_shutdown_count - 1; i >= 0; i--) {
+        s_shutdown_handlers[i]();
+    }
+    reset(true);
+}
+
+void sim_power_off(void)
+{
+    reset(false);
+}
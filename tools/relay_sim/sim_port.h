@@ -0,0 +1,294 @@
+/**
+ * @file sim_port.h
+ * @brief Virtual-clock runtime behind the simulator's ESP-IDF port
+ *
+ * Simulated tasks are coroutines. The scheduler always resumes the task
+ * with the earliest wake time (higher priority first on a tie) and moves
+ * the clock straight to it, so idle time costs nothing and a run is fully
+ * deterministic. Code between two blocking calls takes no virtual time.
+ */
+
+#ifndef SIM_PORT_H
+#define SIM_PORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/select.h>
+#include "esp_err.h"
+#include "thermostat.h"           // thermo_sensor_t for the simulated room
+
+#define SIM_NEVER           INT64_MAX
+#define SIM_WIFI_APS        2           // Access points of the SSID
+
+// Priorities of the simulated tasks (as configured on the device)
+#define SIM_PRIO_TIMER      22          // esp_timer task
+#define SIM_PRIO_EVENT      20          // sys_evt (default event loop)
+#define SIM_PRIO_HTTPD      5           // HTTP_TASK_PRIORITY
+#define SIM_PRIO_MAIN       1           // app_main
+
+typedef struct sim_task sim_task_t;
+
+/**
+ * @brief Run counters
+ */
+typedef struct {
+    uint64_t switches;          // Task resumptions
+    uint64_t timer_callbacks;
+    int64_t timer_late_max_us;  // Worst callback start after its deadline
+    uint64_t gpio_edges;
+    uint64_t gpio_failed;       // Output writes refused or dropped by a fault
+    uint64_t nvs_writes;        // Sets and erases that changed flash
+    uint64_t nvs_unchanged;     // Sets skipped because the value was equal
+    uint64_t nvs_failed;        // Writes refused by an injected fault
+    uint64_t wifi_events;       // Events delivered to handlers
+    uint64_t flash_writes;      // Partition programs (power-fail records)
+    uint64_t flash_erases;      // Partition erase calls
+    uint64_t cache_stalls;      // NVS writes that turned the flash cache off
+} sim_stats_t;
+
+/**
+ * @brief Set the clock and create the esp_timer task
+ *
+ * @param boot_us Virtual time the boot starts at (0, or after a restart)
+ */
+void sim_init(int64_t boot_us);
+
+/**
+ * @brief Create a simulated task, ready at the current time
+ */
+sim_task_t *sim_task_create(const char *name, int priority, void (*fn)(void *), void *arg);
+
+/**
+ * @brief Run tasks until none can make progress or the end time is reached
+ *
+ * @param end_us Virtual time to stop at (SIM_NEVER to run until idle)
+ */
+void sim_run(int64_t end_us);
+
+/**
+ * @brief Let the run end while the calling task still has work
+ *
+ * sim_run() returns once only background tasks can make progress, so
+ * endless monitor loops do not keep it going.
+ */
+void sim_set_background(void);
+
+/**
+ * @brief Current virtual time in microseconds since the first boot
+ */
+int64_t sim_now(void);
+
+/**
+ * @brief Block the calling task until a virtual time (no tick rounding)
+ */
+void sim_sleep_until(int64_t t_us);
+
+/**
+ * @brief Firmware log verbosity on stderr (0 none, 1 info, 2 debug)
+ */
+void sim_set_verbosity(int level);
+
+/**
+ * @brief Model the flash cache being off for us after each NVS write that
+ *        changes flash (0, the default, leaves it out)
+ *
+ * The writing task sleeps through it and no other task runs until it
+ * ends; ESP_TIMER_ISR callbacks still fire on time.
+ */
+void sim_set_cache_stall(int64_t us);
+
+/**
+ * @brief Let the clock follow the wall clock from now on (host builds that
+ *        serve real sockets)
+ *
+ * The scheduler then sleeps until the next wake time instead of jumping
+ * to it, and wakes early for a socket that a task waits on in select().
+ * A run is no longer deterministic.
+ */
+void sim_set_realtime(bool on);
+
+/**
+ * @brief select() for simulated tasks (lwip/sockets.h maps it here)
+ *
+ * Blocks the calling task, not the process, until a descriptor is ready
+ * or the timeout has passed on the simulated clock.
+ */
+int sim_select(int nfds, fd_set *rd, fd_set *wr, fd_set *ex, struct timeval *timeout);
+
+const sim_stats_t *sim_get_stats(void);
+
+/*============================================================================
+ * esp_http_server stand-in (sim_httpd.c)
+ *============================================================================*/
+
+/**
+ * @brief Listen on this port instead of the configured one (0: configured)
+ */
+void sim_httpd_set_port(uint16_t port);
+
+/**
+ * @brief Time each request takes in the server task before its handler
+ *        runs (0 by default)
+ */
+void sim_httpd_set_service_time(int64_t us);
+
+/*============================================================================
+ * Simulated room for the thermostat (sim_room.c)
+ *
+ * A temperature source for thermostat_init() in host builds: the room
+ * gains heat at a constant rate and each fan stage whose relay output is
+ * driven ON removes heat. The outputs are read from the GPIO levels, so a
+ * write the relay service refused cools nothing.
+ *============================================================================*/
+
+/**
+ * @brief The room as a thermostat sensor
+ */
+const thermo_sensor_t *sim_room_sensor(void);
+
+/**
+ * @brief Set the temperature and the heat balance
+ *
+ * @param temp_c Room temperature now
+ * @param heat_c_per_s Constant heat load
+ * @param cool_c_per_s Heat removed per running fan stage
+ */
+void sim_room_set(float temp_c, float heat_c_per_s, float cool_c_per_s);
+
+/**
+ * @brief Fail the next count reads (sensor fault)
+ */
+void sim_room_fail_reads(int count);
+
+/*============================================================================
+ * Flash and RTC memory that survive a restart
+ *
+ * esp_restart() ends the boot through sim_on_restart(). The front end runs
+ * each boot in a fresh process so firmware statics start clean, and keeps
+ * the flash in memory shared between them. RTC_NOINIT_ATTR variables are
+ * saved there too by esp_restart() and by a failed ESP_ERROR_CHECK, and
+ * cleared by sim_power_off().
+ *============================================================================*/
+
+size_t sim_flash_size(void);
+
+/**
+ * @brief Keep NVS, partition and RTC contents in caller memory (zeroed
+ *        memory is erased flash and cleared RTC memory)
+ */
+void sim_flash_attach(void *mem);
+
+/**
+ * @brief Cut the power: end the boot without shutdown handlers, losing RTC memory
+ */
+void sim_power_off(void) __attribute__((noreturn));
+
+/*============================================================================
+ * Fault injection
+ *============================================================================*/
+
+/**
+ * @brief Fail the next count NVS writes with err
+ */
+void sim_fault_nvs_fail(int count, esp_err_t err);
+
+/**
+ * @brief Refuse every NVS write until the partition is erased
+ *
+ * nvs_flash_init() reports ESP_ERR_NVS_NO_FREE_PAGES meanwhile, as it does
+ * for a partition without a free page.
+ */
+void sim_fault_nvs_full(void);
+
+/**
+ * @brief True while injected NVS faults are pending
+ */
+bool sim_nvs_faulty(void);
+
+/**
+ * @brief Number of keys whose last write failed, so flash holds an old value
+ */
+int sim_nvs_stale(void);
+
+/**
+ * @brief Break the next count gpio_set_level() calls on the given pins
+ *
+ * @param pins Bit N selects GPIO N
+ * @param stuck false: the call returns ESP_FAIL and the pin keeps its level;
+ *        true: the call returns ESP_OK but the pin still keeps its level, so
+ *        only a read-back notices
+ */
+void sim_fault_gpio(uint64_t pins, int count, bool stuck);
+
+/**
+ * @brief True while injected GPIO faults are pending
+ */
+bool sim_gpio_faulty(void);
+
+/**
+ * @brief Switch all access points off or on
+ */
+void sim_wifi_set_ap(bool up);
+
+bool sim_wifi_ap_up(void);
+
+/**
+ * @brief Switch one access point off, or on with a signal level
+ *
+ * @param ap Index, 0 .. SIM_WIFI_APS - 1 (AP 0 starts on at -55 dBm)
+ * @param rssi dBm as heard by the station
+ */
+void sim_wifi_set_ap_signal(int ap, bool on, int rssi);
+
+/**
+ * @brief Signal of an access point, 0 if it is off
+ */
+int sim_wifi_ap_rssi(int ap);
+
+/**
+ * @brief Access point the station is joined to, -1 if none
+ */
+int sim_wifi_current_ap(void);
+
+/**
+ * @brief True while the station holds an address on a live access point
+ */
+bool sim_wifi_link_up(void);
+
+/**
+ * @brief Drive a GPIO input; an armed edge interrupt runs in the caller
+ */
+void sim_gpio_input(int pin, int level);
+
+/*============================================================================
+ * Hooks implemented by the simulator front end
+ *============================================================================*/
+
+/**
+ * @brief A GPIO output changed level
+ */
+void sim_on_gpio(int pin, int level);
+
+/**
+ * @brief An NVS value was written (len 0: erased)
+ */
+void sim_on_nvs(const char *ns, const char *key, const void *data, size_t len);
+
+/**
+ * @brief A partition range was programmed or erased
+ */
+void sim_on_flash(const char *label, size_t offset, size_t len, bool erase);
+
+/**
+ * @brief A task has just blocked or an ISR timer callback returned; called
+ *        from the scheduler
+ */
+void sim_on_step(void);
+
+/**
+ * @brief esp_restart() was called; must not return
+ */
+void sim_on_restart(void) __attribute__((noreturn));
+
+#endif // SIM_PORT_H
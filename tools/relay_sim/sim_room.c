@@ -0,0 +1,62 @@
+/**
+ * @file sim_room.c
+ * @brief Simulated room for the thermostat in host builds
+ *
+ * Each read advances the room by one THERMO_PERIOD_MS: constant heat load
+ * in, heat out per fan stage whose relay output is ON. The outputs come
+ * from the GPIO levels (RELAY_ACTIVE_LOW), not from the relay
+ * states, so the room only cools if the write reached the pins.
+ */
+
+#include "sim_port.h"
+#include "relay_service.h"
+#include "config.h"
+#include "driver/gpio.h"
+
+static float s_temp_c = 24.0f;
+static float s_heat_c_per_s = 0.02f;
+static float s_cool_c_per_s = 0.03f;
+static int s_fail_reads = 0;
+
+static bool output_on(uint8_t relay_id)
+{
+    return gpio_get_level(relay_get_info(relay_id)->gpio_pin) == (RELAY_ACTIVE_LOW ? 0 : 1);
+}
+
+static esp_err_t room_read(void *ctx, float *temp_c)
+{
+    (void)ctx;
+    const float dt = THERMO_PERIOD_MS / 1000.0f;
+    int running = output_on(THERMO_STAGE1_RELAY) + output_on(THERMO_STAGE2_RELAY);
+
+    s_temp_c += (s_heat_c_per_s - s_cool_c_per_s * running) * dt;
+    if (s_fail_reads > 0) {
+        s_fail_reads--;
+        return ESP_ERR_TIMEOUT;
+    }
+    *temp_c = s_temp_c;
+    return ESP_OK;
+}
+
+static const thermo_sensor_t s_room = {
+    .name = "simulated",
+    .read = room_read,
+    .ctx = NULL
+};
+
+const thermo_sensor_t *sim_room_sensor(void)
+{
+    return &s_room;
+}
+
+void sim_room_set(float temp_c, float heat_c_per_s, float cool_c_per_s)
+{
+    s_temp_c = temp_c;
+    s_heat_c_per_s = heat_c_per_s;
+    s_cool_c_per_s = cool_c_per_s;
+}
+
+void sim_room_fail_reads(int count)
+{
+    s_fail_reads = count;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file solar_test.c
+ * @brief Host test of solar_compute_day() against reference sun times
+ *
+ * Checks sunrise and sunset for fixed dates and locations against times
+ * from the NOAA solar calculator, within TOLERANCE_MIN. The cases cover
+ * both solstices and an equinox, a leap day, the southern hemisphere, a
+ * sunset after local midnight, polar day and polar night in both
+ * hemispheres, and the first sunrise after a polar night.
+ *
+ * solar_schedule.c is linked with the simulator port only for its other
+ * functions; no simulated task runs. Prints one line per case and exits
+ * 1 if any failed.
+ *
+ * Build and run (from the repository root):
+ *   gcc -O2 -Itools/relay_sim/port -Itools/relay_sim -Iinclude -o solar_test \
+ *       tools/relay_sim/solar_test.c tools/relay_sim/sim_port.c \
+ *       src/solar_schedule.c src/relay_service.c src/powerfail.c \
+ *       src/block_pool.c -lm
+ *   ./solar_test
+ */
+
+#include "sim_port.h"
+#include "solar_schedule.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TOLERANCE_MIN       2
+#define NONE                -1          // No such event (polar day/night)
+
+typedef struct {
+    const char *name;
+    int yday;                   // 0 = January 1st
+    int year;
+    double lat;
+    double lon;
+    int utc_offset_min;
+    int sunrise_min;            // Reference, local time
+    int sunset_min;
+} solar_case_t;
+
+static const solar_case_t s_cases[] = {
+    { "London, 2024-06-21",    172, 2024,  51.5074,  -0.1278,   60,  283, 1282 },
+    { "New York, 2024-12-21",  355, 2024,  40.7128, -74.0060, -300,  437,  992 },
+    { "Quito, 2024-03-20",      79, 2024,  -0.1807, -78.4678, -300,  378, 1104 },
+    { "Sydney, 2024-12-21",    355, 2024, -33.8688, 151.2093,  660,  341, 1206 },
+    { "Berlin, 2024-02-29",     59, 2024,  52.5200,  13.4050,   60,  414, 1064 },
+    { "Reykjavik, 2024-06-21", 172, 2024,  64.1466, -21.9426,    0,  175,    4 },
+    { "Tromso, 2024-06-21",    172, 2024,  69.6492,  18.9553,  120, NONE, NONE },
+    { "Tromso, 2024-12-21",    355, 2024,  69.6492,  18.9553,   60, NONE, NONE },
+    { "Tromso, 2025-01-20",     19, 2025,  69.6492,  18.9553,   60,  634,  797 },
+    { "McMurdo, 2025-12-21",   354, 2025, -77.8500, 166.6700,  780, NONE, NONE },
+    { "McMurdo, 2025-06-21",   171, 2025, -77.8500, 166.6700,  720, NONE, NONE },
+};
+
+/*============================================================================
+ * Simulator hooks (unused: no task runs)
+ *============================================================================*/
+
+void sim_on_gpio(int pin, int level)
+{
+    (void)pin; (void)level;
+}
+
+void sim_on_nvs(const char *ns, const char *key, const void *data, size_t len)
+{
+    (void)ns; (void)key; (void)data; (void)len;
+}
+
+void sim_on_flash(const char *label, size_t offset, size_t len, bool erase)
+{
+    (void)label; (void)offset; (void)len; (void)erase;
+}
+
+void sim_on_step(void)
+{
+}
+
+void sim_on_restart(void)
+{
+    exit(1);
+}
+
+/*============================================================================
+ * Test
+ *============================================================================*/
+
+/**
+ * @brief Minutes between two times of day, across midnight
+ */
+static int minutes_apart(int a, int b)
+{
+    int d = abs(a - b) % 1440;
+    return d > 720 ? 1440 - d : d;
+}
+
+static bool event_ok(int got, int want)
+{
+    if (want == NONE || got == NONE) return got == want;
+    return minutes_apart(got, want) <= TOLERANCE_MIN;
+}
+
+static void format(char *buf, size_t len, int minutes)
+{
+    if (minutes == NONE) {
+        snprintf(buf, len, "--:--");
+    } else {
+        snprintf(buf, len, "%02d:%02d", minutes / 60, minutes % 60);
+    }
+}
+
+int main(void)
+{
+    int failures = 0;
+    int count = sizeof(s_cases) / sizeof(s_cases[0]);
+
+    for (int i = 0; i < count; i++) {
+        const solar_case_t *c = &s_cases[i];
+        solar_day_t day;
+        solar_compute_day(c->yday, c->year, c->lat, c->lon, c->utc_offset_min, &day);
+
+        bool ok = event_ok(day.sunrise_min, c->sunrise_min) &&
+                  event_ok(day.sunset_min, c->sunset_min);
+        char rise[16], set[16], want_rise[16], want_set[16];
+        format(rise, sizeof(rise), day.sunrise_min);
+        format(set, sizeof(set), day.sunset_min);
+        format(want_rise, sizeof(want_rise), c->sunrise_min);
+        format(want_set, sizeof(want_set), c->sunset_min);
+        printf("%-24s %-4s %s %s (reference %s %s)\n", c->name, ok ? "ok" : "FAIL",
+               rise, set, want_rise, want_set);
+        if (!ok) failures++;
+    }
+
+    printf("%d failed (tolerance %d min)\n", failures, TOLERANCE_MIN);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,269 @@
+/**
+ * @file thermo_test.c
+ * @brief Host test of the thermostat control loop on the virtual clock
+ *
+ * Runs the real thermostat.c and relay_service.c on the simulator port
+ * against the simulated room of sim_room.c and watches the stage relay
+ * outputs at the GPIO level. The room is driven through phases: a heat
+ * load both fan stages are needed for, no load so the stages drop again,
+ * a stage 1 output that refuses one write, and a sensor that stops
+ * answering. Checked:
+ *
+ *   loop       one pass per THERMO_PERIOD_MS, jitter within one tick
+ *   counts     switch_count per stage equals the ON edges on its pin
+ *   holds      no output switches before THERMO_MIN_ON_S/THERMO_MIN_OFF_S
+ *              outside the forced fail-safe change
+ *   order      stage 2 never runs without stage 1, and comes on in a
+ *              later pass
+ *   refused    a stage change the relay service refuses counts one
+ *              relay_errors, commits nothing and is retried next pass
+ *   failsafe   THERMO_SENSOR_MAX_FAILS bad reads switch the stages per
+ *              THERMO_FAILSAFE_ON
+ *
+ * Prints one line per check and exits 1 if any failed.
+ *
+ * Build and run (from the repository root):
+ *   gcc -O2 -Itools/relay_sim/port -Itools/relay_sim -Iinclude -o thermo_test \
+ *       tools/relay_sim/thermo_test.c tools/relay_sim/sim_port.c \
+ *       tools/relay_sim/sim_room.c src/relay_service.c src/thermostat.c \
+ *       src/powerfail.c src/block_pool.c -lm
+ *   ./thermo_test [-v]
+ */
+
+#include "sim_port.h"
+#include "config.h"
+#include "relay_service.h"
+#include "thermostat.h"
+#include "nvs_flash.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STAGES              2
+#define TICK_US             ((int64_t)portTICK_PERIOD_MS * 1000)
+#define PERIOD_US           ((int64_t)THERMO_PERIOD_MS * 1000)
+#define SETPOINT_C          26.0f
+#define END_US              (3600LL * 1000000)
+
+static const uint8_t stage_relay[STAGES] = { THERMO_STAGE1_RELAY, THERMO_STAGE2_RELAY };
+
+/**
+ * @brief What the hooks saw on one stage output
+ */
+typedef struct {
+    int pin;                    // -1 until the relay service is up
+    bool on;
+    int64_t changed_us;
+    uint32_t on_edges;
+    uint32_t hold_violations;   // Switched before the minimum run/rest time
+} stage_watch_t;
+
+static stage_watch_t s_watch[STAGES] = { { .pin = -1 }, { .pin = -1 } };
+static bool s_forced = false;               // Fail-safe phase: holds do not apply
+static uint32_t s_order_violations = 0;     // Steps that left stage 2 on alone
+static int64_t s_stage2_first_on_us = -1;
+static int64_t s_stage1_first_on_us = -1;
+static int s_failures = 0;
+static bool s_done = false;
+
+static void check(const char *name, bool ok, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void check(const char *name, bool ok, const char *fmt, ...)
+{
+    va_list ap;
+    printf("%-10s %-4s ", name, ok ? "ok" : "FAIL");
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    putchar('\n');
+    if (!ok) s_failures++;
+}
+
+/*============================================================================
+ * Simulator hooks
+ *============================================================================*/
+
+void sim_on_gpio(int pin, int level)
+{
+    for (int i = 0; i < STAGES; i++) {
+        stage_watch_t *w = &s_watch[i];
+        if (w->pin != pin) continue;
+        bool on = level == (RELAY_ACTIVE_LOW ? 0 : 1);
+        if (on == w->on) continue;
+
+        int64_t now = sim_now();
+        int64_t min_us = (int64_t)(w->on ? THERMO_MIN_ON_S : THERMO_MIN_OFF_S) * 1000000;
+        if (!s_forced && w->changed_us >= 0 && now - w->changed_us < min_us) {
+            w->hold_violations++;
+        }
+        w->on = on;
+        w->changed_us = now;
+        if (on) {
+            w->on_edges++;
+            int64_t *first = (i == 0) ? &s_stage1_first_on_us : &s_stage2_first_on_us;
+            if (*first < 0) *first = now;
+        }
+    }
+}
+
+void sim_on_nvs(const char *ns, const char *key, const void *data, size_t len)
+{
+    (void)ns; (void)key; (void)data; (void)len;
+}
+
+void sim_on_flash(const char *label, size_t offset, size_t len, bool erase)
+{
+    (void)label; (void)offset; (void)len; (void)erase;
+}
+
+void sim_on_step(void)
+{
+    // After each task step, so the writes of one frame count as one change
+    if (s_watch[1].on && !s_watch[0].on) {
+        s_order_violations++;
+    }
+}
+
+void sim_on_restart(void)
+{
+    printf("%-10s %-4s firmware called esp_restart()\n", "restart", "FAIL");
+    exit(1);
+}
+
+/*============================================================================
+ * Test
+ *============================================================================*/
+
+/**
+ * @brief Run until the thermostat shows the given stage count, or timeout
+ *
+ * @return Virtual time it got there, or -1
+ */
+static int64_t wait_stages(uint8_t stages, int64_t timeout_us)
+{
+    int64_t deadline = sim_now() + timeout_us;
+    thermo_status_t st;
+    while (sim_now() < deadline) {
+        thermostat_get_status(&st);
+        if (st.stages_on == stages) return sim_now();
+        vTaskDelay(pdMS_TO_TICKS(THERMO_PERIOD_MS));
+    }
+    return -1;
+}
+
+static void test_task(void *arg)
+{
+    (void)arg;
+    thermo_status_t st;
+
+    ESP_ERROR_CHECK(nvs_flash_init());
+    ESP_ERROR_CHECK(relay_service_init());
+    for (int i = 0; i < STAGES; i++) {
+        s_watch[i].pin = relay_get_info(stage_relay[i])->gpio_pin;
+        s_watch[i].changed_us = -1;
+    }
+
+    sim_room_set(SETPOINT_C - 2.0f, 0.10f, 0.03f);
+    ESP_ERROR_CHECK(thermostat_init(sim_room_sensor()));
+    ESP_ERROR_CHECK(thermostat_set_setpoint(SETPOINT_C));
+    ESP_ERROR_CHECK(thermostat_set_enabled(true));
+    int64_t start_us = sim_now();
+
+    // Heat beyond what both fans remove: stage 1, then stage 2
+    int64_t t = wait_stages(2, 600LL * 1000000);
+    check("order", t >= 0 && s_stage2_first_on_us > s_stage1_first_on_us,
+          "stage 1 on at %.1f s, stage 2 at %.1f s",
+          s_stage1_first_on_us / 1e6, s_stage2_first_on_us / 1e6);
+
+    // No load: stage 2 drops first, then stage 1
+    vTaskDelay(pdMS_TO_TICKS(60 * 1000));
+    thermostat_get_status(&st);
+    sim_room_set(st.temp_c, 0.0f, 0.03f);
+    t = wait_stages(0, 900LL * 1000000);
+    check("stage-down", t >= 0 && s_watch[0].changed_us >= s_watch[1].changed_us,
+          "stage 2 off at %.1f s, stage 1 at %.1f s",
+          s_watch[1].changed_us / 1e6, s_watch[0].changed_us / 1e6);
+
+    // The stage 1 output refuses one write: nothing commits, the next pass retries
+    vTaskDelay(pdMS_TO_TICKS(THERMO_MIN_OFF_S * 1000));
+    thermo_status_t before;
+    thermostat_get_status(&before);
+    sim_fault_gpio(1ULL << s_watch[0].pin, 1, false);
+    sim_room_set(SETPOINT_C + 1.0f, 0.04f, 0.03f);
+    vTaskDelay(pdMS_TO_TICKS(THERMO_PERIOD_MS));
+    thermostat_get_status(&st);
+    check("refused", st.relay_errors == before.relay_errors + 1 && st.stages_on == 0 &&
+          st.switch_count[0] == before.switch_count[0] && !s_watch[0].on,
+          "relay_errors %lu -> %lu, stages %u, stage 1 count %lu -> %lu",
+          (unsigned long)before.relay_errors, (unsigned long)st.relay_errors,
+          st.stages_on, (unsigned long)before.switch_count[0],
+          (unsigned long)st.switch_count[0]);
+    vTaskDelay(pdMS_TO_TICKS(THERMO_PERIOD_MS));
+    thermostat_get_status(&st);
+    check("retried", st.stages_on == 1 && s_watch[0].on &&
+          st.switch_count[0] == before.switch_count[0] + 1,
+          "stages %u one pass later", st.stages_on);
+
+    // Sensor stops answering while a stage runs
+    vTaskDelay(pdMS_TO_TICKS(60 * 1000));
+    s_forced = true;
+    thermostat_get_status(&before);
+    sim_room_fail_reads(THERMO_SENSOR_MAX_FAILS);
+    vTaskDelay(pdMS_TO_TICKS(THERMO_SENSOR_MAX_FAILS * THERMO_PERIOD_MS));
+    thermostat_get_status(&st);
+    uint8_t want = THERMO_FAILSAFE_ON ? STAGES : 0;
+    check("failsafe", st.failsafe && st.stages_on == want &&
+          st.sensor_errors == before.sensor_errors + THERMO_SENSOR_MAX_FAILS,
+          "%lu bad reads, stages %u (want %u)",
+          (unsigned long)(st.sensor_errors - before.sensor_errors), st.stages_on, want);
+    vTaskDelay(pdMS_TO_TICKS(THERMO_PERIOD_MS));
+    thermostat_get_status(&st);
+    check("recovered", !st.failsafe && st.sensor_ok, "sensor_ok %d", st.sensor_ok);
+
+    // Whole run
+    vTaskDelay(pdMS_TO_TICKS(THERMO_PERIOD_MS / 2));
+    thermostat_get_status(&st);
+    int64_t expected = (sim_now() - start_us) / PERIOD_US;
+    check("loop", llabs((int64_t)st.iterations - expected) <= 1 && st.max_jitter_us <= TICK_US,
+          "%lu passes in %.1f s (expected %lld), max jitter %lu us",
+          (unsigned long)st.iterations, (sim_now() - start_us) / 1e6, (long long)expected,
+          (unsigned long)st.max_jitter_us);
+    for (int i = 0; i < STAGES; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "count%d", i + 1);
+        check(name, st.switch_count[i] == s_watch[i].on_edges,
+              "stage %d switch_count %lu, ON edges %lu", i + 1,
+              (unsigned long)st.switch_count[i], (unsigned long)s_watch[i].on_edges);
+    }
+    check("holds", s_watch[0].hold_violations == 0 && s_watch[1].hold_violations == 0,
+          "%lu/%lu early switches", (unsigned long)s_watch[0].hold_violations,
+          (unsigned long)s_watch[1].hold_violations);
+    check("alone", s_order_violations == 0, "%lu steps with stage 2 on alone",
+          (unsigned long)s_order_violations);
+
+    s_done = true;
+    sim_set_background();
+    for (;;) {
+        vTaskDelay(portMAX_DELAY);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    sim_set_verbosity(argc > 1 && strcmp(argv[1], "-v") == 0 ? 1 : 0);
+    sim_init(0);
+    sim_task_create("test", SIM_PRIO_MAIN, test_task, NULL);
+    sim_run(END_US);
+
+    if (!s_done) {
+        printf("%-10s %-4s ended at %.1f s\n", "finished", "FAIL", sim_now() / 1e6);
+        s_failures++;
+    }
+    printf("%d failed\n", s_failures);
+    return s_failures ? 1 : 0;
+}
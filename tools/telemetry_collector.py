@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""
+Local stand-in collector for the telemetry agent (src/telemetry.c).
+
+Decodes the binary batches the controller POSTs, prints one line per
+sample, and reports sample gaps, bytes received per sampling interval and
+how large the same samples would be as JSON. It can fail on purpose to
+exercise buffering and backoff.
+
+Usage:
+    python3 tools/telemetry_collector.py --port 8081 [--fail-rate 0.3]
+    curl -X POST -d "http://<this-host>:8081/telemetry" http://192.168.1.100/telemetry
+"""
+
+import argparse
+import json
+import random
+import struct
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+HEADER = struct.Struct("<4sBBHIIIHH")           # 24 bytes
+RECORD = struct.Struct("<IIIbBBBHhHHHHHH8H")    # 48 bytes
+FIELDS = ("uptime_s", "free_heap", "min_free_heap", "rssi", "relay_mask", "flags",
+          "wifi_disconnects", "power_w", "temp_centi", "relay_changes", "loads_shed",
+          "rejected", "modbus_requests", "modbus_exceptions", "webhook_dropped")
+HIST_BOUNDS_US = [32 << i for i in range(7)]
+
+
+class Collector:
+    def __init__(self, fail_rate):
+        self.fail_rate = fail_rate
+        self.next_seq = {}          # node -> next expected sample number
+        self.samples = 0
+        self.batches = 0
+        self.bytes = 0
+        self.json_bytes = 0
+        self.gaps = 0
+        self.failed = 0
+
+
+def decode(body):
+    magic, version, rec_len, count, node, first, dropped, interval, _ = HEADER.unpack_from(body)
+    if magic != b"RTM1" or version != 1 or rec_len != RECORD.size:
+        raise ValueError("bad header")
+    if len(body) != HEADER.size + count * rec_len:
+        raise ValueError("bad length")
+
+    samples = []
+    for i in range(count):
+        values = RECORD.unpack_from(body, HEADER.size + i * rec_len)
+        sample = dict(zip(FIELDS, values[:len(FIELDS)]))
+        sample["modbus_hist"] = list(values[len(FIELDS):])
+        samples.append(sample)
+    return node, first, dropped, interval, samples
+
+
+def hist_text(hist):
+    labels = ["<%d" % b for b in HIST_BOUNDS_US] + [">=%d" % HIST_BOUNDS_US[-1]]
+    return " ".join("%s:%d" % (l, n) for l, n in zip(labels, hist) if n)
+
+
+def make_handler(col):
+    class Handler(BaseHTTPRequestHandler):
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+            if random.random() < col.fail_rate:
+                col.failed += 1
+                self.send_response(503)
+                self.end_headers()
+                return
+
+            try:
+                node, first, dropped, interval, samples = decode(body)
+            except (ValueError, struct.error):
+                self.send_response(400)
+                self.end_headers()
+                return
+
+            expected = col.next_seq.get(node)
+            if expected is not None and first != expected:
+                col.gaps += 1
+                print("  gap: %d sample(s) missing before #%d" % (first - expected, first))
+            col.next_seq[node] = first + len(samples)
+
+            for i, s in enumerate(samples):
+                temp = "-" if s["temp_centi"] == -32768 else "%.2fC" % (s["temp_centi"] / 100.0)
+                print("%08x #%d up %ds heap %d/%d rssi %d relays %#04x %dW %s "
+                      "changes %d modbus %d %s" %
+                      (node, first + i, s["uptime_s"], s["free_heap"], s["min_free_heap"],
+                       s["rssi"], s["relay_mask"], s["power_w"], temp, s["relay_changes"],
+                       s["modbus_requests"], hist_text(s["modbus_hist"])))
+
+            col.samples += len(samples)
+            col.batches += 1
+            col.bytes += len(body)
+            col.json_bytes += sum(len(json.dumps(s, separators=(",", ":"))) for s in samples)
+            print("  batch %d: %d sample(s), %d bytes, board dropped %d; "
+                  "%.1f bytes/interval (JSON would be %.1f), gaps %d, failed %d" %
+                  (col.batches, len(samples), len(body), dropped,
+                   col.bytes / col.samples, col.json_bytes / col.samples, col.gaps, col.failed))
+
+            self.send_response(204)
+            self.end_headers()
+
+        def log_message(self, fmt, *args):
+            pass
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--port", type=int, default=8081)
+    parser.add_argument("--fail-rate", type=float, default=0.0,
+                        help="fraction of POSTs answered with 503")
+    args = parser.parse_args()
+
+    col = Collector(args.fail_rate)
+    server = ThreadingHTTPServer(("0.0.0.0", args.port), make_handler(col))
+    print("Telemetry collector listening on port %d" % args.port)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
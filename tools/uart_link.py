@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+"""
+Controller for the wired UART link (src/uart_link.c), and its latency bench.
+
+Speaks the framed binary protocol from include/uart_link.h: COBS frames with
+a CRC-16/MODBUS. Works with a USB serial adapter wired to the board's
+UART_LINK_TX_GPIO / UART_LINK_RX_GPIO, or with the pty printed by
+"uart_link_pty -s" (tools/uart_link_pty). Only the standard library is
+needed; the port is put in raw mode with termios.
+
+bench alternates SET ON / SET OFF on one relay and reports the round trip
+from write() to the reply decoded. On the board that covers the request
+on the wire, the driver's RX timeout, the command and the reply on the
+wire; the board's own frame-received-to-outputs-written time comes from
+STATUS (max_edge_us) and GET /uart/status. A failed or lost reply is
+retried once with the same seq, which the board answers without
+switching again.
+
+Usage:
+    python3 tools/uart_link.py /dev/ttyUSB0 status
+    python3 tools/uart_link.py /dev/ttyUSB0 set 1 on
+    python3 tools/uart_link.py /dev/ttyUSB0 toggle 2
+    python3 tools/uart_link.py /dev/ttyUSB0 mask 0x0f 0x05
+    python3 tools/uart_link.py /dev/ttyUSB0 bench --count 500 --relay 0
+"""
+
+import argparse
+import math
+import os
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+
+CMD_SET, CMD_TOGGLE, CMD_MASK, CMD_STATUS = 1, 2, 3, 4
+RESULTS = ("ok", "bad request", "bad relay", "power budget", "output fault", "busy")
+
+BAUDS = {9600: termios.B9600, 19200: termios.B19200, 38400: termios.B38400,
+         57600: termios.B57600, 115200: termios.B115200, 230400: termios.B230400,
+         460800: termios.B460800, 921600: termios.B921600}
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_at = 0
+    for b in data:
+        if b == 0:
+            out[code_at] = len(out) - code_at
+            code_at = len(out)
+            out.append(0)
+        else:
+            out.append(b)
+    out[code_at] = len(out) - code_at
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def frame(payload):
+    # Leading delimiter: noise on the line cannot spoil this frame
+    return b"\0" + cobs_encode(payload + struct.pack("<H", crc16(payload))) + b"\0"
+
+
+class Link:
+    def __init__(self, path, baud):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        if baud:
+            attrs = termios.tcgetattr(self.fd)
+            attrs[4] = attrs[5] = BAUDS[baud]
+            termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+        termios.tcflush(self.fd, termios.TCIOFLUSH)
+        self.rx = bytearray()
+        # Random start, so a new run does not repeat the last run's final
+        # request (which the board would take for a retry)
+        self.seq = os.urandom(1)[0]
+
+    def read_frame(self, timeout):
+        deadline = time.monotonic() + timeout
+        while True:
+            while b"\0" in self.rx:
+                raw, _, rest = self.rx.partition(b"\0")
+                self.rx = bytearray(rest)
+                data = cobs_decode(bytes(raw)) if raw else None
+                if data and len(data) > 2 and crc16(data[:-2]) == struct.unpack("<H", data[-2:])[0]:
+                    return data[:-2]
+            left = deadline - time.monotonic()
+            if left <= 0 or not select.select([self.fd], [], [], left)[0]:
+                return None
+            self.rx += os.read(self.fd, 256)
+
+    def request(self, cmd, args=b"", timeout=0.2, retries=1):
+        """Send a command; return (reply, round-trip seconds of the last try)."""
+        self.seq = (self.seq + 1) & 0xFF
+        req = frame(bytes([self.seq, cmd]) + args)
+        for _ in range(retries + 1):
+            start = time.perf_counter()
+            os.write(self.fd, req)
+            while True:
+                reply = self.read_frame(timeout)
+                if reply is None or (reply[0] == self.seq and reply[1] == cmd | 0x80):
+                    break
+            if reply is not None:
+                return reply, time.perf_counter() - start
+        return None, None
+
+
+def show(reply):
+    if reply is None:
+        sys.exit("no reply")
+    result, mask = reply[2], struct.unpack("<I", reply[3:7])[0]
+    name = RESULTS[result] if result < len(RESULTS) else str(result)
+    print("result %s, relays 0x%02x" % (name, mask))
+    if len(reply) >= 24:
+        count, version, requests, errors, max_edge = struct.unpack("<BIIII", reply[7:24])
+        print("relays %d, version %d, requests %d, errors %d, max edge %d us"
+              % (count, version, requests, errors, max_edge))
+    return result
+
+
+def percentile(sorted_ms, p):
+    # Nearest rank
+    return sorted_ms[max(0, math.ceil(p / 100.0 * len(sorted_ms)) - 1)]
+
+
+def bench(link, relay, count, interval):
+    rtts = []
+    failures = 0
+    for i in range(count):
+        time.sleep(interval)
+        reply, rtt = link.request(CMD_SET, bytes([relay, (i + 1) & 1]), retries=0)
+        if reply is None or reply[2] != 0:
+            failures += 1
+            continue
+        rtts.append(rtt * 1000.0)
+    rtts.sort()
+    print("%5s %5s %8s %8s %8s %8s" % ("ok", "fail", "p50 ms", "p90 ms", "p99 ms", "max ms"))
+    if rtts:
+        print("%5d %5d %8.3f %8.3f %8.3f %8.3f" % (len(rtts), failures, percentile(rtts, 50),
+              percentile(rtts, 90), percentile(rtts, 99), rtts[-1]))
+    else:
+        print("%5d %5d" % (0, failures))
+    show(link.request(CMD_STATUS)[0])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("port")
+    parser.add_argument("--baud", type=int, default=115200, choices=sorted(BAUDS),
+                        help="line speed (ignored by a pty)")
+    sub = parser.add_subparsers(dest="command", required=True)
+    sub.add_parser("status")
+    p = sub.add_parser("set")
+    p.add_argument("relay", type=int)
+    p.add_argument("state", choices=("on", "off"))
+    p = sub.add_parser("toggle")
+    p.add_argument("relay", type=int)
+    p = sub.add_parser("mask")
+    p.add_argument("mask", type=lambda s: int(s, 0))
+    p.add_argument("values", type=lambda s: int(s, 0))
+    p = sub.add_parser("bench")
+    p.add_argument("--relay", type=int, default=0)
+    p.add_argument("--count", type=int, default=200)
+    p.add_argument("--interval", type=float, default=0.02, help="idle seconds before each command")
+    args = parser.parse_args()
+
+    link = Link(args.port, args.baud)
+    if args.command == "status":
+        result = show(link.request(CMD_STATUS)[0])
+    elif args.command == "set":
+        result = show(link.request(CMD_SET, bytes([args.relay, args.state == "on"]))[0])
+    elif args.command == "toggle":
+        result = show(link.request(CMD_TOGGLE, bytes([args.relay]))[0])
+    elif args.command == "mask":
+        result = show(link.request(CMD_MASK, struct.pack("<II", args.mask, args.values))[0])
+    else:
+        bench(link, args.relay, args.count, args.interval)
+        result = 0
+    sys.exit(1 if result else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,77 @@
+/**
+ * @file uart.h
+ * @brief PTY harness port: the ESP-IDF UART driver on a pseudo-terminal
+ *
+ * A reader thread stands in for the driver's interrupt: it blocks in
+ * read() on the attached file descriptor, appends what arrives to the
+ * ring buffer and posts a UART_DATA event, or UART_BUFFER_FULL when the
+ * ring has no room. Writes go straight to the descriptor. Line settings,
+ * pins and the RX timeout are accepted and ignored.
+ */
+
+#ifndef PTY_DRIVER_UART_H
+#define PTY_DRIVER_UART_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#define UART_NUM_MAX        3
+#define UART_PIN_NO_CHANGE  (-1)
+
+typedef int uart_port_t;
+
+typedef enum { UART_DATA_5_BITS, UART_DATA_6_BITS, UART_DATA_7_BITS, UART_DATA_8_BITS } uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE = 0, UART_PARITY_EVEN = 2, UART_PARITY_ODD = 3 } uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1, UART_STOP_BITS_1_5 = 2, UART_STOP_BITS_2 = 3 } uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE = 0 } uart_hw_flowcontrol_t;
+typedef enum { UART_SCLK_DEFAULT = 0 } uart_sclk_t;
+
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    uart_sclk_t source_clk;
+} uart_config_t;
+
+typedef enum {
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_DATA_BREAK,
+    UART_PATTERN_DET,
+    UART_EVENT_MAX
+} uart_event_type_t;
+
+typedef struct {
+    uart_event_type_t type;
+    size_t size;
+    bool timeout_flag;
+} uart_event_t;
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *queue, int intr_alloc_flags);
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+esp_err_t uart_set_rx_timeout(uart_port_t port, const uint8_t tout_thresh);
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks);
+int uart_write_bytes(uart_port_t port, const void *src, size_t size);
+esp_err_t uart_flush_input(uart_port_t port);
+
+/**
+ * @brief Harness only: the descriptor a port reads and writes
+ *
+ * Call before uart_driver_install().
+ */
+void pty_uart_attach(uart_port_t port, int fd);
+
+#endif // PTY_DRIVER_UART_H
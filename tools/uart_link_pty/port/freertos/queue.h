@@ -0,0 +1,18 @@
+/**
+ * @file queue.h
+ * @brief PTY harness port: FreeRTOS queues on a mutex and condition variable
+ */
+
+#ifndef PTY_FREERTOS_QUEUE_H
+#define PTY_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct pty_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+#endif // PTY_FREERTOS_QUEUE_H
@@ -0,0 +1,774 @@
+/**
+ * @file uart_link_pty.c
+ * @brief Run the wired UART link against a pseudo-terminal pair
+ *
+ * Runs the real uart_link.c and uart_frame.c on the host. The link task is
+ * a thread blocked on the UART event queue, and the UART is one end of a
+ * pty (see port/driver/uart.h). The relay service is a stand-in that keeps
+ * a mask, a power budget of PTY_BUDGET_RELAYS relays ON, an output fault
+ * switch and a shadow model. It timestamps every output write.
+ *
+ * The default run plays the controller on the other end of the pty. It
+ * checks every command, result code and error path (bad CRC, noise,
+ * overlong frames, split and pipelined frames, retries, shadow mode). It
+ * then times N SET commands, alternately ON and OFF:
+ *   edge   controller write() to the stand-in's output write
+ *   reply  controller write() to the reply decoded
+ * A pty has no baud rate, so wire time is left out. The summary adds it
+ * for UART_LINK_BAUD, computed rather than measured, as an estimate for
+ * the board.
+ *
+ * With -s the harness only serves: it prints the pty path for a client
+ * such as tools/uart_link.py and runs until interrupted.
+ *
+ * Build (from the repository root):
+ *   gcc -O2 -pthread -Itools/uart_link_pty/port -Itools/relay_sim/port \
+ *       -Iinclude -o uart_link_pty tools/uart_link_pty/uart_link_pty.c \
+ *       src/uart_link.c src/uart_frame.c -lutil
+ * Usage:
+ *   uart_link_pty [-n COUNT] [-v]     self-test, then latency
+ *   uart_link_pty -s [-v]             serve on a pty until Ctrl-C
+ */
+
+#define _GNU_SOURCE
+#include "uart_link.h"
+#include "uart_frame.h"
+#include "relay_service.h"
+#include "config.h"
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <pty.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PTY_BUDGET_RELAYS   3           // Stand-in power budget: relays ON at once
+#define REPLY_TIMEOUT_MS    200
+#define SILENCE_MS          50          // Wait that proves no reply is coming
+
+static int s_verbosity;
+static int s_failures;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*============================================================================
+ * Port: log, timer, tasks and queues
+ *============================================================================*/
+
+void sim_log(char level, const char *tag, const char *fmt, ...)
+{
+    if (s_verbosity == 0 || (level == 'D' && s_verbosity < 2) || level == 'V') {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "%c %s: ", level, tag);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "error";
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_ns() / 1000;
+}
+
+typedef struct {
+    TaskFunction_t fn;
+    void *arg;
+} task_start_t;
+
+static void *task_entry(void *p)
+{
+    task_start_t start = *(task_start_t *)p;
+    free(p);
+    start.fn(start.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *out)
+{
+    pthread_t thread;
+    task_start_t *start = malloc(sizeof(*start));
+    start->fn = fn;
+    start->arg = arg;
+    if (pthread_create(&thread, NULL, task_entry, start) != 0) {
+        free(start);
+        return pdFALSE;
+    }
+    pthread_detach(thread);
+    if (out != NULL) {
+        *out = (TaskHandle_t)thread;
+    }
+    return pdPASS;
+}
+
+struct pty_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    uint8_t *items;
+    size_t item_size;
+    unsigned length, head, count;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t q = calloc(1, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->ready, NULL);
+    q->items = calloc(length, item_size);
+    q->item_size = item_size;
+    q->length = length;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&q->lock);
+    bool room = q->count < q->length;
+    if (room) {
+        memcpy(q->items + ((q->head + q->count) % q->length) * q->item_size, item, q->item_size);
+        q->count++;
+        pthread_cond_signal(&q->ready);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return room ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && ticks == portMAX_DELAY) {
+        pthread_cond_wait(&q->ready, &q->lock);
+    }
+    bool got = q->count > 0;
+    if (got) {
+        memcpy(item, q->items + q->head * q->item_size, q->item_size);
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return got ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->head = 0;
+    q->count = 0;
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+/*============================================================================
+ * Port: UART driver on a file descriptor
+ *============================================================================*/
+
+typedef struct {
+    int fd;
+    QueueHandle_t events;
+    pthread_mutex_t lock;
+    uint8_t *ring;
+    size_t size, head, count;
+} pty_uart_t;
+
+static pty_uart_t s_uarts[UART_NUM_MAX];
+static int64_t s_tx_ns;                 // Last write by the link (under s_relay_lock)
+static pthread_mutex_t s_relay_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void pty_uart_attach(uart_port_t port, int fd)
+{
+    s_uarts[port].fd = fd;
+}
+
+/**
+ * @brief Driver interrupt stand-in: bytes into the ring, an event per read
+ */
+static void *uart_reader(void *arg)
+{
+    pty_uart_t *u = arg;
+    uint8_t buf[128];
+
+    while (1) {
+        ssize_t n = read(u->fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return NULL;
+        }
+
+        uart_event_t event = { .type = UART_DATA, .size = (size_t)n };
+        pthread_mutex_lock(&u->lock);
+        if (u->count + n > u->size) {
+            event.type = UART_BUFFER_FULL;
+        } else {
+            for (ssize_t i = 0; i < n; i++) {
+                u->ring[(u->head + u->count++) % u->size] = buf[i];
+            }
+        }
+        pthread_mutex_unlock(&u->lock);
+        xQueueSend(u->events, &event, 0);
+    }
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *queue, int intr_alloc_flags)
+{
+    pty_uart_t *u = &s_uarts[port];
+    pthread_t thread;
+
+    pthread_mutex_init(&u->lock, NULL);
+    u->ring = malloc(rx_buffer_size);
+    u->size = rx_buffer_size;
+    u->events = xQueueCreate(queue_size, sizeof(uart_event_t));
+    *queue = u->events;
+    if (pthread_create(&thread, NULL, uart_reader, u) != 0) {
+        return ESP_FAIL;
+    }
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_rx_timeout(uart_port_t port, const uint8_t tout_thresh)
+{
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks)
+{
+    pty_uart_t *u = &s_uarts[port];
+    uint8_t *out = buf;
+    uint32_t n = 0;
+
+    pthread_mutex_lock(&u->lock);
+    while (n < length && u->count > 0) {
+        out[n++] = u->ring[u->head];
+        u->head = (u->head + 1) % u->size;
+        u->count--;
+    }
+    pthread_mutex_unlock(&u->lock);
+    return (int)n;
+}
+
+int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+    ssize_t n = write(s_uarts[port].fd, src, size);
+    pthread_mutex_lock(&s_relay_lock);
+    s_tx_ns = now_ns();
+    pthread_mutex_unlock(&s_relay_lock);
+    return (int)n;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    pty_uart_t *u = &s_uarts[port];
+    pthread_mutex_lock(&u->lock);
+    u->head = 0;
+    u->count = 0;
+    pthread_mutex_unlock(&u->lock);
+    return ESP_OK;
+}
+
+/*============================================================================
+ * Relay service stand-in
+ *============================================================================*/
+
+static struct {
+    uint32_t live;
+    uint32_t shadow;
+    uint32_t version;
+    bool shadow_enabled;
+    bool shadow_in_scope;
+    bool shadow_busy;                   // relay_shadow_begin() fails
+    bool output_fault;                  // Output writes fail (rolled back)
+    int64_t edge_ns;                    // Last live output write
+    uint32_t saves;
+    uint32_t saves_before_reply;        // Saves with no reply written since the change
+    int64_t change_ns;                  // Last model change
+} s_relay;
+
+/**
+ * @brief relay_set_mask() and relay_toggle_mask(): toggles read the model
+ *        under the same lock as the write, as the relay service does
+ */
+static esp_err_t set_mask(uint32_t mask, uint32_t values, bool toggle)
+{
+    if (mask >> RELAY_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&s_relay_lock);
+    uint32_t *model = s_relay.shadow_in_scope ? &s_relay.shadow : &s_relay.live;
+    esp_err_t ret = ESP_OK;
+
+    if (!s_relay.shadow_in_scope && s_relay.output_fault) {
+        pthread_mutex_unlock(&s_relay_lock);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    if (toggle) {
+        values = ~*model & mask;
+    }
+    uint32_t next = (*model & ~mask) | (values & mask);
+    // Budget: refuse ON changes, highest relay first, until it fits
+    for (int i = RELAY_COUNT - 1; i >= 0 && __builtin_popcount(next) > PTY_BUDGET_RELAYS; i--) {
+        uint32_t bit = 1UL << i;
+        if ((next & bit) && !(*model & bit)) {
+            next &= ~bit;
+            ret = ESP_ERR_NOT_ALLOWED;
+        }
+    }
+
+    if (next != *model) {
+        *model = next;
+        s_relay.version++;
+        s_relay.change_ns = now_ns();
+        if (!s_relay.shadow_in_scope) {
+            s_relay.edge_ns = s_relay.change_ns;
+        }
+    }
+    pthread_mutex_unlock(&s_relay_lock);
+    return ret;
+}
+
+esp_err_t relay_set_mask(uint32_t mask, uint32_t values, bool persist)
+{
+    (void)persist;
+    return set_mask(mask, values, false);
+}
+
+esp_err_t relay_toggle_mask(uint32_t mask, bool persist)
+{
+    (void)persist;
+    return set_mask(mask, 0, true);
+}
+
+uint32_t relay_get_mask(void)
+{
+    pthread_mutex_lock(&s_relay_lock);
+    uint32_t mask = s_relay.shadow_in_scope ? s_relay.shadow : s_relay.live;
+    pthread_mutex_unlock(&s_relay_lock);
+    return mask;
+}
+
+uint32_t relay_get_version(void)
+{
+    pthread_mutex_lock(&s_relay_lock);
+    uint32_t version = s_relay.version;
+    pthread_mutex_unlock(&s_relay_lock);
+    return version;
+}
+
+esp_err_t relay_save_states(void)
+{
+    pthread_mutex_lock(&s_relay_lock);
+    s_relay.saves++;
+    if (s_tx_ns < s_relay.change_ns) {
+        s_relay.saves_before_reply++;
+    }
+    pthread_mutex_unlock(&s_relay_lock);
+    return ESP_OK;
+}
+
+bool relay_shadow_enabled(void)
+{
+    return s_relay.shadow_enabled;
+}
+
+esp_err_t relay_shadow_begin(void)
+{
+    if (s_relay.shadow_busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_mutex_lock(&s_relay_lock);
+    s_relay.shadow_in_scope = true;
+    s_relay.shadow = s_relay.live;
+    pthread_mutex_unlock(&s_relay_lock);
+    return ESP_OK;
+}
+
+void relay_shadow_end(void)
+{
+    s_relay.shadow_in_scope = false;
+}
+
+/*============================================================================
+ * Controller end
+ *============================================================================*/
+
+static int s_ctl_fd;
+static uart_frame_decoder_t s_ctl_decoder;
+static uint8_t s_reply[UART_FRAME_PAYLOAD_MAX];
+static int64_t s_reply_ns;
+
+static void send_raw(const uint8_t *data, size_t len)
+{
+    if (write(s_ctl_fd, data, len) != (ssize_t)len) {
+        perror("write");
+        exit(1);
+    }
+}
+
+static void send_payload(const uint8_t *payload, size_t len)
+{
+    uint8_t wire[UART_FRAME_WIRE_MAX];
+    send_raw(wire, uart_frame_encode(payload, len, wire));
+}
+
+/**
+ * @brief Wait for the next valid reply
+ *
+ * @return Reply length, or 0 on timeout
+ */
+static int read_reply(int timeout_ms)
+{
+    static uint8_t pending[256];
+    static size_t pending_len, pending_off;
+    int64_t deadline = now_ns() + (int64_t)timeout_ms * 1000000;
+
+    while (1) {
+        while (pending_off < pending_len) {
+            size_t used;
+            const uint8_t *payload;
+            int n = uart_frame_feed(&s_ctl_decoder, pending + pending_off,
+                                    pending_len - pending_off, &used, &payload);
+            pending_off += used;
+            if (n > 0) {
+                s_reply_ns = now_ns();
+                memcpy(s_reply, payload, n);
+                return n;
+            }
+        }
+
+        int left_ms = (int)((deadline - now_ns()) / 1000000);
+        if (left_ms <= 0) {
+            return 0;
+        }
+        struct pollfd pfd = { .fd = s_ctl_fd, .events = POLLIN };
+        if (poll(&pfd, 1, left_ms) <= 0) {
+            return 0;
+        }
+        ssize_t n = read(s_ctl_fd, pending, sizeof(pending));
+        if (n <= 0) {
+            return 0;
+        }
+        pending_len = (size_t)n;
+        pending_off = 0;
+    }
+}
+
+static uint32_t reply_mask(void)
+{
+    return (uint32_t)s_reply[3] | ((uint32_t)s_reply[4] << 8) |
+           ((uint32_t)s_reply[5] << 16) | ((uint32_t)s_reply[6] << 24);
+}
+
+static void check(bool ok, const char *name, const char *detail)
+{
+    if (ok) {
+        printf("ok    %s\n", name);
+    } else {
+        printf("FAIL  %s: %s\n", name, detail);
+        s_failures++;
+    }
+}
+
+/**
+ * @brief Send a request, expect a reply with this result and mask
+ */
+static void expect(const char *name, const uint8_t *req, size_t len, uint8_t result, uint32_t mask)
+{
+    char detail[96];
+    send_payload(req, len);
+    int n = read_reply(REPLY_TIMEOUT_MS);
+    if (n < 7) {
+        check(false, name, "no reply");
+        return;
+    }
+    snprintf(detail, sizeof(detail), "seq %u cmd 0x%02x result %u mask 0x%lx",
+             s_reply[0], s_reply[1], s_reply[2], (unsigned long)reply_mask());
+    check(s_reply[0] == req[0] && s_reply[1] == (req[1] | UART_LINK_REPLY) &&
+          s_reply[2] == result && reply_mask() == mask, name, detail);
+}
+
+static void expect_silence(const char *name)
+{
+    check(read_reply(SILENCE_MS) == 0, name, "unexpected reply");
+}
+
+static void set_relays(uint32_t mask)
+{
+    uint8_t req[] = { 0xF0, UART_LINK_CMD_MASK, 0x0F, 0, 0, 0, 0, 0, 0, 0 };
+    static uint8_t seq;
+    req[0] += seq++ % 16;
+    req[6] = (uint8_t)mask;
+    send_payload(req, sizeof(req));
+    read_reply(REPLY_TIMEOUT_MS);
+}
+
+/*============================================================================
+ * Self-test
+ *============================================================================*/
+
+static void self_test(void)
+{
+    uart_link_stats_t st;
+
+    // Commands and results
+    expect("set on", (uint8_t[]){ 1, UART_LINK_CMD_SET, 0, 1 }, 4, UART_LINK_OK, 0x1);
+    expect("set off", (uint8_t[]){ 2, UART_LINK_CMD_SET, 0, 0 }, 4, UART_LINK_OK, 0x0);
+    expect("toggle", (uint8_t[]){ 3, UART_LINK_CMD_TOGGLE, 2 }, 3, UART_LINK_OK, 0x4);
+    expect("toggle back", (uint8_t[]){ 4, UART_LINK_CMD_TOGGLE, 2 }, 3, UART_LINK_OK, 0x0);
+    expect("mask", (uint8_t[]){ 5, UART_LINK_CMD_MASK, 0x0F, 0, 0, 0, 0x05, 0, 0, 0 }, 10,
+           UART_LINK_OK, 0x5);
+    expect("mask budget", (uint8_t[]){ 6, UART_LINK_CMD_MASK, 0x0F, 0, 0, 0, 0x0F, 0, 0, 0 }, 10,
+           UART_LINK_BUDGET, 0x7);
+    expect("bad relay", (uint8_t[]){ 7, UART_LINK_CMD_SET, RELAY_COUNT, 1 }, 4,
+           UART_LINK_BAD_RELAY, 0x7);
+    expect("bad mask bit", (uint8_t[]){ 8, UART_LINK_CMD_MASK, 0, 1, 0, 0, 0, 1, 0, 0 }, 10,
+           UART_LINK_BAD_RELAY, 0x7);
+    expect("bad state", (uint8_t[]){ 9, UART_LINK_CMD_SET, 0, 2 }, 4, UART_LINK_BAD_REQUEST, 0x7);
+    expect("bad length", (uint8_t[]){ 10, UART_LINK_CMD_TOGGLE, 0, 0 }, 4, UART_LINK_BAD_REQUEST, 0x7);
+    expect("unknown command", (uint8_t[]){ 11, 0x7F }, 2, UART_LINK_BAD_REQUEST, 0x7);
+
+    s_relay.output_fault = true;
+    expect("output fault", (uint8_t[]){ 12, UART_LINK_CMD_SET, 0, 0 }, 4,
+           UART_LINK_OUTPUT_FAULT, 0x7);
+    s_relay.output_fault = false;
+
+    expect("status", (uint8_t[]){ 13, UART_LINK_CMD_STATUS }, 2, UART_LINK_OK, 0x7);
+    check(s_reply[7] == RELAY_COUNT && s_reply[8] == s_relay.version, "status fields", "count or version");
+
+    // A retry (same seq and bytes) is answered without running again
+    set_relays(0);
+    uint32_t version = s_relay.version;
+    expect("retry first", (uint8_t[]){ 14, UART_LINK_CMD_TOGGLE, 1 }, 3, UART_LINK_OK, 0x2);
+    expect("retry repeat", (uint8_t[]){ 14, UART_LINK_CMD_TOGGLE, 1 }, 3, UART_LINK_OK, 0x2);
+    uart_link_get_stats(&st);
+    check(s_relay.version == version + 1 && st.retries == 1, "retry switches once", "toggled twice");
+    usleep((UART_LINK_RETRY_WINDOW_MS + 50) * 1000);
+    expect("repeat after window", (uint8_t[]){ 14, UART_LINK_CMD_TOGGLE, 1 }, 3, UART_LINK_OK, 0x0);
+    expect("new request", (uint8_t[]){ 15, UART_LINK_CMD_TOGGLE, 1 }, 3, UART_LINK_OK, 0x2);
+
+    // Damaged frames get no reply and are counted
+    uint8_t wire[UART_FRAME_WIRE_MAX];
+    size_t n = uart_frame_encode((uint8_t[]){ 24, UART_LINK_CMD_SET, 3, 1 }, 4, wire);
+    wire[2] ^= 0x40;
+    send_raw(wire, n);
+    expect_silence("bad crc ignored");
+    uart_link_get_stats(&st);
+    check(st.crc_errors == 1, "bad crc counted", "crc_errors != 1");
+
+    uint8_t noise[100];
+    memset(noise, 0xA5, sizeof(noise));
+    send_raw(noise, sizeof(noise));
+    send_raw((uint8_t[]){ 0 }, 1);
+    expect_silence("overlong ignored");
+    expect("resync after overlong", (uint8_t[]){ 16, UART_LINK_CMD_SET, 3, 1 }, 4, UART_LINK_OK, 0xA);
+
+    // Line noise, then a frame led by a delimiter as a sender should send it
+    send_raw((uint8_t[]){ 0x13, 0x37, 0x42, 0 }, 4);
+    expect("resync after noise", (uint8_t[]){ 17, UART_LINK_CMD_SET, 3, 0 }, 4, UART_LINK_OK, 0x2);
+    uart_link_get_stats(&st);
+    check(st.framing_errors == 2, "framing errors counted", "framing_errors != 2");
+
+    // Split and pipelined frames
+    n = uart_frame_encode((uint8_t[]){ 18, UART_LINK_CMD_SET, 0, 1 }, 4, wire);
+    for (size_t i = 0; i < n; i++) {
+        send_raw(wire + i, 1);
+        usleep(2000);
+    }
+    check(read_reply(REPLY_TIMEOUT_MS) >= 7 && s_reply[0] == 18 && reply_mask() == 0x3,
+          "byte at a time", "no reply or wrong mask");
+
+    uint8_t batch[3 * UART_FRAME_WIRE_MAX];
+    size_t len = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        len += uart_frame_encode((uint8_t[]){ (uint8_t)(19 + i), UART_LINK_CMD_TOGGLE, i }, 3, batch + len);
+    }
+    send_raw(batch, len);
+    bool in_order = true;
+    for (uint8_t i = 0; i < 3; i++) {
+        in_order &= read_reply(REPLY_TIMEOUT_MS) >= 7 && s_reply[0] == 19 + i;
+    }
+    check(in_order && reply_mask() == 0x4, "pipelined frames", "missing, out of order or wrong mask");
+
+    // NVS is saved only after the reply is out
+    check(s_relay.saves > 0 && s_relay.saves_before_reply == 0, "save after reply",
+          "a save came before its reply");
+
+    // Shadow mode: the live outputs do not move
+    s_relay.shadow_enabled = true;
+    int64_t edge = s_relay.edge_ns;
+    expect("shadow set", (uint8_t[]){ 22, UART_LINK_CMD_SET, 0, 1 }, 4, UART_LINK_OK, 0x5);
+    check(s_relay.live == 0x4 && s_relay.edge_ns == edge, "shadow leaves outputs", "live outputs changed");
+    s_relay.shadow_busy = true;
+    expect("shadow busy", (uint8_t[]){ 23, UART_LINK_CMD_SET, 0, 1 }, 4, UART_LINK_BUSY, 0x4);
+    s_relay.shadow_busy = false;
+    s_relay.shadow_enabled = false;
+}
+
+/*============================================================================
+ * Latency
+ *============================================================================*/
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_row(const char *name, int64_t *ns, int count)
+{
+    qsort(ns, count, sizeof(*ns), cmp_i64);
+    printf("%-7s %8.1f %8.1f %8.1f %8.1f\n", name,
+           ns[(count - 1) / 2] / 1e3, ns[(count * 9 - 1) / 10] / 1e3,
+           ns[(count * 99 - 1) / 100] / 1e3, ns[count - 1] / 1e3);
+}
+
+static void latency(int count)
+{
+    int64_t *edge = calloc(count, sizeof(int64_t));
+    int64_t *reply = calloc(count, sizeof(int64_t));
+    uint8_t wire[UART_FRAME_WIRE_MAX];
+    int done = 0;
+
+    set_relays(0);
+    for (int i = 0; i < count; i++) {
+        uint8_t req[] = { (uint8_t)i, UART_LINK_CMD_SET, 0, (uint8_t)((i + 1) & 1) };
+        size_t n = uart_frame_encode(req, sizeof(req), wire);
+
+        int64_t t0 = now_ns();
+        send_raw(wire, n);
+        if (read_reply(REPLY_TIMEOUT_MS) < 7 || s_reply[0] != req[0]) {
+            continue;
+        }
+        pthread_mutex_lock(&s_relay_lock);
+        edge[done] = s_relay.edge_ns - t0;
+        pthread_mutex_unlock(&s_relay_lock);
+        reply[done] = s_reply_ns - t0;
+        done++;
+    }
+
+    if (done == 0) {
+        check(false, "latency", "no replies");
+        return;
+    }
+
+    printf("\n%d SET commands over the pty (us)\n", done);
+    printf("%-7s %8s %8s %8s %8s\n", "", "p50", "p90", "p99", "max");
+    print_row("edge", edge, done);
+    print_row("reply", reply, done);
+
+    uart_link_stats_t st;
+    uart_link_get_stats(&st);
+    printf("link task: frame received to outputs written, avg %.1f us, max %lu us\n",
+           st.edges ? (double)st.total_edge_us / st.edges : 0.0, (unsigned long)st.max_edge_us);
+
+    // On the board the request also has to cross the wire: 10 bits per
+    // character, plus the RX timeout before the driver posts the last byte
+    size_t req_chars = uart_frame_encode((uint8_t[]){ 0, UART_LINK_CMD_SET, 0, 1 }, 4, wire);
+    size_t reply_chars = uart_frame_encode((uint8_t[]){ 0, 0x81, 0, 0, 0, 0, 0 }, 7, wire);
+    double char_us = 10e6 / UART_LINK_BAUD;
+    printf("wire at %d baud (computed): request %zu chars %.0f us + RX timeout %.0f us, reply %zu chars %.0f us\n",
+           UART_LINK_BAUD, req_chars, req_chars * char_us, UART_LINK_RX_TIMEOUT_CHARS * char_us,
+           reply_chars, reply_chars * char_us);
+
+    free(edge);
+    free(reply);
+}
+
+/*============================================================================
+ * Main
+ *============================================================================*/
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: uart_link_pty [-n COUNT] [-v]\n"
+                    "       uart_link_pty -s [-v]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int count = 2000;
+    bool serve = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            serve = true;
+        } else if (strncmp(argv[i], "-v", 2) == 0) {
+            s_verbosity = (int)strlen(argv[i]) - 1;
+        } else {
+            usage();
+        }
+    }
+    if (count < 1) usage();
+
+    int board, controller;
+    char path[64];
+    if (openpty(&board, &controller, path, NULL, NULL) != 0) {
+        perror("openpty");
+        return 1;
+    }
+    // Raw bytes both ways: no echo, no line editing, no CR/LF mapping
+    struct termios tio;
+    tcgetattr(controller, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(controller, TCSANOW, &tio);
+
+    pty_uart_attach(UART_LINK_PORT, board);
+    if (uart_link_init() != ESP_OK) {
+        fprintf(stderr, "uart_link_init failed\n");
+        return 1;
+    }
+
+    if (serve) {
+        printf("%s\n", path);
+        fflush(stdout);
+        while (1) {
+            pause();
+        }
+    }
+
+    s_ctl_fd = controller;
+    uart_frame_decoder_init(&s_ctl_decoder);
+    self_test();
+    latency(count);
+
+    printf("\n%s\n", s_failures ? "FAILED" : "all checks passed");
+    return s_failures ? 1 : 0;
+}
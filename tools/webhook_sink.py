@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""
+Local HTTP sink for testing webhook delivery (src/webhook.c).
+
+Accepts the JSON batches the controller POSTs, prints each event, and
+reports sequence gaps and the board's dropped counter. It can also fail or
+stall on purpose to exercise retries and backoff.
+
+Usage:
+    python3 tools/webhook_sink.py --port 8080 [--fail-rate 0.3] [--delay-ms 500]
+    curl -X POST -d "http://<this-host>:8080/hook" http://192.168.1.100/webhooks
+"""
+
+import argparse
+import json
+import random
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+class Sink:
+    def __init__(self, fail_rate, delay_ms):
+        self.fail_rate = fail_rate
+        self.delay_ms = delay_ms
+        self.last_seq = {}          # node -> last seq seen
+        self.events = 0
+        self.batches = 0
+        self.gaps = 0
+        self.failed = 0
+
+
+def make_handler(sink):
+    class Handler(BaseHTTPRequestHandler):
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+            if sink.delay_ms:
+                time.sleep(sink.delay_ms / 1000.0)
+            if random.random() < sink.fail_rate:
+                sink.failed += 1
+                self.send_response(500)
+                self.end_headers()
+                return
+
+            try:
+                batch = json.loads(body)
+            except ValueError:
+                self.send_response(400)
+                self.end_headers()
+                return
+
+            node = batch.get("node", "?")
+            for event in batch.get("events", []):
+                last = sink.last_seq.get(node)
+                if last is not None and event["seq"] != last + 1:
+                    sink.gaps += 1
+                    print("  gap: seq %d after %d" % (event["seq"], last))
+                sink.last_seq[node] = event["seq"]
+                print("%s #%d %s -> %s (uptime %d ms)" %
+                      (node, event["seq"], event["name"], event["state"], event["uptime_ms"]))
+
+            sink.events += len(batch.get("events", []))
+            sink.batches += 1
+            print("  batch %d: %d event(s), board dropped %d, total %d, gaps %d, failed %d" %
+                  (sink.batches, len(batch.get("events", [])), batch.get("dropped", 0),
+                   sink.events, sink.gaps, sink.failed))
+
+            self.send_response(204)
+            self.end_headers()
+
+        def log_message(self, fmt, *args):
+            pass
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--fail-rate", type=float, default=0.0,
+                        help="fraction of POSTs answered with 500")
+    parser.add_argument("--delay-ms", type=int, default=0,
+                        help="stall every POST this long before answering")
+    args = parser.parse_args()
+
+    sink = Sink(args.fail_rate, args.delay_ms)
+    server = ThreadingHTTPServer(("0.0.0.0", args.port), make_handler(sink))
+    print("Webhook sink listening on port %d" % args.port)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
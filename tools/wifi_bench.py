@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Measure request round-trip time under each radio profile (src/wifi_service.c).
+
+For every profile the board is switched with GET /wifi/profile?name=...,
+given time to reassociate if the listen interval changed, and then sent
+sequential requests on fresh connections, spaced so the radio can doze
+between them as it does with a real client. The RTT distribution per
+profile shows what power save costs: with modem sleep the first frame of
+a request waits in the AP until the station next wakes for a beacon, so
+latency grows with the DTIM period and the listen interval.
+
+The board is left on the profile it had before the run.
+
+Usage:
+    python3 tools/wifi_bench.py 192.168.1.100
+    python3 tools/wifi_bench.py 192.168.1.100 --count 200 --interval 1.5
+    python3 tools/wifi_bench.py 192.168.1.100 --profiles latency low_power
+"""
+
+import argparse
+import http.client
+import json
+import math
+import sys
+import time
+
+PROFILES = ("latency", "balanced", "low_power")
+
+
+def get(host, port, path, timeout):
+    conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    try:
+        conn.request("GET", path)
+        resp = conn.getresponse()
+        body = resp.read()
+        return resp.status, body
+    finally:
+        conn.close()
+
+
+def set_profile(host, port, name, timeout):
+    status, body = get(host, port, "/wifi/profile?name=" + name, timeout)
+    if status != 200:
+        sys.exit("profile %s: %d %s" % (name, status, body.decode(errors="replace")))
+    return json.loads(body)
+
+
+def wait_linked(host, port, timeout, limit):
+    """Poll until the board answers again after a reassociation."""
+    deadline = time.monotonic() + limit
+    while time.monotonic() < deadline:
+        try:
+            status, body = get(host, port, "/wifi/status", timeout)
+            if status == 200 and json.loads(body).get("connected"):
+                return True
+        except (OSError, http.client.HTTPException, ValueError):
+            pass
+        time.sleep(0.5)
+    return False
+
+
+def percentile(sorted_ms, p):
+    # Nearest rank
+    if not sorted_ms:
+        return float("nan")
+    return sorted_ms[max(0, math.ceil(p / 100.0 * len(sorted_ms)) - 1)]
+
+
+def bench(host, port, path, count, interval, timeout):
+    rtts = []
+    failures = 0
+    for _ in range(count):
+        time.sleep(interval)
+        start = time.perf_counter()
+        try:
+            status, _ = get(host, port, path, timeout)
+            if status != 200:
+                failures += 1
+                continue
+        except (OSError, http.client.HTTPException):
+            failures += 1
+            continue
+        rtts.append((time.perf_counter() - start) * 1000.0)
+    return sorted(rtts), failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("host", metavar="HOST[:PORT]")
+    parser.add_argument("--profiles", nargs="+", choices=PROFILES, default=list(PROFILES))
+    parser.add_argument("--count", type=int, default=100, help="requests per profile")
+    parser.add_argument("--interval", type=float, default=0.5,
+                        help="idle seconds before each request")
+    parser.add_argument("--path", default="/relay/all/status", help="request to time")
+    parser.add_argument("--settle", type=float, default=2.0,
+                        help="seconds to wait after a switch, before the reassociation check")
+    parser.add_argument("--timeout", type=float, default=5.0)
+    args = parser.parse_args()
+
+    host, port = args.host, 80
+    if ":" in host:
+        host, port = host.rsplit(":", 1)
+    port = int(port)
+
+    try:
+        _, body = get(host, port, "/wifi/profile", args.timeout)
+    except (OSError, http.client.HTTPException) as e:
+        sys.exit("%s: %s" % (args.host, e))
+    original = json.loads(body)["profile"]
+
+    print("%-10s %-9s %6s %5s %5s %8s %8s %8s %8s"
+          % ("profile", "ps", "listen", "ok", "fail", "p50 ms", "p90 ms", "p99 ms", "max ms"))
+    try:
+        for name in args.profiles:
+            info = set_profile(host, port, name, args.timeout)
+            time.sleep(args.settle)
+            if not wait_linked(host, port, args.timeout, 60.0):
+                sys.exit("board did not come back after switching to %s" % name)
+            rtts, failures = bench(host, port, args.path, args.count, args.interval, args.timeout)
+            print("%-10s %-9s %6d %5d %5d %8.1f %8.1f %8.1f %8.1f"
+                  % (name, info["ps"], info["listen_interval"], len(rtts), failures,
+                     percentile(rtts, 50), percentile(rtts, 90), percentile(rtts, 99),
+                     rtts[-1] if rtts else float("nan")))
+            sys.stdout.flush()
+    finally:
+        set_profile(host, port, original, args.timeout)
+        wait_linked(host, port, args.timeout, 60.0)
+
+
+if __name__ == "__main__":
+    main()